@@ -1,12 +1,15 @@
 #version 330 core
 in vec2 TexCoords;
+in vec3 TextColor;
 out vec4 color;
 
 uniform sampler2D text;
-uniform vec3 textColor;
 
 void main()
 {
-	vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, TexCoords).r);
-	color = vec4(textColor, 1.0) * sampled;
+	// Signed distance field, the glyph edge is at 0.5 whatever the text size
+	float distance = texture(text, TexCoords).r;
+	float smoothing = 0.7 * fwidth(distance);
+	float alpha = smoothstep(0.5 - smoothing, 0.5 + smoothing, distance);
+	color = vec4(TextColor, alpha);
 }
\ No newline at end of file
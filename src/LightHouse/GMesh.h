@@ -12,7 +12,8 @@ public:
         const std::string& directory,
         const std::string& filename,
         const std::string& name,
-        MeshMap& mapMeshes) override;
+        MeshMap& mapMeshes,
+        unsigned int lodLevels = 0) override;
 };
 
 class GMeshCreator : public MeshCreator {
@@ -13,6 +13,10 @@ public:
         const std::string& fragPath,
         const std::string& name,
         ShaderMap& mapShaders) override;
+    void LoadCompute(
+        const std::string& compPath,
+        const std::string& name,
+        ShaderMap& mapShaders) override;
 };
 
 class GShaderCreator : public ShaderCreator {
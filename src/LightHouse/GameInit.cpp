@@ -3,11 +3,18 @@
 #include "GShader.h"
 #include "GTexture.h"
 
+#include "core/gpu/gpu_scene.h"
+#include "core/gpu/gpu_particles.h"
+
 #include <fstream>
 #include <cstdlib>
 #include <vector>
 
 
+// Size of the layers of the boat material array
+static const unsigned int BOAT_MATERIAL_SIZE = 1024;
+
+
 /// <summary>
 /// Load all resources (textures, meshes, shaders) required for the game.
 /// </summary>
@@ -40,11 +47,24 @@ void GameInit::LoadAllMeshes()
     GMesh* mesh = meshCreator->LoadMesh();
 
     // Load meshes for various objects like lighthouse, boats, moon, lake, bamboo
+    // (small repeated objects get 3 simplified levels of detail, the lake grid keeps its full resolution)
     mesh->Load(sourceLightHouse, "lighthouse.obj", "lighthouse", meshes);
-    mesh->Load(sourceBoats, "wake_boat.glb", "wake_boat", meshes);
-    mesh->Load(sourceMoon, "sphere.obj", "sphere", meshes);
+    mesh->Load(sourceBoats, "wake_boat.glb", "wake_boat", meshes, 3);
+    mesh->Load(sourceMoon, "sphere.obj", "sphere", meshes, 3);
     mesh->Load(sourceLake, "gridMesh.obj", "lake", meshes);
-    mesh->Load(sourceBamboo, "bamboo.obj", "bamboo", meshes);
+    mesh->Load(sourceBamboo, "bamboo.obj", "bamboo", meshes, 3);
+
+    // The lake vertex shader scales the grid by 2 on XZ and lifts it by up to 5 units
+    // from the height map, so the flat grid bounds would cull the mountains too early
+    // (the extra 0.2 margin covers the wave displacement of the water)
+    auto lake = meshes.find("lake");
+    if (lake != meshes.end() && lake->second->GetBoundingBox().IsValid())
+    {
+        const BoundingBox& lakeBox = lake->second->GetBoundingBox();
+        lake->second->SetBoundingBox(BoundingBox(
+            glm::vec3(lakeBox.min.x * 2.0f - 0.2f, lakeBox.min.y - 0.2f, lakeBox.min.z * 2.0f - 0.2f),
+            glm::vec3(lakeBox.max.x * 2.0f + 0.2f, lakeBox.max.y + 5.2f, lakeBox.max.z * 2.0f + 0.2f)));
+    }
 }
 
 
@@ -57,6 +77,9 @@ void GameInit::LoadAllShaders()
     const std::string sourceShadersDir = PATH_JOIN(window->props.selfDir, SOURCE_PATH::PATH_PROJECT, "LightHouse", "shaders");
     const std::string sourceSliderVERTEXDir = PATH_JOIN(sourceShadersDir, "Sliders", "vertex");
     const std::string sourceSliderFRAGMENTDir = PATH_JOIN(sourceShadersDir, "Sliders", "fragment");
+    const std::string sourcePostProcessDir = PATH_JOIN(sourceShadersDir, "PostProcess");
+    const std::string sourceShadowsDir = PATH_JOIN(sourceShadersDir, "Shadows");
+    const std::string sourceDeferredDir = PATH_JOIN(sourceShadersDir, "Deferred");
 
     // The shaderCreator object creates GShader objects from shader files
     GShaderCreator* shaderCreator = new GShaderCreator();
@@ -72,16 +95,55 @@ void GameInit::LoadAllShaders()
     /// MOON + LIGHTHOUSE (TOP PART)
     shader->Load(PATH_JOIN(sourceShadersDir, "V_LightHouse.glsl"),
         PATH_JOIN(sourceShadersDir, "F_LightHouse.glsl"), "LightHouse", shaders);
-    /// RGB
-    shader->Load(PATH_JOIN(sourceSliderVERTEXDir, "V_RGB.glsl"),
-        PATH_JOIN(sourceSliderFRAGMENTDir, "F_RGB.glsl"), "RGB", shaders);
-    /// HVS
-    shader->Load(PATH_JOIN(sourceSliderVERTEXDir, "V_HSV.glsl"),
-        PATH_JOIN(sourceSliderFRAGMENTDir, "F_Hue.glsl"), "HUE", shaders);
-    shader->Load(PATH_JOIN(sourceSliderVERTEXDir, "V_HSV.glsl"),
-        PATH_JOIN(sourceSliderFRAGMENTDir, "F_Saturation.glsl"), "SAT", shaders);
-    shader->Load(PATH_JOIN(sourceSliderVERTEXDir, "V_HSV.glsl"),
-        PATH_JOIN(sourceSliderFRAGMENTDir, "F_Value.glsl"), "VAL", shaders);
+    /// SLIDERS (ONE SHADER FOR EVERY WIDGET)
+    shader->Load(PATH_JOIN(sourceSliderVERTEXDir, "V_UI.glsl"),
+        PATH_JOIN(sourceSliderFRAGMENTDir, "F_UI.glsl"), "UI", shaders);
+    /// SCREEN PASSES
+    shader->Load(PATH_JOIN(sourcePostProcessDir, "V_Screen.glsl"),
+        PATH_JOIN(sourcePostProcessDir, "F_Present.glsl"), "Present", shaders);
+    shader->Load(PATH_JOIN(sourcePostProcessDir, "V_Screen.glsl"),
+        PATH_JOIN(sourcePostProcessDir, "F_Upscale.glsl"), "Upscale", shaders);
+    shader->Load(PATH_JOIN(sourcePostProcessDir, "V_Screen.glsl"),
+        PATH_JOIN(sourcePostProcessDir, "F_ColorGrade.glsl"), "ColorGrade", shaders);
+    /// SHADOW MAPS
+    shader->Load(PATH_JOIN(sourceShadowsDir, "V_Shadow.glsl"),
+        PATH_JOIN(sourceShadowsDir, "F_Shadow.glsl"), "Shadow", shaders);
+    shader->Load(PATH_JOIN(sourceShadowsDir, "V_ShadowTerrain.glsl"),
+        PATH_JOIN(sourceShadowsDir, "F_Shadow.glsl"), "ShadowTerrain", shaders);
+    /// DEFERRED SHADING
+    shader->Load(PATH_JOIN(sourceShadersDir, "VertexShader.glsl"),
+        PATH_JOIN(sourceDeferredDir, "F_GBuffer.glsl"), "SceneGBuffer", shaders);
+    shader->Load(PATH_JOIN(sourceShadersDir, "V_Moutain.glsl"),
+        PATH_JOIN(sourceDeferredDir, "F_MountainGBuffer.glsl"), "LakeGBuffer", shaders);
+    shader->Load(PATH_JOIN(sourcePostProcessDir, "V_Screen.glsl"),
+        PATH_JOIN(sourceDeferredDir, "F_DeferredAmbient.glsl"), "DeferredAmbient", shaders);
+    shader->Load(PATH_JOIN(sourceDeferredDir, "V_LightVolume.glsl"),
+        PATH_JOIN(sourceDeferredDir, "F_DeferredLight.glsl"), "DeferredLight", shaders);
+    shader->Load(PATH_JOIN(sourceDeferredDir, "V_LightVolume.glsl"),
+        PATH_JOIN(sourceDeferredDir, "F_Stencil.glsl"), "LightStencil", shaders);
+    shader->Load(PATH_JOIN(sourcePostProcessDir, "V_Screen.glsl"),
+        PATH_JOIN(sourceDeferredDir, "F_DeferredResolve.glsl"), "DeferredResolve", shaders);
+    /// GPU DRIVEN RENDERING (GL 4.3, THE SCENE IS DRAWN BY THE CPU LOOP WITHOUT IT)
+    if (GpuScene::IsSupported())
+    {
+        const std::string sourceGpuDrivenDir = PATH_JOIN(sourceShadersDir, "GpuDriven");
+        shader->Load(PATH_JOIN(sourceGpuDrivenDir, "V_SceneIndirect.glsl"),
+            PATH_JOIN(sourceShadersDir, "FragmentShader.glsl"), "SceneIndirect", shaders);
+        shader->Load(PATH_JOIN(sourceGpuDrivenDir, "V_SceneIndirect.glsl"),
+            PATH_JOIN(sourceDeferredDir, "F_GBuffer.glsl"), "SceneGBufferIndirect", shaders);
+        shader->LoadCompute(PATH_JOIN(sourceGpuDrivenDir, "C_Cull.glsl"), "GpuCull", shaders);
+        shader->LoadCompute(PATH_JOIN(sourceGpuDrivenDir, "C_HiZ.glsl"), "HiZ", shaders);
+    }
+    /// PARTICLES (GL 4.3, THE SCENE HAS NONE WITHOUT IT)
+    if (GpuParticles::IsSupported())
+    {
+        const std::string sourceParticlesDir = PATH_JOIN(sourceShadersDir, "Particles");
+        shader->LoadCompute(PATH_JOIN(sourceParticlesDir, "C_ParticleArgs.glsl"), "ParticleArgs", shaders);
+        shader->LoadCompute(PATH_JOIN(sourceParticlesDir, "C_ParticleSimulate.glsl"), "ParticleSimulate", shaders);
+        shader->LoadCompute(PATH_JOIN(sourceParticlesDir, "C_ParticleEmit.glsl"), "ParticleEmit", shaders);
+        shader->Load(PATH_JOIN(sourceParticlesDir, "V_Particle.glsl"),
+            PATH_JOIN(sourceParticlesDir, "F_Particle.glsl"), "Particle", shaders);
+    }
 }
 
 
@@ -112,17 +174,16 @@ void GameInit::LoadAllTextures()
     texture->Load(lightHouseRedTexturePath.c_str(), "mid-house", GL_REPEAT, textures);
     texture->Load(baseHouseTexturePath.c_str(), "base-house", GL_REPEAT, textures);
 
-    // Boat Textures
-    std::string darkIronTexturePath = PATH_JOIN(boatsTextureDir, "iron_dark.jpg");
-    std::string rustyIronTexturePath = PATH_JOIN(boatsTextureDir, "iron_rust.jpg");
-    std::string wood1TexturePath = PATH_JOIN(boatsTextureDir, "wood1.jpg");
-    std::string wood2TexturePath = PATH_JOIN(boatsTextureDir, "wood2.jpg");
-    std::string wood3TexturePath = PATH_JOIN(boatsTextureDir, "wood3.jpg");
-    texture->Load(darkIronTexturePath.c_str(), "iron_dark", GL_MIRROR_CLAMP_TO_EDGE, textures);
-    texture->Load(rustyIronTexturePath.c_str(), "iron_rust", GL_MIRROR_CLAMP_TO_EDGE, textures);
-    texture->Load(wood1TexturePath.c_str(), "wood1", GL_MIRRORED_REPEAT, textures);
-    texture->Load(wood2TexturePath.c_str(), "wood2", GL_MIRRORED_REPEAT, textures);
-    texture->Load(wood3TexturePath.c_str(), "wood3", GL_MIRRORED_REPEAT, textures);
+    // Boat Textures, packed as the layers of one array so all the boats share a binding.
+    // The images have different sizes and are resampled to the size of the array
+    Texture2DArray* boatMaterials = new Texture2DArray(BOAT_MATERIAL_SIZE, BOAT_MATERIAL_SIZE);
+    boatMaterials->AddLayer("wood1", PATH_JOIN(boatsTextureDir, "wood1.jpg"));
+    boatMaterials->AddLayer("wood2", PATH_JOIN(boatsTextureDir, "wood2.jpg"));
+    boatMaterials->AddLayer("wood3", PATH_JOIN(boatsTextureDir, "wood3.jpg"));
+    boatMaterials->AddLayer("iron_dark", PATH_JOIN(boatsTextureDir, "iron_dark.jpg"));
+    boatMaterials->AddLayer("iron_rust", PATH_JOIN(boatsTextureDir, "iron_rust.jpg"));
+    boatMaterials->Build(GL_MIRRORED_REPEAT);
+    textureArrays["boats"] = boatMaterials;
 
     // Basic Ground Textures
     std::string rockTexturePath = PATH_JOIN(groundTextureDir, "ground.jpg");
@@ -219,10 +280,109 @@ Mesh* GameInit::CreateMesh(
     meshes[name]->InitFromBuffer(VAO, static_cast<unsigned int>(indices.size()));
     meshes[name]->vertices = vertices;
     meshes[name]->indices = indices;
+    meshes[name]->ComputeBounds();
     return meshes[name];
 }
 
 
+/// <summary>
+/// Create a sphere of radius 1 around the origin
+/// The vertices are pushed out so the flat faces enclose the round sphere,
+/// it is used as a light volume and must not cut off any lit pixel.
+/// Faces are counter clockwise seen from outside.
+/// </summary>
+/// <param name="name">Name of the mesh</param>
+/// <param name="slices">Segments around the Y axis</param>
+/// <param name="stacks">Segments from pole to pole</param>
+/// <returns>The created mesh</returns>
+Mesh* GameInit::CreateSphereMesh(const char* name, const int slices, const int stacks)
+{
+    std::vector<VertexFormat> vertices;
+    std::vector<unsigned int> indices;
+
+    const float stepTheta = static_cast<float>(M_PI) / stacks;
+    const float stepPhi = 2.0f * static_cast<float>(M_PI) / slices;
+    // Half the diagonal of a face, the largest angle between a face and the sphere
+    const float radius = 1.0f / cos(0.5f * sqrt(stepTheta * stepTheta + stepPhi * stepPhi));
+
+    for (int i = 0; i <= stacks; ++i)
+    {
+        for (int j = 0; j <= slices; ++j)
+        {
+            float theta = i * stepTheta;
+            float phi = j * stepPhi;
+            glm::vec3 normal(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+            vertices.push_back(VertexFormat(normal * radius, glm::vec3(1), normal));
+        }
+    }
+
+    for (int i = 0; i < stacks; ++i)
+    {
+        for (int j = 0; j < slices; ++j)
+        {
+            unsigned int topLeft = i * (slices + 1) + j;
+            unsigned int topRight = topLeft + 1;
+            unsigned int bottomLeft = topLeft + slices + 1;
+            unsigned int bottomRight = bottomLeft + 1;
+
+            indices.push_back(topLeft);
+            indices.push_back(topRight);
+            indices.push_back(bottomLeft);
+
+            indices.push_back(topRight);
+            indices.push_back(bottomRight);
+            indices.push_back(bottomLeft);
+        }
+    }
+
+    return CreateMesh(name, vertices, indices);
+}
+
+
+/// <summary>
+/// Create a closed cone with the apex at the origin and a base of radius 1 at Z = 1
+/// The base ring is pushed out so the flat sides enclose the round cone.
+/// Faces are counter clockwise seen from outside.
+/// </summary>
+/// <param name="name">Name of the mesh</param>
+/// <param name="segments">Segments around the Z axis</param>
+/// <returns>The created mesh</returns>
+Mesh* GameInit::CreateConeMesh(const char* name, const int segments)
+{
+    std::vector<VertexFormat> vertices;
+    std::vector<unsigned int> indices;
+
+    const float step = 2.0f * static_cast<float>(M_PI) / segments;
+    const float radius = 1.0f / cos(0.5f * step);
+
+    // Apex, base center, then the base ring
+    vertices.push_back(VertexFormat(glm::vec3(0, 0, 0)));
+    vertices.push_back(VertexFormat(glm::vec3(0, 0, 1)));
+    for (int j = 0; j < segments; ++j)
+    {
+        vertices.push_back(VertexFormat(glm::vec3(radius * cos(j * step), radius * sin(j * step), 1)));
+    }
+
+    for (int j = 0; j < segments; ++j)
+    {
+        unsigned int current = 2 + j;
+        unsigned int next = 2 + (j + 1) % segments;
+
+        // Side
+        indices.push_back(0);
+        indices.push_back(next);
+        indices.push_back(current);
+
+        // Base
+        indices.push_back(1);
+        indices.push_back(current);
+        indices.push_back(next);
+    }
+
+    return CreateMesh(name, vertices, indices);
+}
+
+
 ///         ! WARNING ! 
 ///         IT IS UNUSED
 ///     IT WAS ONLY USED ONCE 
@@ -5,6 +5,7 @@
 
 #include "components/simple_scene.h"
 #include "components/transform.h"
+#include "core/gpu/texture2D_array.h"
 
 #include <string>
 #include <unordered_map>
@@ -17,12 +18,15 @@ public:
     GameInit(
         std::unordered_map<std::string, Mesh*>& initMeshes,
         std::unordered_map<std::string, Shader*>& initShaders,
-        std::unordered_map<std::string, Texture2D*>& initTextures
-    ) : meshes(initMeshes), shaders(initShaders), textures(initTextures) {}
+        std::unordered_map<std::string, Texture2D*>& initTextures,
+        std::unordered_map<std::string, Texture2DArray*>& initTextureArrays
+    ) : meshes(initMeshes), shaders(initShaders), textures(initTextures), textureArrays(initTextureArrays) {}
 
     void LoadResources();
     Mesh* CreateMesh(const char* name, const std::vector<VertexFormat>& vertices, const std::vector<unsigned int>& indices);
     Mesh* CreateGridMesh(const int gridX, const int gridZ, const float gridSizeX, const float gridSizeZ);
+    Mesh* CreateSphereMesh(const char* name, const int slices, const int stacks);
+    Mesh* CreateConeMesh(const char* name, const int segments);
 
 private:
     void LoadAllTextures();
@@ -32,6 +36,7 @@ private:
     std::unordered_map<std::string, Mesh*>& meshes;
     std::unordered_map<std::string, Shader*>& shaders;
     std::unordered_map<std::string, Texture2D*>& textures;
+    std::unordered_map<std::string, Texture2DArray*>& textureArrays;
 };
 
 #endif // GAMEINIT_H
@@ -12,25 +12,74 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <cstdio>
 #include <cstdlib>
 #include <algorithm>
+#include <tuple>
 
 
 using namespace std;
 
 
+const unsigned int LightHouse::HUD_HISTORY;
+const double LightHouse::SIMULATION_STEP = 1.0 / 60.0;
+
+// Texture unit of the shadow atlas in the scene shaders
+static const int SHADOW_TEXTURE_UNIT = 10;
+
+// Texture unit of the material array in the scene shaders, after the shadow atlas
+static const int MATERIAL_TEXTURE_UNIT = 11;
+
+// Queued draws recorded per job, smaller passes are recorded on the main thread
+static const size_t DRAW_RECORD_GRAIN = 64;
+
+// Uniform block binding of the PerDraw block of the scene shaders
+static const GLuint PER_DRAW_BINDING = 0;
+
+// Per frame region of the PerDraw ring, room for 4096 blocks at the usual 256 byte alignment
+static const GLsizeiptr PER_DRAW_REGION_SIZE = 1 << 20;
+
+// Particles alive at once, spray and mist together
+static const unsigned int PARTICLE_CAPACITY = 1 << 20;
+
+
+LightHouse::SimulationState::SimulationState() : time(0)
+{
+    std::fill(boatAngles, boatAngles + 4, 0.0f);
+}
+
+
 LightHouse::LightHouse() :
     /// LOADING SHADERS+TEXTUERS+MESHES
-    gameInit(new GameInit(meshes, shaders, textures)),  // GameInit
+    gameInit(new GameInit(meshes, shaders, textures, textureArrays)),  // GameInit
     sliderManager(new SliderManager()),                 // SliderManager
-    elapsedTime(Engine::GetElapsedTime()),              // Time elapsed since the start of the engine
     lighthousePosition(glm::vec3(0, 1, 0)),             // Position of the lighthouse in the scene
+    screenVAO(0),
+    deferredShading(false),
+    moonShadow(-1),
+    showHud(false),
+    hudText(nullptr),
+    hudViewport(0),
+    hudFrame(0),
+    hudMilliseconds(0),
+    gpuDriven(false),
+    particlesEnabled(false),
+    mistEmitter(0),
+    trianglesDrawn(0),
+    pickedNode(INVALID_TRANSFORM),
+    pickedDistance(0.0f),
+    pickedMoonlit(false),
     /// LIGHT PROPERTIES
     materialShininess(0),
     materialKd(0.0f), materialKs(0.0f),
     materialKa(0.0f), materialKe(glm::vec3(0.0f)),
     angleCutOff(0.0f) {
 
+    spotShadows[0] = spotShadows[1] = -1;
+    std::fill(sprayEmitters, sprayEmitters + 4, 0u);
+    std::fill(cpuFrameTimes, cpuFrameTimes + HUD_HISTORY, 0.0f);
+    std::fill(gpuFrameTimes, gpuFrameTimes + HUD_HISTORY, 0.0f);
+
     // Load resources and initialize game components
     gameInit->LoadResources();
 
@@ -49,7 +98,7 @@ LightHouse::LightHouse() :
 
     for (int i = 0; i < 4; i++)
     {
-        boatRotationAngles[i] = angleDist(gen);
+        simulationState.boatAngles[i] = angleDist(gen);
         boatRotationSpeeds[i] = speedDist(gen);
         boatRotationDirections[i] = directionDist(gen) ? 1 : -1;
 
@@ -62,43 +111,19 @@ LightHouse::LightHouse() :
         }
     }
 
-    vector<VertexFormat> vertices
-    {
-        VertexFormat(glm::vec3(0, 0, 0), glm::vec3(1, 0, 0)),
-        VertexFormat(glm::vec3(0.5, 0, 0), glm::vec3(0, 1, 0)),
-        VertexFormat(glm::vec3(1, 0, 0), glm::vec3(0, 0, 1)),
-        // Second row (middle)
-        VertexFormat(glm::vec3(0, 0.5, 0), glm::vec3(1, 0, 0)),
-        VertexFormat(glm::vec3(0.5, 0.5, 0), glm::vec3(0, 1, 0)),
-        VertexFormat(glm::vec3(1, 0.5, 0), glm::vec3(0, 0, 1)),
-        // Third row (top)
-        VertexFormat(glm::vec3(0, 1, 0), glm::vec3(1, 0, 0)),
-        VertexFormat(glm::vec3(0.5, 1, 0), glm::vec3(0, 1, 0)),
-        VertexFormat(glm::vec3(1, 1, 0), glm::vec3(0, 0, 1))
-    };
-
-    vector<unsigned int> indices =
-    {
-        // First square
-        0, 1, 4,
-        0, 4, 3,
-        // Second square
-        1, 2, 5,
-        1, 5, 4,
-        // Third square
-        3, 4, 7,
-        3, 7, 6,
-        // Fourth square
-        4, 5, 8,
-        4, 8, 7
-    };
-
-    gameInit->CreateMesh("slider", vertices, indices);
+    // Light volumes of the deferred path, scaled to the range of each light
+    gameInit->CreateSphereMesh("light_sphere", 16, 8);
+    gameInit->CreateConeMesh("light_cone", 16);
 }
 
 
 LightHouse::~LightHouse()
 { 
+    // The simulation reads the boat parameters, it has to end first
+    simulationThread.Stop();
+    if (screenVAO)
+        glDeleteVertexArrays(1, &screenVAO);
+    delete hudText;
     delete gameInit;
     delete sliderManager;
 }
@@ -106,6 +131,11 @@ LightHouse::~LightHouse()
 
 void LightHouse::FrameStart()
 {
+    frameStartTime = std::chrono::steady_clock::now();
+
+    // Only waits when the GPU is still reading the blocks of 3 frames ago
+    drawUniforms.BeginFrame();
+
     // Clears the color buffer (using the previously set color) and depth buffer
     glClearColor(0, 0, 0, 1);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -113,6 +143,14 @@ void LightHouse::FrameStart()
     resolution = window->GetResolution();
     windowWidth = resolution.x;
     windowHeight = resolution.y;
+    // Nothing happens unless the window size changed, the graph targets follow the new size
+    renderGraph.Resize(resolution.x, resolution.y);
+
+    // GPU time of an earlier frame, the scene scale follows it toward the budget
+    float gpuMilliseconds;
+    if (frameTimer.Poll(gpuMilliseconds)) {
+        dynamicResolution.AddSample(gpuMilliseconds);
+    }
     // Sets the screen area where to draw
     glViewport(0, 0, resolution.x, resolution.y);
 }
@@ -120,6 +158,22 @@ void LightHouse::FrameStart()
 void LightHouse::FrameEnd()
 {
     DrawCoordinateSystem();
+
+    // Queues the read back of the finished frame when recording, the files are written in the background
+    frameCapture.Capture(resolution.x, resolution.y);
+
+    // Last frame, the frames in flight are read back while the context is still alive
+    if (window->ShouldClose())
+        frameCapture.Flush();
+
+    // CPU time of the frame without the buffer swap, which waits for the display.
+    // The GPU time is the newest finished measurement, a few frames old
+    const unsigned int slot = hudFrame % HUD_HISTORY;
+    cpuFrameTimes[slot] = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameStartTime).count();
+    gpuFrameTimes[slot] = frameTimer.GetMilliseconds();
+    hudFrame++;
+
+    drawUniforms.EndFrame();
 }
 
 
@@ -147,6 +201,290 @@ void LightHouse::Init()
         materialKa = 0.01;
         materialKe = glm::vec3(0.1f);
     }
+
+    CreateSceneNodes();
+    BuildSceneBVH();
+
+    // The lighthouse body hides most of the lake behind it
+    lighthouseOccluder = occlusionCuller.AddOccluderMesh(meshes["lighthouse"]);
+    lighthouseBaseOccluder = occlusionCuller.AddOccluderMesh(meshes["sphere"]);
+
+    glGenVertexArrays(1, &screenVAO);
+    drawUniforms.Init(PER_DRAW_REGION_SIZE);
+
+    // Objects drawn with these shaders go through the G-buffer when deferred
+    // shading is on, the emissive ones keep their forward shader
+    gbufferShaders[shaders["Scene"]] = shaders["SceneGBuffer"];
+    gbufferShaders[shaders["Lake"]] = shaders["LakeGBuffer"];
+
+    // The scene shader objects are culled and drawn by the GPU when GL 4.3 is
+    // there, its shaders aren't even loaded otherwise
+    const char* gpuDrivenShaders[4] = { "GpuCull", "HiZ", "SceneIndirect", "SceneGBufferIndirect" };
+    gpuDriven = GpuScene::IsSupported();
+    for (const char* name : gpuDrivenShaders) {
+        gpuDriven = gpuDriven && shaders[name] && shaders[name]->GetProgramID();
+    }
+    if (gpuDriven)
+    {
+        indirectShaders[shaders["Scene"]] = shaders["SceneIndirect"];
+        indirectShaders[shaders["SceneGBuffer"]] = shaders["SceneGBufferIndirect"];
+    }
+
+    // Same requirement for the particles, their shaders are only loaded with GL 4.3
+    const char* particleShaders[4] = { "ParticleArgs", "ParticleSimulate", "ParticleEmit", "Particle" };
+    particlesEnabled = GpuParticles::IsSupported();
+    for (const char* name : particleShaders) {
+        particlesEnabled = particlesEnabled && shaders[name] && shaders[name]->GetProgramID();
+    }
+    if (particlesEnabled)
+    {
+        particles.Init(PARTICLE_CAPACITY);
+        CreateParticleEmitters();
+    }
+
+    // The spotlights rotate, their static casters are redrawn every frame. The
+    // moon moves slowly, its cached page only follows it twice per second
+    shadowAtlas.Init();
+    spotShadows[0] = shadowAtlas.AddLight(1);
+    spotShadows[1] = shadowAtlas.AddLight(1);
+    moonShadow = shadowAtlas.AddLight(30);
+    shadowAtlas.SetStaticBudget(2);
+
+    StartSimulation();
+}
+
+
+/// <summary>
+/// Start advancing the animated objects on the simulation thread
+/// The initial state is published first, so the first frame already has one to draw.
+/// </summary>
+void LightHouse::StartSimulation()
+{
+    simulationThread.Stop();
+
+    SimulationSnapshot& snapshot = simulationSnapshots.GetWriteBuffer();
+    snapshot.previous = simulationState;
+    snapshot.current = simulationState;
+    snapshot.due = FixedStepThread::Clock::now();
+    simulationSnapshots.Publish();
+
+    simulationThread.Start(SIMULATION_STEP, [this](unsigned long long, FixedStepThread::Clock::time_point due) {
+        StepSimulation(due);
+    });
+}
+
+
+/// <summary>
+/// Advance the simulation by one fixed step and publish the result
+/// Runs on the simulation thread. The new state only depends on the previous one
+/// and the step, not on the frame rate.
+/// </summary>
+/// <param name="due">Time the new state belongs to</param>
+void LightHouse::StepSimulation(FixedStepThread::Clock::time_point due)
+{
+    SimulationState next = simulationState;
+    next.time += SIMULATION_STEP;
+
+    // Circular motion around the lighthouse
+    for (int i = 0; i < 4; i++) {
+        next.boatAngles[i] += static_cast<float>(SIMULATION_STEP) * boatRotationSpeeds[i] * boatRotationDirections[i];
+    }
+
+    SimulationSnapshot& snapshot = simulationSnapshots.GetWriteBuffer();
+    snapshot.previous = simulationState;
+    snapshot.current = next;
+    snapshot.due = due;
+    simulationSnapshots.Publish();
+
+    simulationState = next;
+}
+
+
+/// <summary>
+/// State of the animated objects for the frame being drawn
+/// The frame shows the scene one step in the past, in between the two latest
+/// published states, so the motion stays smooth at any frame rate.
+/// </summary>
+/// <returns>Interpolated state</returns>
+LightHouse::SimulationState LightHouse::GetFrameState()
+{
+    simulationSnapshots.Read();
+    const SimulationSnapshot& snapshot = simulationSnapshots.GetReadBuffer();
+
+    double sinceDue = std::chrono::duration<double>(FixedStepThread::Clock::now() - snapshot.due).count();
+    float alpha = glm::clamp(static_cast<float>(sinceDue / SIMULATION_STEP), 0.0f, 1.0f);
+
+    SimulationState state;
+    state.time = snapshot.previous.time + (snapshot.current.time - snapshot.previous.time) * alpha;
+    for (int i = 0; i < 4; i++) {
+        state.boatAngles[i] = lerp(snapshot.previous.boatAngles[i], snapshot.current.boatAngles[i], alpha);
+    }
+    return state;
+}
+
+
+/// <summary>
+/// Create the transform nodes of the scene objects
+/// Static objects get their final placement here, animated ones are updated every frame.
+/// </summary>
+void LightHouse::CreateSceneNodes()
+{
+    sceneTransforms.Clear();
+    const glm::quat identity(1, 0, 0, 0);
+
+    // Lighthouse parts are placed relative to a common root
+    lighthouseNode = sceneTransforms.Create();
+    lighthouseBaseNode = sceneTransforms.Create(lighthouseNode);
+    sceneTransforms.SetLocalTRS(lighthouseBaseNode, glm::vec3(0, 0.0, 0), identity, glm::vec3(3.f, 1.5f, 3.f));
+    lighthouseMiddleNode = sceneTransforms.Create(lighthouseNode);
+    sceneTransforms.SetLocalTRS(lighthouseMiddleNode, glm::vec3(0, 0.5, 0), identity, glm::vec3(2.45f, 10.0f, 2.45f));
+    lighthouseLowerLayerNode = sceneTransforms.Create(lighthouseNode);
+    sceneTransforms.SetLocalTRS(lighthouseLowerLayerNode, glm::vec3(0, 10.5, 0), identity, glm::vec3(3.0f, 0.25f, 3.0f));
+    lighthouseUpperLayerNode = sceneTransforms.Create(lighthouseNode);
+    sceneTransforms.SetLocalTRS(lighthouseUpperLayerNode, glm::vec3(0, 10.5, 0), identity, glm::vec3(2.5f, 1.5f, 2.5f));
+    lighthouseTopNode = sceneTransforms.Create(lighthouseNode);
+    sceneTransforms.SetLocalTRS(lighthouseTopNode, glm::vec3(0, 12.f, 0), identity, glm::vec3(3.0f, 0.25f, 3.0f));
+
+    for (int i = 0; i < 4; i++) {
+        boatNodes[i] = sceneTransforms.Create();
+    }
+
+    moonNode = sceneTransforms.Create();
+
+    lakeNode = sceneTransforms.Create();
+    sceneTransforms.SetLocalScale(lakeNode, glm::vec3(0.75));
+
+    std::vector<glm::vec3> bambooPositions =
+    {
+        glm::vec3(-1.75, 0, -1.75),
+        glm::vec3(1.75, 0, -1.75),
+        glm::vec3(-1.75, 0, 1.75),
+        glm::vec3(1.75, 0, 1.75),
+        /// between each of the first 4 bamboos put other bamboos
+        (glm::vec3(-1.75, 0, -1.75) + glm::vec3(1.75, 0, -1.75)) / 1.5f,
+        (glm::vec3(1.75, 0, -1.75) + glm::vec3(1.75, 0, 1.75)) / 1.5f,
+        (glm::vec3(-1.75, 0, 1.75) + glm::vec3(1.75, 0, 1.75)) / 1.5f,
+        (glm::vec3(-1.75, 0, -1.75) + glm::vec3(-1.75, 0, 1.75)) / 1.5f
+    };
+
+    float bambooScale = 0.1f;
+    glm::quat bambooRotation = glm::angleAxis(glm::radians(90.0f), glm::vec3(0, 1, 0));
+
+    bambooNodes.clear();
+    for (const auto& pos : bambooPositions) {
+        TransformHandle node = sceneTransforms.Create();
+        sceneTransforms.SetLocalTRS(node, pos, bambooRotation, glm::vec3(bambooScale));
+        bambooNodes.push_back(node);
+    }
+}
+
+
+/// <summary>
+/// Build the ray query hierarchies of the scene
+/// One triangle BVH per mesh, shared by all its instances, plus a top level BVH over the instances.
+/// </summary>
+void LightHouse::BuildSceneBVH()
+{
+    sceneTransforms.Update();
+
+    lighthouseBVH.Build(meshes["lighthouse"]);
+    sphereBVH.Build(meshes["sphere"]);
+    boatBVH.Build(meshes["wake_boat"]);
+    bambooBVH.Build(meshes["bamboo"]);
+    // The lake is displaced in V_Moutain, picking uses the flat grid
+    lakeBVH.Build(meshes["lake"]);
+
+    sceneBVH.Clear();
+    nodeNames.clear();
+
+    auto addInstance = [this](const MeshBVH& bvh, TransformHandle node, const std::string& name) {
+        nodeNames[node] = name;
+        return sceneBVH.AddInstance(&bvh, sceneTransforms.GetWorldMatrix(node), node);
+    };
+
+    addInstance(sphereBVH, lighthouseBaseNode, "lighthouse base");
+    addInstance(lighthouseBVH, lighthouseMiddleNode, "lighthouse");
+    addInstance(lighthouseBVH, lighthouseLowerLayerNode, "lighthouse balcony");
+    addInstance(lighthouseBVH, lighthouseUpperLayerNode, "lighthouse lantern");
+    addInstance(lighthouseBVH, lighthouseTopNode, "lighthouse roof");
+    addInstance(lakeBVH, lakeNode, "lake");
+    moonInstance = addInstance(sphereBVH, moonNode, "moon");
+
+    for (int i = 0; i < 4; i++) {
+        boatInstances[i] = addInstance(boatBVH, boatNodes[i], "boat " + std::to_string(i + 1));
+    }
+    for (size_t i = 0; i < bambooNodes.size(); i++) {
+        addInstance(bambooBVH, bambooNodes[i], "bamboo " + std::to_string(i + 1));
+    }
+
+    sceneBVH.Build();
+}
+
+
+/// <summary>
+/// Move the animated instances of the top level BVH
+/// Only the bounds are refitted, the tree itself is kept.
+/// </summary>
+void LightHouse::UpdateSceneBVH()
+{
+    for (int i = 0; i < 4; i++) {
+        sceneBVH.SetTransform(boatInstances[i], sceneTransforms.GetWorldMatrix(boatNodes[i]));
+    }
+    sceneBVH.SetTransform(moonInstance, sceneTransforms.GetWorldMatrix(moonNode));
+    sceneBVH.Refit();
+}
+
+
+/// <summary>
+/// Pick the object under the mouse cursor
+/// Casts a ray through the scene BVH and checks if the hit point sees the moon.
+/// The result is kept for the HUD.
+/// </summary>
+/// <param name="mouseX">Cursor position in window pixels</param>
+/// <param name="mouseY">Cursor position in window pixels, from the top</param>
+void LightHouse::PickObject(int mouseX, int mouseY)
+{
+    if (windowWidth <= 0 || windowHeight <= 0) return;
+
+    // Unproject the cursor on the near and far planes
+    gfxc::Camera* camera = GetSceneCamera();
+    glm::mat4 invViewProjection = glm::inverse(camera->GetProjectionMatrix() * camera->GetViewMatrix());
+    float x = 2.0f * mouseX / windowWidth - 1.0f;
+    float y = 1.0f - 2.0f * mouseY / windowHeight;
+
+    glm::vec4 nearPoint = invViewProjection * glm::vec4(x, y, -1, 1);
+    glm::vec4 farPoint = invViewProjection * glm::vec4(x, y, 1, 1);
+    nearPoint /= nearPoint.w;
+    farPoint /= farPoint.w;
+
+    Ray ray(glm::vec3(nearPoint), glm::vec3(farPoint - nearPoint), 1.0f);
+    RayHit hit;
+
+    if (!sceneBVH.Intersect(ray, hit))
+    {
+        pickedNode = INVALID_TRANSFORM;
+        return;
+    }
+
+    pickedNode = hit.instance;
+    glm::vec3 point = ray.origin + hit.t * ray.direction;
+
+    // Line of sight towards the moon, ending before its own surface
+    glm::vec3 moonPosition = sceneTransforms.GetWorldPosition(moonNode);
+    float moonRadius = bounds_utils::Transform(meshes["sphere"]->GetBoundingSphere(), sceneTransforms.GetWorldMatrix(moonNode)).radius;
+    glm::vec3 toMoon = moonPosition - point;
+    float moonDistance = glm::length(toMoon);
+    bool moonlit = true;
+
+    if (pickedNode != moonNode && moonDistance > moonRadius)
+    {
+        glm::vec3 from = point + toMoon * (1e-3f / moonDistance);
+        glm::vec3 to = point + toMoon * (1.0f - moonRadius / moonDistance);
+        moonlit = sceneBVH.HasLineOfSight(from, to);
+    }
+
+    pickedDistance = hit.t * glm::length(ray.direction);
+    pickedMoonlit = moonlit;
 }
 
 
@@ -154,62 +492,54 @@ void LightHouse::Init()
 /// Render the lighthouse object in the scene
 /// Set up textures and positions for the lighthouse components. 
 /// </summary>
-void LightHouse::RenderLighthouseObject()
+/// <param name="state">Simulation state of the frame</param>
+void LightHouse::RenderLighthouseObject(const SimulationState& state)
 {
     std::vector<Texture2D*> baseHouseTextures = { textures["base-house"] };
     std::vector<Texture2D*> lighthouseMidTextures = { textures["mid-house"] };
     std::vector<Texture2D*> lighthouseTextures = { textures["top-house"] };
 
     // Render the base of the lighthouse
-    glm::mat4 baseModelMatrix = glm::translate(glm::mat4(1), glm::vec3(0, 0.0, 0));
-    baseModelMatrix = glm::scale(baseModelMatrix, glm::vec3(3.f, 1.5f, 3.f));
-    RenderTextured(meshes["sphere"], shaders["Scene"], baseModelMatrix, baseHouseTextures);
+    QueueTextured(meshes["sphere"], shaders["Scene"], lighthouseBaseNode, baseHouseTextures);
 
     // Setup lighting around the lighthouse
     SetupLighthouseLighting();
 
     // Render the middle of the lighthouse
-    glm::mat4 middleModelMatrix = glm::translate(glm::mat4(1), glm::vec3(0, 0.5, 0));
-    middleModelMatrix = glm::scale(middleModelMatrix, glm::vec3(2.45f, 10.0f, 2.45f));
-    RenderTextured(meshes["lighthouse"], shaders["Scene"], middleModelMatrix, lighthouseMidTextures);
+    QueueTextured(meshes["lighthouse"], shaders["Scene"], lighthouseMiddleNode, lighthouseMidTextures);
 
     // Render the lower layer (balcony-like structure)
-    glm::mat4 lowerLayerModelMatrix = glm::translate(glm::mat4(1), glm::vec3(0, 10.5, 0));
-    lowerLayerModelMatrix = glm::scale(lowerLayerModelMatrix, glm::vec3(3.0f, 0.25f, 3.0f));
-    RenderTextured(meshes["lighthouse"], shaders["Scene"], lowerLayerModelMatrix, lighthouseTextures);
+    QueueTextured(meshes["lighthouse"], shaders["Scene"], lighthouseLowerLayerNode, lighthouseTextures);
 
     // Update light positions and render the upper layer with rotating lights
-    UpdateAndRenderUpperLayer();
+    UpdateAndRenderUpperLayer(state);
 
     // Render the top of the lighthouse
-    glm::mat4 topModelMatrix = glm::translate(glm::mat4(1), glm::vec3(0, 12.f, 0));
-    topModelMatrix = glm::scale(topModelMatrix, glm::vec3(3.0f, 0.25f, 3.0f));
-    RenderTextured(meshes["lighthouse"], shaders["Scene"], topModelMatrix, lighthouseTextures);
+    QueueTextured(meshes["lighthouse"], shaders["Scene"], lighthouseTopNode, lighthouseTextures);
 }
 
 
 /// <summary>
 /// Render boats in the scene
-/// Responsible for animating and displaying boats around the lighthouse.
+/// Places the boats and their lights where the simulation moved them.
 /// </summary>
-/// <param name="deltaTimeSeconds">Time elapsed since the last frame, used for animations.</param>
-void LightHouse::RenderBoats(float deltaTimeSeconds)
+/// <param name="state">Simulation state of the frame</param>
+void LightHouse::RenderBoats(const SimulationState& state)
 {
-    std::vector<Texture2D*> boatCombo1 = { textures["wood1"], textures["wood3"], textures["iron_dark"] };
-    std::vector<Texture2D*> boatCombo2 = { textures["wood1"], textures["wood2"], textures["iron_dark"] };
-    std::vector<Texture2D*> boatCombo3 = { textures["wood1"], textures["wood3"], textures["iron_rust"] };
-    std::vector<Texture2D*> boatCombo4 = { textures["wood1"], textures["wood2"], textures["iron_rust"] };
-    std::vector<std::vector<Texture2D*>> boatCombos = { boatCombo1, boatCombo2, boatCombo3, boatCombo4 };
+    // Layers of the boat material array, the boats only differ by the layers they mix
+    Texture2DArray* boatMaterials = textureArrays["boats"];
+    std::vector<int> boatCombo1 = { boatMaterials->GetLayer("wood1"), boatMaterials->GetLayer("wood3"), boatMaterials->GetLayer("iron_dark") };
+    std::vector<int> boatCombo2 = { boatMaterials->GetLayer("wood1"), boatMaterials->GetLayer("wood2"), boatMaterials->GetLayer("iron_dark") };
+    std::vector<int> boatCombo3 = { boatMaterials->GetLayer("wood1"), boatMaterials->GetLayer("wood3"), boatMaterials->GetLayer("iron_rust") };
+    std::vector<int> boatCombo4 = { boatMaterials->GetLayer("wood1"), boatMaterials->GetLayer("wood2"), boatMaterials->GetLayer("iron_rust") };
+    std::vector<std::vector<int>> boatCombos = { boatCombo1, boatCombo2, boatCombo3, boatCombo4 };
     std::vector<float> mixFactorsBoats = { 0.5f, 0.5f };
 
     for (int i = 0; i <= 3; i++)
     {
-        // Update rotation angle for circular motion around the lighthouse
-        boatRotationAngles[i] += deltaTimeSeconds * boatRotationSpeeds[i] * boatRotationDirections[i];
-
         // Calculate new position for the boat
-        float x = lighthousePosition.x + radiusDist[i] * cos(boatRotationAngles[i]);
-        float z = lighthousePosition.z + radiusDist[i] * sin(boatRotationAngles[i]);
+        float x = lighthousePosition.x + radiusDist[i] * cos(state.boatAngles[i]);
+        float z = lighthousePosition.z + radiusDist[i] * sin(state.boatAngles[i]);
         glm::vec3 boatPosition = glm::vec3(x, 0.5, z);
 
         // Update the corresponding point light position
@@ -218,21 +548,19 @@ void LightHouse::RenderBoats(float deltaTimeSeconds)
         point_light_dir[i] = glm::vec3(0, -1, 0);
         point_light_color[i] = boatInitialColors[i];
 
-        // Set up model matrix for the boat
-        glm::mat4 modelMatrix = glm::mat4(1);
-        modelMatrix = glm::translate(modelMatrix, boatPosition);
+        // Set up the boat transform
         float directionAngle = atan2(-z, x) + M_PI / 2.0f;
-        modelMatrix = glm::rotate(modelMatrix, directionAngle, glm::vec3(0, 1, 0));
+        glm::quat rotation = glm::angleAxis(directionAngle, glm::vec3(0, 1, 0));
 
         if (boatRotationDirections[i] < 0)
         {
-            modelMatrix = glm::rotate(modelMatrix, glm::radians(180.0f), glm::vec3(0, 1, 0));
+            rotation = rotation * glm::angleAxis(glm::radians(180.0f), glm::vec3(0, 1, 0));
         }
 
-        modelMatrix = glm::rotate(modelMatrix, glm::radians(180.0f), glm::vec3(0, 1, 1));
-        modelMatrix = glm::scale(modelMatrix, glm::vec3(0.005f));
+        rotation = rotation * glm::angleAxis(glm::radians(180.0f), glm::normalize(glm::vec3(0, 1, 1)));
+        sceneTransforms.SetLocalTRS(boatNodes[i], boatPosition, rotation, glm::vec3(0.005f));
 
-        RenderTextured(meshes["wake_boat"], shaders["Scene"], modelMatrix, boatCombos[i], mixFactorsBoats);
+        QueueLayered(meshes["wake_boat"], shaders["Scene"], boatNodes[i], boatMaterials, boatCombos[i], mixFactorsBoats);
     }
 }
 
@@ -241,35 +569,34 @@ void LightHouse::RenderBoats(float deltaTimeSeconds)
 /// Render the moon in the scene
 /// Position and textures the moon, and sets up its lighting.
 /// </summary>
-void LightHouse::RenderMoon()
+/// <param name="state">Simulation state of the frame</param>
+void LightHouse::RenderMoon(const SimulationState& state)
 {
+    const float time = static_cast<float>(state.time);
     float moonSpeed = 0.1f;
     float moonOrbitRadius = 200.0f;
     std::vector<Texture2D*> moonTextures = { textures["moonHMap"] };
 
     // Calculate the moon's position in a circular orbit
     glm::vec3 position = glm::vec3(
-        moonOrbitRadius * cos(elapsedTime * moonSpeed),
+        moonOrbitRadius * cos(time * moonSpeed),
         40.0f,
-        moonOrbitRadius * sin(elapsedTime * moonSpeed)
+        moonOrbitRadius * sin(time * moonSpeed)
     );
 
     point_light_pos[6] = position;
     point_light_color[6] = glm::vec3(1.f);
 
-    // Define downward direction for moonlight
-    glm::vec3 moonLightDirection = glm::normalize(position);
+    // Define downward direction for moonlight (from the moon toward the scene)
+    glm::vec3 moonLightDirection = -glm::normalize(position);
     point_light_dir[6] = moonLightDirection;
 
-    // Update model matrix
-    glm::mat4 modelMatrix = glm::translate(glm::mat4(1), position);
-    modelMatrix = glm::scale(modelMatrix, glm::vec3(10.f));
-
     // Tidal locking: Axial rotation matches orbital speed
     float axialRotationSpeed = moonSpeed;
-    modelMatrix = glm::rotate(modelMatrix, elapsedTime * axialRotationSpeed, glm::vec3(0.0f, -1.0f, 0.0f));
+    glm::quat rotation = glm::angleAxis(time * axialRotationSpeed, glm::vec3(0.0f, -1.0f, 0.0f));
+    sceneTransforms.SetLocalTRS(moonNode, position, rotation, glm::vec3(10.f));
 
-    RenderTextured(meshes["sphere"], shaders["LightHouse"], modelMatrix, moonTextures);
+    QueueTextured(meshes["sphere"], shaders["LightHouse"], moonNode, moonTextures);
 }
 
 
@@ -282,10 +609,7 @@ void LightHouse::RenderLakePlane()
     std::vector<Texture2D*> mountainTexture = { textures["groundHMap"], textures["ground"],
                                                 textures["water"], textures["waterUV"],
                                                 textures["lava"], textures["lavaUV"], textures["lavaOcc"] };
-    glm::mat4 modelMatrix = glm::translate(glm::mat4(1), glm::vec3(0, 0, 0));
-    modelMatrix = glm::scale(modelMatrix, glm::vec3(0.75));
-
-    RenderTextured(meshes["lake"], shaders["Lake"], modelMatrix, mountainTexture);
+    QueueTextured(meshes["lake"], shaders["Lake"], lakeNode, mountainTexture);
 }
 
 
@@ -313,7 +637,8 @@ void LightHouse::SetupLighthouseLighting()
 /// Update and renders the upper layer of the lighthouse
 /// Handle the animation and lighting of the upper layer.
 /// </summary>
-void LightHouse::UpdateAndRenderUpperLayer()
+/// <param name="state">Simulation state of the frame</param>
+void LightHouse::UpdateAndRenderUpperLayer(const SimulationState& state)
 {
     const float rotationSpeed = 1.0f;
     const float rotationRadius = 1.0f;
@@ -321,7 +646,7 @@ void LightHouse::UpdateAndRenderUpperLayer()
 
     for (int i = 4; i <= 5; ++i)
     {
-        float rotationAngle = elapsedTime * rotationSpeed + (i == 5 ? M_PI : 0.0f);
+        float rotationAngle = static_cast<float>(state.time) * rotationSpeed + (i == 5 ? M_PI : 0.0f);
         glm::vec3 position = upperLayerCenter + rotationRadius * glm::vec3(cos(rotationAngle), 0, sin(rotationAngle));
 
         point_light_pos[i] = position;
@@ -329,162 +654,1487 @@ void LightHouse::UpdateAndRenderUpperLayer()
         point_light_color[i] = sliderManager->getLighthouseColor();
     }
 
-    glm::mat4 upperLayerModelMatrix = glm::translate(glm::mat4(1), glm::vec3(0, 10.5, 0));
-    upperLayerModelMatrix = glm::scale(upperLayerModelMatrix, glm::vec3(2.5f, 1.5f, 2.5f));
-    RenderTextured(meshes["lighthouse"], shaders["LightHouse"], upperLayerModelMatrix, {}, {}, sliderManager->getLighthouseColor());
+    QueueTextured(meshes["lighthouse"], shaders["LightHouse"], lighthouseUpperLayerNode, {}, {}, sliderManager->getLighthouseColor());
 }
 
 
 /// <summary>
 /// Render sliders for the UI
-/// Draw sliders for user interaction, like color adjustment.
+/// All the bars go into one batch drawn with the UI shader, the
+/// backgrounds first so the bars are painted over them.
 /// </summary>
 void LightHouse::RenderSliders()
 {
+    Shader* shader = shaders["UI"];
+    if (!shader || !shader->GetProgramID()) return;
+
     const auto& sliders = sliderManager->getSliders();
 
-    for (size_t i = 0; i < sliders.size(); ++i)
-    {
-        // Create model matrix based on slider position and size
-        glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(sliders[i].position, 0.0f));
-        modelMatrix = glm::scale(modelMatrix, glm::vec3(sliders[i].size, 1.0f));
+    // Backgrounds follow the 6 bars
+    for (size_t i = 6; i < sliders.size(); ++i) {
+        uiBatch.AddQuad(sliders[i].position, sliders[i].size, sliders[i].color, WIDGET_SOLID);
+    }
 
-        // Determine which shader to use based on the slider index
+    for (size_t i = 0; i < sliders.size() && i < 6; ++i)
+    {
+        // Determine the widget type based on the slider index
         switch (i) {
         case 0: case 1: case 2: // RGB Sliders
-            RenderSlider(meshes["slider"], shaders["RGB"], modelMatrix, sliders[i].color);
+            uiBatch.AddQuad(sliders[i].position, sliders[i].size, sliders[i].color, WIDGET_SOLID);
             break;
         case 3: // Hue Slider
-            RenderSlider(meshes["slider"], shaders["HUE"], modelMatrix, sliders[i].color);
+            uiBatch.AddQuad(sliders[i].position, sliders[i].size, sliders[i].color, WIDGET_HUE);
             break;
         case 4: // Saturation Slider
-            RenderSlider(meshes["slider"], shaders["SAT"], modelMatrix, sliderManager->getLighthouseColor());
+            uiBatch.AddQuad(sliders[i].position, sliders[i].size, sliderManager->getLighthouseColor(), WIDGET_SATURATION);
             break;
         case 5: // Value Slider
-            RenderSlider(meshes["slider"], shaders["VAL"], modelMatrix, sliders[i].color);
-            break;
-        default: // Default case for unexpected index
-            RenderSlider(meshes["slider"], shaders["RGB"], modelMatrix, sliders[i].color);
+            uiBatch.AddQuad(sliders[i].position, sliders[i].size, sliders[i].color, WIDGET_VALUE);
             break;
         }
     }
+
+    FlushUIBatch();
 }
 
 
 /// <summary>
-/// Render a single slider
-/// Helper method for drawing individual sliders.
+/// Draw the quads added to the UI batch
+/// Coordinates are window pixels from the bottom left corner.
 /// </summary>
-/// <param name="mesh">Mesh for the slider</param>
-/// <param name="shader">Shader to use</param>
-/// <param name="modelMatrix">Model matrix for positioning the slider</param>
-/// <param name="color">Color of the slider</param>
-void LightHouse::RenderSlider(Mesh* mesh, Shader* shader, const glm::mat4& modelMatrix, const glm::vec3& color)
+void LightHouse::FlushUIBatch()
 {
-    RenderTextured(mesh, shader, modelMatrix, {}, {}, color, true);
+    Shader* shader = shaders["UI"];
+    if (!shader || !shader->GetProgramID()) return;
+
+    glm::mat4 projection = glm::ortho(0.0f, static_cast<float>(windowWidth), 0.0f, static_cast<float>(windowHeight));
+
+    shader->Use();
+    glUniformMatrix4fv(glGetUniformLocation(shader->program, "Projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform2f(glGetUniformLocation(shader->program, "u_resolution"), static_cast<float>(windowWidth), static_cast<float>(windowHeight));
+
+    // The UI is on top of the scene
+    glDisable(GL_DEPTH_TEST);
+    uiBatch.Flush();
+    glEnable(GL_DEPTH_TEST);
 }
 
 
 /// <summary>
-/// Render bamboo objects in the scene
-/// Place and textures several bamboo objects around the lighthouse.
+/// Draw the performance HUD in the top left corner
+/// Everything shown is already known on the CPU: the counters of the previous
+/// frame, timer queries read back frames later and sizes of the allocated
+/// textures, so the HUD never makes the CPU wait for the GPU. The panel and
+/// the graph are one UI batch draw and the text one more.
 /// </summary>
-void LightHouse::RenderBamboos()
+void LightHouse::RenderHud()
 {
-    std::vector<glm::vec3> bambooPositions =
+    Shader* shader = shaders["UI"];
+    if (!shader || !shader->GetProgramID()) return;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    const float fontSize = 16.0f;
+    const float lineHeight = 20.0f;
+    const float margin = 10.0f;
+    const unsigned int lineCount = 17;
+    const glm::vec2 graphSize(280.0f, 80.0f);
+    const float graphRange = 100.0f / 3.0f;     // Milliseconds at the top of the graph, two frames at 60 Hz
+
+    if (!hudText)
     {
-        glm::vec3(-1.75, 0, -1.75),
-        glm::vec3(1.75, 0, -1.75),
-        glm::vec3(-1.75, 0, 1.75),
-        glm::vec3(1.75, 0, 1.75),
-        /// between each of the first 4 bamboos put other bamboos
-        (glm::vec3(-1.75, 0, -1.75) + glm::vec3(1.75, 0, -1.75)) / 1.5f,
-        (glm::vec3(1.75, 0, -1.75) + glm::vec3(1.75, 0, 1.75)) / 1.5f,
-        (glm::vec3(-1.75, 0, 1.75) + glm::vec3(1.75, 0, 1.75)) / 1.5f,
-        (glm::vec3(-1.75, 0, -1.75) + glm::vec3(-1.75, 0, 1.75)) / 1.5f
+        hudText = new gfxc::TextRenderer(window->props.selfDir, windowWidth, windowHeight);
+        hudText->Load(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::FONTS, "Hack-Bold.ttf"), static_cast<GLuint>(fontSize));
+        hudViewport = resolution;
+    }
+    if (hudViewport != resolution)
+    {
+        hudText->SetViewport(windowWidth, windowHeight);
+        hudViewport = resolution;
+    }
+
+    // Panel from the top left corner, the text is laid out from the top and the batch from the bottom
+    const glm::vec2 panelSize(graphSize.x + 2 * margin, lineCount * lineHeight + graphSize.y + 3 * margin);
+    const glm::vec2 panelPosition(margin, windowHeight - margin - panelSize.y);
+    const glm::vec2 graphPosition(panelPosition.x + margin, panelPosition.y + margin);
+    const glm::vec3 cpuColor(1.0f, 0.6f, 0.2f);
+    const glm::vec3 gpuColor(0.3f, 0.8f, 1.0f);
+
+    uiBatch.AddQuad(panelPosition, panelSize, glm::vec3(0.05f), WIDGET_SOLID);
+    uiBatch.AddQuad(graphPosition, graphSize, glm::vec3(0.12f), WIDGET_SOLID);
+
+    // Oldest frame on the left, CPU as bars and GPU as a line over them
+    const unsigned int frames = MIN(hudFrame, HUD_HISTORY);
+    const float barWidth = graphSize.x / HUD_HISTORY;
+    float cpuMax = 0, gpuMax = 0;
+
+    for (unsigned int i = 0; i < frames; i++)
+    {
+        const unsigned int slot = (hudFrame - frames + i) % HUD_HISTORY;
+        const float x = graphPosition.x + (HUD_HISTORY - frames + i) * barWidth;
+        const float cpuHeight = MIN(cpuFrameTimes[slot] / graphRange, 1.0f) * graphSize.y;
+        const float gpuHeight = MIN(gpuFrameTimes[slot] / graphRange, 1.0f) * graphSize.y;
+
+        uiBatch.AddQuad(glm::vec2(x, graphPosition.y), glm::vec2(barWidth, cpuHeight), cpuColor, WIDGET_SOLID);
+        uiBatch.AddQuad(glm::vec2(x, graphPosition.y + MAX(gpuHeight - 2.0f, 0.0f)), glm::vec2(barWidth, 2.0f), gpuColor, WIDGET_SOLID);
+
+        cpuMax = MAX(cpuMax, cpuFrameTimes[slot]);
+        gpuMax = MAX(gpuMax, gpuFrameTimes[slot]);
+    }
+
+    // 60 Hz budget
+    uiBatch.AddQuad(glm::vec2(graphPosition.x, graphPosition.y + graphSize.y * 0.5f), glm::vec2(graphSize.x, 1.0f), glm::vec3(0.5f), WIDGET_SOLID);
+
+    FlushUIBatch();
+
+    const unsigned int newest = (hudFrame + HUD_HISTORY - 1) % HUD_HISTORY;
+    const RenderStats& stats = render_stats::GetLastFrame();
+    const CullingStats& frustum = frustumCuller.GetStats();
+    const CullingStats& occlusion = occlusionCuller.GetStats();
+    const FramePacingStats& pacing = GetFramePacer().GetStats();
+    const auto& sliders = sliderManager->getSliders();
+
+    char line[128];
+    float y = margin + margin;
+    auto addLine = [&](const glm::vec3& color) {
+        hudText->RenderText(line, 2 * margin, y, 1.0f, color);
+        y += lineHeight;
     };
 
-    float bambooScale = 0.1f;
+    snprintf(line, sizeof(line), "CPU %6.2f ms  max %6.2f", cpuFrameTimes[newest], cpuMax);
+    addLine(cpuColor);
+    snprintf(line, sizeof(line), "GPU %6.2f ms  max %6.2f", gpuFrameTimes[newest], gpuMax);
+    addLine(gpuColor);
+    snprintf(line, sizeof(line), "Draws %u  Triangles %.1fk", stats.drawCalls, stats.triangles / 1000.0f);
+    addLine(glm::vec3(1));
+    snprintf(line, sizeof(line), "Texture binds %u  Programs %u", stats.textureBinds, stats.programSwitches);
+    addLine(glm::vec3(1));
+    snprintf(line, sizeof(line), "Present %5.2f ms  jitter %4.2f  late %u", pacing.average, pacing.jitter, pacing.lateFrames);
+    addLine(glm::vec3(1));
+    snprintf(line, sizeof(line), "Input to present %5.2f ms  max %5.2f", pacing.inputLatency, pacing.inputLatencyMax);
+    addLine(glm::vec3(1));
+    snprintf(line, sizeof(line), "VRAM ~%.1f MB  Scale %.2f %s", GetVideoMemoryEstimate() / (1024.0f * 1024.0f),
+             dynamicResolution.GetScale(), dynamicResolution.IsEnabled() ? "auto" : "fixed");
+    addLine(glm::vec3(1));
+    snprintf(line, sizeof(line), "%s  Passes %u, %u culled, %u bad FBO", deferredShading ? "Deferred" : "Forward",
+             renderGraph.GetPassCount(), renderGraph.GetCulledPassCount(), renderGraph.GetIncompleteFramebufferCount());
+    addLine(renderGraph.GetIncompleteFramebufferCount() ? glm::vec3(1, 0.3f, 0.3f) : glm::vec3(1));
+    snprintf(line, sizeof(line), "Visible %u/%u  Occluded %u", frustum.visible, frustum.tested, occlusion.culled);
+    addLine(glm::vec3(1));
+    snprintf(line, sizeof(line), "GPU driven %s  %u instances, %u batches",
+             indirectShaders.empty() ? "n/a" : gpuDriven ? "on" : "off",
+             gpuScene.GetInstanceCount(), gpuScene.GetBatchCount());
+    addLine(glm::vec3(1));
+    snprintf(line, sizeof(line), "Particles %s  %.1fk alive, %u emitted",
+             !particles.IsValid() ? "n/a" : particlesEnabled ? "on" : "off",
+             particles.GetLiveCount() / 1000.0f, particles.GetEmittedLastStep());
+    addLine(glm::vec3(1));
+    snprintf(line, sizeof(line), "PerDraw ring %u stalls %u overflows", drawUniforms.GetStalls(), drawUniforms.GetOverflows());
+    addLine(drawUniforms.GetOverflows() ? glm::vec3(1, 0.3f, 0.3f) : glm::vec3(1));
+    snprintf(line, sizeof(line), "Shadow pages %u static %u dynamic%s", shadowAtlas.GetStaticUpdates(), shadowAtlas.GetDynamicUpdates(),
+             shadowAtlas.IsComplete() ? "" : ", bad FBO");
+    addLine(shadowAtlas.IsComplete() ? glm::vec3(1) : glm::vec3(1, 0.3f, 0.3f));
+    snprintf(line, sizeof(line), "Capture %s  %u ok %u drop %u fail", frameCapture.IsRecording() ? "rec" : "idle",
+             frameCapture.GetFramesWritten(), frameCapture.GetFramesDropped(), frameCapture.GetFramesFailed());
+    addLine(frameCapture.GetFramesFailed() ? glm::vec3(1, 0.3f, 0.3f) : glm::vec3(1));
+    if (pickedNode != INVALID_TRANSFORM && nodeNames.count(pickedNode)) {
+        snprintf(line, sizeof(line), "Picked %s  %.1f, %s", nodeNames[pickedNode].c_str(), pickedDistance,
+                 pickedMoonlit ? "moonlit" : "shadowed");
+    } else {
+        snprintf(line, sizeof(line), "Picked nothing");
+    }
+    addLine(glm::vec3(1));
+    snprintf(line, sizeof(line), "RGB %3.0f %3.0f %3.0f  HSV %3.0f %3.0f %3.0f",
+             sliders[0].value * RGB_MAX, sliders[1].value * RGB_MAX, sliders[2].value * RGB_MAX,
+             sliders[3].value * HUE_CONE, sliders[4].value * SATURATION_PERCENT, sliders[5].value * VALUE_PERCENT);
+    addLine(sliderManager->getLighthouseColor());
+    snprintf(line, sizeof(line), "HUD %.3f ms", hudMilliseconds);
+    addLine(glm::vec3(0.6f));
+
+    glDisable(GL_DEPTH_TEST);
+    hudText->Flush();
+    glEnable(GL_DEPTH_TEST);
+
+    hudMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+/// <summary>
+/// Estimate the video memory used by the textures
+/// Loaded textures count with their mipmaps, the render graph pool and the
+/// shadow atlas with their formats. Buffers are left out.
+/// </summary>
+/// <returns>Estimate in bytes</returns>
+size_t LightHouse::GetVideoMemoryEstimate() const
+{
+    size_t bytes = renderGraph.GetTextureMemory();
+
+    // Two 32 bit depth textures, the static casters and the final pages
+    bytes += 2 * static_cast<size_t>(shadowAtlas.GetSize()) * shadowAtlas.GetSize() * 4;
+
+    // RGBA8 color grading table
+    const size_t lutSize = colorGrading.GetSize();
+    bytes += lutSize * lutSize * lutSize * 4;
+
+    for (const auto& entry : textures)
+    {
+        if (!entry.second) continue;
+        size_t pixels = static_cast<size_t>(entry.second->GetWidth()) * entry.second->GetHeight();
+        bytes += pixels * MAX(entry.second->GetNrChannels(), 1u) * 4 / 3;
+    }
+
+    // RGBA8 layers with their mipmaps
+    for (const auto& entry : textureArrays)
+    {
+        if (!entry.second) continue;
+        size_t pixels = static_cast<size_t>(entry.second->GetWidth()) * entry.second->GetHeight() * entry.second->GetLayerCount();
+        bytes += pixels * 4 * 4 / 3;
+    }
+    return bytes;
+}
+
+
+/// <summary>
+/// Render bamboo objects in the scene
+/// Place and textures several bamboo objects around the lighthouse.
+/// </summary>
+void LightHouse::RenderBamboos()
+{
     std::vector<Texture2D*> bambooTextures = { textures["bamboo"] };
 
-    for (const auto& pos : bambooPositions) {
-        glm::mat4 bambooModelMatrix = glm::mat4(1);
-        bambooModelMatrix = glm::translate(bambooModelMatrix, pos);
-        bambooModelMatrix = glm::rotate(bambooModelMatrix, glm::radians(90.0f), glm::vec3(0, 1, 0));
-        bambooModelMatrix = glm::scale(bambooModelMatrix, glm::vec3(bambooScale));
-        RenderTextured(meshes["bamboo"], shaders["Scene"], bambooModelMatrix, bambooTextures);
+    for (TransformHandle node : bambooNodes) {
+        QueueTextured(meshes["bamboo"], shaders["Scene"], node, bambooTextures);
     }
 }
 
 
 /// <summary>
-/// Updates the scene based on elapsed time
-/// Handles time-based updates like animations.
+/// Draws the frame
+/// The animation is advanced on the simulation thread, the frame draws the
+/// state interpolated from its latest results.
 /// </summary>
 /// <param name="deltaTimeSeconds">Time elapsed since the last frame.</param>
 void LightHouse::Update(float deltaTimeSeconds)
 {
-    elapsedTime = Engine::GetElapsedTime();
     std::srand(std::time(nullptr));
-    RenderBoats(deltaTimeSeconds);
-    RenderLighthouseObject();
-    RenderMoon();
+
+    const SimulationState state = GetFrameState();
+
+    // Scene objects are queued first, then culled against the camera frustum in one batch
+    drawQueue.clear();
+    RenderBoats(state);
+    RenderLighthouseObject(state);
+    RenderMoon(state);
     RenderLakePlane();
     RenderBamboos();
-    RenderSliders();
+
+    // World matrices are needed by the shadow pass before the scene pass
+    sceneTransforms.Update();
+    UpdateShadowLights();
+    CullDrawQueue();
+    SimulateParticles(deltaTimeSeconds);
+
+    // Passes are declared again every frame, their textures stay pooled in the graph
+    BuildRenderGraph();
+    renderGraph.Compile();
+    frameTimer.Begin();
+    renderGraph.Execute();
+    frameTimer.End();
+
+    UpdateSceneBVH();
 }
 
 
 /// <summary>
-/// Render a textured object
-/// General method for rendering any textured object in the scene.
+/// Declare the render passes of the frame
+/// The shadow atlas is brought up to date first. The scene is drawn into an offscreen target at the dynamic resolution
+/// scale, forward or deferred, color graded when the sliders set a grade, then upscaled to the screen.
+/// The sliders are drawn on top at the window resolution.
 /// </summary>
-/// <param name="mesh">Mesh of the object</param>
-/// <param name="shader">Shader to use</param>
-/// <param name="modelMatrix">Model matrix for positioning</param>
-/// <param name="textures">Textures to apply</param>
-/// <param name="mixFactors">Factors for mixing textures</param>
-/// <param name="color">Color of the object</param>
-/// <param name="orthographic_perspective">Whether to use orthographic perspective</param>
-void LightHouse::RenderTextured(
-    Mesh* mesh,
-    Shader* shader,
-    // Model matrix applied with (T, R, S)
-    const glm::mat4& modelMatrix,
-    // Textures of the objects,
-    // plus with an uniform mix of them applied on object
-    std::vector<Texture2D*> textures,
-    std::vector<float> mixFactors,
-    // Color of the objects, in case if they dont use textures
-    const glm::vec3& color,
-    // Ortographic sliders, in rest perspective
-    bool orthographic_perspective)
+void LightHouse::BuildRenderGraph()
 {
-    if (!mesh || !shader || !shader->GetProgramID()) return;
+    renderGraph.Reset();
 
-    glUseProgram(shader->program);
+    const float scale = dynamicResolution.GetScale();
+    RenderTargetHandle sceneColor = renderGraph.CreateTarget("scene color", RenderTargetDesc::Color(16, scale));
+    RenderTargetHandle sceneDepth = renderGraph.CreateTarget("scene depth",
+        deferredShading ? RenderTargetDesc::DepthStencil(scale) : RenderTargetDesc::Depth(scale));
+    RenderTargetHandle shadowMaps = renderGraph.ImportTexture("shadow atlas", shadowAtlas.GetTexture(), true);
 
-    SetupMatrices(shader, modelMatrix, orthographic_perspective);
-    SetupSlider(shader, color);
-    SetupLighting(shader, color);
-    SetupTextures(shader, textures, mixFactors);
+    renderGraph.AddPass("shadows", {}, { shadowMaps }, [this]() {
+        RenderShadows();
+    });
+
+    if (deferredShading)
+    {
+        AddDeferredPasses(shadowMaps, sceneColor, sceneDepth);
+    }
+    else
+    {
+        renderGraph.AddPass("scene", { shadowMaps }, { sceneColor, sceneDepth }, [this, sceneDepth]() {
+            glClearColor(0, 0, 0, 1);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            RenderDrawQueue(DrawFilter::All);
+            BuildHiZ(sceneDepth);
+            RenderParticles();
+        });
+    }
 
-    glBindVertexArray(mesh->GetBuffers()->m_VAO);
-    glDrawElements(mesh->GetDrawMode(), static_cast<int>(mesh->indices.size()), GL_UNSIGNED_INT, 0);
+    // Graded at the scene resolution, before the upscale. Without a grade the pass is left out
+    RenderTargetHandle presentColor = sceneColor;
+    if (!colorGrading.GetGrade().IsIdentity())
+    {
+        presentColor = renderGraph.CreateTarget("graded color", RenderTargetDesc::Color(8, scale));
+        renderGraph.AddPass("color grading", { sceneColor }, { presentColor }, [this, sceneColor]() {
+            RenderColorGrade(sceneColor);
+        });
+    }
+
+    renderGraph.AddPass("present", { presentColor, sceneDepth }, { RenderGraph::BACKBUFFER }, [this, presentColor, sceneDepth]() {
+        RenderPresent(presentColor, sceneDepth);
+    });
+
+    renderGraph.AddPass("sliders", {}, { RenderGraph::BACKBUFFER }, [this]() {
+        RenderSliders();
+    });
+
+    if (showHud)
+    {
+        renderGraph.AddPass("hud", {}, { RenderGraph::BACKBUFFER }, [this]() {
+            RenderHud();
+        });
+    }
 }
 
 
 /// <summary>
-/// Set up textures for rendering
-/// Bind textures and sets shader uniforms for texture mixing.
+/// Declare the passes of the deferred path
+/// The opaque objects write their surface into a G-buffer, the moon and the
+/// point light ambient are applied in one full screen pass and every other
+/// light only shades the pixels inside its volume. The emissive objects are
+/// drawn forward on top of the resolved image.
 /// </summary>
-/// <param name="shader">Shader to use</param>
-/// <param name="textures">Textures to apply</param>
-/// <param name="mixFactors">Factors for mixing textures</param>
-void LightHouse::SetupTextures(
-    Shader* shader,
-    const std::vector<Texture2D*>& textures,
-    std::vector<float>& mixFactors)
+/// <param name="shadowMaps">Shadow atlas target</param>
+/// <param name="sceneColor">Target receiving the lit scene</param>
+/// <param name="sceneDepth">Depth and stencil of the scene, the light volumes are marked in its stencil</param>
+void LightHouse::AddDeferredPasses(RenderTargetHandle shadowMaps, RenderTargetHandle sceneColor, RenderTargetHandle sceneDepth)
+{
+    const float scale = dynamicResolution.GetScale();
+
+    GBufferTargets gbuffer;
+    gbuffer.albedo = renderGraph.CreateTarget("gbuffer albedo", RenderTargetDesc::Color(8, scale));
+    gbuffer.normal = renderGraph.CreateTarget("gbuffer normal", RenderTargetDesc::Color(16, scale, 2));
+    gbuffer.material = renderGraph.CreateTarget("gbuffer material", RenderTargetDesc::Color(8, scale));
+    gbuffer.depth = renderGraph.CreateTarget("gbuffer depth", RenderTargetDesc::DepthStencil(scale));
+    RenderTargetHandle lightAccum = renderGraph.CreateTarget("light accumulation", RenderTargetDesc::Color(24, scale));
+
+    renderGraph.AddPass("gbuffer", {}, { gbuffer.albedo, gbuffer.normal, gbuffer.material, gbuffer.depth }, [this, gbuffer]() {
+        glClearColor(0, 0, 0, 0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        RenderDrawQueue(DrawFilter::GBuffer);
+        BuildHiZ(gbuffer.depth);
+    });
+
+    renderGraph.AddPass("lighting", { gbuffer.albedo, gbuffer.normal, gbuffer.material, gbuffer.depth, shadowMaps },
+        { lightAccum, sceneDepth }, [this, gbuffer]() {
+        RenderDeferredLights(gbuffer);
+    });
+
+    renderGraph.AddPass("resolve", { gbuffer.albedo, lightAccum }, { sceneColor, sceneDepth }, [this, gbuffer, lightAccum]() {
+        ResolveDeferred(gbuffer, lightAccum);
+        RenderDrawQueue(DrawFilter::Forward);
+        RenderParticles();
+    });
+}
+
+
+/// <summary>
+/// Bind the G-buffer for a lighting shader
+/// Also sets what the lighting shaders need to rebuild the world position of a pixel.
+/// </summary>
+/// <param name="shader">Shader to use</param>
+/// <param name="gbuffer">G-buffer targets</param>
+void LightHouse::SetupGBuffer(Shader* shader, const GBufferTargets& gbuffer)
+{
+    const char* names[4] = { "g_albedo", "g_normal", "g_material", "g_depth" };
+    const RenderTargetHandle targets[4] = { gbuffer.albedo, gbuffer.normal, gbuffer.material, gbuffer.depth };
+
+    for (int i = 0; i < 4; i++)
+    {
+        renderGraph.GetTexture(targets[i])->BindToTextureUnit(GL_TEXTURE0 + i);
+        glUniform1i(glGetUniformLocation(shader->program, names[i]), i);
+    }
+
+    gfxc::Camera* camera = GetSceneCamera();
+    glm::mat4 inverseViewProjection = glm::inverse(camera->GetProjectionMatrix() * camera->GetViewMatrix());
+    glm::vec3 eyePosition = camera->m_transform->GetWorldPosition();
+
+    glUniformMatrix4fv(glGetUniformLocation(shader->program, "inverse_view_projection"), 1, GL_FALSE, glm::value_ptr(inverseViewProjection));
+    glUniform3fv(glGetUniformLocation(shader->program, "eye_position"), 1, glm::value_ptr(eyePosition));
+    glUniform3fv(glGetUniformLocation(shader->program, "material_ke"), 1, glm::value_ptr(materialKe));
+}
+
+
+/// <summary>
+/// Accumulate the light of every pixel of the G-buffer
+/// The full screen pass writes the moon and the unattenuated ambient of the
+/// point lights, then the attenuated point lights and the spotlights are added
+/// through their volumes.
+/// </summary>
+/// <param name="gbuffer">G-buffer targets</param>
+void LightHouse::RenderDeferredLights(const GBufferTargets& gbuffer)
+{
+    // The volumes are depth tested against the scene
+    renderGraph.BlitDepth(gbuffer.depth);
+
+    glDisable(GL_DEPTH_TEST);
+
+    Shader* ambient = shaders["DeferredAmbient"];
+    if (ambient && ambient->GetProgramID())
+    {
+        ambient->Use();
+        SetupGBuffer(ambient, gbuffer);
+        SetupShadows(ambient);
+        glUniform3fv(glGetUniformLocation(ambient->program, "light_position"), 15, glm::value_ptr(point_light_pos[0]));
+        glUniform3fv(glGetUniformLocation(ambient->program, "light_direction"), 15, glm::value_ptr(point_light_dir[0]));
+        glUniform3fv(glGetUniformLocation(ambient->program, "light_color"), 15, glm::value_ptr(point_light_color[0]));
+        RenderFullscreen(ambient);
+    }
+
+    Shader* shader = shaders["DeferredLight"];
+    if (!shader || !shader->GetProgramID())
+    {
+        glEnable(GL_DEPTH_TEST);
+        return;
+    }
+
+    shader->Use();
+    SetupGBuffer(shader, gbuffer);
+    SetupShadows(shader);
+    glUniform1f(glGetUniformLocation(shader->program, "angle"), angleCutOff);
+
+    GLint lightType = glGetUniformLocation(shader->program, "light_type");
+    GLint lightPosition = glGetUniformLocation(shader->program, "light_position");
+    GLint lightDirection = glGetUniformLocation(shader->program, "light_direction");
+    GLint lightColor = glGetUniformLocation(shader->program, "light_color");
+    GLint shadowPage = glGetUniformLocation(shader->program, "shadow_page");
+
+    // Clipping a volume at the near or far plane would lose its faces for the stencil test
+    glEnable(GL_DEPTH_CLAMP);
+    glEnable(GL_STENCIL_TEST);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glDepthMask(GL_FALSE);
+
+    // Point lights end where the brightest diffuse and specular term drops under
+    // one step of an 8 bit color: 2 (kd + ks) c / (1 + 0.2 d + 0.1 d^2) < 1 / 256
+    for (int i = 0; i < 15; i++)
+    {
+        if (i >= 4 && i <= 6) continue;
+
+        const glm::vec3& color = point_light_color[i];
+        float brightest = 256.0f * 2.0f * (materialKd + materialKs) * MAX(color.r, MAX(color.g, color.b));
+        if (brightest <= 1.0f) continue;
+        float range = (-0.2f + sqrt(0.04f + 0.4f * (brightest - 1.0f))) / 0.2f;
+
+        shader->Use();
+        glUniform1i(lightType, 0);
+        glUniform3fv(lightPosition, 1, glm::value_ptr(point_light_pos[i]));
+        glUniform3fv(lightColor, 1, glm::value_ptr(color));
+
+        glm::mat4 modelMatrix = glm::translate(glm::mat4(1), point_light_pos[i]) * glm::scale(glm::mat4(1), glm::vec3(range));
+        RenderLightVolume(shader, meshes["light_sphere"], modelMatrix);
+    }
+
+    // The spots light their whole cone without attenuation (ambient and emissive
+    // terms), their volumes reach past the far side of the terrain
+    BoundingSphere terrain = GetTerrainBounds();
+    for (int k = 0; k < 2; k++)
+    {
+        const glm::vec3& position = point_light_pos[4 + k];
+        glm::vec3 direction = glm::normalize(-point_light_dir[4 + k]);
+        glm::vec3 up = fabs(direction.y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+        glm::vec3 side = glm::normalize(glm::cross(up, direction));
+        up = glm::cross(direction, side);
+
+        float length = glm::length(terrain.center - position) + terrain.radius;
+        float radius = length * tan(angleCutOff);
+        glm::mat4 modelMatrix(glm::vec4(side * radius, 0), glm::vec4(up * radius, 0),
+                              glm::vec4(direction * length, 0), glm::vec4(position, 1));
+
+        shader->Use();
+        glUniform1i(lightType, 1);
+        glUniform3fv(lightPosition, 1, glm::value_ptr(point_light_pos[4 + k]));
+        glUniform3fv(lightDirection, 1, glm::value_ptr(point_light_dir[4 + k]));
+        glUniform3fv(lightColor, 1, glm::value_ptr(point_light_color[4 + k]));
+        glUniform1i(shadowPage, k);
+        RenderLightVolume(shader, meshes["light_cone"], modelMatrix);
+    }
+
+    glDisable(GL_STENCIL_TEST);
+    glDisable(GL_DEPTH_CLAMP);
+    glDisable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_DEPTH_TEST);
+}
+
+
+/// <summary>
+/// Shade the pixels of the scene inside a light volume
+/// The first draw counts in the stencil the volume faces hidden by the scene,
+/// back faces up and front faces down, which leaves a non zero value exactly
+/// where the scene surface is inside the volume, also with the camera inside it.
+/// The second draw shades those pixels once and clears their stencil.
+/// </summary>
+/// <param name="shader">Lighting shader, with the uniforms of the light set</param>
+/// <param name="mesh">Closed volume of the light</param>
+/// <param name="modelMatrix">Placement of the volume</param>
+void LightHouse::RenderLightVolume(Shader* shader, Mesh* mesh, const glm::mat4& modelMatrix)
+{
+    Shader* stencil = shaders["LightStencil"];
+    if (!mesh || !stencil || !stencil->GetProgramID()) return;
+
+    stencil->Use();
+    SetupMatrices(stencil, modelMatrix, false);
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_BLEND);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glStencilFunc(GL_ALWAYS, 0, 0xFF);
+    glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+    glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+    mesh->RenderGeometry(0);
+
+    shader->Use();
+    SetupMatrices(shader, modelMatrix, false);
+
+    // Back faces only, they stay on screen when the camera is inside the volume
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_FRONT);
+    glEnable(GL_BLEND);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+    glStencilOp(GL_ZERO, GL_ZERO, GL_ZERO);
+    mesh->RenderGeometry(0);
+}
+
+
+/// <summary>
+/// Combine the G-buffer albedo with the accumulated light
+/// The depth of the scene is kept, the forward objects drawn next are tested against it.
+/// </summary>
+/// <param name="gbuffer">G-buffer targets</param>
+/// <param name="lightAccum">Light accumulation target</param>
+void LightHouse::ResolveDeferred(const GBufferTargets& gbuffer, RenderTargetHandle lightAccum)
+{
+    Shader* shader = shaders["DeferredResolve"];
+    if (!shader || !shader->GetProgramID()) return;
+
+    shader->Use();
+    renderGraph.GetTexture(gbuffer.albedo)->BindToTextureUnit(GL_TEXTURE0);
+    glUniform1i(glGetUniformLocation(shader->program, "g_albedo"), 0);
+    renderGraph.GetTexture(lightAccum)->BindToTextureUnit(GL_TEXTURE1);
+    glUniform1i(glGetUniformLocation(shader->program, "light_accumulation"), 1);
+
+    glDisable(GL_DEPTH_TEST);
+    RenderFullscreen(shader);
+    glEnable(GL_DEPTH_TEST);
+}
+
+
+/// <summary>
+/// Copy a color target to the screen
+/// Targets smaller than the window are upscaled with an edge aware filter.
+/// The depth target is written too, so what is drawn on the screen
+/// afterwards is still hidden by the scene.
+/// </summary>
+/// <param name="color">Target copied to the screen</param>
+/// <param name="depth">Depth of the color target</param>
+void LightHouse::RenderPresent(RenderTargetHandle color, RenderTargetHandle depth)
+{
+    const glm::ivec2 sourceSize = renderGraph.GetSize(color);
+    const bool upscale = sourceSize != renderGraph.GetResolution();
+
+    Shader* shader = upscale ? shaders["Upscale"] : shaders["Present"];
+    Texture2D* colorTexture = renderGraph.GetTexture(color);
+    Texture2D* depthTexture = renderGraph.GetTexture(depth);
+    if (!shader || !shader->GetProgramID() || !colorTexture || !depthTexture) return;
+
+    shader->Use();
+
+    if (upscale)
+    {
+        // Sharpen more as the scale drops and more detail is lost
+        float sharpness = glm::clamp(2.0f * (1.0f - dynamicResolution.GetScale()), 0.0f, 1.0f);
+        glUniform2f(glGetUniformLocation(shader->program, "source_size"), static_cast<float>(sourceSize.x), static_cast<float>(sourceSize.y));
+        glUniform1f(glGetUniformLocation(shader->program, "sharpness"), sharpness);
+    }
+
+    colorTexture->BindToTextureUnit(GL_TEXTURE0);
+    glUniform1i(glGetUniformLocation(shader->program, "scene_color"), 0);
+    depthTexture->BindToTextureUnit(GL_TEXTURE1);
+    glUniform1i(glGetUniformLocation(shader->program, "scene_depth"), 1);
+
+    // The copy replaces the cleared depth everywhere, including the background
+    glDepthFunc(GL_ALWAYS);
+    RenderFullscreen(shader);
+    glDepthFunc(GL_LESS);
+}
+
+
+/// <summary>
+/// Apply the color grade of the sliders to a color target
+/// Each pixel is one lookup in the table of the grade.
+/// </summary>
+/// <param name="color">Target to grade</param>
+void LightHouse::RenderColorGrade(RenderTargetHandle color)
+{
+    Shader* shader = shaders["ColorGrade"];
+    Texture2D* colorTexture = renderGraph.GetTexture(color);
+    if (!shader || !shader->GetProgramID() || !colorTexture) return;
+
+    shader->Use();
+    colorTexture->BindToTextureUnit(GL_TEXTURE0);
+    glUniform1i(glGetUniformLocation(shader->program, "scene_color"), 0);
+    colorGrading.BindToTextureUnit(GL_TEXTURE1);
+    glUniform1i(glGetUniformLocation(shader->program, "color_lut"), 1);
+    glUniform1f(glGetUniformLocation(shader->program, "lut_size"), static_cast<float>(colorGrading.GetSize()));
+
+    glDisable(GL_DEPTH_TEST);
+    RenderFullscreen(shader);
+    glEnable(GL_DEPTH_TEST);
+}
+
+
+/// <summary>
+/// Set the color grade from the HSV sliders
+/// The saturation of the slider color is the strength of the grade, so a
+/// gray slider color leaves the scene untouched. Hues turn toward the slider
+/// hue, and the slider value darkens or brightens the scene.
+/// </summary>
+void LightHouse::UpdateColorGrade()
+{
+    const auto& sliders = sliderManager->getSliders();
+    const float hue = sliders[3].value;
+    const float strength = sliders[4].value;
+    const float value = sliders[5].value;
+
+    ColorGrade grade;
+    grade.hue = hue;
+    grade.hueShift = 0.5f * strength;
+    grade.saturation = 1.0f + 0.5f * strength;
+    grade.value = lerp(1.0f, 0.5f + value, strength);
+
+    // Only computes the table again when the grade actually changed
+    colorGrading.SetGrade(grade);
+}
+
+
+/// <summary>
+/// Draw one triangle covering the screen with the given shader
+/// </summary>
+/// <param name="shader">Shader to use</param>
+void LightHouse::RenderFullscreen(Shader* shader)
+{
+    if (!shader || !shader->GetProgramID()) return;
+
+    shader->Use();
+    glBindVertexArray(screenVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    render_stats::AddDraw(GL_TRIANGLES, 3);
+    glBindVertexArray(0);
+}
+
+
+/// <summary>
+/// Compute the shadow matrices of the lights
+/// The atlas only applies them when it redraws the page of the light.
+/// </summary>
+void LightHouse::UpdateShadowLights()
+{
+    // The spots shine away from the tower, see SpotLight in the scene shader
+    glm::mat4 spotProjection = glm::perspective(2.0f * angleCutOff, 1.0f, 0.1f, 50.0f);
+    for (int k = 0; k < 2; k++)
+    {
+        glm::vec3 position = point_light_pos[4 + k];
+        glm::vec3 direction = -point_light_dir[4 + k];
+        glm::mat4 view = glm::lookAt(position, position + direction, glm::vec3(0, 1, 0));
+        shadowAtlas.SetLightMatrix(spotShadows[k], spotProjection * view);
+    }
+
+    // The moon covers the terrain
+    BoundingSphere terrain = GetTerrainBounds();
+    float radius = terrain.radius;
+
+    glm::vec3 direction = glm::normalize(point_light_dir[6]);
+    glm::vec3 up = fabs(direction.y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+    glm::mat4 view = glm::lookAt(terrain.center - direction * (2.0f * radius), terrain.center, up);
+    glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, radius, 3.0f * radius);
+    shadowAtlas.SetLightMatrix(moonShadow, projection * view);
+}
+
+
+/// <summary>
+/// Bounds of the displaced terrain
+/// The lake shader doubles the grid and raises it by up to 5 units.
+/// </summary>
+/// <returns>Sphere around the terrain in world space</returns>
+BoundingSphere LightHouse::GetTerrainBounds()
+{
+    BoundingSphere lake = bounds_utils::Transform(meshes["lake"]->GetBoundingSphere(), sceneTransforms.GetWorldMatrix(lakeNode));
+    lake.radius = MAX(lake.radius * 2.0f + 5.0f, 1.0f);
+    return lake;
+}
+
+
+/// <summary>
+/// Redraw the shadow atlas pages due this frame
+/// </summary>
+void LightHouse::RenderShadows()
+{
+    shadowAtlas.Update(
+        [this](unsigned int light, const glm::mat4& viewProjection) {
+            RenderShadowCasters(light, viewProjection, false);
+        },
+        [this](unsigned int light, const glm::mat4& viewProjection) {
+            RenderShadowCasters(light, viewProjection, true);
+        });
+}
+
+
+/// <summary>
+/// Draw the shadow casters of a light into the bound atlas page
+/// Static casters are the lighthouse, the bamboos and the terrain, the boats are the moving ones.
+/// </summary>
+/// <param name="light">Atlas light the page belongs to</param>
+/// <param name="viewProjection">Light matrix of the page</param>
+/// <param name="moving">Whether to draw the moving casters instead of the static ones</param>
+void LightHouse::RenderShadowCasters(unsigned int light, const glm::mat4& viewProjection, bool moving)
+{
+    Shader* shader = shaders["Shadow"];
+
+    if (moving)
+    {
+        for (int i = 0; i < 4; i++) {
+            RenderShadowCaster(shader, meshes["wake_boat"], boatNodes[i], viewProjection);
+        }
+        return;
+    }
+
+    // The spots sit inside the lighthouse, it would hide everything from them
+    if (static_cast<int>(light) == moonShadow)
+    {
+        RenderShadowCaster(shader, meshes["sphere"], lighthouseBaseNode, viewProjection);
+        RenderShadowCaster(shader, meshes["lighthouse"], lighthouseMiddleNode, viewProjection);
+        RenderShadowCaster(shader, meshes["lighthouse"], lighthouseLowerLayerNode, viewProjection);
+        RenderShadowCaster(shader, meshes["lighthouse"], lighthouseUpperLayerNode, viewProjection);
+        RenderShadowCaster(shader, meshes["lighthouse"], lighthouseTopNode, viewProjection);
+    }
+
+    for (TransformHandle node : bambooNodes) {
+        RenderShadowCaster(shader, meshes["bamboo"], node, viewProjection, textures["bamboo"]);
+    }
+
+    // The terrain is displaced by its height map in the vertex shader
+    Shader* terrainShader = shaders["ShadowTerrain"];
+    if (terrainShader && terrainShader->GetProgramID())
+    {
+        terrainShader->Use();
+        textures["groundHMap"]->BindToTextureUnit(GL_TEXTURE0);
+        glUniform1i(glGetUniformLocation(terrainShader->program, "heightMap"), 0);
+        RenderShadowCaster(terrainShader, meshes["lake"], lakeNode, viewProjection);
+    }
+}
+
+
+/// <summary>
+/// Draw the depth of one object for a shadow map
+/// </summary>
+/// <param name="shader">Depth only shader</param>
+/// <param name="mesh">Mesh of the object</param>
+/// <param name="node">Transform node of the object</param>
+/// <param name="viewProjection">Light matrix</param>
+/// <param name="texture">Texture whose alpha cuts out the object, if any</param>
+void LightHouse::RenderShadowCaster(Shader* shader, Mesh* mesh, TransformHandle node, const glm::mat4& viewProjection, Texture2D* texture)
+{
+    if (!mesh || !shader || !shader->GetProgramID()) return;
+
+    shader->Use();
+    glUniformMatrix4fv(glGetUniformLocation(shader->program, "Model"), 1, GL_FALSE, glm::value_ptr(sceneTransforms.GetWorldMatrix(node)));
+    glUniformMatrix4fv(glGetUniformLocation(shader->program, "LightViewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+
+    if (texture)
+    {
+        texture->BindToTextureUnit(GL_TEXTURE0);
+        glUniform1i(glGetUniformLocation(shader->program, "textures[0]"), 0);
+    }
+    glUniform1i(glGetUniformLocation(shader->program, "numTextures"), texture ? 1 : 0);
+
+    mesh->RenderGeometry(0);
+}
+
+
+/// <summary>
+/// Set up the shadow atlas for rendering
+/// Bind the atlas and the page of every shadowed light.
+/// </summary>
+/// <param name="shader">Shader to use</param>
+void LightHouse::SetupShadows(Shader* shader)
+{
+    const int pages[3] = { spotShadows[0], spotShadows[1], moonShadow };
+
+    Texture2D* atlas = shadowAtlas.GetTexture();
+    bool ready = atlas != nullptr;
+    for (int page : pages) {
+        ready = ready && page >= 0 && shadowAtlas.IsReady(page);
+    }
+
+    glUniform1i(glGetUniformLocation(shader->program, "shadows_enabled"), ready ? 1 : 0);
+    if (!ready) return;
+
+    glm::mat4 matrices[3];
+    glm::vec4 rects[3];
+    for (int k = 0; k < 3; k++)
+    {
+        matrices[k] = shadowAtlas.GetLightMatrix(pages[k]);
+        rects[k] = shadowAtlas.GetPageRect(pages[k]);
+    }
+
+    atlas->BindToTextureUnit(GL_TEXTURE0 + SHADOW_TEXTURE_UNIT);
+    glUniform1i(glGetUniformLocation(shader->program, "shadow_atlas"), SHADOW_TEXTURE_UNIT);
+    glUniformMatrix4fv(glGetUniformLocation(shader->program, "shadow_matrices"), 3, GL_FALSE, glm::value_ptr(matrices[0]));
+    glUniform4fv(glGetUniformLocation(shader->program, "shadow_pages"), 3, glm::value_ptr(rects[0]));
+    glUniform1f(glGetUniformLocation(shader->program, "shadow_texel"), 1.0f / shadowAtlas.GetSize());
+}
+
+
+/// <summary>
+/// Queue a textured object for rendering
+/// Same parameters as RenderTextured, but placed by a scene transform node.
+/// The draw is submitted by RenderDrawQueue if visible.
+/// </summary>
+void LightHouse::QueueTextured(
+    Mesh* mesh,
+    Shader* shader,
+    TransformHandle node,
+    std::vector<Texture2D*> textures,
+    std::vector<float> mixFactors,
+    const glm::vec3& color)
+{
+    if (!mesh || !shader) return;
+
+    DrawCommand command;
+    command.mesh = mesh;
+    command.shader = shader;
+    command.node = node;
+    command.lod = 0;
+    command.textures = std::move(textures);
+    command.textureArray = nullptr;
+    command.mixFactors = std::move(mixFactors);
+    command.color = color;
+    drawQueue.push_back(std::move(command));
+}
+
+
+/// <summary>
+/// Queue an object textured from the layers of a material array
+/// The objects of the same array share its binding, nothing is bound between them.
+/// </summary>
+/// <param name="mesh">Mesh of the object</param>
+/// <param name="shader">Shader to use, reading the material_layers sampler</param>
+/// <param name="node">Scene transform node of the object</param>
+/// <param name="textureArray">Material array of the object</param>
+/// <param name="layers">Layers mixed as the textures of the object, at most 8</param>
+/// <param name="mixFactors">Factors for mixing the layers</param>
+void LightHouse::QueueLayered(
+    Mesh* mesh,
+    Shader* shader,
+    TransformHandle node,
+    Texture2DArray* textureArray,
+    std::vector<int> layers,
+    std::vector<float> mixFactors)
+{
+    if (!mesh || !shader || !textureArray) return;
+
+    DrawCommand command;
+    command.mesh = mesh;
+    command.shader = shader;
+    command.node = node;
+    command.lod = 0;
+    command.textureArray = textureArray;
+    command.textureLayers = std::move(layers);
+    command.mixFactors = std::move(mixFactors);
+    command.color = glm::vec3(0);
+    drawQueue.push_back(std::move(command));
+}
+
+
+/// <summary>
+/// Cull the queued objects and select their level of detail
+/// The bounding volumes are transformed per instance and tested against the camera frustum and,
+/// in a job, against the software occlusion buffer.
+/// </summary>
+void LightHouse::CullDrawQueue()
+{
+    gfxc::Camera* camera = GetSceneCamera();
+    glm::mat4 viewProjection = camera->GetProjectionMatrix() * camera->GetViewMatrix();
+    frustumCuller.SetViewProjection(viewProjection);
+    frustumCuller.ResetStats();
+    lodSelector.SetView(camera->m_transform->GetWorldPosition(), camera->GetProjectionMatrix(),
+        static_cast<float>(windowHeight) * dynamicResolution.GetScale());
+    nodeLods.resize(sceneTransforms.Size(), 0);
+
+    drawBounds.Clear();
+    drawBoxes.clear();
+    for (auto& command : drawQueue)
+    {
+        const glm::mat4& modelMatrix = sceneTransforms.GetWorldMatrix(command.node);
+        drawBounds.Add(bounds_utils::Transform(command.mesh->GetBoundingSphere(), modelMatrix));
+        drawBoxes.push_back(bounds_utils::Transform(command.mesh->GetBoundingBox(), modelMatrix));
+
+        command.lod = lodSelector.Select(command.mesh, modelMatrix, nodeLods[command.node]);
+        nodeLods[command.node] = static_cast<unsigned char>(command.lod);
+    }
+
+    std::vector<OccluderInstance> occluders =
+    {
+        OccluderInstance(lighthouseOccluder, sceneTransforms.GetWorldMatrix(lighthouseMiddleNode)),
+        OccluderInstance(lighthouseBaseOccluder, sceneTransforms.GetWorldMatrix(lighthouseBaseNode))
+    };
+
+    // The occlusion test runs as a job while the frustum test runs here
+    occlusionCuller.Submit(viewProjection, occluders, drawBoxes);
+    frustumCuller.Cull(drawBounds, drawVisibility);
+    occlusionCuller.Wait(occlusionVisibility);
+
+    BuildGpuScene(viewProjection);
+
+    trianglesDrawn = 0;
+}
+
+
+/// <summary>
+/// Hand the queued objects with an indirect shader to the GPU scene and cull them there
+/// The objects sharing a mesh, level of detail and pipeline state form one batch, drawn by a single
+/// indirect call whatever its number of instances. The culling shader tests them against the frustum
+/// and against the depth pyramid of the last frame.
+/// </summary>
+/// <param name="viewProjection">Camera of the frame</param>
+void LightHouse::BuildGpuScene(const glm::mat4& viewProjection)
+{
+    gpuScene.Clear();
+    indirectBatches.clear();
+    drawIndirect.assign(drawQueue.size(), 0);
+    if (!gpuDriven)
+    {
+        // A pyramid left from before would be from another camera when turned back on
+        hizPyramid.Release();
+        return;
+    }
+
+    for (size_t i = 0; i < drawQueue.size(); ++i)
+    {
+        const DrawCommand& command = drawQueue[i];
+        if (indirectShaders.find(command.shader) == indirectShaders.end()) continue;
+
+        auto batch = indirectBatches.insert(std::make_pair(&command, 0u));
+        if (batch.second)
+        {
+            batch.first->second = gpuScene.AddBatch(command.mesh, command.lod);
+            PrepareDrawTextures(command.textures);
+        }
+
+        const BoundingSphere bounds(glm::vec3(drawBounds.centerX[i], drawBounds.centerY[i], drawBounds.centerZ[i]), drawBounds.radius[i]);
+        gpuScene.AddInstance(batch.first->second, sceneTransforms.GetWorldMatrix(command.node), bounds);
+        drawIndirect[i] = 1;
+    }
+
+    gpuScene.Cull(shaders["GpuCull"], viewProjection, &hizPyramid);
+}
+
+
+/// <summary>
+/// Build the depth pyramid the next frame culls the GPU scene with
+/// Called at the end of the pass writing the depth of the opaque objects.
+/// </summary>
+/// <param name="depth">Depth target of the pass</param>
+void LightHouse::BuildHiZ(RenderTargetHandle depth)
+{
+    if (!gpuDriven) return;
+
+    gfxc::Camera* camera = GetSceneCamera();
+    hizPyramid.Build(shaders["HiZ"], renderGraph.GetTexture(depth)->GetTextureID(), renderGraph.GetSize(depth),
+        camera->GetProjectionMatrix() * camera->GetViewMatrix());
+}
+
+
+/// <summary>
+/// Add the particle emitters of the scene
+/// Each boat throws spray up from the water and the lamp of the lighthouse is wrapped in a slow mist.
+/// At their rates the spray and the mist keep close to a million particles alive.
+/// </summary>
+void LightHouse::CreateParticleEmitters()
+{
+    ParticleEmitter spray;
+    spray.radius = 0.15f;
+    spray.velocity = glm::vec3(0, 1.2f, 0);
+    spray.spread = 0.6f;
+    spray.color = glm::vec4(0.85f, 0.9f, 1.0f, 0.25f);
+    spray.rate = 60000.0f;
+    spray.lifetime = 1.6f;
+    spray.size = 0.02f;
+    spray.gravity = 3.0f;
+    spray.drag = 0.5f;
+    for (int i = 0; i < 4; i++) {
+        sprayEmitters[i] = particles.AddEmitter(spray);
+    }
+
+    ParticleEmitter mist;
+    mist.radius = 1.5f;
+    mist.velocity = glm::vec3(0.15f, 0.05f, 0.05f);
+    mist.spread = 0.3f;
+    mist.color = glm::vec4(0.7f, 0.75f, 0.8f, 0.05f);
+    mist.rate = 80000.0f;
+    mist.lifetime = 7.0f;
+    mist.size = 0.08f;
+    mist.gravity = -0.02f;
+    mist.drag = 0.05f;
+    mistEmitter = particles.AddEmitter(mist);
+}
+
+
+/// <summary>
+/// Move the emitters to their objects and advance the particles
+/// Only the emitters are uploaded, the particles stay on the GPU.
+/// </summary>
+/// <param name="deltaTime">Time since the last frame</param>
+void LightHouse::SimulateParticles(float deltaTime)
+{
+    if (!particlesEnabled) return;
+
+    for (int i = 0; i < 4; i++) {
+        particles.GetEmitter(sprayEmitters[i]).position = sceneTransforms.GetWorldPosition(boatNodes[i]);
+    }
+    particles.GetEmitter(mistEmitter).position = sceneTransforms.GetWorldPosition(lighthouseTopNode);
+
+    particles.Simulate(shaders["ParticleArgs"], shaders["ParticleSimulate"], shaders["ParticleEmit"], deltaTime);
+}
+
+
+/// <summary>
+/// Draw the particles over the scene
+/// Added to the color without writing depth, so they need no sorting. Called at the end of the pass
+/// drawing the scene color, after the opaque objects.
+/// </summary>
+void LightHouse::RenderParticles()
+{
+    Shader* shader = shaders["Particle"];
+    if (!particlesEnabled || !shader || !shader->GetProgramID()) return;
+
+    gfxc::Camera* camera = GetSceneCamera();
+    shader->Use();
+    glUniformMatrix4fv(shader->GetUniformSlot("View"), 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
+    glUniformMatrix4fv(shader->GetUniformSlot("Projection"), 1, GL_FALSE, glm::value_ptr(camera->GetProjectionMatrix()));
+    glUniform1f(shader->GetUniformSlot("viewport_height"), windowHeight * dynamicResolution.GetScale());
+
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glDepthMask(GL_FALSE);
+
+    particles.Draw();
+
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+    glDisable(GL_PROGRAM_POINT_SIZE);
+}
+
+
+bool LightHouse::IndirectStateLess::operator()(const DrawCommand* a, const DrawCommand* b) const
+{
+    return std::tie(a->mesh, a->shader, a->lod, a->textures, a->textureArray, a->textureLayers, a->mixFactors, a->color.x, a->color.y, a->color.z)
+         < std::tie(b->mesh, b->shader, b->lod, b->textures, b->textureArray, b->textureLayers, b->mixFactors, b->color.x, b->color.y, b->color.z);
+}
+
+
+/// <summary>
+/// Render the queued objects left by CullDrawQueue
+/// The G-buffer pass draws the objects whose shader has a G-buffer version, with that version,
+/// and the forward pass of the deferred path draws the others.
+/// The GL work a draw needs is picked here; the commands are then recorded by the job threads
+/// and executed in queue order. The batches of the GPU scene come last, one indirect draw each.
+/// </summary>
+/// <param name="filter">Which objects to draw</param>
+void LightHouse::RenderDrawQueue(DrawFilter filter)
+{
+    drawList.clear();
+    for (size_t i = 0; i < drawQueue.size(); ++i)
+    {
+        if (drawIndirect[i] || !drawVisibility[i] || !occlusionVisibility[i]) continue;
+
+        const DrawCommand& command = drawQueue[i];
+        Shader* shader = GetPassShader(command.shader, filter);
+        if (!shader || !shader->GetProgramID()) continue;
+
+        PrepareDrawTextures(command.textures);
+        drawList.push_back({ &command, GetDrawSlots(shader), -1 });
+        trianglesDrawn += command.mesh->GetLodIndexCount(command.lod) / 3;
+    }
+
+    // Culled on the GPU, the instances drawn are never known here
+    for (const auto& batch : indirectBatches)
+    {
+        Shader* shader = GetPassShader(batch.first->shader, filter);
+        if (!shader) continue;
+
+        Shader* indirectShader = indirectShaders[shader];
+        drawList.push_back({ batch.first, GetDrawSlots(indirectShader), static_cast<int>(batch.second) });
+    }
+
+    gfxc::Camera* camera = GetSceneCamera();
+    DrawFrame frame;
+    frame.view = camera->GetViewMatrix();
+    frame.projection = camera->GetProjectionMatrix();
+    frame.eyePosition = camera->m_transform->GetWorldPosition();
+    frame.time = static_cast<float>(Engine::GetElapsedTime());
+
+    const int pages[3] = { spotShadows[0], spotShadows[1], moonShadow };
+    Texture2D* atlas = shadowAtlas.GetTexture();
+    frame.shadowsReady = atlas != nullptr;
+    for (int page : pages) {
+        frame.shadowsReady = frame.shadowsReady && page >= 0 && shadowAtlas.IsReady(page);
+    }
+    if (frame.shadowsReady)
+    {
+        frame.shadowAtlas = atlas->GetTextureID();
+        for (int k = 0; k < 3; k++)
+        {
+            frame.shadowMatrices[k] = shadowAtlas.GetLightMatrix(pages[k]);
+            frame.shadowPages[k] = shadowAtlas.GetPageRect(pages[k]);
+        }
+        frame.shadowTexel = 1.0f / shadowAtlas.GetSize();
+    }
+
+    drawCommands.Reset();
+    drawCommands.Record(drawList.size(), [this, &frame](CommandBuffer& commands, size_t begin, size_t end)
+    {
+        GLuint program = 0;
+        for (size_t i = begin; i < end; ++i) {
+            RecordDraw(commands, frame, drawList[i], program);
+        }
+    }, DRAW_RECORD_GRAIN);
+    drawUniforms.Flush();
+    drawCommands.Execute();
+}
+
+
+/// <summary>
+/// Get the shader drawing a queued object in a scene pass
+/// </summary>
+/// <param name="shader">Shader the object was queued with</param>
+/// <param name="filter">Objects drawn by the pass</param>
+/// <returns>The shader or its G-buffer version, null when the pass doesn't draw the object</returns>
+Shader* LightHouse::GetPassShader(Shader* shader, DrawFilter filter) const
+{
+    if (filter == DrawFilter::All) return shader;
+
+    auto gbufferShader = gbufferShaders.find(shader);
+    bool deferred = gbufferShader != gbufferShaders.end() && gbufferShader->second;
+    if (deferred != (filter == DrawFilter::GBuffer)) return nullptr;
+
+    return deferred ? gbufferShader->second : shader;
+}
+
+
+/// <summary>
+/// Get the uniform slots of a shader drawing queued objects
+/// Looked up again after the shader is reloaded.
+/// </summary>
+/// <param name="shader">Shader to use</param>
+/// <returns>Slots of the linked program, stable while the shader lives</returns>
+const LightHouse::DrawSlots* LightHouse::GetDrawSlots(Shader* shader)
+{
+    DrawSlots& slots = drawSlots[shader];
+    if (slots.program == shader->GetProgramID()) return &slots;
+
+    slots.program = shader->GetProgramID();
+    slots.view = shader->GetUniformSlot("View");
+    slots.projection = shader->GetUniformSlot("Projection");
+    slots.eyePosition = shader->GetUniformSlot("eye_position");
+    slots.time = shader->GetUniformSlot("time");
+
+    slots.lightPosition = shader->GetUniformSlot("light_position");
+    slots.lightDirection = shader->GetUniformSlot("light_direction");
+    slots.lightColor = shader->GetUniformSlot("light_color");
+
+    slots.materialShininess = shader->GetUniformSlot("material_shininess");
+    slots.materialKe = shader->GetUniformSlot("material_ke");
+    slots.materialKa = shader->GetUniformSlot("material_ka");
+    slots.materialKd = shader->GetUniformSlot("material_kd");
+    slots.materialKs = shader->GetUniformSlot("material_ks");
+    slots.angle = shader->GetUniformSlot("angle");
+
+    for (int i = 0; i < MAX_2D_TEXTURES; ++i) {
+        slots.textures[i] = shader->GetUniformSlot("textures[" + std::to_string(i) + "]");
+    }
+    slots.materialLayers = shader->GetUniformSlot("material_layers");
+
+    slots.shadowsEnabled = shader->GetUniformSlot("shadows_enabled");
+    slots.shadowAtlas = shader->GetUniformSlot("shadow_atlas");
+    slots.shadowMatrices = shader->GetUniformSlot("shadow_matrices");
+    slots.shadowPages = shader->GetUniformSlot("shadow_pages");
+    slots.shadowTexel = shader->GetUniformSlot("shadow_texel");
+
+    // GLSL 330 can't set the binding in the shader
+    GLuint perDrawBlock = glGetUniformBlockIndex(slots.program, "PerDraw");
+    slots.perDraw = perDrawBlock != GL_INVALID_INDEX;
+    if (slots.perDraw) {
+        glUniformBlockBinding(slots.program, perDrawBlock, PER_DRAW_BINDING);
+    }
+
+    return &slots;
+}
+
+
+/// <summary>
+/// Generate the mipmaps of the textures of a queued object
+/// Done the first time a texture is drawn, the recording jobs can't make GL calls.
+/// </summary>
+/// <param name="textures">Textures of the object</param>
+void LightHouse::PrepareDrawTextures(const std::vector<Texture2D*>& textures)
+{
+    for (Texture2D* texture : textures)
+    {
+        if (!texture || !mipmappedTextures.insert(texture).second) continue;
+
+        glBindTexture(GL_TEXTURE_2D, texture->GetTextureID());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+/// <summary>
+/// Record the commands of a queued object
+/// Same uniforms as RenderTextured. Uniforms stay with their program, so the values shared by
+/// the pass are only recorded when the program changes; the values of the object go to its
+/// PerDraw block in the ring and only the range of the block is bound. A batch of the GPU scene
+/// takes its model matrices from the instances, its block only holds the shared values.
+/// Called from the job threads, it only reads the scene and allocates from the lock free ring.
+/// </summary>
+/// <param name="commands">Buffer of the calling thread</param>
+/// <param name="frame">Values shared by the pass</param>
+/// <param name="draw">Object to draw</param>
+/// <param name="program">Program bound by the previous commands of the buffer, updated</param>
+void LightHouse::RecordDraw(CommandBuffer& commands, const DrawFrame& frame, const QueuedDraw& draw, GLuint& program)
+{
+    const DrawCommand& command = *draw.command;
+    const DrawSlots& slots = *draw.slots;
+
+    UniformAllocation block = {};
+    if (slots.perDraw)
+    {
+        const glm::mat4 modelMatrix = draw.indirectBatch < 0 ? sceneTransforms.GetWorldMatrix(command.node) : glm::mat4(1);
+        block = WritePerDraw(modelMatrix, command.color, command.textures, command.textureLayers, command.mixFactors);
+        // The ring is full for this frame, drawing with the block of another object would be worse
+        if (!block.data) return;
+    }
+
+    if (slots.program != program)
+    {
+        program = slots.program;
+        commands.UseProgram(program);
+
+        commands.SetUniform(slots.view, &frame.view);
+        commands.SetUniform(slots.projection, &frame.projection);
+        commands.SetUniform(slots.eyePosition, &frame.eyePosition);
+        commands.SetUniform(slots.time, frame.time);
+
+        commands.SetUniform(slots.lightPosition, point_light_pos, 15);
+        commands.SetUniform(slots.lightDirection, point_light_dir, 15);
+        commands.SetUniform(slots.lightColor, point_light_color, 15);
+
+        commands.SetUniform(slots.materialShininess, materialShininess);
+        commands.SetUniform(slots.materialKe, &materialKe);
+        commands.SetUniform(slots.materialKa, materialKa);
+        commands.SetUniform(slots.materialKd, materialKd);
+        commands.SetUniform(slots.materialKs, materialKs);
+        commands.SetUniform(slots.angle, angleCutOff);
+
+        // Texture i of an object is always bound to unit i
+        for (int i = 0; i < MAX_2D_TEXTURES; ++i) {
+            commands.SetUniform(slots.textures[i], i);
+        }
+        // Set even without an array, the sampler left on unit 0 would clash with textures[0]
+        commands.SetUniform(slots.materialLayers, MATERIAL_TEXTURE_UNIT);
+
+        commands.SetUniform(slots.shadowsEnabled, frame.shadowsReady ? 1 : 0);
+        if (frame.shadowsReady)
+        {
+            commands.BindTexture(SHADOW_TEXTURE_UNIT, GL_TEXTURE_2D, frame.shadowAtlas);
+            commands.SetUniform(slots.shadowAtlas, SHADOW_TEXTURE_UNIT);
+            commands.SetUniform(slots.shadowMatrices, frame.shadowMatrices, 3);
+            commands.SetUniform(slots.shadowPages, frame.shadowPages, 3);
+            commands.SetUniform(slots.shadowTexel, frame.shadowTexel);
+        }
+    }
+
+    if (block.data)
+    {
+        commands.BindUniformBlock(PER_DRAW_BINDING, drawUniforms.GetBuffer(),
+            static_cast<unsigned int>(block.offset), static_cast<unsigned int>(block.size));
+    }
+
+    for (size_t i = 0; i < command.textures.size() && i < MAX_2D_TEXTURES; ++i)
+    {
+        if (command.textures[i]) {
+            commands.BindTexture(static_cast<unsigned int>(i), GL_TEXTURE_2D, command.textures[i]->GetTextureID());
+        }
+    }
+
+    // Skipped by the executor when the previous object used the same array
+    if (command.textureArray) {
+        commands.BindTexture(MATERIAL_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, command.textureArray->GetTextureID());
+    }
+
+    if (draw.indirectBatch < 0) {
+        command.mesh->RecordGeometry(commands, command.lod);
+    } else {
+        gpuScene.RecordBatch(commands, static_cast<unsigned int>(draw.indirectBatch));
+    }
+}
+
+
+/// <summary>
+/// Write the PerDraw block of an object to the ring
+/// Same mix normalization as SetupTextures. An object textured from a material array mixes its
+/// layers instead of its textures. Safe to call from the job threads.
+/// </summary>
+/// <param name="modelMatrix">Model matrix of the object</param>
+/// <param name="color">Color of the object, used without textures</param>
+/// <param name="textures">Textures of the object</param>
+/// <param name="layers">Layers of the object in its material array, empty without one</param>
+/// <param name="mixFactors">Factors for mixing the textures</param>
+/// <returns>Block in the ring, without data when the region of the frame is full</returns>
+UniformAllocation LightHouse::WritePerDraw(
+    const glm::mat4& modelMatrix,
+    const glm::vec3& color,
+    const std::vector<Texture2D*>& textures,
+    const std::vector<int>& layers,
+    const std::vector<float>& mixFactors)
+{
+    UniformAllocation allocation = drawUniforms.Allocate(sizeof(PerDrawBlock));
+    if (!allocation.data) return allocation;
+
+    // Filled on the stack, the mapped memory may be write combined and is best written in one go
+    PerDrawBlock block;
+    block.model = modelMatrix;
+    block.objectColor = color;
+    block.numTextures = 0;
+
+    const size_t nrLayers = sizeof(block.textureLayers) / sizeof(block.textureLayers[0]) * 4;
+    for (size_t i = 0; i < nrLayers; ++i) {
+        block.textureLayers[i / 4][i % 4] = i < layers.size() ? layers[i] : -1;
+    }
+
+    float totalMixFactor = 0.0f;
+    const size_t nrTextures = layers.empty() ? MIN(textures.size(), static_cast<size_t>(MAX_2D_TEXTURES)) : MIN(layers.size(), nrLayers);
+    for (size_t i = 0; i < nrTextures; ++i)
+    {
+        if (layers.empty() ? !textures[i] : layers[i] < 0) continue;
+
+        block.numTextures++;
+        if (i < mixFactors.size()) {
+            totalMixFactor += mixFactors[i];
+        }
+    }
+
+    // Without factors the textures are mixed evenly, the block has no value left from another object
+    const size_t nrFactors = sizeof(block.mixFactors) / sizeof(block.mixFactors[0]);
+    const float evenFactor = block.numTextures ? 1.0f / block.numTextures : 0.0f;
+    bool normalize = !mixFactors.empty() && totalMixFactor < 1.0f && block.numTextures > 1;
+    for (size_t i = 0; i < nrFactors; ++i)
+    {
+        float factor = mixFactors.empty() ? evenFactor : i < mixFactors.size() ? mixFactors[i] : 0.0f;
+        block.mixFactors[i] = glm::vec4(normalize ? factor / totalMixFactor : factor, 0.0f, 0.0f, 0.0f);
+    }
+
+    memcpy(allocation.data, &block, sizeof(block));
+    return allocation;
+}
+
+
+/// <summary>
+/// Render a textured object
+/// General method for rendering any textured object in the scene.
+/// </summary>
+/// <param name="mesh">Mesh of the object</param>
+/// <param name="shader">Shader to use</param>
+/// <param name="modelMatrix">Model matrix for positioning</param>
+/// <param name="textures">Textures to apply</param>
+/// <param name="mixFactors">Factors for mixing textures</param>
+/// <param name="color">Color of the object</param>
+/// <param name="orthographic_perspective">Whether to use orthographic perspective</param>
+/// <param name="lod">Level of detail of the mesh to draw</param>
+void LightHouse::RenderTextured(
+    Mesh* mesh,
+    Shader* shader,
+    // Model matrix applied with (T, R, S)
+    const glm::mat4& modelMatrix,
+    // Textures of the objects,
+    // plus with an uniform mix of them applied on object
+    std::vector<Texture2D*> textures,
+    std::vector<float> mixFactors,
+    // Color of the objects, in case if they dont use textures
+    const glm::vec3& color,
+    // Ortographic sliders, in rest perspective
+    bool orthographic_perspective,
+    // Level of detail, 0 is the full mesh
+    unsigned int lod)
+{
+    if (!mesh || !shader || !shader->GetProgramID()) return;
+
+    shader->Use();
+
+    // The scene shaders read the values of the object from their PerDraw block, written before SetupTextures normalizes the factors
+    if (GetDrawSlots(shader)->perDraw)
+    {
+        UniformAllocation block = WritePerDraw(modelMatrix, color, textures, {}, mixFactors);
+        if (!block.data) return;
+
+        drawUniforms.Flush();
+        glBindBufferRange(GL_UNIFORM_BUFFER, PER_DRAW_BINDING, drawUniforms.GetBuffer(), block.offset, block.size);
+    }
+
+    SetupMatrices(shader, modelMatrix, orthographic_perspective);
+    SetupLighting(shader, color);
+    SetupTextures(shader, textures, mixFactors);
+    if (!orthographic_perspective) {
+        SetupShadows(shader);
+    }
+
+    mesh->RenderGeometry(lod);
+}
+
+
+/// <summary>
+/// Set up textures for rendering
+/// Bind textures and sets shader uniforms for texture mixing.
+/// </summary>
+/// <param name="shader">Shader to use</param>
+/// <param name="textures">Textures to apply</param>
+/// <param name="mixFactors">Factors for mixing textures</param>
+void LightHouse::SetupTextures(
+    Shader* shader,
+    const std::vector<Texture2D*>& textures,
+    std::vector<float>& mixFactors)
 {
     int texturesBound = 0;
     float totalMixFactor = 0.0f;
@@ -495,6 +2145,7 @@ void LightHouse::SetupTextures(
         {
             glActiveTexture(GL_TEXTURE0 + i);
             glBindTexture(GL_TEXTURE_2D, textures[i]->GetTextureID());
+            render_stats::AddTextureBind();
 
             glGenerateMipmap(GL_TEXTURE_2D);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -519,6 +2170,7 @@ void LightHouse::SetupTextures(
     if (!mixFactors.empty())
         glUniform1fv(glGetUniformLocation(shader->program, "mix_factors"), mixFactors.size(), mixFactors.data());
     glUniform1i(glGetUniformLocation(shader->program, "numTextures"), texturesBound);
+    glUniform1i(glGetUniformLocation(shader->program, "material_layers"), MATERIAL_TEXTURE_UNIT);
 
 }
 
@@ -550,20 +2202,6 @@ void LightHouse::SetupMatrices(
 }
 
 
-/// <summary>
-/// Set up slider properties for rendering
-/// Configure shader uniforms specific to sliders.
-/// </summary>
-/// <param name="shader">Shader to use</param>
-/// <param name="color">Color of the slider</param>
-void LightHouse::SetupSlider(Shader* shader, const glm::vec3& color)
-{
-    glUniform3fv(glGetUniformLocation(shader->GetProgramID(), "u_color"), 1, glm::value_ptr(color));
-    glUniform2f(glGetUniformLocation(shader->GetProgramID(), "u_resolution"), static_cast<float>(windowWidth), static_cast<float>(windowHeight));
-
-}
-
-
 /// <summary>
 /// Set up lighting for rendering
 /// Configure shader uniforms related to lighting properties. 
@@ -590,6 +2228,61 @@ void LightHouse::SetupLighting(Shader* shader, const glm::vec3& color)
 
 void LightHouse::OnKeyPress(int key, int mods)
 {
+    if (key == GLFW_KEY_P)
+    {
+        std::string path = PATH_JOIN(window->props.selfDir, "screenshot_" + std::to_string(std::time(nullptr)) + ".png");
+        frameCapture.RequestScreenshot(path);
+        return;
+    }
+
+    if (key == GLFW_KEY_V)
+    {
+        if (frameCapture.IsRecording())
+        {
+            frameCapture.StopRecording();
+        }
+        else
+        {
+            std::string prefix = PATH_JOIN(window->props.selfDir, "recording_" + std::to_string(std::time(nullptr)));
+            frameCapture.StartRecording(prefix);
+        }
+        return;
+    }
+
+    if (key == GLFW_KEY_F1)
+    {
+        showHud = !showHud;
+        return;
+    }
+
+    if (key == GLFW_KEY_F2)
+    {
+        deferredShading = !deferredShading;
+        return;
+    }
+
+    if (key == GLFW_KEY_F6)
+    {
+        // Needs GL 4.3, the HUD shows it as unsupported otherwise
+        if (!indirectShaders.empty())
+            gpuDriven = !gpuDriven;
+        return;
+    }
+
+    if (key == GLFW_KEY_F7)
+    {
+        // Needs GL 4.3, the HUD shows it as unsupported otherwise
+        if (particles.IsValid())
+            particlesEnabled = !particlesEnabled;
+        return;
+    }
+
+    if (key == GLFW_KEY_R)
+    {
+        dynamicResolution.SetEnabled(!dynamicResolution.IsEnabled());
+        return;
+    }
+
     if (sliderManager->updateSliderSizes(key))
     {
         sliderManager->updateSliderValues();
@@ -601,14 +2294,23 @@ void LightHouse::OnKeyPress(int key, int mods)
         }
 
         sliderManager->setColor();
-        sliderManager->printDebugInfo();
+        UpdateColorGrade();
     }
 }
 
+
+void LightHouse::OnMouseBtnPress(int mouseX, int mouseY, int button, int mods)
+{
+    if (IS_BIT_SET(button, GLFW_MOUSE_BUTTON_LEFT)) {
+        PickObject(mouseX, mouseY);
+    }
+}
+
+
 void LightHouse::OnInputUpdate(float deltaTime, int mods) {}
 void LightHouse::OnKeyRelease(int key, int mods) {}
 void LightHouse::OnMouseMove(int mouseX, int mouseY, int deltaX, int deltaY) {}
-void LightHouse::OnMouseBtnPress(int mouseX, int mouseY, int button, int mods) {}
+
 void LightHouse::OnMouseBtnRelease(int mouseX, int mouseY, int button, int mods) {}
 void LightHouse::OnMouseScroll(int mouseX, int mouseY, int offsetX, int offsetY) {}
 void LightHouse::OnWindowResize(int width, int height) {}
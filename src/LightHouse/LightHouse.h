@@ -1,14 +1,38 @@
 #pragma once
 
 #include "components/simple_scene.h"
+#include "components/text_renderer.h"
 #include "components/transform.h"
+#include "core/culling/frustum_culler.h"
+#include "core/culling/occlusion_culler.h"
+#include "core/gpu/render_graph.h"
+#include "core/gpu/gpu_timer.h"
+#include "core/gpu/dynamic_resolution.h"
+#include "core/gpu/shadow_atlas.h"
+#include "core/gpu/frame_capture.h"
+#include "core/gpu/ui_batch.h"
+#include "core/gpu/color_grading.h"
+#include "core/gpu/render_stats.h"
+#include "core/gpu/command_buffer.h"
+#include "core/gpu/gpu_scene.h"
+#include "core/gpu/gpu_particles.h"
+#include "core/gpu/hiz_pyramid.h"
+#include "core/gpu/uniform_ring.h"
+#include "core/scene/transform_system.h"
+#include "core/scene/lod_selector.h"
+#include "core/scene/fixed_step_thread.h"
+#include "core/scene/triple_buffer.h"
+#include "core/spatial/scene_bvh.h"
 
 #include "GameInit.h"
 #include "SliderManager.h"
 
+#include <chrono>
 #include <random>
+#include <map>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 
 
 class LightHouse : public gfxc::SimpleScene
@@ -23,13 +47,30 @@ private:
     void Update(float deltaTimeSeconds) override;
     void FrameEnd() override;
 
-    void SetupSlider(Shader* shader, const glm::vec3& color);
     void SetupLighting(Shader* shader, const glm::vec3& color);
     void SetupMatrices(Shader* shader, const glm::mat4& modelMatrix, bool orthographicPerspective);
     void SetupTextures(Shader* shader, const std::vector<Texture2D*>& textures, std::vector<float>& mixFactors);
 
-    void LightHouse::RenderMoon();
-    void LightHouse::RenderLakePlane();
+    /// Animated part of the scene, advanced only by the simulation thread
+    struct SimulationState {
+        SimulationState();
+        double time;            // Simulated seconds, number of steps times the step
+        float boatAngles[4];    // Angles of the boats on their circles
+    };
+
+    /// Two latest states, published together so the frame can be drawn in between
+    struct SimulationSnapshot {
+        SimulationState previous;
+        SimulationState current;
+        FixedStepThread::Clock::time_point due;     // Time the current state belongs to
+    };
+
+    void StartSimulation();
+    void StepSimulation(FixedStepThread::Clock::time_point due);
+    SimulationState GetFrameState();
+
+    void RenderMoon(const SimulationState& state);
+    void RenderLakePlane();
 
 
     void RenderTextured(
@@ -39,15 +80,86 @@ private:
         std::vector<Texture2D*> textures = {},
         std::vector<float> mixFactors = {},
         const glm::vec3& color = glm::vec3(0),
-        bool ortographic_perspective = false); // DEFAULT PERSPECTIVE
+        bool ortographic_perspective = false,  // DEFAULT PERSPECTIVE
+        unsigned int lod = 0);
+
+    void QueueTextured(
+        Mesh* mesh,
+        Shader* shader,
+        TransformHandle node,
+        std::vector<Texture2D*> textures = {},
+        std::vector<float> mixFactors = {},
+        const glm::vec3& color = glm::vec3(0));
+    void QueueLayered(
+        Mesh* mesh,
+        Shader* shader,
+        TransformHandle node,
+        Texture2DArray* textureArray,
+        std::vector<int> layers,
+        std::vector<float> mixFactors = {});
+    void CullDrawQueue();
+    void BuildGpuScene(const glm::mat4& viewProjection);
+    void BuildHiZ(RenderTargetHandle depth);
+    void CreateParticleEmitters();
+    void SimulateParticles(float deltaTime);
+    void RenderParticles();
+
+    /// Which of the queued draws a scene pass submits
+    enum class DrawFilter { All, GBuffer, Forward };
+    void RenderDrawQueue(DrawFilter filter);
+    Shader* GetPassShader(Shader* shader, DrawFilter filter) const;
+
+    struct DrawSlots;
+    struct DrawFrame;
+    struct QueuedDraw;
+    struct PerDrawBlock;
+    const DrawSlots* GetDrawSlots(Shader* shader);
+    void PrepareDrawTextures(const std::vector<Texture2D*>& textures);
+    void RecordDraw(CommandBuffer& commands, const DrawFrame& frame, const QueuedDraw& draw, GLuint& program);
+    UniformAllocation WritePerDraw(const glm::mat4& modelMatrix, const glm::vec3& color,
+        const std::vector<Texture2D*>& textures, const std::vector<int>& layers, const std::vector<float>& mixFactors);
+
+    void BuildRenderGraph();
+    void AddDeferredPasses(RenderTargetHandle shadowMaps, RenderTargetHandle sceneColor, RenderTargetHandle sceneDepth);
+    void RenderPresent(RenderTargetHandle color, RenderTargetHandle depth);
+    void RenderColorGrade(RenderTargetHandle color);
+    void UpdateColorGrade();
+    void RenderFullscreen(Shader* shader);
+
+    void UpdateShadowLights();
+    void RenderShadows();
+    void RenderShadowCasters(unsigned int light, const glm::mat4& viewProjection, bool moving);
+    void RenderShadowCaster(Shader* shader, Mesh* mesh, TransformHandle node, const glm::mat4& viewProjection, Texture2D* texture = nullptr);
+    void SetupShadows(Shader* shader);
+    BoundingSphere GetTerrainBounds();
+
+    /// G-buffer of the deferred path
+    struct GBufferTargets {
+        RenderTargetHandle albedo;
+        RenderTargetHandle normal;
+        RenderTargetHandle material;
+        RenderTargetHandle depth;
+    };
+
+    void SetupGBuffer(Shader* shader, const GBufferTargets& gbuffer);
+    void RenderDeferredLights(const GBufferTargets& gbuffer);
+    void RenderLightVolume(Shader* shader, Mesh* mesh, const glm::mat4& modelMatrix);
+    void ResolveDeferred(const GBufferTargets& gbuffer, RenderTargetHandle lightAccum);
 
-    void RenderBoats(float deltaTimeSeconds);
-    void RenderLighthouseObject();
+    void CreateSceneNodes();
+    void BuildSceneBVH();
+    void UpdateSceneBVH();
+    void PickObject(int mouseX, int mouseY);
+
+    void RenderBoats(const SimulationState& state);
+    void RenderLighthouseObject(const SimulationState& state);
     void SetupLighthouseLighting();
-    void UpdateAndRenderUpperLayer();
+    void UpdateAndRenderUpperLayer(const SimulationState& state);
     void RenderBamboos();
     void RenderSliders();
-    void RenderSlider(Mesh* mesh, Shader* shader, const glm::mat4& modelMatrix, const glm::vec3& color);
+    void FlushUIBatch();
+    void RenderHud();
+    size_t GetVideoMemoryEstimate() const;
 
     void OnInputUpdate(float deltaTime, int mods) override;
     void OnKeyPress(int key, int mods) override;
@@ -58,7 +170,76 @@ private:
     void OnMouseScroll(int mouseX, int mouseY, int offsetX, int offsetY) override;
     void OnWindowResize(int width, int height) override;
 
-    float elapsedTime;
+public:
+    const CullingStats& GetCullingStats() const { return frustumCuller.GetStats(); }
+    const CullingStats& GetOcclusionStats() const { return occlusionCuller.GetStats(); }
+    unsigned int GetTrianglesDrawn() const { return trianglesDrawn; }
+    const RenderGraph& GetRenderGraph() const { return renderGraph; }
+    float GetGpuFrameTime() const { return frameTimer.GetMilliseconds(); }
+    float GetRenderScale() const { return dynamicResolution.GetScale(); }
+    bool IsDeferredShading() const { return deferredShading; }
+
+private:
+    /// Perspective draw recorded during Update and submitted after culling
+    struct DrawCommand {
+        Mesh* mesh;
+        Shader* shader;
+        TransformHandle node;
+        unsigned int lod;
+        std::vector<Texture2D*> textures;
+        Texture2DArray* textureArray;   // Material array read by the layers, shared by the objects using it
+        std::vector<int> textureLayers;
+        std::vector<float> mixFactors;
+        glm::vec3 color;
+    };
+
+    /// Uniform slots of a shader drawing queued objects, looked up once per linked program
+    struct DrawSlots {
+        GLuint program;
+        bool perDraw;           // Whether the program reads the PerDraw block
+        GLint view, projection, eyePosition, time;
+        GLint lightPosition, lightDirection, lightColor;
+        GLint materialShininess, materialKe, materialKa, materialKd, materialKs, angle;
+        GLint textures[MAX_2D_TEXTURES];
+        GLint materialLayers;
+        GLint shadowsEnabled, shadowAtlas, shadowMatrices, shadowPages, shadowTexel;
+    };
+
+    /// PerDraw uniform block of the scene shaders, std140 layout
+    struct PerDrawBlock {
+        glm::mat4 model;
+        glm::vec3 objectColor;
+        GLint numTextures;
+        glm::vec4 mixFactors[9];    // Only x is read, std140 gives 16 bytes to each element of a float array
+        glm::ivec4 textureLayers[2];    // Layer of each texture in the material array, -1 for a texture of its own
+    };
+    static_assert(sizeof(PerDrawBlock) == 256, "PerDrawBlock must match the std140 layout of the PerDraw block");
+
+    /// Values shared by all the queued draws of a pass
+    struct DrawFrame {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::vec3 eyePosition;
+        float time;
+        bool shadowsReady;
+        GLuint shadowAtlas;
+        glm::mat4 shadowMatrices[3];
+        glm::vec4 shadowPages[3];
+        float shadowTexel;
+    };
+
+    /// Visible draw of the pass being recorded
+    struct QueuedDraw {
+        const DrawCommand* command;
+        const DrawSlots* slots;
+        int indirectBatch;          // Batch of the GPU scene drawing the object and its kind, -1 for a single draw
+    };
+
+    /// Orders the queued draws by what an indirect batch shares: mesh, level of detail and pipeline state
+    struct IndirectStateLess {
+        bool operator()(const DrawCommand* a, const DrawCommand* b) const;
+    };
+
     int windowWidth, windowHeight;
     glm::ivec2 resolution;
 
@@ -67,10 +248,137 @@ private:
     GameInit* gameInit;
     SliderManager* sliderManager;
     std::unordered_map<std::string, Texture2D*> textures;
-        
+    std::unordered_map<std::string, Texture2DArray*> textureArrays;
+
+    /// RENDER GRAPH ///
+
+    RenderGraph renderGraph;
+    GLuint screenVAO;       // Empty, full screen passes build their triangle from gl_VertexID
+
+    /// DEFERRED SHADING ///
+
+    bool deferredShading;
+    std::unordered_map<Shader*, Shader*> gbufferShaders;  // Forward shader to the G-buffer shader replacing it
+
+    /// COLOR GRADING ///
+
+    ColorGradingLut colorGrading;
+
+    /// DYNAMIC RESOLUTION ///
+
+    GpuTimer frameTimer;
+    DynamicResolution dynamicResolution;
+
+    /// SHADOWS ///
+
+    ShadowAtlas shadowAtlas;
+    int spotShadows[2];     // Atlas lights of the rotating spotlights 4 and 5
+    int moonShadow;
+
+    /// UI ///
+
+    /// Widget types of the UI shader
+    enum UIWidget { WIDGET_SOLID = 0, WIDGET_HUE = 1, WIDGET_SATURATION = 2, WIDGET_VALUE = 3 };
+    UIBatch uiBatch;
+
+    /// PERFORMANCE HUD ///
+
+    static const unsigned int HUD_HISTORY = 240;   // Frames shown by the graph
+
+    bool showHud;
+    gfxc::TextRenderer* hudText;    // Created on first use, it starts a rasterizer thread
+    glm::ivec2 hudViewport;
+    std::chrono::steady_clock::time_point frameStartTime;
+    float cpuFrameTimes[HUD_HISTORY];
+    float gpuFrameTimes[HUD_HISTORY];
+    unsigned int hudFrame;          // Frames recorded in the history, the newest is at hudFrame - 1
+    float hudMilliseconds;          // CPU time of the last RenderHud
+
+    /// CAPTURE ///
+
+    FrameCapture frameCapture;
+
+    /// CULLING ///
+
+    std::vector<DrawCommand> drawQueue;
+    SphereBatch drawBounds;
+    std::vector<unsigned char> drawVisibility;
+    FrustumCuller frustumCuller;
+    std::vector<BoundingBox> drawBoxes;
+    std::vector<unsigned char> occlusionVisibility;
+    OcclusionCuller occlusionCuller;
+    unsigned int lighthouseOccluder;
+    unsigned int lighthouseBaseOccluder;
+
+    /// COMMAND RECORDING ///
+
+    CommandQueue drawCommands;
+    std::vector<QueuedDraw> drawList;
+    std::unordered_map<Shader*, DrawSlots> drawSlots;
+    std::unordered_set<Texture2D*> mipmappedTextures;   // Textures of the draw queue get their mipmaps once
+    UniformRing drawUniforms;                           // PerDraw blocks, one region per frame in flight
+
+    /// GPU DRIVEN RENDERING ///
+
+    bool gpuDriven;                                             // GL 4.3, the objects with an indirect shader are culled and drawn by the GPU
+    GpuScene gpuScene;
+    HiZPyramid hizPyramid;                                      // Depth of the last frame for the occlusion test of the GPU scene
+    std::unordered_map<Shader*, Shader*> indirectShaders;       // Scene shader to the version reading the GPU scene instances
+    std::vector<unsigned char> drawIndirect;                    // Per queued draw, whether the GPU scene draws it
+    std::map<const DrawCommand*, unsigned int, IndirectStateLess> indirectBatches;  // First draw of a batch to its index
+
+    /// PARTICLES ///
+
+    bool particlesEnabled;          // GL 4.3, simulated and drawn without the CPU touching a particle
+    GpuParticles particles;
+    unsigned int sprayEmitters[4];  // Wake spray of each boat
+    unsigned int mistEmitter;       // Around the lighthouse lamp
+
+    /// TRANSFORMS ///
+
+    TransformSystem sceneTransforms;
+    TransformHandle lighthouseNode;
+    TransformHandle lighthouseBaseNode;
+    TransformHandle lighthouseMiddleNode;
+    TransformHandle lighthouseLowerLayerNode;
+    TransformHandle lighthouseUpperLayerNode;
+    TransformHandle lighthouseTopNode;
+    TransformHandle boatNodes[4];
+    TransformHandle moonNode;
+    TransformHandle lakeNode;
+    std::vector<TransformHandle> bambooNodes;
+
+    /// LEVEL OF DETAIL ///
+
+    LodSelector lodSelector;
+    std::vector<unsigned char> nodeLods;    // Level used last frame, per transform node
+    unsigned int trianglesDrawn;
+
+    /// PICKING ///
+
+    MeshBVH lighthouseBVH;
+    MeshBVH sphereBVH;
+    MeshBVH boatBVH;
+    MeshBVH bambooBVH;
+    MeshBVH lakeBVH;
+    SceneBVH sceneBVH;
+    unsigned int boatInstances[4];
+    unsigned int moonInstance;
+    std::unordered_map<TransformHandle, std::string> nodeNames;
+    TransformHandle pickedNode;     // Last object clicked, shown by the HUD
+    float pickedDistance;
+    bool pickedMoonlit;             // The moon is visible from the picked point
+
+    /// SIMULATION ///
+
+    static const double SIMULATION_STEP;
+
+    FixedStepThread simulationThread;
+    SimulationState simulationState;                    // Simulation thread only once it runs
+    TripleBuffer<SimulationSnapshot> simulationSnapshots;
+
     /// BOATS ///
 
-    float boatRotationAngles[4];
     float boatRotationSpeeds[4];
     float radiusDist[4];
     int   boatRotationDirections[4];
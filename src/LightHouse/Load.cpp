@@ -8,9 +8,11 @@ void GMesh::Load(
     const std::string& directory,
     const std::string& filename,
     const std::string& name,
-    MeshMap& mapMeshes)
+    MeshMap& mapMeshes,
+    unsigned int lodLevels)
 {
     Mesh* internalMesh = new Mesh(name);
+    internalMesh->SetLodLevels(lodLevels);
     internalMesh->LoadMesh(directory, filename);
     mapMeshes[internalMesh->GetMeshID()] = internalMesh;
 }
@@ -30,6 +32,18 @@ void GMesh::Load(
  }
 
 
+ void GShader::LoadCompute(
+     const std::string& compPath,
+     const std::string& name,
+     ShaderMap& mapShaders)
+ {
+     Shader* internalShader = new Shader(name);
+     internalShader->AddShader(compPath, GL_COMPUTE_SHADER);
+     internalShader->CreateAndLink();
+     mapShaders[internalShader->GetName()] = internalShader;
+ }
+
+
 void GTexture::Load(
     const std::string& path,
     const std::string& name,
@@ -33,7 +33,8 @@ public:
         const std::string& directory,
         const std::string& filename,
         const std::string& name,
-        MeshMap& mapMeshes) = 0;
+        MeshMap& mapMeshes,
+        unsigned int lodLevels = 0) = 0;
 };
 
 
@@ -45,6 +46,10 @@ public:
         const std::string& fragPath,
         const std::string& name,
         ShaderMap& mapShaders) = 0;
+    virtual void LoadCompute(
+        const std::string& compPath,
+        const std::string& name,
+        ShaderMap& mapShaders) = 0;
 };
 
 #endif // LOAD_H
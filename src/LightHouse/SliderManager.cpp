@@ -256,27 +256,6 @@ void SliderManager::updateHSVSliders()
 }
 
 
-/// <summary>
-/// Print current RGB and HSV values for debugging
-/// </summary>
-void SliderManager::printDebugInfo()
-{
-    // Output the current values of RGB and HSV sliders to the console
-
-    // Print RGB values
-    std::cout << "RGB (normalized): ["
-        << sliders[0].value << ", "
-        << sliders[1].value << ", "
-        << sliders[2].value << "]" << std::endl;
-
-    // Print HSV values
-    std::cout << "HSV: ["
-        << sliders[3].value * HUE_CONE << " (Hue), "
-        << sliders[4].value * SATURATION_PERCENT << "% (Saturation), "
-        << sliders[5].value * VALUE_PERCENT << "% (Value)]" << std::endl;
-}
-
-
 /// <summary>
 /// Set the color of the lighthouse based on RGB slider values
 /// </summary>
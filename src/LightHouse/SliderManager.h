@@ -59,7 +59,6 @@ public:
     void updateHSVSliders();
 
     void setColor();
-    void printDebugInfo();
 
     const glm::vec3& getLighthouseColor() const { return lighthouseColor; }
     const std::vector<Slider>& getSliders() const { return sliders; }
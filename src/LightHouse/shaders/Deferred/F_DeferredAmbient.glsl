@@ -0,0 +1,150 @@
+#version 330
+
+// Full screen part of the deferred lighting: the moon and the ambient term of
+// the point lights, which the forward shaders apply without attenuation and
+// so reaches past any light volume.
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Input
+in vec2 texCoords;
+
+// G-buffer
+uniform sampler2D g_albedo;              // Surface type in alpha (0 = scene object, 1 = terrain)
+uniform sampler2D g_normal;
+uniform sampler2D g_material;
+uniform sampler2D g_depth;
+uniform mat4 inverse_view_projection;
+
+uniform vec3 light_position[15];         // 4 BOATS + 2 LIGHTHOUSE + 1 MOON + 8 BASE LIGHTHOUSE
+uniform vec3 light_direction[15];        // 4 BOATS + 2 LIGHTHOUSE + 1 MOON + 8 BASE LIGHTHOUSE
+uniform vec3 light_color[15];            // 4 BOATS + 2 LIGHTHOUSE + 1 MOON + 8 BASE LIGHTHOUSE
+
+uniform vec3 eye_position;
+uniform vec3 material_ke;
+
+// Shadow atlas pages of the 2 lighthouse spotlights and the moon
+uniform sampler2D shadow_atlas;
+uniform mat4 shadow_matrices[3];         // Light view projection of each page
+uniform vec4 shadow_pages[3];            // Page offset (xy) and size (zw) in the atlas
+uniform float shadow_texel;              // Size of an atlas texel
+uniform int shadows_enabled;
+
+// Output, the light accumulation target
+layout(location = 0) out vec4 out_light;
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+vec3 DecodeNormal(vec2 f)
+{
+    f = f * 2.0 - 1.0;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+
+// World position of the G-buffer texel from its depth
+vec3 WorldPosition(ivec2 texel, float depth)
+{
+    vec2 uv = (vec2(texel) + 0.5) / vec2(textureSize(g_depth, 0));
+    vec4 position = inverse_view_projection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    return position.xyz / position.w;
+}
+
+
+// Fraction of the 3x3 atlas texels around the fragment that see the light
+float ShadowFactor(int page, vec3 fragPos)
+{
+    if (shadows_enabled == 0)
+    {
+        return 1.0;
+    }
+
+    vec4 lightPos = shadow_matrices[page] * vec4(fragPos, 1.0);
+    if (lightPos.w <= 0.0)
+    {
+        return 1.0;
+    }
+
+    // Outside of the light frustum nothing is known, keep it lit
+    vec3 coords = lightPos.xyz / lightPos.w * 0.5 + 0.5;
+    if (any(lessThan(coords, vec3(0.0))) || any(greaterThan(coords, vec3(1.0))))
+    {
+        return 1.0;
+    }
+
+    vec4 rect = shadow_pages[page];
+    vec2 texel = shadow_texel / rect.zw;
+    float lit = 0.0;
+
+    for (int x = -1; x <= 1; x++)
+    {
+        for (int y = -1; y <= 1; y++)
+        {
+            // Clamped to the page, the neighbouring pages belong to other lights
+            vec2 uv = clamp(coords.xy + vec2(x, y) * texel, 0.5 * texel, 1.0 - 0.5 * texel);
+            float depth = texture(shadow_atlas, rect.xy + uv * rect.zw).r;
+            lit += (coords.z - 0.0005 <= depth) ? 1.0 : 0.0;
+        }
+    }
+
+    return lit / 9.0;
+}
+
+
+vec3 DirectionalLight(vec3 lightDir, vec3 lightColor, vec3 fragPos, vec3 normal, vec4 material, bool terrain)
+{
+    vec3 L = normalize(lightDir);
+    vec3 V = normalize(eye_position - fragPos);
+    vec3 R = reflect(-L, normal);
+
+    float d = max(dot(normal, -L), 0.0);
+    float s = pow(max(dot(V, R), 0.0), material.w);
+
+    vec3 A = material.z * lightColor;
+    vec3 D = material.x * d * lightColor;
+    vec3 S = material.y * s * lightColor;
+    // The scene shader tints the emission with the moon, the terrain shader doesn't
+    vec3 E = terrain ? material_ke : material_ke * lightColor;
+
+    return A + (D + S) * ShadowFactor(2, fragPos) + E;
+}
+
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(g_depth, texel, 0).r;
+
+    // Background, nothing to light
+    if (depth >= 1.0)
+    {
+        out_light = vec4(0.0);
+        return;
+    }
+
+    vec3 fragPos = WorldPosition(texel, depth);
+    vec3 normal = DecodeNormal(texelFetch(g_normal, texel, 0).xy);
+    vec4 material = texelFetch(g_material, texel, 0);
+    material.w = floor(material.w * 255.0 + 0.5);
+    bool terrain = texelFetch(g_albedo, texel, 0).a > 0.5;
+
+    vec3 resultLight = DirectionalLight(light_direction[6], light_color[6], fragPos, normal, material, terrain);
+
+    // Ambient of the boats (i < 4) and the lighthouse ground lights (i >= 7)
+    for (int i = 0; i < 15; i++)
+    {
+        if (i >= 4 && i <= 6)
+        {
+            continue;
+        }
+
+        if (dot(normal, light_position[i] - fragPos) >= 0.0)
+        {
+            resultLight += material.z * light_color[i];
+        }
+    }
+
+    out_light = vec4(resultLight, 0.0);
+}
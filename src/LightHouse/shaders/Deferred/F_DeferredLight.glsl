@@ -0,0 +1,178 @@
+#version 330
+
+// Light volume pass of the deferred path. Adds the attenuated part of one
+// point light or the whole of one spotlight, the terms match the forward
+// shaders so both paths give the same image.
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// G-buffer
+uniform sampler2D g_albedo;              // Surface type in alpha (0 = scene object, 1 = terrain)
+uniform sampler2D g_normal;
+uniform sampler2D g_material;
+uniform sampler2D g_depth;
+uniform mat4 inverse_view_projection;
+
+uniform vec3 eye_position;
+uniform vec3 material_ke;
+uniform float angle;
+
+// The light of the volume
+uniform int light_type;                  // 0 = point light, 1 = spotlight
+uniform vec3 light_position;
+uniform vec3 light_direction;
+uniform vec3 light_color;
+uniform int shadow_page;                 // Spotlights only
+
+// Shadow atlas pages of the 2 lighthouse spotlights and the moon
+uniform sampler2D shadow_atlas;
+uniform mat4 shadow_matrices[3];         // Light view projection of each page
+uniform vec4 shadow_pages[3];            // Page offset (xy) and size (zw) in the atlas
+uniform float shadow_texel;              // Size of an atlas texel
+uniform int shadows_enabled;
+
+// Output, added to the light accumulation target
+layout(location = 0) out vec4 out_light;
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+vec3 DecodeNormal(vec2 f)
+{
+    f = f * 2.0 - 1.0;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+
+// World position of the G-buffer texel from its depth
+vec3 WorldPosition(ivec2 texel, float depth)
+{
+    vec2 uv = (vec2(texel) + 0.5) / vec2(textureSize(g_depth, 0));
+    vec4 position = inverse_view_projection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    return position.xyz / position.w;
+}
+
+
+// Fraction of the 3x3 atlas texels around the fragment that see the light
+float ShadowFactor(int page, vec3 fragPos)
+{
+    if (shadows_enabled == 0)
+    {
+        return 1.0;
+    }
+
+    vec4 lightPos = shadow_matrices[page] * vec4(fragPos, 1.0);
+    if (lightPos.w <= 0.0)
+    {
+        return 1.0;
+    }
+
+    // Outside of the light frustum nothing is known, keep it lit
+    vec3 coords = lightPos.xyz / lightPos.w * 0.5 + 0.5;
+    if (any(lessThan(coords, vec3(0.0))) || any(greaterThan(coords, vec3(1.0))))
+    {
+        return 1.0;
+    }
+
+    vec4 rect = shadow_pages[page];
+    vec2 texel = shadow_texel / rect.zw;
+    float lit = 0.0;
+
+    for (int x = -1; x <= 1; x++)
+    {
+        for (int y = -1; y <= 1; y++)
+        {
+            // Clamped to the page, the neighbouring pages belong to other lights
+            vec2 uv = clamp(coords.xy + vec2(x, y) * texel, 0.5 * texel, 1.0 - 0.5 * texel);
+            float depth = texture(shadow_atlas, rect.xy + uv * rect.zw).r;
+            lit += (coords.z - 0.0005 <= depth) ? 1.0 : 0.0;
+        }
+    }
+
+    return lit / 9.0;
+}
+
+
+// Attenuated diffuse and specular of PointLight, the ambient term is added by the full screen pass
+vec3 PointLight(vec3 fragPos, vec3 normal, vec4 material)
+{
+    vec3 L = normalize(light_position - fragPos);
+    vec3 V = normalize(eye_position - fragPos);
+    vec3 R = reflect(-L, normal);
+
+    float N = dot(normal, L);
+    if (N < 0.0)
+    {
+        return vec3(0.0);
+    }
+
+    float d = max(N, 0.0);
+    float s = pow(max(dot(V, R), 0.0), material.w);
+
+    float dist = length(light_position - fragPos);
+    float a = 1.0 / (1.0 + 0.2 * dist + 0.1 * dist * dist);
+
+    vec3 D = material.x * 2.0 * d * light_color;
+    vec3 S = material.y * 2.0 * s * light_color;
+
+    return a * (D + S);
+}
+
+
+vec3 SpotLight(vec3 fragPos, vec3 normal, vec4 material, bool terrain)
+{
+    vec3 L = normalize(fragPos - light_position);
+    vec3 V = normalize(eye_position - fragPos);
+    vec3 R = reflect(L, normal);
+
+    float theta = dot(L, normalize(-light_direction));
+    if (theta <= cos(angle))
+    {
+        return vec3(0.0);
+    }
+
+    float dist = length(light_position - fragPos);
+    float a = 1.0 / (1.0 + 0.7 * dist + 1.8 * dist * dist);
+
+    float d = max(dot(normal, -L), 0.0);
+    float s = pow(max(dot(V, R), 0.0), material.w);
+
+    vec3 lightColor = light_color * 5.0;
+
+    vec3 A = material.z * lightColor;
+    vec3 D = material.x * 3.0 * d * lightColor;
+    vec3 S = material.y * 5.0 * s * lightColor;
+    // The terrain shader tints the emission with the light, the scene shader doesn't
+    vec3 E = terrain ? material_ke * lightColor : material_ke;
+
+    return A + a * (D + S) * ShadowFactor(shadow_page, fragPos) + E;
+}
+
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(g_depth, texel, 0).r;
+
+    // Background behind the volume
+    if (depth >= 1.0)
+    {
+        discard;
+    }
+
+    vec3 fragPos = WorldPosition(texel, depth);
+    vec3 normal = DecodeNormal(texelFetch(g_normal, texel, 0).xy);
+    vec4 material = texelFetch(g_material, texel, 0);
+    material.w = floor(material.w * 255.0 + 0.5);
+
+    if (light_type == 0)
+    {
+        out_light = vec4(PointLight(fragPos, normal, material), 0.0);
+    }
+    else
+    {
+        bool terrain = texelFetch(g_albedo, texel, 0).a > 0.5;
+        out_light = vec4(SpotLight(fragPos, normal, material, terrain), 0.0);
+    }
+}
@@ -0,0 +1,27 @@
+#version 330
+
+// Input texture coordinates
+in vec2 texCoords;
+
+// Albedo of the G-buffer and the light accumulated by the deferred passes
+uniform sampler2D g_albedo;              // Surface type in alpha (0 = scene object, 1 = terrain)
+uniform sampler2D light_accumulation;
+
+// Output fragment color
+out vec4 fragColor;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    vec4 albedo = texelFetch(g_albedo, texel, 0);
+    vec3 light = texelFetch(light_accumulation, texel, 0).rgb;
+
+    // The forward scene shader applies its light twice, the terrain shader once
+    vec3 color = albedo.rgb * light;
+    if (albedo.a < 0.5)
+    {
+        color *= light;
+    }
+
+    fragColor = vec4(color, 1.0);
+}
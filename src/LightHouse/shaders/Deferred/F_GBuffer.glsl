@@ -0,0 +1,80 @@
+#version 330
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Input
+in vec3 world_position;
+in vec3 world_normal;
+in vec2 texCoords;
+
+uniform float material_kd;
+uniform float material_ks;
+uniform float material_ka;
+uniform uint material_shininess;
+
+// Uniform
+uniform sampler2D textures[10];      // Array of textures, MAX = 10
+uniform sampler2DArray material_layers;  // Material array of the draw, see texture_layers
+
+// Values of the draw, bound as a range of the per draw ring buffer
+layout(std140) uniform PerDraw
+{
+    mat4 Model;
+    vec3 objectColor;            // Object color if no textures are used
+    int numTextures;             // The actual number of textures used
+    float mix_factors[9];        // Mix factors for blending textures
+    ivec4 texture_layers[2];     // Layer of material_layers for textures 0 to 7, -1 when read from textures[i]
+};
+
+// Output, see the lighting passes for the layout
+layout(location = 0) out vec4 out_albedo;      // Color, surface type in alpha (0 = scene object)
+layout(location = 1) out vec2 out_normal;      // Octahedral world normal
+layout(location = 2) out vec4 out_material;    // kd, ks, ka, shininess / 255
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+vec2 OctWrap(vec2 v)
+{
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+
+// Unit vector folded onto the octahedron and flattened to [0, 1]^2
+vec2 EncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    n.xy = n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+    return n.xy * 0.5 + 0.5;
+}
+
+
+void main()
+{
+    vec4 albedo;
+
+    // Same texture mix as the forward scene shader
+    if (numTextures > 0)
+    {
+        albedo = vec4(0.0);
+        for (int i = 0; i < numTextures; ++i)
+        {
+            int layer = i < 8 ? texture_layers[i / 4][i % 4] : -1;
+            if (layer >= 0)
+                albedo += texture(material_layers, vec3(texCoords, layer)) * mix_factors[i];
+            else
+                albedo += texture(textures[i], texCoords) * mix_factors[i];
+        }
+    }
+    else
+    {
+        albedo = vec4(objectColor, 1.0);
+    }
+
+    if (albedo.a < 0.1)
+    {
+        discard;
+    }
+
+    out_albedo = vec4(albedo.rgb, 0.0);
+    out_normal = EncodeNormal(normalize(world_normal));
+    out_material = vec4(material_kd, material_ks, material_ka, float(material_shininess) / 255.0);
+}
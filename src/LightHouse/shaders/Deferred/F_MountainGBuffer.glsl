@@ -0,0 +1,78 @@
+#version 330
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Input
+in vec3 world_position;
+in vec3 world_normal;
+in vec2 texCoords;
+
+uniform float material_kd;
+uniform float material_ks;
+uniform float material_ka;
+uniform uint material_shininess;
+
+// Deformations of the plane in vertex shader (lake and mountains)
+in float vertex_height;
+// MAX = 10 (it can support maximum 10 texture)
+uniform sampler2D textures[10];
+
+// Output, see the lighting passes for the layout
+layout(location = 0) out vec4 out_albedo;      // Color, surface type in alpha (1 = terrain)
+layout(location = 1) out vec2 out_normal;      // Octahedral world normal
+layout(location = 2) out vec4 out_material;    // kd, ks, ka, shininess / 255
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+vec2 OctWrap(vec2 v)
+{
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+
+// Unit vector folded onto the octahedron and flattened to [0, 1]^2
+vec2 EncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    n.xy = n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+    return n.xy * 0.5 + 0.5;
+}
+
+
+void main() {
+    vec4 PEAKS = texture(textures[0], texCoords).rrrr;              // Ground texture
+    vec4 groundColor = texture(textures[0], texCoords).rrba;        // Ground texture
+    vec4 heightColor = texture(textures[1], texCoords).brga;        // Height texture
+    vec4 waterColor = texture(textures[2], texCoords);              // Water color texture
+    vec4 uvDistortion = texture(textures[3], texCoords);            // UV distortion texture for water
+    vec4 lavaColor = texture(textures[4], texCoords);               // Lava color texture
+    vec4 lavaUVDistortion = texture(textures[5], texCoords);        // UV distortion texture for lava
+    vec4 lavaOccColor = texture(textures[6], texCoords);            // Lava occlusion texture
+
+    // Water and lava with their distorted coordinates, as in the forward shader
+    vec4 distortedWaterColor = texture(textures[2], texCoords + uvDistortion.xy * 0.1);
+    vec4 finalWaterColor = mix(waterColor, distortedWaterColor, 0.35);
+
+    vec4 distortedLavaColor = texture(textures[4], texCoords + lavaUVDistortion.xy * 0.1);
+    vec4 finalLavaColor = mix(lavaColor, distortedLavaColor, 0.8);
+    finalLavaColor *= lavaOccColor;
+
+    vec4 albedo;
+
+    // Plane effect (depending on the vertex height plane)
+    if (vertex_height < 0.1)
+    {
+        albedo = finalWaterColor;
+    }
+    else if (vertex_height >= 0.1 && vertex_height < 0.25)
+    {
+        albedo = mix(groundColor, heightColor, smoothstep(0.0, 1.0, vertex_height));
+    }
+    else
+    {
+        albedo = mix(finalLavaColor, PEAKS, smoothstep(0.0, 1.0, vertex_height));
+    }
+
+    out_albedo = vec4(albedo.rgb, 1.0);
+    out_normal = EncodeNormal(normalize(world_normal));
+    out_material = vec4(material_kd, material_ks, material_ka, float(material_shininess) / 255.0);
+}
@@ -0,0 +1,6 @@
+#version 330
+
+void main()
+{
+    // Only the stencil of the light volume is written, the color mask is off
+}
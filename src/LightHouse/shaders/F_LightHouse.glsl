@@ -2,12 +2,20 @@
 
 // Input from vertex shader
 in vec2 texcoord;
-uniform vec3 objectColor;
 
 // Uniforms
 uniform sampler2D textures[10];
 // MAX = 10 (it can support maximum 10 texture)
-uniform int numTextures;
+
+// Values of the draw, bound as a range of the per draw ring buffer
+layout(std140) uniform PerDraw
+{
+    mat4 Model;
+    vec3 objectColor;            // Object color if no textures are used
+    int numTextures;             // The actual number of textures used
+    float mix_factors[9];        // Mix factors for blending textures
+    ivec4 texture_layers[2];     // Layer of material_layers for textures 0 to 7, -1 when read from textures[i]
+};
 
 // Output
 layout(location = 0) out vec4 out_color;
@@ -21,6 +21,13 @@ uniform float material_ka;
 uniform vec3 material_ke;
 uniform uint material_shininess;
 
+// Shadow atlas pages of the 2 lighthouse spotlights and the moon
+uniform sampler2D shadow_atlas;
+uniform mat4 shadow_matrices[3];         // Light view projection of each page
+uniform vec4 shadow_pages[3];            // Page offset (xy) and size (zw) in the atlas
+uniform float shadow_texel;              // Size of an atlas texel
+uniform int shadows_enabled;
+
 // Deformations of the plane in vertex shader (lake and mountains)
 in float vertex_height;
 // MAX = 10 (it can support maximum 10 texture)
@@ -30,6 +37,46 @@ uniform sampler2D textures[10];
 layout(location = 0) out vec4 out_color;
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+
+// Fraction of the 3x3 atlas texels around the fragment that see the light
+float ShadowFactor(int page, vec3 fragPos)
+{
+    if (shadows_enabled == 0)
+    {
+        return 1.0;
+    }
+
+    vec4 lightPos = shadow_matrices[page] * vec4(fragPos, 1.0);
+    if (lightPos.w <= 0.0)
+    {
+        return 1.0;
+    }
+
+    // Outside of the light frustum nothing is known, keep it lit
+    vec3 coords = lightPos.xyz / lightPos.w * 0.5 + 0.5;
+    if (any(lessThan(coords, vec3(0.0))) || any(greaterThan(coords, vec3(1.0))))
+    {
+        return 1.0;
+    }
+
+    vec4 rect = shadow_pages[page];
+    vec2 texel = shadow_texel / rect.zw;
+    float lit = 0.0;
+
+    for (int x = -1; x <= 1; x++)
+    {
+        for (int y = -1; y <= 1; y++)
+        {
+            // Clamped to the page, the neighbouring pages belong to other lights
+            vec2 uv = clamp(coords.xy + vec2(x, y) * texel, 0.5 * texel, 1.0 - 0.5 * texel);
+            float depth = texture(shadow_atlas, rect.xy + uv * rect.zw).r;
+            lit += (coords.z - 0.0005 <= depth) ? 1.0 : 0.0;
+        }
+    }
+
+    return lit / 9.0;
+}
+
 vec3 PointLight(vec3 lightPos, vec3 lightColor, vec3 fragPos, vec3 normal)
 {
     vec3 L = normalize(lightPos - fragPos);
@@ -59,7 +106,7 @@ vec3 PointLight(vec3 lightPos, vec3 lightColor, vec3 fragPos, vec3 normal)
 }
 
 
-vec3 SpotLight(vec3 lightPos, vec3 lightDir, vec3 lightColor, vec3 fragPos, vec3 normal, float cutoffAngle)
+vec3 SpotLight(vec3 lightPos, vec3 lightDir, vec3 lightColor, vec3 fragPos, vec3 normal, float cutoffAngle, float shadow)
 {
     vec3 L = normalize(fragPos - lightPos);
     vec3 V = normalize(eye_position - fragPos);
@@ -91,7 +138,7 @@ vec3 SpotLight(vec3 lightPos, vec3 lightDir, vec3 lightColor, vec3 fragPos, vec3
         vec3 S = material_ks * 5.0 * s * lightColor;
         vec3 E = material_ke * lightColor;
 
-        return (A + a * (D + S) + E);
+        return (A + a * (D + S) * shadow + E);
     }
     else
     {
@@ -100,7 +147,7 @@ vec3 SpotLight(vec3 lightPos, vec3 lightDir, vec3 lightColor, vec3 fragPos, vec3
     }
 }
 
-vec3 DirectionalLight(vec3 lightDir, vec3 lightColor, vec3 fragPos, vec3 normal)
+vec3 DirectionalLight(vec3 lightDir, vec3 lightColor, vec3 fragPos, vec3 normal, float shadow)
 {
     vec3 L = normalize(lightDir);
     vec3 V = normalize(eye_position - fragPos);
@@ -118,7 +165,7 @@ vec3 DirectionalLight(vec3 lightDir, vec3 lightColor, vec3 fragPos, vec3 normal)
     vec3 S = material_ks * s * lightColor;
     vec3 E = material_ke;
 
-    return (A + D + S + E);
+    return (A + (D + S) * shadow + E);
 }
 
 
@@ -169,11 +216,13 @@ void main() {
         }
         else if (i >= 4 && i <= 5)
         {
-          resultLight += SpotLight(light_position[i], light_direction[i], light_color[i], world_position, world_normal, angle);
+          resultLight += SpotLight(light_position[i], light_direction[i], light_color[i], world_position, world_normal, angle,
+                ShadowFactor(i - 4, world_position));
         }
         else if (i == 6)
         {
-          resultLight += DirectionalLight(light_direction[i], light_color[i], world_position, world_normal);
+          resultLight += DirectionalLight(light_direction[i], light_color[i], world_position, world_normal,
+                ShadowFactor(2, world_position));
         }
         else if (i >= 7)
         {
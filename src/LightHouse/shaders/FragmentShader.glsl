@@ -21,17 +21,72 @@ uniform float material_ka;
 uniform vec3 material_ke;
 uniform uint material_shininess;
 
+// Shadow atlas pages of the 2 lighthouse spotlights and the moon
+uniform sampler2D shadow_atlas;
+uniform mat4 shadow_matrices[3];         // Light view projection of each page
+uniform vec4 shadow_pages[3];            // Page offset (xy) and size (zw) in the atlas
+uniform float shadow_texel;              // Size of an atlas texel
+uniform int shadows_enabled;
+
 // Uniform
 uniform sampler2D textures[10];      // Array of textures, MAX = 10
-uniform float mix_factors[9];        // Mix factors for blending textures
-uniform int numTextures;             // The actual number of textures used
-uniform vec3 objectColor;            // Object color if no textures are used
+uniform sampler2DArray material_layers;  // Material array of the draw, see texture_layers
+
+// Values of the draw, bound as a range of the per draw ring buffer
+layout(std140) uniform PerDraw
+{
+    mat4 Model;
+    vec3 objectColor;            // Object color if no textures are used
+    int numTextures;             // The actual number of textures used
+    float mix_factors[9];        // Mix factors for blending textures
+    ivec4 texture_layers[2];     // Layer of material_layers for textures 0 to 7, -1 when read from textures[i]
+};
 
 // Output
 layout(location = 0) out vec4 out_color;
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
+
+// Fraction of the 3x3 atlas texels around the fragment that see the light
+float ShadowFactor(int page, vec3 fragPos)
+{
+    if (shadows_enabled == 0)
+    {
+        return 1.0;
+    }
+
+    vec4 lightPos = shadow_matrices[page] * vec4(fragPos, 1.0);
+    if (lightPos.w <= 0.0)
+    {
+        return 1.0;
+    }
+
+    // Outside of the light frustum nothing is known, keep it lit
+    vec3 coords = lightPos.xyz / lightPos.w * 0.5 + 0.5;
+    if (any(lessThan(coords, vec3(0.0))) || any(greaterThan(coords, vec3(1.0))))
+    {
+        return 1.0;
+    }
+
+    vec4 rect = shadow_pages[page];
+    vec2 texel = shadow_texel / rect.zw;
+    float lit = 0.0;
+
+    for (int x = -1; x <= 1; x++)
+    {
+        for (int y = -1; y <= 1; y++)
+        {
+            // Clamped to the page, the neighbouring pages belong to other lights
+            vec2 uv = clamp(coords.xy + vec2(x, y) * texel, 0.5 * texel, 1.0 - 0.5 * texel);
+            float depth = texture(shadow_atlas, rect.xy + uv * rect.zw).r;
+            lit += (coords.z - 0.0005 <= depth) ? 1.0 : 0.0;
+        }
+    }
+
+    return lit / 9.0;
+}
+
 vec3 PointLight(vec3 lightPos, vec3 lightColor, vec3 fragPos, vec3 normal)
 {
     vec3 L = normalize(lightPos - fragPos);
@@ -61,7 +116,7 @@ vec3 PointLight(vec3 lightPos, vec3 lightColor, vec3 fragPos, vec3 normal)
 }
 
 
-vec3 SpotLight(vec3 lightPos, vec3 lightDir, vec3 lightColor, vec3 fragPos, vec3 normal, float cutoffAngle)
+vec3 SpotLight(vec3 lightPos, vec3 lightDir, vec3 lightColor, vec3 fragPos, vec3 normal, float cutoffAngle, float shadow)
 {
     vec3 L = normalize(fragPos - lightPos);
     vec3 V = normalize(eye_position - fragPos);
@@ -93,7 +148,7 @@ vec3 SpotLight(vec3 lightPos, vec3 lightDir, vec3 lightColor, vec3 fragPos, vec3
         vec3 S = material_ks * 5.0 * s * lightColor;
         vec3 E = material_ke;
 
-        return (A + a * (D + S) + E);
+        return (A + a * (D + S) * shadow + E);
     }
     else
     {
@@ -103,7 +158,7 @@ vec3 SpotLight(vec3 lightPos, vec3 lightDir, vec3 lightColor, vec3 fragPos, vec3
 }
 
 
-vec3 DirectionalLight(vec3 lightDir, vec3 lightColor, vec3 fragPos, vec3 normal)
+vec3 DirectionalLight(vec3 lightDir, vec3 lightColor, vec3 fragPos, vec3 normal, float shadow)
 {
     vec3 L = normalize(lightDir);
     vec3 V = normalize(eye_position - fragPos);
@@ -121,7 +176,7 @@ vec3 DirectionalLight(vec3 lightDir, vec3 lightColor, vec3 fragPos, vec3 normal)
     vec3 S = material_ks * s * lightColor;
     vec3 E = material_ke * lightColor;
 
-    return (A + D + S + E);
+    return (A + (D + S) * shadow + E);
 }
 
 
@@ -143,11 +198,13 @@ void main()
         }
         else if (i >= 4 && i <= 5)
         {
-           resultLight += SpotLight(light_position[i], light_direction[i], light_color[i], world_position, world_normal, angle);
+           resultLight += SpotLight(light_position[i], light_direction[i], light_color[i], world_position, world_normal, angle,
+                ShadowFactor(i - 4, world_position));
         }
         else if (i == 6)
         {
-          resultLight += DirectionalLight(light_direction[i], light_color[i], world_position, world_normal);
+          resultLight += DirectionalLight(light_direction[i], light_color[i], world_position, world_normal,
+                ShadowFactor(2, world_position));
         }
         else if (i >= 7)
         {
@@ -160,10 +217,15 @@ void main()
     // Apply textures (if any) or use object color
     if (numTextures > 0)
     {
-        vec4 mixedColor = texture(textures[0], texCoords) * mix_factors[0];
-        for (int i = 1; i < numTextures; ++i)
+        vec4 mixedColor = vec4(0.0);
+        for (int i = 0; i < numTextures; ++i)
         {
-            mixedColor += texture(textures[i], texCoords) * mix_factors[i];
+            // A texture packed in the material array is read from its layer
+            int layer = i < 8 ? texture_layers[i / 4][i % 4] : -1;
+            if (layer >= 0)
+                mixedColor += texture(material_layers, vec3(texCoords, layer)) * mix_factors[i];
+            else
+                mixedColor += texture(textures[i], texCoords) * mix_factors[i];
         }
         finalColor = mixedColor * vec4(resultLight, 1.0);
     }
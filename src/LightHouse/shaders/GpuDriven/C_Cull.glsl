@@ -0,0 +1,125 @@
+#version 430
+
+// Culls the instances of the GPU driven scene and writes the indirect draws.
+// A visible instance takes the next slot of the range of its batch, the
+// instanceCount of the first command of the batch is the counter and the
+// other commands of the batch follow it.
+layout(local_size_x = 64) in;
+
+// Same layouts as GpuScene
+struct Instance
+{
+    mat4 model;
+    vec4 sphere;                // World center, radius; negative when unknown
+    uint batch;
+};
+
+struct Batch
+{
+    uint firstCommand;
+    uint commandCount;
+    uint firstInstance;
+    uint padding;               // Keeps the array stride at 16 bytes, like the C++ side
+};
+
+struct DrawCommand
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer Instances { Instance instances[]; };
+layout(std430, binding = 1) readonly buffer Batches { Batch batches[]; };
+layout(std430, binding = 2) buffer Commands { DrawCommand commands[]; };
+layout(std430, binding = 3) writeonly buffer Visible { uint visible[]; };
+
+// Uniforms
+uniform uint instance_count;
+uniform vec4 frustum_planes[6];     // Normalized, inside is positive
+
+// Depth pyramid of the previous frame, see C_HiZ
+uniform int occlusion_enabled;
+layout(binding = 0) uniform sampler2D hiz;
+uniform mat4 hiz_view_projection;   // Camera the pyramid was drawn with
+uniform vec2 hiz_size;
+uniform int hiz_levels;
+
+bool InsideFrustum(vec3 center, float radius)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        if (dot(frustum_planes[i].xyz, center) + frustum_planes[i].w < -radius) return false;
+    }
+    return true;
+}
+
+bool Occluded(vec3 center, float radius)
+{
+    // Screen rectangle and nearest depth of the corners of the box around the sphere
+    vec3 rectMin = vec3(1.0);
+    vec3 rectMax = vec3(-1.0);
+    for (int i = 0; i < 8; i++)
+    {
+        vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = hiz_view_projection * vec4(corner, 1.0);
+
+        // Crossing the near plane of the old camera, nothing is known
+        if (clip.w <= 0.0) return false;
+
+        vec3 ndc = clip.xyz / clip.w;
+        rectMin = min(rectMin, ndc);
+        rectMax = max(rectMax, ndc);
+    }
+
+    vec2 uvMin = clamp(rectMin.xy * 0.5 + 0.5, 0.0, 1.0);
+    vec2 uvMax = clamp(rectMax.xy * 0.5 + 0.5, 0.0, 1.0);
+    float nearestDepth = rectMin.z * 0.5 + 0.5;
+
+    // Level 0 texels under the rectangle
+    ivec2 baseSize = ivec2(hiz_size);
+    ivec2 texelMin = min(ivec2(uvMin * hiz_size), baseSize - 1);
+    ivec2 texelMax = min(ivec2(uvMax * hiz_size), baseSize - 1);
+
+    // The level where the rectangle spans at most 2 texels on each axis, so 4 texels cover it
+    ivec2 extent = texelMax - texelMin + 1;
+    int level = int(ceil(log2(float(max(extent.x, extent.y)))));
+    level = min(level, hiz_levels - 1);
+
+    // The levels are rounded down, with an odd size the last texel of a level also covers
+    // the texels left over below it (see C_HiZ). Texel coordinates follow that, uv doesn't
+    ivec2 lastTexel = textureSize(hiz, level) - 1;
+    ivec2 levelMin = min(texelMin >> level, lastTexel);
+    ivec2 levelMax = min(texelMax >> level, lastTexel);
+
+    float farthest = max(max(texelFetch(hiz, levelMin, level).r, texelFetch(hiz, ivec2(levelMax.x, levelMin.y), level).r),
+                         max(texelFetch(hiz, ivec2(levelMin.x, levelMax.y), level).r, texelFetch(hiz, levelMax, level).r));
+
+    return nearestDepth > farthest;
+}
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= instance_count) return;
+
+    Instance instance = instances[index];
+    vec3 center = instance.sphere.xyz;
+    float radius = instance.sphere.w;
+
+    if (radius >= 0.0)
+    {
+        if (!InsideFrustum(center, radius)) return;
+        if (occlusion_enabled == 1 && Occluded(center, radius)) return;
+    }
+
+    Batch batch = batches[instance.batch];
+    uint slot = atomicAdd(commands[batch.firstCommand].instanceCount, 1u);
+    visible[batch.firstInstance + slot] = index;
+
+    for (uint c = 1u; c < batch.commandCount; c++) {
+        atomicMax(commands[batch.firstCommand + c].instanceCount, slot + 1u);
+    }
+}
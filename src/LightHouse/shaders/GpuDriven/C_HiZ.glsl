@@ -0,0 +1,50 @@
+#version 430
+
+// One level of the depth pyramid: a copy of the depth buffer for level 0,
+// the farthest of the texels below for the others
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// Uniforms
+layout(binding = 0) uniform sampler2D depth_texture;
+layout(binding = 0, r32f) readonly uniform image2D source;
+layout(binding = 1, r32f) writeonly uniform image2D destination;
+
+uniform int copy_depth;
+uniform ivec2 source_size;
+uniform ivec2 destination_size;
+
+float LoadSource(ivec2 texel)
+{
+    return imageLoad(source, min(texel, source_size - 1)).r;
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, destination_size))) return;
+
+    if (copy_depth == 1)
+    {
+        imageStore(destination, texel, vec4(texelFetch(depth_texture, texel, 0).r));
+        return;
+    }
+
+    ivec2 base = texel * 2;
+    float depth = max(max(LoadSource(base), LoadSource(base + ivec2(1, 0))),
+                      max(LoadSource(base + ivec2(0, 1)), LoadSource(base + ivec2(1, 1))));
+
+    // With an odd source size the last row and column also cover the texels left over
+    bool extraColumn = (source_size.x & 1) != 0 && texel.x == destination_size.x - 1;
+    bool extraRow = (source_size.y & 1) != 0 && texel.y == destination_size.y - 1;
+    if (extraColumn) {
+        depth = max(depth, max(LoadSource(base + ivec2(2, 0)), LoadSource(base + ivec2(2, 1))));
+    }
+    if (extraRow) {
+        depth = max(depth, max(LoadSource(base + ivec2(0, 2)), LoadSource(base + ivec2(1, 2))));
+    }
+    if (extraColumn && extraRow) {
+        depth = max(depth, LoadSource(base + ivec2(2, 2)));
+    }
+
+    imageStore(destination, texel, vec4(depth));
+}
@@ -0,0 +1,45 @@
+#version 430
+
+// Input
+layout(location = 0) in vec3 v_position;
+layout(location = 1) in vec3 v_normal;
+layout(location = 2) in vec2 v_texture_coord;
+layout(location = 3) in vec3 v_objectColor;
+layout(location = 8) in uint instance_index;   // Visible instance, per instance from the list written by C_Cull
+
+// Instances of the GPU driven scene, same layout as in C_Cull
+struct Instance
+{
+    mat4 model;
+    vec4 sphere;
+    uint batch;
+};
+
+layout(std430, binding = 0) readonly buffer Instances
+{
+    Instance instances[];
+};
+
+// Uniforms
+uniform mat4 View;
+uniform mat4 Projection;
+
+// Output
+out vec2 texCoords;
+out vec3 fragObjectColor;
+
+out vec3 world_position;
+out vec3 world_normal;
+
+void main()
+{
+    mat4 Model = instances[instance_index].model;
+
+    world_position = (Model * vec4(v_position, 1)).xyz;
+    world_normal = normalize(mat3(Model) * normalize(v_normal));
+
+    texCoords = v_texture_coord;
+    fragObjectColor = v_objectColor;
+
+    gl_Position = Projection * View * vec4(world_position, 1.0);
+}
@@ -0,0 +1,45 @@
+#version 430
+
+// Indirect arguments of the particle system, a single invocation.
+// Stage 0 runs before the simulation: one group per live particle of the
+// source buffer and an empty destination. Stage 1 runs after the emission:
+// the destination is drawn, its count clamped to the capacity.
+layout(local_size_x = 1) in;
+
+// Same layout as GpuParticles
+layout(std430, binding = 3) buffer State
+{
+    uint live_count[2];         // Particles in each buffer
+    uint dispatch_args[3];      // Simulation of the source buffer
+    uint draw_args[4];          // Points of the destination buffer
+};
+
+// Uniforms
+uniform int stage;
+uniform uint source;            // Buffer written by the last step
+uniform uint capacity;
+
+const uint GROUP_SIZE = 256u;   // Work group of C_ParticleSimulate
+
+
+void main()
+{
+    uint destination = 1u - source;
+
+    if (stage == 0)
+    {
+        dispatch_args[0] = (live_count[source] + GROUP_SIZE - 1u) / GROUP_SIZE;
+        dispatch_args[1] = 1u;
+        dispatch_args[2] = 1u;
+        live_count[destination] = 0u;
+    }
+    else
+    {
+        // The emission counts the particles it had no room for too
+        live_count[destination] = min(live_count[destination], capacity);
+        draw_args[0] = live_count[destination];
+        draw_args[1] = 1u;
+        draw_args[2] = 0u;
+        draw_args[3] = 0u;
+    }
+}
@@ -0,0 +1,101 @@
+#version 430
+
+// Appends the particles emitted during the step to the destination buffer,
+// after the ones the simulation kept. Each emitter owns a range of the
+// invocations, set by GpuParticles from its rate.
+layout(local_size_x = 256) in;
+
+// Same layouts as GpuParticles
+struct Particle
+{
+    vec3 position;
+    float age;
+    vec3 velocity;
+    uint emitter;
+};
+
+struct Emitter
+{
+    vec4 position;
+    vec4 velocity;
+    vec4 color;
+    vec4 motion;
+    uint first_spawn;
+    uint spawn_count;
+    uint padding[2];
+};
+
+layout(std430, binding = 1) writeonly buffer Destination { Particle destination_particles[]; };
+layout(std430, binding = 2) readonly buffer Emitters { Emitter emitters[]; };
+layout(std430, binding = 3) buffer State
+{
+    uint live_count[2];
+    uint dispatch_args[3];
+    uint draw_args[4];
+};
+
+// Uniforms
+uniform uint source;
+uniform uint capacity;
+uniform uint spawn_total;
+uniform uint emitter_count;
+uniform uint frame_seed;
+uniform float delta_time;
+
+
+// PCG hash, https://www.reedbeta.com/blog/hash-functions-for-gpu-rendering/
+uint Hash(uint value)
+{
+    uint state = value * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+
+// Uniform in [0, 1], advances the seed
+float Random(inout uint seed)
+{
+    seed = Hash(seed);
+    return float(seed) / 4294967295.0;
+}
+
+
+vec3 RandomSigned(inout uint seed)
+{
+    return vec3(Random(seed), Random(seed), Random(seed)) * 2.0 - 1.0;
+}
+
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= spawn_total)
+    {
+        return;
+    }
+
+    // Emitter whose range holds the invocation, there are only a few
+    uint e = 0u;
+    while (e + 1u < emitter_count && index >= emitters[e].first_spawn + emitters[e].spawn_count)
+    {
+        e++;
+    }
+
+    // A full buffer drops the new particles, the count is clamped by C_ParticleArgs
+    uint slot = atomicAdd(live_count[1u - source], 1u);
+    if (slot >= capacity)
+    {
+        return;
+    }
+
+    Emitter emitter = emitters[e];
+    uint seed = Hash(index ^ Hash(frame_seed));
+
+    Particle particle;
+    particle.position = emitter.position.xyz + RandomSigned(seed) * emitter.motion.w;
+    particle.velocity = emitter.velocity.xyz + RandomSigned(seed) * emitter.position.w;
+    // Spread over the step, a steady rate doesn't emit in sheets
+    particle.age = Random(seed) * delta_time;
+    particle.emitter = e;
+    destination_particles[slot] = particle;
+}
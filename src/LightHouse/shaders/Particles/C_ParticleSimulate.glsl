@@ -0,0 +1,67 @@
+#version 430
+
+// Ages and moves the live particles of the source buffer. The ones still
+// alive are appended to the destination buffer, the dead ones are dropped,
+// so the live particles always fill the start of a buffer.
+layout(local_size_x = 256) in;
+
+// Same layouts as GpuParticles
+struct Particle
+{
+    vec3 position;
+    float age;                  // Seconds since the emission
+    vec3 velocity;
+    uint emitter;
+};
+
+struct Emitter
+{
+    vec4 position;              // Center, random start velocity on each axis (w)
+    vec4 velocity;              // Mean start velocity, lifetime in seconds (w)
+    vec4 color;                 // Alpha scales the additive contribution
+    vec4 motion;                // Size, gravity, drag, radius of the emission cube
+    uint first_spawn;
+    uint spawn_count;
+    uint padding[2];
+};
+
+layout(std430, binding = 0) readonly buffer Source { Particle source_particles[]; };
+layout(std430, binding = 1) writeonly buffer Destination { Particle destination_particles[]; };
+layout(std430, binding = 2) readonly buffer Emitters { Emitter emitters[]; };
+layout(std430, binding = 3) buffer State
+{
+    uint live_count[2];
+    uint dispatch_args[3];
+    uint draw_args[4];
+};
+
+// Uniforms
+uniform uint source;
+uniform float delta_time;
+
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= live_count[source])
+    {
+        return;
+    }
+
+    Particle particle = source_particles[index];
+    Emitter emitter = emitters[particle.emitter];
+
+    particle.age += delta_time;
+    if (particle.age >= emitter.velocity.w)
+    {
+        return;
+    }
+
+    // Gravity, then drag as the fraction of the velocity lost per second
+    particle.velocity.y -= emitter.motion.y * delta_time;
+    particle.velocity *= max(1.0 - emitter.motion.z * delta_time, 0.0);
+    particle.position += particle.velocity * delta_time;
+
+    uint slot = atomicAdd(live_count[1u - source], 1u);
+    destination_particles[slot] = particle;
+}
@@ -0,0 +1,22 @@
+#version 430
+
+// Input
+in vec4 particle_color;
+
+// Output
+layout(location = 0) out vec4 out_color;
+
+
+void main()
+{
+    // Round and soft, from the center of the point to its edge
+    vec2 offset = gl_PointCoord * 2.0 - 1.0;
+    float falloff = 1.0 - dot(offset, offset);
+    if (falloff <= 0.0)
+    {
+        discard;
+    }
+
+    // Added to the scene, the alpha of the target is left alone
+    out_color = vec4(particle_color.rgb * particle_color.a * falloff, 0.0);
+}
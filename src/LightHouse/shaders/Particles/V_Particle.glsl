@@ -0,0 +1,53 @@
+#version 430
+
+// Draws the live particles as points, the vertex is the index of the
+// particle. Nothing is bound as vertex attributes.
+
+// Same layouts as GpuParticles
+struct Particle
+{
+    vec3 position;
+    float age;
+    vec3 velocity;
+    uint emitter;
+};
+
+struct Emitter
+{
+    vec4 position;
+    vec4 velocity;
+    vec4 color;
+    vec4 motion;
+    uint first_spawn;
+    uint spawn_count;
+    uint padding[2];
+};
+
+layout(std430, binding = 0) readonly buffer Particles { Particle particles[]; };
+layout(std430, binding = 2) readonly buffer Emitters { Emitter emitters[]; };
+
+// Uniforms
+uniform mat4 View;
+uniform mat4 Projection;
+uniform float viewport_height;
+
+// Output
+out vec4 particle_color;
+
+
+void main()
+{
+    Particle particle = particles[gl_VertexID];
+    Emitter emitter = emitters[particle.emitter];
+
+    vec4 view_position = View * vec4(particle.position, 1.0);
+    gl_Position = Projection * view_position;
+
+    // World size to pixels, Projection[1][1] is the cotangent of half the vertical field of view
+    float depth = max(-view_position.z, 0.01);
+    gl_PointSize = max(emitter.motion.x * Projection[1][1] * 0.5 * viewport_height / depth, 1.0);
+
+    // Fades in quickly and out over the rest of its life
+    float life = particle.age / emitter.velocity.w;
+    particle_color = vec4(emitter.color.rgb, emitter.color.a * smoothstep(0.0, 0.1, life) * (1.0 - life));
+}
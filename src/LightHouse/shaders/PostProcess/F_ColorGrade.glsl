@@ -0,0 +1,22 @@
+#version 330
+
+// Input texture coordinates
+in vec2 texCoords;
+
+// Scene color rendered by the scene pass
+uniform sampler2D scene_color;
+// Graded color of every input color, computed on the CPU
+uniform sampler3D color_lut;
+uniform float lut_size;         // Entries along each axis
+
+// Output fragment color
+out vec4 fragColor;
+
+void main()
+{
+    vec4 color = texture(scene_color, texCoords);
+
+    // Inputs of 0 and 1 land on the centers of the first and last entries
+    vec3 coords = clamp(color.rgb, 0.0, 1.0) * ((lut_size - 1.0) / lut_size) + 0.5 / lut_size;
+    fragColor = vec4(texture(color_lut, coords).rgb, color.a);
+}
@@ -0,0 +1,18 @@
+#version 330
+
+// Input texture coordinates
+in vec2 texCoords;
+
+// Scene color and depth rendered by the scene pass
+uniform sampler2D scene_color;
+uniform sampler2D scene_depth;
+
+// Output fragment color
+out vec4 fragColor;
+
+void main()
+{
+    fragColor = texture(scene_color, texCoords);
+    // Keeps the depth so later passes on the screen are still depth tested against the scene
+    gl_FragDepth = texture(scene_depth, texCoords).r;
+}
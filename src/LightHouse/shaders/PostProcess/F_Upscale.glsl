@@ -0,0 +1,39 @@
+#version 330
+
+// Input texture coordinates
+in vec2 texCoords;
+
+// Scene color and depth rendered below the window resolution
+uniform sampler2D scene_color;
+uniform sampler2D scene_depth;
+uniform vec2 source_size;       // Size of the scene targets in pixels
+uniform float sharpness;        // 0 (none) to 1 (strongest)
+
+// Output fragment color
+out vec4 fragColor;
+
+// Bilinear upscale followed by contrast adaptive sharpening: the neighbours
+// are subtracted with a weight that shrinks where the local contrast is high,
+// so flat areas get their detail back and hard edges don't ring.
+void main()
+{
+    vec2 texel = 1.0 / source_size;
+
+    vec4 center = texture(scene_color, texCoords);
+    vec3 north = texture(scene_color, texCoords + vec2(0.0, texel.y)).rgb;
+    vec3 south = texture(scene_color, texCoords - vec2(0.0, texel.y)).rgb;
+    vec3 east = texture(scene_color, texCoords + vec2(texel.x, 0.0)).rgb;
+    vec3 west = texture(scene_color, texCoords - vec2(texel.x, 0.0)).rgb;
+
+    vec3 minimum = min(center.rgb, min(min(north, south), min(east, west)));
+    vec3 maximum = max(center.rgb, max(max(north, south), max(east, west)));
+
+    vec3 amplitude = sqrt(clamp(min(minimum, 2.0 - maximum) / max(maximum, vec3(1e-4)), 0.0, 1.0));
+    vec3 weight = amplitude * (-1.0 / mix(8.0, 5.0, sharpness));
+
+    vec3 color = (center.rgb + (north + south + east + west) * weight) / (1.0 + 4.0 * weight);
+    fragColor = vec4(clamp(color, 0.0, 1.0), center.a);
+
+    // Depth isn't filtered, the depth target samples the nearest pixel
+    gl_FragDepth = texture(scene_depth, texCoords).r;
+}
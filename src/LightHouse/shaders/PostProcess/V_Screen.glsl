@@ -0,0 +1,12 @@
+#version 330
+
+// Output texture coordinates for fragment shader
+out vec2 texCoords;
+
+void main()
+{
+    // One triangle covering the screen, no vertex buffer needed
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    texCoords = position;
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,17 @@
+#version 330
+
+// Input
+in vec2 texCoords;
+
+// Uniform
+uniform sampler2D textures[1];      // First texture of the object, for the alpha test
+uniform int numTextures;
+
+void main()
+{
+    // Same cut out as the scene shader, so leaves cast leaf shaped shadows
+    if (numTextures > 0 && texture(textures[0], texCoords).a < 0.1)
+    {
+        discard;
+    }
+}
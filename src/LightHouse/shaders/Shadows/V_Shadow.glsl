@@ -0,0 +1,18 @@
+#version 330
+
+// Input
+layout(location = 0) in vec3 v_position;
+layout(location = 2) in vec2 v_texture_coord;
+
+// Uniforms
+uniform mat4 Model;
+uniform mat4 LightViewProjection;
+
+// Output texture coordinates for the alpha test
+out vec2 texCoords;
+
+void main()
+{
+    texCoords = v_texture_coord;
+    gl_Position = LightViewProjection * Model * vec4(v_position, 1.0);
+}
@@ -0,0 +1,26 @@
+#version 330
+
+// Input
+layout(location = 0) in vec3 v_position;
+layout(location = 2) in vec2 v_texture_coord;
+
+// Uniforms
+uniform mat4 Model;
+uniform mat4 LightViewProjection;
+
+/// HEIGHTMAP TEXTURE
+uniform sampler2D heightMap;
+
+// Output texture coordinates for the alpha test
+out vec2 texCoords;
+
+void main()
+{
+    texCoords = v_texture_coord;
+
+    // Same displacement as V_Moutain.glsl, without the waves that are too small to cast shadows
+    float vertex_height = texture(heightMap, texCoords).r;
+    vec3 position = v_position * vec3(2.0, 1.0, 2.0) + vec3(0.0, vertex_height * 5, 0.0);
+
+    gl_Position = LightViewProjection * Model * vec4(position, 1.0);
+}
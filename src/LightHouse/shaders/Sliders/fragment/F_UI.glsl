@@ -0,0 +1,87 @@
+#version 330
+
+// Widget types, see LightHouse::RenderSliders
+#define WIDGET_SOLID        0
+#define WIDGET_HUE          1
+#define WIDGET_SATURATION   2
+#define WIDGET_VALUE        3
+
+// Input from the vertex shader
+in vec2 local;
+in vec3 color;
+flat in int widget;
+
+// Screen resolution
+uniform vec2 u_resolution;
+
+// Output fragment color
+out vec4 fragColor;
+
+// White & Black colors
+const vec3 white = vec3(1.0);
+const vec3 black = vec3(0.0);
+
+vec3 hsv2rgb(vec3 c)
+{
+    // Convert HSV color to RGB color - rainbow 6 sectors effect
+
+    // constants for color conversion
+    vec4 K = vec4(1.0, 2.0 / 3.0, 1.0 / 3.0, 3.0);
+
+    //      p based on the hue value (c.x) and constants in K
+    // Creates repeating pattern as hue changes, scaled and mirrored
+    //              it can fit within [0,1]
+    vec3 p = abs(fract(c.xxx + K.xyz) * 6.0 - K.www);
+
+    //      c.z - represents the value (brightness)
+    // Mixes colors and clamps them to create the final RGB color
+    //              it can fit within [0,1]
+    return c.z * mix(K.xxx, clamp(p - K.xxx, 0.0, 1.0), c.y);
+}
+
+// Black to color, then color to white, with a smooth gradient
+vec3 SaturationGradient(float position)
+{
+    if (position < 0.75)
+    {
+        return mix(black, color, smoothstep(0.0, 0.5, position));
+    }
+    return mix(color, white, smoothstep(0.5, 1.0, position));
+}
+
+// Black to color, then color to white, with a linear gradient
+vec3 ValueGradient(float position)
+{
+    if (position < 0.5)
+    {
+        return mix(black, color, position * 2.0);
+    }
+    return mix(color, white, (position - 0.5) * 2.0);
+}
+
+void main()
+{
+    // Gradients of the saturation and value bars follow the horizontal screen position
+    float position = gl_FragCoord.x / u_resolution.x;
+    vec3 result;
+
+    if (widget == WIDGET_HUE)
+    {
+        // Fully saturated and has full brightness, the rainbow spans the bar
+        result = hsv2rgb(vec3(local.x, 1.0, 1.0));
+    }
+    else if (widget == WIDGET_SATURATION)
+    {
+        result = SaturationGradient(position);
+    }
+    else if (widget == WIDGET_VALUE)
+    {
+        result = ValueGradient(position);
+    }
+    else
+    {
+        result = color;
+    }
+
+    fragColor = vec4(result, 1.0);
+}
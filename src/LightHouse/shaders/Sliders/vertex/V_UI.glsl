@@ -0,0 +1,23 @@
+#version 330
+
+// Input vertex of a UI quad
+layout (location = 0) in vec2 v_position;   // Screen position
+layout (location = 1) in vec2 v_local;      // Position inside the quad [0,1]
+layout (location = 2) in vec3 v_color;
+layout (location = 3) in float v_widget;
+
+// Orthographic projection of the screen
+uniform mat4 Projection;
+
+// Output for fragment shader
+out vec2 local;
+out vec3 color;
+flat out int widget;
+
+void main()
+{
+    local = v_local;
+    color = v_color;
+    widget = int(v_widget + 0.5);
+    gl_Position = Projection * vec4(v_position, 0.0, 1.0);
+}
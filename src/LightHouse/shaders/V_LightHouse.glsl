@@ -3,7 +3,16 @@
 layout(location = 0) in vec3 v_position;
 layout(location = 2) in vec2 v_texture_coord;
 
-uniform mat4 Model;
+// Values of the draw, bound as a range of the per draw ring buffer
+layout(std140) uniform PerDraw
+{
+    mat4 Model;
+    vec3 objectColor;            // Object color if no textures are used
+    int numTextures;             // The actual number of textures used
+    float mix_factors[9];        // Mix factors for blending textures
+    ivec4 texture_layers[2];     // Layer of material_layers for textures 0 to 7, -1 when read from textures[i]
+};
+
 uniform mat4 View;
 uniform mat4 Projection;
 
@@ -0,0 +1,117 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "core/jobs/job_system.h"
+#include "core/scene/transform_system.h"
+#include "utils/math_utils.h"
+
+
+// Scaling of JobSystem::ParallelFor on a 10M node transform update. The
+// nodes are all roots, so TransformSystem::Update() is a single ParallelFor
+// over the whole array. The update is timed with 1 thread, then with twice
+// as many threads up to the hardware threads, and every speedup is checked
+// against the thread count.
+//
+// Usage: ParallelForBenchmark [max threads] [frames]
+// Returns 1 when a thread count with its own hardware thread scales below MIN_EFFICIENCY.
+// MIN_EFFICIENCY is the target, not a measured result: no multi-core run has been
+// recorded yet. With a single hardware thread nothing is checked and the run says so.
+
+namespace
+{
+    const unsigned int NODES = 10000000;
+
+    // Speedup over 1 thread divided by the thread count, below this the scaling is reported as failed.
+    // Expected for this embarrassingly parallel update, still to be confirmed on a multi-core machine
+    const double MIN_EFFICIENCY = 0.7;
+
+
+    // Every node gets a new local TRS, so the next Update() recomputes all of them
+    void Animate(TransformSystem &system, unsigned int frame)
+    {
+        const glm::quat rotation = glm::angleAxis(frame * 0.01f, glm::vec3(0, 1, 0));
+        for (unsigned int i = 0; i < NODES; i++)
+            system.SetLocalTRS(i, glm::vec3(static_cast<float>(i % 1024), static_cast<float>(frame), 0), rotation, glm::vec3(1));
+    }
+
+
+    // Milliseconds of the fastest update, the slower ones were disturbed by something else
+    double TimeUpdate(TransformSystem &system, unsigned int threads, unsigned int frames)
+    {
+        JobSystem::Init(threads - 1);
+
+        double best = 0;
+        for (unsigned int frame = 0; frame < frames; frame++)
+        {
+            Animate(system, frame);
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            system.Update();
+            double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            best = frame == 0 ? milliseconds : MIN(best, milliseconds);
+        }
+
+        JobSystem::Shutdown();
+        return best;
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    const unsigned int hardwareThreads = MAX(std::thread::hardware_concurrency(), 1u);
+    const unsigned int maxThreads = argc > 1 ? static_cast<unsigned int>(MAX(atoi(argv[1]), 1)) : hardwareThreads;
+    const unsigned int frames = argc > 2 ? static_cast<unsigned int>(MAX(atoi(argv[2]), 1)) : 5;
+
+    TransformSystem system;
+    for (unsigned int i = 0; i < NODES; i++)
+        system.Create();
+
+    std::vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    std::cout << NODES << " nodes, " << hardwareThreads << " hardware threads, best of " << frames << " updates" << std::endl;
+
+    bool scales = true;
+    unsigned int checked = 0;
+    double serial = 0;
+    for (unsigned int threads : threadCounts)
+    {
+        const double milliseconds = TimeUpdate(system, threads, frames);
+        if (threads == 1)
+            serial = milliseconds;
+
+        const double speedup = serial / milliseconds;
+        const double efficiency = speedup / threads;
+        std::cout << threads << " threads  " << milliseconds << " ms  speedup " << speedup << "x  efficiency " << efficiency;
+
+        // More threads than the hardware runs at once can't scale, they are only shown
+        if (threads > hardwareThreads)
+        {
+            std::cout << "  (not checked, more threads than hardware threads)";
+        }
+        else if (threads > 1)
+        {
+            checked++;
+            if (efficiency < MIN_EFFICIENCY)
+            {
+                std::cout << "  below " << MIN_EFFICIENCY;
+                scales = false;
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    // The world matrices were computed, and by every part of the range
+    const glm::vec3 last = system.GetWorldPosition(NODES - 1);
+    std::cout << "Last node at " << last.x << " " << last.y << " " << last.z << std::endl;
+
+    if (checked == 0)
+        std::cout << "Scaling not checked, it needs more than one hardware thread" << std::endl;
+    return scales ? 0 : 1;
+}
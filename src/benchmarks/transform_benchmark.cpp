@@ -0,0 +1,123 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "components/transform.h"
+#include "core/scene/transform_system.h"
+#include "utils/math_utils.h"
+
+
+// Updates the same animated hierarchy through TransformSystem and through
+// gfxc::Transform: every frame all the nodes get a new local position and
+// rotation, then the world matrix of every node is read. The job system is
+// not started, so both run on the calling thread.
+//
+// Usage: TransformBenchmark [frames]
+
+namespace
+{
+    // 1000 roots, 9 children per root, 10 children per child: 100000 nodes
+    const unsigned int ROOTS = 1000;
+    const unsigned int CHILDREN = 9;
+    const unsigned int GRANDCHILDREN = 10;
+
+    struct Hierarchy
+    {
+        std::vector<int> parents;   // Parents before their children, -1 for the roots
+    };
+
+
+    Hierarchy BuildHierarchy()
+    {
+        Hierarchy hierarchy;
+        for (unsigned int i = 0; i < ROOTS; i++)
+            hierarchy.parents.push_back(-1);
+        for (unsigned int i = 0; i < ROOTS * CHILDREN; i++)
+            hierarchy.parents.push_back(i / CHILDREN);
+        for (unsigned int i = 0; i < ROOTS * CHILDREN * GRANDCHILDREN; i++)
+            hierarchy.parents.push_back(ROOTS + i / GRANDCHILDREN);
+        return hierarchy;
+    }
+
+
+    glm::vec3 GetPosition(unsigned int node, unsigned int frame)
+    {
+        const float t = frame * 0.016f + node * 0.37f;
+        return glm::vec3(std::sin(t), 0.1f * (node % 7), std::cos(t));
+    }
+
+
+    glm::quat GetRotation(unsigned int node, unsigned int frame)
+    {
+        return glm::angleAxis(frame * 0.01f + node * 0.13f, glm::vec3(0, 1, 0));
+    }
+
+
+    double GetMilliseconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    const unsigned int frames = argc > 1 ? static_cast<unsigned int>(MAX(atoi(argv[1]), 1)) : 20;
+    const Hierarchy hierarchy = BuildHierarchy();
+    const unsigned int count = static_cast<unsigned int>(hierarchy.parents.size());
+
+    TransformSystem system;
+    std::vector<TransformHandle> handles(count);
+    for (unsigned int i = 0; i < count; i++)
+        handles[i] = system.Create(hierarchy.parents[i] < 0 ? INVALID_TRANSFORM : handles[hierarchy.parents[i]]);
+
+    std::vector<gfxc::Transform> transforms(count);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (hierarchy.parents[i] >= 0)
+            transforms[hierarchy.parents[i]].AddChild(&transforms[i]);
+    }
+
+    // Summed world translations, reading the matrices keeps the work from being optimized out
+    float systemSum = 0, transformSum = 0;
+    double systemTime = 0, transformTime = 0;
+
+    // The animation of a frame is computed before timing either update
+    std::vector<glm::vec3> positions(count);
+    std::vector<glm::quat> rotations(count);
+
+    for (unsigned int frame = 0; frame < frames; frame++)
+    {
+        for (unsigned int i = 0; i < count; i++)
+        {
+            positions[i] = GetPosition(i, frame);
+            rotations[i] = GetRotation(i, frame);
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < count; i++)
+            system.SetLocalTRS(handles[i], positions[i], rotations[i], glm::vec3(1));
+        system.Update();
+        for (unsigned int i = 0; i < count; i++)
+            systemSum += system.GetWorldMatrix(handles[i])[3].x;
+        systemTime += GetMilliseconds(start);
+
+        start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < count; i++)
+        {
+            transforms[i].SetLocalPosition(positions[i]);
+            transforms[i].SetReleativeRotation(rotations[i]);
+        }
+        for (unsigned int i = 0; i < count; i++)
+            transformSum += transforms[i].GetModel()[3].x;
+        transformTime += GetMilliseconds(start);
+    }
+
+    std::cout << count << " nodes, " << frames << " frames" << std::endl;
+    std::cout << "TransformSystem  " << systemTime / frames << " ms per frame (sum " << systemSum << ")" << std::endl;
+    std::cout << "gfxc::Transform  " << transformTime / frames << " ms per frame (sum " << transformSum << ")" << std::endl;
+    std::cout << "Speedup          " << transformTime / MAX(systemTime, 1e-6) << "x" << std::endl;
+    return 0;
+}
@@ -16,17 +16,22 @@ void gfxc::CameraInput::OnInputUpdate(float deltaTime, int mods)
 {
     if (!window->MouseHold(GLFW_MOUSE_BUTTON_RIGHT)) return;
 
+    float speed = 1;
     if (window->GetSpecialKeyState() & GLFW_MOD_SHIFT)
     {
+        speed = 2;
         deltaTime *= 2;
     }
 
-    if (window->KeyHold(GLFW_KEY_W))            camera->MoveForward(deltaTime);
-    if (window->KeyHold(GLFW_KEY_S))            camera->MoveBackward(deltaTime);
-    if (window->KeyHold(GLFW_KEY_A))            camera->MoveLeft(deltaTime);
-    if (window->KeyHold(GLFW_KEY_D))            camera->MoveRight(deltaTime);
-    if (window->KeyHold(GLFW_KEY_Q))            camera->MoveDown(deltaTime);
-    if (window->KeyHold(GLFW_KEY_E))            camera->MoveUp(deltaTime);
+    // Moves for the time each key was held during the frame, not the whole frame
+    auto held = [this, speed](int key) { return speed * window->GetKeyHoldTime(key); };
+
+    if (held(GLFW_KEY_W) > 0)                   camera->MoveForward(held(GLFW_KEY_W));
+    if (held(GLFW_KEY_S) > 0)                   camera->MoveBackward(held(GLFW_KEY_S));
+    if (held(GLFW_KEY_A) > 0)                   camera->MoveLeft(held(GLFW_KEY_A));
+    if (held(GLFW_KEY_D) > 0)                   camera->MoveRight(held(GLFW_KEY_D));
+    if (held(GLFW_KEY_Q) > 0)                   camera->MoveDown(held(GLFW_KEY_Q));
+    if (held(GLFW_KEY_E) > 0)                   camera->MoveUp(held(GLFW_KEY_E));
 
     if (window->KeyHold(GLFW_KEY_KP_MULTIPLY))  camera->UpdateSpeed();
     if (window->KeyHold(GLFW_KEY_KP_DIVIDE))    camera->UpdateSpeed(-0.2f);
@@ -8,17 +8,86 @@
 ******************************************************************/
 #include "components/text_renderer.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 
 #include "utils/text_utils.h"
 #include "glm/gtc/matrix_transform.hpp"
 #include "core/managers/resource_path.h"
+#include "core/gpu/render_stats.h"
 
 #include "ft2build.h"
 #include FT_FREETYPE_H
 
 
-gfxc::TextRenderer::TextRenderer(const std::string &selfDir, GLuint width, GLuint height)
+namespace
+{
+    const unsigned int NO_GLYPH = 0xFFFFFFFF;
+    const float FAR_DISTANCE = 1e20f;
+
+
+    // Squared distance transform of one row or column (Felzenszwalb and
+    // Huttenlocher): lower envelope of the parabolas rooted at each sample
+    void DistanceTransform1D(const float *f, float *d, int n, int *v, float *z)
+    {
+        int k = 0;
+        v[0] = 0;
+        z[0] = -FAR_DISTANCE;
+        z[1] = FAR_DISTANCE;
+
+        for (int q = 1; q < n; q++)
+        {
+            float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+            while (s <= z[k])
+            {
+                k--;
+                s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+            }
+            k++;
+            v[k] = q;
+            z[k] = s;
+            z[k + 1] = FAR_DISTANCE;
+        }
+
+        k = 0;
+        for (int q = 0; q < n; q++)
+        {
+            while (z[k + 1] < q) k++;
+            d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+        }
+    }
+
+
+    // In place: 0 on the seed pixels, FAR_DISTANCE elsewhere becomes the squared distance to the nearest seed
+    void DistanceTransform2D(std::vector<float> &grid, int width, int height)
+    {
+        const int n = std::max(width, height);
+        std::vector<float> f(n), d(n), z(n + 1);
+        std::vector<int> v(n);
+
+        for (int x = 0; x < width; x++)
+        {
+            for (int y = 0; y < height; y++) f[y] = grid[y * width + x];
+            DistanceTransform1D(f.data(), d.data(), height, v.data(), z.data());
+            for (int y = 0; y < height; y++) grid[y * width + x] = d[y];
+        }
+
+        for (int y = 0; y < height; y++)
+        {
+            DistanceTransform1D(&grid[y * width], d.data(), width, v.data(), z.data());
+            std::copy(d.begin(), d.begin() + width, grid.begin() + y * width);
+        }
+    }
+}
+
+
+gfxc::TextRenderer::TextRenderer(const std::string &selfDir, GLuint width, GLuint height, GLuint atlasSize)
+    : VAO(0), VBO(0), atlasTexture(0), atlasSize(atlasSize), cellSize(2 * SDF_SIZE), cellsPerRow(0),
+      fontSize(static_cast<GLfloat>(SDF_SIZE)), baseline(0), bufferCapacity(0), frame(0), residentGlyphs(0),
+      evictions(0), library(nullptr), face(nullptr), quit(false)
 {
     // Load and configure shader
     Shader *shader = new Shader("ShaderText");
@@ -27,163 +96,445 @@ gfxc::TextRenderer::TextRenderer(const std::string &selfDir, GLuint width, GLuin
     shader->CreateAndLink();
     this->m_textShader = shader;
 
-    
-    int loc_projection_matrix = glGetUniformLocation(shader->program, "projection");
-    glUniformMatrix4fv(loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(glm::ortho(0.0f, static_cast<GLfloat>(width), static_cast<GLfloat>(height), 0.0f)));
-
-    int loc_text = glGetUniformLocation(shader->program, "text");
-    glUniform1i(loc_text, 0);
+    SetViewport(width, height);
 
-    // Configure VAO/VBO for texture quads
+    // Configure VAO/VBO for the text quads, the buffer is sized on the first flush
     glGenVertexArrays(1, &this->VAO);
     glGenBuffers(1, &this->VBO);
     glBindVertexArray(this->VAO);
     glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), 0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, color));
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+
+    // Atlas of fixed cells, each large enough for a glyph and its distance border
+    cellsPerRow = atlasSize / cellSize;
+    std::vector<unsigned char> zeros(atlasSize * atlasSize, 0);
+
+    glGenTextures(1, &atlasTexture);
+    glBindTexture(GL_TEXTURE_2D, atlasTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlasSize, atlasSize, 0, GL_RED, GL_UNSIGNED_BYTE, zeros.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+gfxc::TextRenderer::~TextRenderer()
+{
+    StopWorker();
+    CloseFont();
+
+    if (atlasTexture) glDeleteTextures(1, &atlasTexture);
+    if (VBO) glDeleteBuffers(1, &VBO);
+    if (VAO) glDeleteVertexArrays(1, &VAO);
+    delete m_textShader;
+}
+
+
+void gfxc::TextRenderer::SetViewport(GLuint width, GLuint height)
+{
+    m_textShader->Use();
+
+    int loc_projection_matrix = glGetUniformLocation(m_textShader->program, "projection");
+    glUniformMatrix4fv(loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(glm::ortho(0.0f, static_cast<GLfloat>(width), static_cast<GLfloat>(height), 0.0f)));
+
+    int loc_text = glGetUniformLocation(m_textShader->program, "text");
+    glUniform1i(loc_text, 0);
 }
 
 
 void gfxc::TextRenderer::Load(std::string font, GLuint fontSize)
 {
-    // First clear the previously loaded Characters
-    this->Characters.clear();
+    // The glyphs of the previous font are dropped with their cells
+    StopWorker();
+    CloseFont();
+
+    for (auto &glyph : asciiGlyphs) {
+        glyph = Glyph();
+        glyph.cell = -1;
+    }
+    glyphs.clear();
+    vertices.clear();
+    waiting.clear();
+    requests.clear();
+    finished.clear();
+
+    const unsigned int cellCount = cellsPerRow * cellsPerRow;
+    cellOwners.assign(cellCount, NO_GLYPH);
+    freeCells.resize(cellCount);
+    for (unsigned int i = 0; i < cellCount; i++) {
+        freeCells[i] = static_cast<int>(cellCount - 1 - i);
+    }
+    residentGlyphs = 0;
+
+    this->fontPath = font;
+    this->fontSize = static_cast<GLfloat>(fontSize);
 
     // Initialize and load the freetype library. All freetype functions
     // return a value different than 0 whenever an error occurs.
-    FT_Library ft;
-
-    if (FT_Init_FreeType(&ft))
+    if (FT_Init_FreeType(&library))
     {
         std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
+        library = nullptr;
+        return;
     }
 
     // Load font as face
-    FT_Face face;
-    if (FT_New_Face(ft, font.c_str(), 0, &face))
+    if (FT_New_Face(library, font.c_str(), 0, &face))
     {
         std::cout << "ERROR::FREETYPE: Failed to load font" << std::endl;
+        CloseFont();
+        return;
     }
 
-    // Set size to load glyphs as
-    FT_Set_Pixel_Sizes(face, 0, fontSize);
+    // Metrics are read at the size the distance fields are made at
+    FT_Set_Pixel_Sizes(face, 0, SDF_SIZE);
 
-    // Disable byte-alignment restriction
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    baseline = 0;
+    if (!FT_Load_Char(face, 'H', FT_LOAD_DEFAULT)) {
+        baseline = static_cast<GLint>(face->glyph->metrics.horiBearingY >> 6) + SDF_SPREAD;
+    }
+
+    StartWorker();
+}
+
+
+void gfxc::TextRenderer::RenderText(const std::string &text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color)
+{
+    if (!face) return;
+
+    // Glyph metrics are for SDF_SIZE pixels
+    const GLfloat pixelScale = fontSize * scale / SDF_SIZE;
+    std::vector<unsigned int> missing;
+    vertices.reserve(vertices.size() + text.size() * 6);
+
+    // Iterate through all characters
+    size_t position = 0;
+    while (position < text.size())
+    {
+        const unsigned int codepoint = text_utils::DecodeUTF8(text, position);
+        Glyph &glyph = GetGlyph(codepoint);
+        const Character &ch = glyph.character;
+        glyph.lastUsed = frame;
+
+        if (glyph.cell < 0 && !glyph.requested)
+        {
+            glyph.requested = true;
+            missing.push_back(codepoint);
+        }
+
+        // Glyphs not rasterized yet and glyphs without pixels (spaces) only move the cursor
+        if (glyph.cell >= 0)
+        {
+            GLfloat xpos = x + ch.Bearing.x * pixelScale;
+            GLfloat ypos = y + (baseline - ch.Bearing.y) * pixelScale;
+
+            GLfloat w = ch.Size.x * pixelScale;
+            GLfloat h = ch.Size.y * pixelScale;
+
+            glm::vec2 uv0 = ch.TexOffset;
+            glm::vec2 uv1 = ch.TexOffset + ch.TexSize;
+
+            Vertex quad[6] = {
+                { glm::vec2(xpos,     ypos + h), glm::vec2(uv0.x, uv1.y), color },
+                { glm::vec2(xpos + w, ypos),     glm::vec2(uv1.x, uv0.y), color },
+                { glm::vec2(xpos,     ypos),     glm::vec2(uv0.x, uv0.y), color },
+
+                { glm::vec2(xpos,     ypos + h), glm::vec2(uv0.x, uv1.y), color },
+                { glm::vec2(xpos + w, ypos + h), glm::vec2(uv1.x, uv1.y), color },
+                { glm::vec2(xpos + w, ypos),     glm::vec2(uv1.x, uv0.y), color }
+            };
+            vertices.insert(vertices.end(), quad, quad + 6);
+        }
+
+        // Now advance cursors for next glyph. Bitshift by 6
+        // to get value in pixels.
+        x += (ch.Advance >> 6) * pixelScale;
+    }
+
+    if (!missing.empty())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.insert(requests.end(), missing.begin(), missing.end());
+        condition.notify_one();
+    }
+}
+
+
+void gfxc::TextRenderer::Flush()
+{
+    // Glyphs finished by the worker since the last flush. They can't take the
+    // cell of a glyph drawn this frame, those stay queued for a later frame
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &bitmap : finished) {
+            waiting.push_back(std::move(bitmap));
+        }
+        finished.clear();
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < waiting.size(); i++)
+    {
+        if (!PlaceGlyph(waiting[i])) {
+            waiting[kept++] = std::move(waiting[i]);
+        }
+    }
+    waiting.resize(kept);
 
-    // Then for the first 128 ASCII characters, pre-load/compile their characters and store them
-    for (GLubyte c = 0; c < 128; c++)
+    if (!vertices.empty() && this->m_textShader)
     {
-        // Load character glyph 
-        if (FT_Load_Char(face, c, FT_LOAD_RENDER))
+        // Activate corresponding render state
+        this->m_textShader->Use();
+
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        // Orphaning the storage every flush lets the driver keep the previous copy
+        // in flight instead of waiting for it, the size only ever grows
+        if (vertices.size() > bufferCapacity) {
+            bufferCapacity = std::max(vertices.size(), 2 * bufferCapacity);
+        }
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * bufferCapacity, NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Vertex) * vertices.size(), vertices.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, atlasTexture);
+        render_stats::AddTextureBind();
+        glBindVertexArray(this->VAO);
+
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices.size()));
+        render_stats::AddDraw(GL_TRIANGLES, static_cast<unsigned int>(vertices.size()));
+        glDisable(GL_BLEND);
+
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    vertices.clear();
+    frame++;
+}
+
+
+unsigned int gfxc::TextRenderer::GetResidentGlyphCount() const
+{
+    return residentGlyphs;
+}
+
+
+unsigned int gfxc::TextRenderer::GetEvictionCount() const
+{
+    return evictions;
+}
+
+
+gfxc::TextRenderer::Glyph &gfxc::TextRenderer::GetGlyph(unsigned int codepoint)
+{
+    Glyph *glyph;
+    if (codepoint < 128) {
+        glyph = &asciiGlyphs[codepoint];
+    } else {
+        auto it = glyphs.find(codepoint);
+        if (it == glyphs.end())
         {
-            std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
-            continue;
+            it = glyphs.insert(std::make_pair(codepoint, Glyph())).first;
+            it->second.cell = -1;
         }
+        glyph = &it->second;
+    }
 
-        // Generate texture
-        GLuint texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexImage2D(
-            GL_TEXTURE_2D,
-            0,
-            GL_RED,
-            face->glyph->bitmap.width,
-            face->glyph->bitmap.rows,
-            0,
-            GL_RED,
-            GL_UNSIGNED_BYTE,
-            face->glyph->bitmap.buffer
-        );
-
-        // Set texture options
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        // Now store character for later use
-        Character character = {
-            texture,
-            glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
-            glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-            (GLuint)face->glyph->advance.x
-        };
-
-        Characters.insert(std::pair<GLchar, Character>(c, character));
+    // Only the advance is needed before the worker is done, it is cheap to read here
+    if (!glyph->measured && face)
+    {
+        glyph->measured = true;
+        if (!FT_Load_Char(face, codepoint, FT_LOAD_DEFAULT)) {
+            glyph->character.Advance = static_cast<GLuint>(face->glyph->advance.x);
+        }
     }
 
+    return *glyph;
+}
+
+
+bool gfxc::TextRenderer::PlaceGlyph(const GlyphBitmap &bitmap)
+{
+    Glyph &glyph = GetGlyph(bitmap.codepoint);
+    if (glyph.cell >= 0 || !glyph.requested) return true;
+
+    Character &character = glyph.character;
+    character.Size = bitmap.size;
+    character.Bearing = bitmap.bearing;
+
+    // Nothing to draw, the glyph stays requested so it isn't rasterized again
+    if (bitmap.size.x <= 0 || bitmap.size.y <= 0) return true;
+
+    int cell = AcquireCell();
+    if (cell < 0) return false;
+
+    glm::ivec2 offset(cell % cellsPerRow * cellSize, cell / cellsPerRow * cellSize);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, atlasTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, offset.x, offset.y, bitmap.size.x, bitmap.size.y, GL_RED, GL_UNSIGNED_BYTE, bitmap.pixels.data());
     glBindTexture(GL_TEXTURE_2D, 0);
 
-    // Destroy freetype once we're finished
-    FT_Done_Face(face);
-    FT_Done_FreeType(ft);
+    character.TexOffset = glm::vec2(offset) / static_cast<GLfloat>(atlasSize);
+    character.TexSize = glm::vec2(bitmap.size) / static_cast<GLfloat>(atlasSize);
+
+    glyph.cell = cell;
+    glyph.requested = false;
+    cellOwners[cell] = bitmap.codepoint;
+    residentGlyphs++;
+    return true;
 }
 
 
-void gfxc::TextRenderer::RenderText(std::string text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color)
+int gfxc::TextRenderer::AcquireCell()
 {
-    // Activate corresponding render state    
-    if (this->m_textShader)
+    if (!freeCells.empty())
     {
-        glUseProgram(this->m_textShader->program);
-        CheckOpenGLError();
+        int cell = freeCells.back();
+        freeCells.pop_back();
+        return cell;
     }
 
-    // TODO(developer): Update this class
-    int loc_text_color = glGetUniformLocation(this->m_textShader->program, "textColor");
-    glUniform3f(loc_text_color, color.r, color.g, color.b);
+    // Least recently used glyph, glyphs of the current frame are already in the vertex array
+    int oldest = -1;
+    unsigned int oldestFrame = frame;
+    for (size_t cell = 0; cell < cellOwners.size(); cell++)
+    {
+        const Glyph &glyph = GetGlyph(cellOwners[cell]);
+        if (glyph.lastUsed < oldestFrame)
+        {
+            oldestFrame = glyph.lastUsed;
+            oldest = static_cast<int>(cell);
+        }
+    }
+    if (oldest < 0) return -1;
+
+    Glyph &evicted = GetGlyph(cellOwners[oldest]);
+    evicted.cell = -1;
+    evicted.requested = false;
+    cellOwners[oldest] = NO_GLYPH;
+    residentGlyphs--;
+    evictions++;
+    return oldest;
+}
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindVertexArray(this->VAO);
 
-    // Iterate through all characters
-    for (auto c = text.cbegin(); c != text.cend(); c++)
+void gfxc::TextRenderer::StartWorker()
+{
+    quit = false;
+    worker = std::thread(&TextRenderer::WorkerLoop, this);
+}
+
+
+void gfxc::TextRenderer::StopWorker()
+{
+    if (!worker.joinable()) return;
+
     {
-        Character ch = Characters[*c];
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    condition.notify_all();
+    worker.join();
+}
 
-        GLfloat xpos = x + ch.Bearing.x * scale;
-        GLfloat ypos = y + (this->Characters['H'].Bearing.y - ch.Bearing.y) * scale;
 
-        GLfloat w = ch.Size.x * scale;
-        GLfloat h = ch.Size.y * scale;
+void gfxc::TextRenderer::CloseFont()
+{
+    if (face) FT_Done_Face(face);
+    if (library) FT_Done_FreeType(library);
+    face = nullptr;
+    library = nullptr;
+}
 
-        // Update VBO for each character
-        GLfloat vertices[6][4] = {
-            { xpos,     ypos + h,   0.0, 1.0 },
-            { xpos + w, ypos,       1.0, 0.0 },
-            { xpos,     ypos,       0.0, 0.0 },
 
-            { xpos,     ypos + h,   0.0, 1.0 },
-            { xpos + w, ypos + h,   1.0, 1.0 },
-            { xpos + w, ypos,       1.0, 0.0 }
-        };
+void gfxc::TextRenderer::WorkerLoop()
+{
+    // FreeType objects can't be shared between threads, the worker opens the font again
+    FT_Library workerLibrary;
+    if (FT_Init_FreeType(&workerLibrary)) return;
 
-        // Render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, ch.TextureID);
+    FT_Face workerFace;
+    if (FT_New_Face(workerLibrary, fontPath.c_str(), 0, &workerFace))
+    {
+        FT_Done_FreeType(workerLibrary);
+        return;
+    }
+    FT_Set_Pixel_Sizes(workerFace, 0, SDF_SIZE);
 
-        // Update content of VBO memory
-        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices); // Be sure to use glBufferSubData and not glBufferData
+    const int maxSize = static_cast<int>(cellSize);
+    std::vector<float> outside, inside;
 
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    for (;;)
+    {
+        unsigned int codepoint;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return quit || !requests.empty(); });
+            if (quit) break;
 
-        // Render quad
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        glDisable(GL_BLEND);
+            codepoint = requests.front();
+            requests.pop_front();
+        }
 
-        // Now advance cursors for next glyph. Bitshift by 6
-        // to get value in pixels.
-        x += (ch.Advance >> 6) * scale; 
+        GlyphBitmap result;
+        result.codepoint = codepoint;
+        result.size = glm::ivec2(0);
+        result.bearing = glm::ivec2(0);
+
+        if (!FT_Load_Char(workerFace, codepoint, FT_LOAD_RENDER) && workerFace->glyph->bitmap.width > 0)
+        {
+            const FT_Bitmap &bitmap = workerFace->glyph->bitmap;
+            const int width = std::min(static_cast<int>(bitmap.width) + 2 * SDF_SPREAD, maxSize);
+            const int height = std::min(static_cast<int>(bitmap.rows) + 2 * SDF_SPREAD, maxSize);
+
+            // Seeds of the two transforms: the pixels inside the glyph, then the ones outside
+            outside.assign(width * height, FAR_DISTANCE);
+            inside.assign(width * height, 0.0f);
+            for (int y = SDF_SPREAD; y < height && y - SDF_SPREAD < static_cast<int>(bitmap.rows); y++)
+            {
+                for (int x = SDF_SPREAD; x < width && x - SDF_SPREAD < static_cast<int>(bitmap.width); x++)
+                {
+                    if (bitmap.buffer[(y - SDF_SPREAD) * bitmap.pitch + x - SDF_SPREAD] >= 128)
+                    {
+                        outside[y * width + x] = 0.0f;
+                        inside[y * width + x] = FAR_DISTANCE;
+                    }
+                }
+            }
+            DistanceTransform2D(outside, width, height);
+            DistanceTransform2D(inside, width, height);
+
+            // The edge is half way between a pixel and its neighbour across it,
+            // 0.5 in the texture and SDF_SPREAD pixels away at 0 or 1
+            result.pixels.resize(width * height);
+            for (int i = 0; i < width * height; i++)
+            {
+                float distance = outside[i] > 0.0f ? std::sqrt(outside[i]) - 0.5f : 0.5f - std::sqrt(inside[i]);
+                float value = 0.5f - 0.5f * distance / SDF_SPREAD;
+                result.pixels[i] = static_cast<unsigned char>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+            }
+
+            result.size = glm::ivec2(width, height);
+            result.bearing = glm::ivec2(workerFace->glyph->bitmap_left - SDF_SPREAD, workerFace->glyph->bitmap_top + SDF_SPREAD);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.push_back(std::move(result));
     }
 
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    FT_Done_Face(workerFace);
+    FT_Done_FreeType(workerLibrary);
 }
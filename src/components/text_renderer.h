@@ -9,8 +9,13 @@
 #ifndef TEXT_RENDERER_H
 #define TEXT_RENDERER_H
 
-#include <map>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "GL/glew.h"
 #include "glm/glm.hpp"
@@ -20,44 +25,134 @@
 #include "core/engine.h"
 
 
+struct FT_LibraryRec_;
+struct FT_FaceRec_;
+
+
 namespace gfxc
 {
-    /// Holds all state information relevant to a character as loaded using FreeType
+    /// Holds all state information relevant to a character as loaded using FreeType.
+    /// Sizes are in pixels of the distance field, which is rasterized at SDF_SIZE
     struct Character
     {
-        GLuint TextureID;   // ID handle of the glyph texture
-        glm::ivec2 Size;    // Size of glyph
-        glm::ivec2 Bearing; // Offset from baseline to left/top of glyph
-        GLuint Advance;     // Horizontal offset to advance to next glyph
+        glm::vec2 TexOffset;    // Top left corner of the glyph in the atlas, in texture coordinates
+        glm::vec2 TexSize;      // Size of the glyph in the atlas, in texture coordinates
+        glm::ivec2 Size;        // Size of glyph, distance field border included
+        glm::ivec2 Bearing;     // Offset from baseline to left/top of glyph
+        GLuint Advance;         // Horizontal offset to advance to next glyph
     };
 
 
-    // A renderer class for rendering text displayed by a font loaded using the 
-    // FreeType library. A single font is loaded, processed into a list of Character
-    // items for later rendering.
+    // A renderer class for rendering text displayed by a font loaded using the
+    // FreeType library. Glyphs are stored as signed distance fields, so one
+    // atlas serves every text size.
+    //
+    // A glyph is rasterized the first time a string uses it, on a worker
+    // thread, and shows up in the frames after it is done. The atlas is a grid
+    // of fixed cells: when it is full, the glyph unused for the longest time
+    // gives its cell away. Strings are UTF-8.
+    //
+    // RenderText only appends the quads of a string to a vertex array, Flush()
+    // uploads everything queued since the last flush and draws it at once, so
+    // a frame of text costs one draw per font.
     class TextRenderer
     {
      public:
-        // Holds a list of pre-compiled Characters
-        std::map<GLchar, Character> Characters;
+        // Pixel size of the distance fields and how far the distance reaches outside the glyph
+        static const int SDF_SIZE = 32;
+        static const int SDF_SPREAD = 6;
 
         // Shader used for text rendering
         Shader *m_textShader;
 
         public:
         // Constructor
-        TextRenderer(const std::string &selfDir, GLuint width, GLuint height);
+        TextRenderer(const std::string &selfDir, GLuint width, GLuint height, GLuint atlasSize = 1024);
+        ~TextRenderer();
 
-        // Pre-compiles a list of characters from the given font
+        // Opens the given font, fontSize is the pixel size of the text at scale 1
         void Load(std::string font, GLuint fontSize);
 
-        // Renders a string of text using the precompiled list of characters
-        void RenderText(std::string text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color = glm::vec3(1.0f));
-        
+        // Queues a string of text, drawn by the next Flush()
+        void RenderText(const std::string &text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color = glm::vec3(1.0f));
+
+        // Places the glyphs rasterized since the last call in the atlas and
+        // draws the text queued since the last call in one draw
+        void Flush();
+
+        // Screen size the text coordinates are given in
+        void SetViewport(GLuint width, GLuint height);
+
+        unsigned int GetResidentGlyphCount() const;
+        unsigned int GetEvictionCount() const;
+
+     private:
+        struct Vertex {
+            glm::vec2 position;
+            glm::vec2 texCoord;
+            glm::vec3 color;
+        };
+
+        struct Glyph {
+            Character character;
+            bool measured;          // Advance read from the font
+            int cell;               // -1 while not in the atlas
+            bool requested;         // Sent to the worker, not placed yet
+            unsigned int lastUsed;  // Frame of the last string using it
+        };
+
+        // Distance field made by the worker
+        struct GlyphBitmap {
+            unsigned int codepoint;
+            glm::ivec2 size;
+            glm::ivec2 bearing;
+            std::vector<unsigned char> pixels;
+        };
+
+        Glyph &GetGlyph(unsigned int codepoint);
+        bool PlaceGlyph(const GlyphBitmap &bitmap);
+        int AcquireCell();
+
+        void StartWorker();
+        void StopWorker();
+        void WorkerLoop();
+        void CloseFont();
+
      private:
         // Render state
         GLuint VAO, VBO;
+        GLuint atlasTexture;
+        GLuint atlasSize;
+        GLuint cellSize;
+        GLuint cellsPerRow;
+        GLfloat fontSize;
+        GLint baseline;             // Bearing of 'H', tops of the capitals line up on it
+
+        std::vector<Vertex> vertices;
+        size_t bufferCapacity;      // Vertices the buffer has room for
+
+        // Glyph table, flat for ASCII
+        Glyph asciiGlyphs[128];
+        std::unordered_map<unsigned int, Glyph> glyphs;
+        std::vector<unsigned int> cellOwners;   // Code point in each cell, NO_GLYPH when free
+        std::vector<int> freeCells;
+        unsigned int frame;
+        unsigned int residentGlyphs;
+        unsigned int evictions;
+
+        // Metrics are read on the calling thread, the worker has its own face
+        std::string fontPath;
+        FT_LibraryRec_ *library;
+        FT_FaceRec_ *face;
+
+        std::thread worker;
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::deque<unsigned int> requests;
+        std::vector<GlyphBitmap> finished;
+        std::vector<GlyphBitmap> waiting;       // Finished, but every cell is used by the current frame
+        bool quit;
     };
 }
 
-#endif 
+#endif
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <limits>
+
+#include "utils/glm_utils.h"
+
+
+// Axis aligned box, stored as its two extreme corners
+struct BoundingBox
+{
+    BoundingBox()
+        : min(std::numeric_limits<float>::max()), max(-std::numeric_limits<float>::max()) { }
+
+    BoundingBox(const glm::vec3 &min, const glm::vec3 &max)
+        : min(min), max(max) { }
+
+    bool IsValid() const
+    {
+        return min.x <= max.x && min.y <= max.y && min.z <= max.z;
+    }
+
+    void Expand(const glm::vec3 &point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void Expand(const BoundingBox &box)
+    {
+        if (!box.IsValid()) return;
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+
+    glm::vec3 GetCenter() const
+    {
+        return (min + max) * 0.5f;
+    }
+
+    glm::vec3 GetExtents() const
+    {
+        return (max - min) * 0.5f;
+    }
+
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+
+// Sphere enclosing an object; a negative radius marks an empty volume
+struct BoundingSphere
+{
+    BoundingSphere()
+        : center(0), radius(-1) { }
+
+    BoundingSphere(const glm::vec3 &center, float radius)
+        : center(center), radius(radius) { }
+
+    bool IsValid() const
+    {
+        return radius >= 0;
+    }
+
+    glm::vec3 center;
+    float radius;
+};
+
+
+namespace bounds_utils
+{
+    // Transforms a box and returns the axis aligned box enclosing the result (Arvo's method)
+    inline BoundingBox Transform(const BoundingBox &box, const glm::mat4 &model)
+    {
+        if (!box.IsValid()) return box;
+
+        glm::vec3 center = glm::vec3(model * glm::vec4(box.GetCenter(), 1.0f));
+        glm::vec3 extents = box.GetExtents();
+        glm::vec3 worldExtents(0);
+
+        for (int row = 0; row < 3; row++) {
+            for (int col = 0; col < 3; col++) {
+                worldExtents[row] += glm::abs(model[col][row]) * extents[col];
+            }
+        }
+
+        return BoundingBox(center - worldExtents, center + worldExtents);
+    }
+
+    // Transforms a sphere, scaling its radius by the largest axis scale of the matrix
+    inline BoundingSphere Transform(const BoundingSphere &sphere, const glm::mat4 &model)
+    {
+        if (!sphere.IsValid()) return sphere;
+
+        float scaleX = glm::length(glm::vec3(model[0]));
+        float scaleY = glm::length(glm::vec3(model[1]));
+        float scaleZ = glm::length(glm::vec3(model[2]));
+        float scale = MAX(scaleX, MAX(scaleY, scaleZ));
+
+        return BoundingSphere(glm::vec3(model * glm::vec4(sphere.center, 1.0f)), sphere.radius * scale);
+    }
+}   // namespace bounds_utils
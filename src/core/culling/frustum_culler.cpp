@@ -0,0 +1,236 @@
+#include "core/culling/frustum_culler.h"
+
+#include <atomic>
+
+#include "core/jobs/job_system.h"
+
+#if defined(__AVX__)
+#   include <immintrin.h>
+#   define FRUSTUM_SIMD_WIDTH   8
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#   include <xmmintrin.h>
+#   define FRUSTUM_SIMD_WIDTH   4
+#else
+#   define FRUSTUM_SIMD_WIDTH   1
+#endif
+
+
+static const unsigned int BATCH_PADDING = 8;
+
+// Spheres per culling job, smaller batches are culled on the calling thread
+static const unsigned int CULL_GRAIN = 4096;
+
+
+SphereBatch::SphereBatch()
+{
+    count = 0;
+}
+
+
+void SphereBatch::Clear()
+{
+    count = 0;
+    centerX.clear();
+    centerY.clear();
+    centerZ.clear();
+    radius.clear();
+}
+
+
+unsigned int SphereBatch::Add(const BoundingSphere &sphere)
+{
+    // Grow by a full SIMD lane at once, unused slots stay zero sized
+    if (count == centerX.size())
+    {
+        size_t size = centerX.size() + BATCH_PADDING;
+        centerX.resize(size, 0.0f);
+        centerY.resize(size, 0.0f);
+        centerZ.resize(size, 0.0f);
+        radius.resize(size, 0.0f);
+    }
+
+    centerX[count] = sphere.center.x;
+    centerY[count] = sphere.center.y;
+    centerZ[count] = sphere.center.z;
+    // Empty volumes can't be tested, keep them always visible
+    radius[count] = sphere.IsValid() ? sphere.radius : std::numeric_limits<float>::max();
+
+    return count++;
+}
+
+
+unsigned int SphereBatch::Size() const
+{
+    return count;
+}
+
+
+FrustumCuller::FrustumCuller()
+{
+    SetViewProjection(glm::mat4(1));
+}
+
+
+void FrustumCuller::SetViewProjection(const glm::mat4 &viewProjection)
+{
+    // Gribb-Hartmann: every plane is a sum or difference of the 4th row with one of the others
+    const glm::mat4 &m = viewProjection;
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    planes[0] = row3 + row0;    // left
+    planes[1] = row3 - row0;    // right
+    planes[2] = row3 + row1;    // bottom
+    planes[3] = row3 - row1;    // top
+    planes[4] = row3 + row2;    // near
+    planes[5] = row3 - row2;    // far
+
+    // Normalize so that the plane equation returns the signed distance
+    for (int i = 0; i < 6; i++)
+    {
+        float length = glm::length(glm::vec3(planes[i]));
+        if (length > 0) planes[i] /= length;
+    }
+}
+
+
+bool FrustumCuller::IsVisible(const BoundingSphere &sphere) const
+{
+    if (!sphere.IsValid()) return true;
+
+    for (int i = 0; i < 6; i++)
+    {
+        if (glm::dot(glm::vec3(planes[i]), sphere.center) + planes[i].w < -sphere.radius)
+            return false;
+    }
+    return true;
+}
+
+
+bool FrustumCuller::IsVisible(const BoundingBox &box) const
+{
+    if (!box.IsValid()) return true;
+
+    // Test the corner that is farthest along each plane normal
+    for (int i = 0; i < 6; i++)
+    {
+        glm::vec3 corner(
+            planes[i].x >= 0 ? box.max.x : box.min.x,
+            planes[i].y >= 0 ? box.max.y : box.min.y,
+            planes[i].z >= 0 ? box.max.z : box.min.z);
+
+        if (glm::dot(glm::vec3(planes[i]), corner) + planes[i].w < 0)
+            return false;
+    }
+    return true;
+}
+
+
+void FrustumCuller::Cull(const SphereBatch &batch, std::vector<unsigned char> &visibility)
+{
+    const unsigned int count = batch.Size();
+    visibility.resize(count);
+
+    // Large batches are split over the job threads, the padding makes every part safe to read past its end
+    std::atomic<unsigned int> nrVisible(0);
+    JobSystem::ParallelFor(count, [this, &batch, &visibility, &nrVisible](size_t begin, size_t end)
+    {
+        nrVisible += CullRange(batch, static_cast<unsigned int>(begin), static_cast<unsigned int>(end), visibility.data());
+    }, CULL_GRAIN);
+
+    stats.tested += count;
+    stats.visible += nrVisible;
+    stats.culled += count - nrVisible;
+}
+
+
+unsigned int FrustumCuller::CullRange(const SphereBatch &batch, unsigned int begin, unsigned int end, unsigned char *visibility) const
+{
+    const float *cx = batch.centerX.data();
+    const float *cy = batch.centerY.data();
+    const float *cz = batch.centerZ.data();
+    const float *cr = batch.radius.data();
+
+    unsigned int i = begin;
+    unsigned int nrVisible = 0;
+
+#if FRUSTUM_SIMD_WIDTH == 8
+    for (; i < end; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(cx + i);
+        __m256 y = _mm256_loadu_ps(cy + i);
+        __m256 z = _mm256_loadu_ps(cz + i);
+        __m256 negR = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(cr + i));
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+        for (int p = 0; p < 6; p++)
+        {
+            __m256 d = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(planes[p].x)), _mm256_mul_ps(y, _mm256_set1_ps(planes[p].y))),
+                _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(planes[p].z)), _mm256_set1_ps(planes[p].w)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negR, _CMP_GE_OQ));
+        }
+
+        int mask = _mm256_movemask_ps(inside);
+        unsigned int lanes = MIN(8u, end - i);
+        for (unsigned int k = 0; k < lanes; k++)
+        {
+            visibility[i + k] = (mask >> k) & 1;
+            nrVisible += visibility[i + k];
+        }
+    }
+#elif FRUSTUM_SIMD_WIDTH == 4
+    for (; i < end; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(cx + i);
+        __m128 y = _mm_loadu_ps(cy + i);
+        __m128 z = _mm_loadu_ps(cz + i);
+        __m128 negR = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(cr + i));
+        __m128 inside = _mm_cmpeq_ps(x, x);
+
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 d = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(planes[p].x)), _mm_mul_ps(y, _mm_set1_ps(planes[p].y))),
+                _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(planes[p].z)), _mm_set1_ps(planes[p].w)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        unsigned int lanes = MIN(4u, end - i);
+        for (unsigned int k = 0; k < lanes; k++)
+        {
+            visibility[i + k] = (mask >> k) & 1;
+            nrVisible += visibility[i + k];
+        }
+    }
+#else
+    for (; i < end; i++)
+    {
+        visibility[i] = IsVisible(BoundingSphere(glm::vec3(cx[i], cy[i], cz[i]), cr[i])) ? 1 : 0;
+        nrVisible += visibility[i];
+    }
+#endif
+
+    return nrVisible;
+}
+
+
+const glm::vec4 *FrustumCuller::GetPlanes() const
+{
+    return planes;
+}
+
+
+const CullingStats &FrustumCuller::GetStats() const
+{
+    return stats;
+}
+
+
+void FrustumCuller::ResetStats()
+{
+    stats = CullingStats();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+#include "core/culling/bounding_volume.h"
+#include "utils/glm_utils.h"
+
+
+struct CullingStats
+{
+    CullingStats() : tested(0), visible(0), culled(0) { }
+
+    unsigned int tested;
+    unsigned int visible;
+    unsigned int culled;
+};
+
+
+// Bounding spheres laid out as a structure of arrays, so the culler can
+// load 4 (SSE) or 8 (AVX) spheres per instruction. The arrays are always
+// padded to a multiple of 8 entries.
+class SphereBatch
+{
+ public:
+    SphereBatch();
+
+    void Clear();
+    unsigned int Add(const BoundingSphere &sphere);
+    unsigned int Size() const;
+
+ public:
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    std::vector<float> radius;
+
+ private:
+    unsigned int count;
+};
+
+
+class FrustumCuller
+{
+ public:
+    FrustumCuller();
+
+    // Extracts the six clip planes from a combined (projection * view) matrix
+    void SetViewProjection(const glm::mat4 &viewProjection);
+
+    bool IsVisible(const BoundingSphere &sphere) const;
+    bool IsVisible(const BoundingBox &box) const;
+
+    // Tests all spheres of the batch and writes 1 (visible) or 0 (culled) for each entry
+    void Cull(const SphereBatch &batch, std::vector<unsigned char> &visibility);
+
+    const glm::vec4 *GetPlanes() const;
+
+    // Counters accumulate over all Cull() calls until reset, usually once per frame
+    const CullingStats &GetStats() const;
+    void ResetStats();
+
+ private:
+    // Writes the entries [begin, end), returns how many are visible
+    unsigned int CullRange(const SphereBatch &batch, unsigned int begin, unsigned int end, unsigned char *visibility) const;
+
+ private:
+    glm::vec4 planes[6];
+    CullingStats stats;
+};
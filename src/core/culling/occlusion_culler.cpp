@@ -0,0 +1,398 @@
+#include "core/culling/occlusion_culler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#   include <immintrin.h>
+#   define OCCLUSION_SIMD_WIDTH 8
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#   include <xmmintrin.h>
+#   define OCCLUSION_SIMD_WIDTH 4
+#else
+#   define OCCLUSION_SIMD_WIDTH 1
+#endif
+
+
+static const unsigned int TILE_SIZE = 8;
+
+// Vertices closer than this to the eye plane are not projected
+static const float MIN_CLIP_W = 1e-4f;
+
+
+OcclusionCuller::OcclusionCuller(unsigned int width, unsigned int height)
+{
+    this->width = (MAX(width, TILE_SIZE) + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE;
+    this->height = (MAX(height, TILE_SIZE) + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE;
+    tilesX = this->width / TILE_SIZE;
+    tilesY = this->height / TILE_SIZE;
+
+    depth.resize(this->width * this->height);
+    tileMaxDepth.resize(tilesX * tilesY);
+}
+
+
+OcclusionCuller::~OcclusionCuller()
+{
+    JobSystem::Wait(job);
+}
+
+
+unsigned int OcclusionCuller::AddOccluderMesh(const Mesh *mesh)
+{
+    OccluderMesh occluder;
+
+    if (mesh)
+    {
+        const bool hasPositions = !mesh->positions.empty();
+        const size_t nrVertices = hasPositions ? mesh->positions.size() : mesh->vertices.size();
+
+        occluder.positions.reserve(nrVertices);
+        for (size_t i = 0; i < nrVertices; i++) {
+            occluder.positions.push_back(hasPositions ? mesh->positions[i] : mesh->vertices[i].position);
+        }
+
+        // Resolve the base vertex of every entry, the occluder is drawn as a single list
+        for (const auto &entry : mesh->meshEntries)
+        {
+            unsigned int lastIndex = MIN(entry.baseIndex + entry.nrIndices, (unsigned int)mesh->indices.size());
+            for (unsigned int i = entry.baseIndex; i + 2 < lastIndex; i += 3)
+            {
+                unsigned int id[3] = { entry.baseVertex + mesh->indices[i], entry.baseVertex + mesh->indices[i + 1], entry.baseVertex + mesh->indices[i + 2] };
+                if (id[0] >= nrVertices || id[1] >= nrVertices || id[2] >= nrVertices)
+                    continue;
+
+                occluder.indices.insert(occluder.indices.end(), id, id + 3);
+            }
+        }
+    }
+
+    // The running job reads the meshes
+    JobSystem::Wait(job);
+    occluderMeshes.push_back(occluder);
+    return static_cast<unsigned int>(occluderMeshes.size() - 1);
+}
+
+
+void OcclusionCuller::Submit(const glm::mat4 &viewProjection,
+                             const std::vector<OccluderInstance> &occluders,
+                             const std::vector<BoundingBox> &boxes)
+{
+    JobSystem::Wait(job);
+
+    this->viewProjection = viewProjection;
+    this->occluders = occluders;
+    this->boxes = boxes;
+
+    JobSystem::Run([this]() { Run(); }, &job);
+}
+
+
+void OcclusionCuller::Wait(std::vector<unsigned char> &visibility)
+{
+    JobSystem::Wait(job);
+
+    visibility = results;
+    lastStats = stats;
+}
+
+
+const CullingStats &OcclusionCuller::GetStats() const
+{
+    return lastStats;
+}
+
+
+float OcclusionCuller::GetRejectedFraction() const
+{
+    return lastStats.tested ? static_cast<float>(lastStats.culled) / lastStats.tested : 0.0f;
+}
+
+
+void OcclusionCuller::Run()
+{
+    ClearDepth();
+
+    for (const auto &occluder : occluders)
+    {
+        if (occluder.mesh < occluderMeshes.size()) {
+            RasterizeOccluder(occluderMeshes[occluder.mesh], viewProjection * occluder.model);
+        }
+    }
+
+    UpdateTiles();
+
+    const unsigned int count = static_cast<unsigned int>(boxes.size());
+    results.resize(count);
+    stats = CullingStats();
+    stats.tested = count;
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        results[i] = IsVisible(boxes[i]) ? 1 : 0;
+        stats.visible += results[i];
+    }
+    stats.culled = stats.tested - stats.visible;
+}
+
+
+void OcclusionCuller::ClearDepth()
+{
+    std::fill(depth.begin(), depth.end(), 1.0f);
+}
+
+
+void OcclusionCuller::RasterizeOccluder(const OccluderMesh &mesh, const glm::mat4 &modelViewProjection)
+{
+    // Clip space positions, a vertex is shared by several triangles
+    projected.resize(mesh.positions.size());
+    for (size_t i = 0; i < mesh.positions.size(); i++)
+        projected[i] = modelViewProjection * glm::vec4(mesh.positions[i], 1.0f);
+
+    auto toScreen = [this](const glm::vec4 &clip) {
+        float invW = 1.0f / clip.w;
+        return glm::vec3(
+            (clip.x * invW * 0.5f + 0.5f) * width,
+            (clip.y * invW * 0.5f + 0.5f) * height,
+            clip.z * invW * 0.5f + 0.5f);
+    };
+
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        const glm::vec4 *triangle[3] = {
+            &projected[mesh.indices[i]], &projected[mesh.indices[i + 1]], &projected[mesh.indices[i + 2]] };
+
+        // Clipped against the near plane z = -w, the part left is a triangle or a quad.
+        // The part in front of the near plane would project with depths below 0 or
+        // mirrored through the eye, and cover pixels the occluder doesn't
+        glm::vec4 polygon[4];
+        int count = 0;
+        for (int v = 0; v < 3; v++)
+        {
+            const glm::vec4 &from = *triangle[v];
+            const glm::vec4 &to = *triangle[(v + 1) % 3];
+            const float fromDistance = from.z + from.w;
+            const float toDistance = to.z + to.w;
+
+            if (fromDistance >= 0)
+                polygon[count++] = from;
+            if ((fromDistance >= 0) != (toDistance >= 0))
+                polygon[count++] = from + (to - from) * (fromDistance / (fromDistance - toDistance));
+        }
+
+        // Only a projection without a near plane in front of the eye gets here, skipping is always safe
+        bool projectable = count >= 3;
+        for (int v = 0; v < count; v++)
+            projectable = projectable && polygon[v].w > MIN_CLIP_W;
+        if (!projectable)
+            continue;
+
+        glm::vec3 screen[4];
+        for (int v = 0; v < count; v++)
+            screen[v] = toScreen(polygon[v]);
+
+        RasterizeTriangle(screen[0], screen[1], screen[2]);
+        if (count == 4)
+            RasterizeTriangle(screen[0], screen[2], screen[3]);
+    }
+}
+
+
+void OcclusionCuller::RasterizeTriangle(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2)
+{
+    // Only depths in front of the far plane are of any use
+    float triangleDepth = MAX(v0.z, MAX(v1.z, v2.z));
+    if (triangleDepth >= 1.0f) return;
+
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+    if (fabs(area) < 1e-6f) return;
+
+    // Both windings are accepted, the edges are oriented so that inside is positive
+    const glm::vec3 &p0 = v0;
+    const glm::vec3 &p1 = area > 0 ? v1 : v2;
+    const glm::vec3 &p2 = area > 0 ? v2 : v1;
+
+    // Clamped as floats, vertices close to the eye can project far outside of the int range
+    int minX = static_cast<int>(MAX(0.0f, floor(MIN(p0.x, MIN(p1.x, p2.x)))));
+    int maxX = static_cast<int>(MIN(width - 1.0f, ceil(MAX(p0.x, MAX(p1.x, p2.x)))));
+    int minY = static_cast<int>(MAX(0.0f, floor(MIN(p0.y, MIN(p1.y, p2.y)))));
+    int maxY = static_cast<int>(MIN(height - 1.0f, ceil(MAX(p0.y, MAX(p1.y, p2.y)))));
+    if (minX > maxX || minY > maxY) return;
+
+    // Edge functions e(x, y) = a * x + b * y + c, evaluated at the pixel centers
+    float a[3], b[3], c[3];
+    const glm::vec3 *edges[3][2] = { { &p0, &p1 }, { &p1, &p2 }, { &p2, &p0 } };
+    for (int e = 0; e < 3; e++)
+    {
+        const glm::vec3 &from = *edges[e][0];
+        const glm::vec3 &to = *edges[e][1];
+        a[e] = from.y - to.y;
+        b[e] = to.x - from.x;
+        c[e] = from.x * to.y - from.y * to.x;
+    }
+
+#if OCCLUSION_SIMD_WIDTH == 8
+    const int startX = minX & ~7;
+    const __m256 laneOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 depth8 = _mm256_set1_ps(triangleDepth);
+
+    for (int y = minY; y <= maxY; y++)
+    {
+        float *row = depth.data() + y * width;
+        const float py = y + 0.5f;
+
+        for (int x = startX; x <= maxX; x += 8)
+        {
+            __m256 px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), laneOffsets);
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+            for (int e = 0; e < 3; e++)
+            {
+                __m256 value = _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(a[e])), _mm256_set1_ps(b[e] * py + c[e]));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(value, zero, _CMP_GE_OQ));
+            }
+
+            if (_mm256_testz_ps(inside, inside))
+                continue;
+
+            __m256 current = _mm256_loadu_ps(row + x);
+            __m256 updated = _mm256_min_ps(current, depth8);
+            _mm256_storeu_ps(row + x, _mm256_blendv_ps(current, updated, inside));
+        }
+    }
+#elif OCCLUSION_SIMD_WIDTH == 4
+    // The width is a multiple of 8, so the last group of a row never reads past it
+    const int startX = minX & ~3;
+    const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 depth4 = _mm_set1_ps(triangleDepth);
+
+    for (int y = minY; y <= maxY; y++)
+    {
+        float *row = depth.data() + y * width;
+        const float py = y + 0.5f;
+
+        for (int x = startX; x <= maxX; x += 4)
+        {
+            __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+            __m128 inside = _mm_cmpeq_ps(px, px);
+
+            for (int e = 0; e < 3; e++)
+            {
+                __m128 value = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(a[e])), _mm_set1_ps(b[e] * py + c[e]));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(value, zero));
+            }
+
+            if (!_mm_movemask_ps(inside))
+                continue;
+
+            // No blend before SSE 4.1, the covered lanes are selected with masks
+            __m128 current = _mm_loadu_ps(row + x);
+            __m128 updated = _mm_min_ps(current, depth4);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, updated), _mm_andnot_ps(inside, current)));
+        }
+    }
+#else
+    for (int y = minY; y <= maxY; y++)
+    {
+        float *row = depth.data() + y * width;
+        const float py = y + 0.5f;
+
+        for (int x = minX; x <= maxX; x++)
+        {
+            const float px = x + 0.5f;
+            if (a[0] * px + b[0] * py + c[0] >= 0 &&
+                a[1] * px + b[1] * py + c[1] >= 0 &&
+                a[2] * px + b[2] * py + c[2] >= 0)
+            {
+                row[x] = MIN(row[x], triangleDepth);
+            }
+        }
+    }
+#endif
+}
+
+
+void OcclusionCuller::UpdateTiles()
+{
+    for (unsigned int ty = 0; ty < tilesY; ty++)
+    {
+        for (unsigned int tx = 0; tx < tilesX; tx++)
+        {
+            float tileMax = 0;
+            for (unsigned int y = ty * TILE_SIZE; y < (ty + 1) * TILE_SIZE; y++)
+            {
+                const float *row = depth.data() + y * width + tx * TILE_SIZE;
+                for (unsigned int x = 0; x < TILE_SIZE; x++) {
+                    tileMax = MAX(tileMax, row[x]);
+                }
+            }
+            tileMaxDepth[ty * tilesX + tx] = tileMax;
+        }
+    }
+}
+
+
+bool OcclusionCuller::IsVisible(const BoundingBox &box) const
+{
+    if (!box.IsValid()) return true;
+
+    // Screen rectangle and nearest depth of the box
+    glm::vec2 screenMin(std::numeric_limits<float>::max());
+    glm::vec2 screenMax(-std::numeric_limits<float>::max());
+    float nearestDepth = std::numeric_limits<float>::max();
+
+    for (int i = 0; i < 8; i++)
+    {
+        glm::vec3 corner(
+            (i & 1) ? box.max.x : box.min.x,
+            (i & 2) ? box.max.y : box.min.y,
+            (i & 4) ? box.max.z : box.min.z);
+
+        glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+
+        // The box reaches behind the eye, it can't be hidden by anything
+        if (clip.w <= MIN_CLIP_W) return true;
+
+        float invW = 1.0f / clip.w;
+        glm::vec2 screen((clip.x * invW * 0.5f + 0.5f) * width, (clip.y * invW * 0.5f + 0.5f) * height);
+        screenMin = glm::min(screenMin, screen);
+        screenMax = glm::max(screenMax, screen);
+        nearestDepth = MIN(nearestDepth, clip.z * invW * 0.5f + 0.5f);
+    }
+
+    // One pixel guard band: occluder pixels are covered by their center only, so
+    // a box is kept if it reaches past a partially covered silhouette pixel
+    int minX = static_cast<int>(MAX(0.0f, floor(screenMin.x) - 1));
+    int maxX = static_cast<int>(MIN(width - 1.0f, ceil(screenMax.x) + 1));
+    int minY = static_cast<int>(MAX(0.0f, floor(screenMin.y) - 1));
+    int maxY = static_cast<int>(MIN(height - 1.0f, ceil(screenMax.y) + 1));
+
+    // Off screen boxes are left to the frustum culler
+    if (minX > maxX || minY > maxY) return true;
+
+    const int tileSize = static_cast<int>(TILE_SIZE);
+    for (int ty = minY / tileSize; ty <= maxY / tileSize; ty++)
+    {
+        for (int tx = minX / tileSize; tx <= maxX / tileSize; tx++)
+        {
+            // Every occluder in the tile is in front of the box
+            if (tileMaxDepth[ty * tilesX + tx] < nearestDepth)
+                continue;
+
+            int x0 = MAX(minX, tx * tileSize), x1 = MIN(maxX, (tx + 1) * tileSize - 1);
+            int y0 = MAX(minY, ty * tileSize), y1 = MIN(maxY, (ty + 1) * tileSize - 1);
+
+            for (int y = y0; y <= y1; y++)
+            {
+                const float *row = depth.data() + y * width;
+                for (int x = x0; x <= x1; x++) {
+                    if (row[x] >= nearestDepth) return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+
+#include "core/culling/bounding_volume.h"
+#include "core/culling/frustum_culler.h"
+#include "core/gpu/mesh.h"
+#include "core/jobs/job_system.h"
+#include "utils/glm_utils.h"
+
+
+struct OccluderInstance
+{
+    OccluderInstance() : mesh(0), model(1) { }
+    OccluderInstance(unsigned int mesh, const glm::mat4 &model) : mesh(mesh), model(model) { }
+
+    unsigned int mesh;      // Index returned by OcclusionCuller::AddOccluderMesh
+    glm::mat4 model;
+};
+
+
+// Software occlusion culling on a low resolution depth buffer. A few large
+// occluders are rasterized in a job (4 pixels per instruction with SSE,
+// 8 with AVX), then the world boxes of the draws are tested against the buffer.
+//
+// Occluders are written with the farthest depth of each triangle and boxes
+// are tested with their nearest depth over a one pixel larger rectangle, so
+// the test errs on the side of keeping objects.
+class OcclusionCuller
+{
+ public:
+    // The width is rounded up to a multiple of 8
+    OcclusionCuller(unsigned int width = 256, unsigned int height = 128);
+    ~OcclusionCuller();
+
+    // Copies the triangles of the mesh, returns the id used by OccluderInstance
+    unsigned int AddOccluderMesh(const Mesh *mesh);
+
+    // Starts a culling job, all arguments are copied
+    void Submit(const glm::mat4 &viewProjection,
+                const std::vector<OccluderInstance> &occluders,
+                const std::vector<BoundingBox> &boxes);
+
+    // Waits for the last job and writes 1 (potentially visible) or 0 (occluded) per box
+    void Wait(std::vector<unsigned char> &visibility);
+
+    // Counters of the last finished job
+    const CullingStats &GetStats() const;
+    float GetRejectedFraction() const;
+
+ private:
+    struct OccluderMesh {
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> indices;
+    };
+
+    void Run();
+
+    void ClearDepth();
+    void RasterizeOccluder(const OccluderMesh &mesh, const glm::mat4 &modelViewProjection);
+    void RasterizeTriangle(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2);
+    void UpdateTiles();
+    bool IsVisible(const BoundingBox &box) const;
+
+ private:
+    unsigned int width, height;
+    unsigned int tilesX, tilesY;
+    std::vector<float> depth;
+    std::vector<float> tileMaxDepth;
+
+    std::vector<OccluderMesh> occluderMeshes;
+    std::vector<glm::vec4> projected;
+
+    // Job data, only touched by the job between Submit and Wait
+    glm::mat4 viewProjection;
+    std::vector<OccluderInstance> occluders;
+    std::vector<BoundingBox> boxes;
+    std::vector<unsigned char> results;
+    CullingStats stats;
+    CullingStats lastStats;
+
+    JobCounter job;
+};
@@ -2,6 +2,7 @@
 
 #include <iostream>
 
+#include "core/jobs/job_system.h"
 #include "core/managers/texture_manager.h"
 #include "utils/gl_utils.h"
 
@@ -28,6 +29,9 @@ WindowObject* Engine::Init(const WindowProperties & props)
 
     TextureManager::Init(window->props.selfDir);
 
+    // The thread owning the GL context is the main thread of the job system
+    JobSystem::Init();
+
     return window;
 }
 
@@ -42,6 +46,7 @@ void Engine::Exit()
 {
     std::cout << "=====================================================" << std::endl;
     std::cout << "Engine closed. Exit" << std::endl;
+    JobSystem::Shutdown();
     glfwTerminate();
 }
 
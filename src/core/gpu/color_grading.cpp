@@ -0,0 +1,308 @@
+#include "core/gpu/color_grading.h"
+
+#include <cmath>
+
+#include "core/gpu/render_stats.h"
+#include "core/jobs/job_system.h"
+#include "utils/math_utils.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#   include <xmmintrin.h>
+#   define COLOR_GRADING_SIMD
+#endif
+
+
+namespace
+{
+    // Fewer slices than this aren't worth a job
+    const unsigned int MIN_SLICES_PER_JOB = 4;
+
+    // Keeps the denominators of the HSV conversion away from zero, gray has delta 0
+    const float EPSILON = 1e-20f;
+
+
+    // Hue wrapped into [0, 1), x is within one turn of it
+    inline float WrapTurn(float x)
+    {
+        if (x < 0) x += 1;
+        if (x >= 1) x -= 1;
+        return x;
+    }
+
+
+    void GradeColor(const ColorGrade &grade, float &r, float &g, float &b)
+    {
+        // rgb2hsv
+        float maxC = MAX(r, MAX(g, b));
+        float minC = MIN(r, MIN(g, b));
+        float delta = maxC - minC;
+        float d = MAX(delta, EPSILON);
+
+        float h;
+        if (maxC == r)      h = (g - b) / d;
+        else if (maxC == g) h = (b - r) / d + 2;
+        else                h = (r - g) / d + 4;
+        h = WrapTurn(h / 6);
+        float s = delta / MAX(maxC, EPSILON);
+        float v = maxC;
+
+        // Short way around the wheel to the target hue
+        float toTarget = grade.hue - h;
+        if (toTarget > 0.5f) toTarget -= 1;
+        else if (toTarget < -0.5f) toTarget += 1;
+
+        h = WrapTurn(h + toTarget * grade.hueShift);
+        s = MIN(s * grade.saturation, 1.0f);
+        v = MIN(v * grade.value, 1.0f);
+
+        // hsv2rgb, each channel is v (1 - s + s clamp(|6 fract(h + k) - 3| - 1, 0, 1))
+        const float offsets[3] = { 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float *channels[3] = { &r, &g, &b };
+        for (int c = 0; c < 3; c++)
+        {
+            float x = h + offsets[c];
+            if (x >= 1) x -= 1;
+            float f = MIN(MAX(fabsf(6 * x - 3) - 1, 0.0f), 1.0f);
+            *channels[c] = v * (1 - s + s * f);
+        }
+    }
+
+
+#ifdef COLOR_GRADING_SIMD
+    inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+
+    inline __m128 WrapTurn4(__m128 x)
+    {
+        const __m128 one = _mm_set1_ps(1.0f);
+        x = _mm_add_ps(x, _mm_and_ps(_mm_cmplt_ps(x, _mm_setzero_ps()), one));
+        return _mm_sub_ps(x, _mm_and_ps(_mm_cmpge_ps(x, one), one));
+    }
+
+
+    void Rgb2Hsv4(__m128 r, __m128 g, __m128 b, __m128 &h, __m128 &s, __m128 &v)
+    {
+        __m128 maxC = _mm_max_ps(r, _mm_max_ps(g, b));
+        __m128 minC = _mm_min_ps(r, _mm_min_ps(g, b));
+        __m128 delta = _mm_sub_ps(maxC, minC);
+        __m128 d = _mm_max_ps(delta, _mm_set1_ps(EPSILON));
+
+        __m128 hr = _mm_div_ps(_mm_sub_ps(g, b), d);
+        __m128 hg = _mm_add_ps(_mm_div_ps(_mm_sub_ps(b, r), d), _mm_set1_ps(2.0f));
+        __m128 hb = _mm_add_ps(_mm_div_ps(_mm_sub_ps(r, g), d), _mm_set1_ps(4.0f));
+
+        // Same priority as the scalar version when two channels are the largest
+        __m128 isRed = _mm_cmpeq_ps(maxC, r);
+        __m128 isGreen = _mm_cmpeq_ps(maxC, g);
+        h = Select(isRed, hr, Select(isGreen, hg, hb));
+        h = WrapTurn4(_mm_mul_ps(h, _mm_set1_ps(1.0f / 6.0f)));
+
+        s = _mm_div_ps(delta, _mm_max_ps(maxC, _mm_set1_ps(EPSILON)));
+        v = maxC;
+    }
+
+
+    void Hsv2Rgb4(__m128 h, __m128 s, __m128 v, __m128 &r, __m128 &g, __m128 &b)
+    {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        const float offsets[3] = { 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        __m128 *channels[3] = { &r, &g, &b };
+
+        // v (1 - s) + v s f
+        __m128 base = _mm_mul_ps(v, _mm_sub_ps(one, s));
+        __m128 scale = _mm_mul_ps(v, s);
+
+        for (int c = 0; c < 3; c++)
+        {
+            __m128 x = _mm_add_ps(h, _mm_set1_ps(offsets[c]));
+            x = _mm_sub_ps(x, _mm_and_ps(_mm_cmpge_ps(x, one), one));
+
+            __m128 f = _mm_sub_ps(_mm_mul_ps(x, _mm_set1_ps(6.0f)), _mm_set1_ps(3.0f));
+            f = _mm_sub_ps(_mm_andnot_ps(signMask, f), one);
+            f = _mm_min_ps(_mm_max_ps(f, _mm_setzero_ps()), one);
+
+            *channels[c] = _mm_add_ps(base, _mm_mul_ps(scale, f));
+        }
+    }
+
+
+    void GradeColor4(const ColorGrade &grade, __m128 &r, __m128 &g, __m128 &b)
+    {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+
+        __m128 h, s, v;
+        Rgb2Hsv4(r, g, b, h, s, v);
+
+        __m128 toTarget = _mm_sub_ps(_mm_set1_ps(grade.hue), h);
+        toTarget = _mm_sub_ps(toTarget, _mm_and_ps(_mm_cmpgt_ps(toTarget, half), one));
+        toTarget = _mm_add_ps(toTarget, _mm_and_ps(_mm_cmplt_ps(toTarget, _mm_sub_ps(_mm_setzero_ps(), half)), one));
+
+        h = WrapTurn4(_mm_add_ps(h, _mm_mul_ps(toTarget, _mm_set1_ps(grade.hueShift))));
+        s = _mm_min_ps(_mm_mul_ps(s, _mm_set1_ps(grade.saturation)), one);
+        v = _mm_min_ps(_mm_mul_ps(v, _mm_set1_ps(grade.value)), one);
+
+        Hsv2Rgb4(h, s, v, r, g, b);
+    }
+#endif
+
+
+    inline unsigned char ToByte(float x)
+    {
+        return static_cast<unsigned char>(MIN(MAX(x, 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+}
+
+
+bool ColorGrade::IsIdentity() const
+{
+    return hueShift == 0 && saturation == 1 && value == 1;
+}
+
+
+bool ColorGrade::operator==(const ColorGrade &other) const
+{
+    return hue == other.hue && hueShift == other.hueShift &&
+           saturation == other.saturation && value == other.value;
+}
+
+
+ColorGradingLut::ColorGradingLut(unsigned int size)
+    : size(MAX(size, 2u)), uploaded(false), regenerations(0), texture(0)
+{
+    Generate();
+}
+
+
+ColorGradingLut::~ColorGradingLut()
+{
+    if (texture)
+        glDeleteTextures(1, &texture);
+}
+
+
+void ColorGradingLut::SetGrade(const ColorGrade &grade)
+{
+    if (grade == this->grade)
+        return;
+
+    this->grade = grade;
+    Generate();
+}
+
+
+const ColorGrade &ColorGradingLut::GetGrade() const
+{
+    return grade;
+}
+
+
+void ColorGradingLut::BindToTextureUnit(GLenum textureUnit)
+{
+    glActiveTexture(textureUnit);
+
+    if (!texture)
+    {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_3D, texture);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8, size, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    }
+
+    glBindTexture(GL_TEXTURE_3D, texture);
+    render_stats::AddTextureBind();
+
+    // The storage is kept, only its content is replaced
+    if (!uploaded)
+    {
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, size, size, size, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+        uploaded = true;
+        CheckOpenGLError();
+    }
+}
+
+
+unsigned int ColorGradingLut::GetSize() const
+{
+    return size;
+}
+
+
+unsigned int ColorGradingLut::GetRegenerationCount() const
+{
+    return regenerations;
+}
+
+
+void ColorGradingLut::Generate()
+{
+    texels.resize(static_cast<size_t>(size) * size * size * 4);
+
+    // Blue slices are split between the job threads
+    JobSystem::ParallelFor(size, [this](size_t first, size_t last) {
+        GenerateSlices(static_cast<unsigned int>(first), static_cast<unsigned int>(last));
+    }, MIN_SLICES_PER_JOB);
+
+    uploaded = false;
+    regenerations++;
+}
+
+
+void ColorGradingLut::GenerateSlices(unsigned int first, unsigned int last)
+{
+    const float step = 1.0f / (size - 1);
+
+    for (unsigned int z = first; z < last; z++)
+    {
+        for (unsigned int y = 0; y < size; y++)
+        {
+            unsigned char *row = &texels[((static_cast<size_t>(z) * size + y) * size) * 4];
+            unsigned int x = 0;
+
+#ifdef COLOR_GRADING_SIMD
+            // Four consecutive reds of the row at once
+            for (; x + 4 <= size; x += 4)
+            {
+                __m128 r = _mm_mul_ps(_mm_set_ps(x + 3.0f, x + 2.0f, x + 1.0f, x + 0.0f), _mm_set1_ps(step));
+                __m128 g = _mm_set1_ps(y * step);
+                __m128 b = _mm_set1_ps(z * step);
+                GradeColor4(grade, r, g, b);
+
+                float red[4], green[4], blue[4];
+                _mm_storeu_ps(red, r);
+                _mm_storeu_ps(green, g);
+                _mm_storeu_ps(blue, b);
+
+                for (int k = 0; k < 4; k++)
+                {
+                    unsigned char *texel = row + (x + k) * 4;
+                    texel[0] = ToByte(red[k]);
+                    texel[1] = ToByte(green[k]);
+                    texel[2] = ToByte(blue[k]);
+                    texel[3] = 255;
+                }
+            }
+#endif
+
+            for (; x < size; x++)
+            {
+                float r = x * step, g = y * step, b = z * step;
+                GradeColor(grade, r, g, b);
+
+                unsigned char *texel = row + x * 4;
+                texel[0] = ToByte(r);
+                texel[1] = ToByte(g);
+                texel[2] = ToByte(b);
+                texel[3] = 255;
+            }
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+
+#include "utils/gl_utils.h"
+
+
+// Color adjustment done in HSV space. Hues are turned toward a target hue
+// along the short way around the wheel, saturation and value are scaled.
+// Colors are in 0 to 1, hues in turns.
+struct ColorGrade
+{
+    ColorGrade() : hue(0), hueShift(0), saturation(1), value(1) { }
+
+    bool IsIdentity() const;
+    bool operator==(const ColorGrade &other) const;
+    bool operator!=(const ColorGrade &other) const { return !(*this == other); }
+
+    float hue;          // Target of the hue shift
+    float hueShift;     // 0 keeps every hue, 1 moves all of them onto the target
+    float saturation;
+    float value;
+};
+
+
+// 3D table of a color grade, sampled with the scene color as coordinates so
+// grading a pixel is one texture fetch whatever the grade does.
+//
+// The table is only computed again when the grade changes, split over the
+// job threads, four colors at a time with SSE. The texture is created on first
+// use and refreshed in place.
+class ColorGradingLut
+{
+ public:
+    // size: entries along each axis
+    ColorGradingLut(unsigned int size = 32);
+    ~ColorGradingLut();
+
+    // Computes the table when the grade differs from the current one
+    void SetGrade(const ColorGrade &grade);
+    const ColorGrade &GetGrade() const;
+
+    // Uploads the table first if it changed since the last bind
+    void BindToTextureUnit(GLenum textureUnit);
+
+    unsigned int GetSize() const;
+    unsigned int GetRegenerationCount() const;
+
+ private:
+    void Generate();
+    void GenerateSlices(unsigned int first, unsigned int last);
+
+ private:
+    unsigned int size;
+    ColorGrade grade;
+
+    std::vector<unsigned char> texels;      // RGBA8, red varies fastest
+    bool uploaded;
+    unsigned int regenerations;
+
+    GLuint texture;
+};
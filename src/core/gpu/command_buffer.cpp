@@ -0,0 +1,338 @@
+#include "core/gpu/command_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "core/gpu/gpu_scene.h"
+#include "core/gpu/render_stats.h"
+#include "core/jobs/job_system.h"
+#include "utils/gl_utils.h"
+
+
+namespace
+{
+    // Texture units the executor tracks to skip rebinding the same texture
+    const unsigned int TRACKED_TEXTURE_UNITS = 32;
+
+    // Binding the executor hasn't set yet, unlike 0 which unbinds
+    const GLuint UNKNOWN_BINDING = ~0u;
+}
+
+
+void CommandBuffer::Clear()
+{
+    commands.clear();
+    payload.clear();
+}
+
+
+size_t CommandBuffer::Size() const
+{
+    return commands.size();
+}
+
+
+void CommandBuffer::UseProgram(unsigned int program)
+{
+    RenderCommand command = {};
+    command.type = RenderCommand::USE_PROGRAM;
+    command.object = program;
+    commands.push_back(command);
+}
+
+
+void CommandBuffer::BindTexture(unsigned int unit, unsigned int target, unsigned int texture)
+{
+    RenderCommand command = {};
+    command.type = RenderCommand::BIND_TEXTURE;
+    command.slot = static_cast<int>(unit);
+    command.mode = target;
+    command.object = texture;
+    commands.push_back(command);
+}
+
+
+void CommandBuffer::DrawIndexed(unsigned int vertexArray, unsigned int mode, unsigned int nrIndices, unsigned int firstIndex, int baseVertex)
+{
+    RenderCommand command = {};
+    command.type = RenderCommand::DRAW_INDEXED;
+    command.object = vertexArray;
+    command.mode = mode;
+    command.count = nrIndices;
+    command.first = firstIndex;
+    command.baseVertex = baseVertex;
+    commands.push_back(command);
+}
+
+
+void CommandBuffer::DrawIndexedIndirect(unsigned int vertexArray, unsigned int mode, unsigned int firstDraw, unsigned int drawCount)
+{
+    RenderCommand command = {};
+    command.type = RenderCommand::DRAW_INDEXED_INDIRECT;
+    command.object = vertexArray;
+    command.mode = mode;
+    command.count = drawCount;
+    command.first = firstDraw;
+    commands.push_back(command);
+}
+
+
+void CommandBuffer::BindUniformBlock(unsigned int binding, unsigned int buffer, unsigned int offset, unsigned int size)
+{
+    RenderCommand command = {};
+    command.type = RenderCommand::BIND_UNIFORM_BLOCK;
+    command.slot = static_cast<int>(binding);
+    command.object = buffer;
+    command.first = offset;
+    command.count = size;
+    commands.push_back(command);
+}
+
+
+void CommandBuffer::BindStorageBuffer(unsigned int binding, unsigned int buffer)
+{
+    RenderCommand command = {};
+    command.type = RenderCommand::BIND_STORAGE_BUFFER;
+    command.slot = static_cast<int>(binding);
+    command.object = buffer;
+    commands.push_back(command);
+}
+
+
+void CommandBuffer::BindIndirectBuffer(unsigned int buffer)
+{
+    RenderCommand command = {};
+    command.type = RenderCommand::BIND_INDIRECT_BUFFER;
+    command.object = buffer;
+    commands.push_back(command);
+}
+
+
+void CommandBuffer::SetUniform(int slot, int value)
+{
+    AddUniform(RenderCommand::UNIFORM_INT, slot, &value, 1, sizeof(value));
+}
+
+
+void CommandBuffer::SetUniform(int slot, unsigned int value)
+{
+    AddUniform(RenderCommand::UNIFORM_UINT, slot, &value, 1, sizeof(value));
+}
+
+
+void CommandBuffer::SetUniform(int slot, float value)
+{
+    AddUniform(RenderCommand::UNIFORM_FLOAT, slot, &value, 1, sizeof(value));
+}
+
+
+void CommandBuffer::SetUniform(int slot, const float *values, unsigned int count)
+{
+    AddUniform(RenderCommand::UNIFORM_FLOAT, slot, values, count, sizeof(float) * count);
+}
+
+
+void CommandBuffer::SetUniform(int slot, const glm::vec3 *values, unsigned int count)
+{
+    AddUniform(RenderCommand::UNIFORM_VEC3, slot, values, count, sizeof(glm::vec3) * count);
+}
+
+
+void CommandBuffer::SetUniform(int slot, const glm::vec4 *values, unsigned int count)
+{
+    AddUniform(RenderCommand::UNIFORM_VEC4, slot, values, count, sizeof(glm::vec4) * count);
+}
+
+
+void CommandBuffer::SetUniform(int slot, const glm::mat4 *values, unsigned int count)
+{
+    AddUniform(RenderCommand::UNIFORM_MAT4, slot, values, count, sizeof(glm::mat4) * count);
+}
+
+
+void CommandBuffer::AddUniform(RenderCommand::Type type, int slot, const void *values, unsigned int count, size_t size)
+{
+    if (slot < 0 || count == 0)
+        return;
+
+    // Every value is a 4 byte scalar, so offsets stay aligned for the executor
+    RenderCommand command = {};
+    command.type = type;
+    command.slot = slot;
+    command.count = count;
+    command.first = static_cast<unsigned int>(payload.size());
+    commands.push_back(command);
+
+    payload.resize(payload.size() + size);
+    memcpy(payload.data() + command.first, values, size);
+}
+
+
+CommandQueue::CommandQueue()
+    : nextKey(0)
+{
+}
+
+
+void CommandQueue::Reset()
+{
+    for (auto &buffer : buffers)
+        buffer.Clear();
+    for (auto &threadSegments : segments)
+        threadSegments.clear();
+
+    nextKey = 0;
+}
+
+
+void CommandQueue::Record(size_t count, const RecordFunction &record, size_t minGrain)
+{
+    // Job threads never change while the system runs, buffers are only added here
+    const size_t threads = JobSystem::GetThreadCount();
+    if (buffers.size() < threads)
+    {
+        buffers.resize(threads);
+        segments.resize(threads);
+    }
+
+    const size_t base = nextKey;
+    nextKey += count;
+
+    JobSystem::ParallelFor(count, [this, &record, base](size_t begin, size_t end)
+    {
+        const unsigned int thread = static_cast<unsigned int>(JobSystem::GetThreadIndex());
+        CommandBuffer &buffer = buffers[thread];
+
+        Segment segment;
+        segment.key = base + begin;
+        segment.thread = thread;
+        segment.first = buffer.Size();
+        record(buffer, begin, end);
+        segment.last = buffer.Size();
+
+        if (segment.last > segment.first)
+            segments[thread].push_back(segment);
+    }, minGrain);
+}
+
+
+void CommandQueue::Execute()
+{
+    // Merges the parts of every thread back in recording order
+    order.clear();
+    for (const auto &threadSegments : segments)
+        order.insert(order.end(), threadSegments.begin(), threadSegments.end());
+
+    std::sort(order.begin(), order.end(), [](const Segment &a, const Segment &b) {
+        return a.key < b.key;
+    });
+
+    // Bindings are only known after this queue set them, the GL state before is left alone
+    GLuint program = UNKNOWN_BINDING;
+    GLuint vertexArray = UNKNOWN_BINDING;
+    GLuint textures[TRACKED_TEXTURE_UNITS];
+    std::fill(textures, textures + TRACKED_TEXTURE_UNITS, UNKNOWN_BINDING);
+
+    for (const auto &segment : order)
+    {
+        const CommandBuffer &buffer = buffers[segment.thread];
+
+        for (size_t i = segment.first; i < segment.last; i++)
+        {
+            const RenderCommand &command = buffer.commands[i];
+            const void *values = command.type >= RenderCommand::UNIFORM_INT ? buffer.payload.data() + command.first : nullptr;
+
+            switch (command.type)
+            {
+            case RenderCommand::USE_PROGRAM:
+                if (command.object != program) {
+                    render_stats::UseProgram(command.object);
+                    program = command.object;
+                }
+                break;
+
+            case RenderCommand::BIND_TEXTURE:
+                if (command.slot >= static_cast<int>(TRACKED_TEXTURE_UNITS) || textures[command.slot] != command.object)
+                {
+                    glActiveTexture(GL_TEXTURE0 + command.slot);
+                    glBindTexture(command.mode, command.object);
+                    render_stats::AddTextureBind();
+
+                    if (command.slot < static_cast<int>(TRACKED_TEXTURE_UNITS))
+                        textures[command.slot] = command.object;
+                }
+                break;
+
+            case RenderCommand::DRAW_INDEXED:
+                if (command.object != vertexArray) {
+                    glBindVertexArray(command.object);
+                    vertexArray = command.object;
+                }
+                glDrawElementsBaseVertex(command.mode, command.count, GL_UNSIGNED_INT,
+                    (void*)(sizeof(unsigned int) * command.first), command.baseVertex);
+                render_stats::AddDraw(command.mode, command.count);
+                break;
+
+            case RenderCommand::DRAW_INDEXED_INDIRECT:
+                if (command.object != vertexArray) {
+                    glBindVertexArray(command.object);
+                    vertexArray = command.object;
+                }
+                glMultiDrawElementsIndirect(command.mode, GL_UNSIGNED_INT,
+                    (void*)(sizeof(DrawElementsIndirectCommand) * command.first), command.count, 0);
+                // The instances drawn are only known to the GPU, one call is counted without triangles
+                render_stats::AddDraw(command.mode, 0);
+                break;
+
+            case RenderCommand::BIND_UNIFORM_BLOCK:
+                glBindBufferRange(GL_UNIFORM_BUFFER, command.slot, command.object, command.first, command.count);
+                break;
+
+            case RenderCommand::BIND_STORAGE_BUFFER:
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, command.slot, command.object);
+                break;
+
+            case RenderCommand::BIND_INDIRECT_BUFFER:
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command.object);
+                break;
+
+            case RenderCommand::UNIFORM_INT:
+                glUniform1iv(command.slot, command.count, static_cast<const GLint *>(values));
+                break;
+
+            case RenderCommand::UNIFORM_UINT:
+                glUniform1uiv(command.slot, command.count, static_cast<const GLuint *>(values));
+                break;
+
+            case RenderCommand::UNIFORM_FLOAT:
+                glUniform1fv(command.slot, command.count, static_cast<const GLfloat *>(values));
+                break;
+
+            case RenderCommand::UNIFORM_VEC3:
+                glUniform3fv(command.slot, command.count, static_cast<const GLfloat *>(values));
+                break;
+
+            case RenderCommand::UNIFORM_VEC4:
+                glUniform4fv(command.slot, command.count, static_cast<const GLfloat *>(values));
+                break;
+
+            case RenderCommand::UNIFORM_MAT4:
+                glUniformMatrix4fv(command.slot, command.count, GL_FALSE, static_cast<const GLfloat *>(values));
+                break;
+            }
+        }
+    }
+
+    if (vertexArray != UNKNOWN_BINDING)
+        glBindVertexArray(0);
+}
+
+
+size_t CommandQueue::GetCommandCount() const
+{
+    size_t count = 0;
+    for (const auto &buffer : buffers)
+        count += buffer.Size();
+
+    return count;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "utils/glm_utils.h"
+
+
+// One recorded render call. Commands only hold plain numbers (program,
+// texture and vertex array names, GL enums and uniform locations), uniform
+// values are copied to the payload of the buffer.
+struct RenderCommand
+{
+    enum Type : unsigned char
+    {
+        USE_PROGRAM,
+        BIND_TEXTURE,
+        DRAW_INDEXED,
+        DRAW_INDEXED_INDIRECT,
+        BIND_UNIFORM_BLOCK,
+        BIND_STORAGE_BUFFER,
+        BIND_INDIRECT_BUFFER,
+        UNIFORM_INT,
+        UNIFORM_UINT,
+        UNIFORM_FLOAT,
+        UNIFORM_VEC3,
+        UNIFORM_VEC4,
+        UNIFORM_MAT4
+    };
+
+    Type type;
+    int slot;               // Uniform location, texture unit or uniform block binding
+    unsigned int object;    // Program, texture, vertex array or buffer
+    unsigned int mode;      // Texture target or primitive
+    unsigned int count;     // Uniform array size, number of indices or draws, or size of the block
+    unsigned int first;     // Offset of the uniform values in the payload, first index or draw, or offset of the block
+    int baseVertex;
+};
+
+
+// Linear list of render commands filled by a single thread. Recording makes
+// no GL call, the commands run later on the GL thread, see CommandQueue.
+// Clearing keeps the memory, so a buffer reused every frame stops allocating.
+class CommandBuffer
+{
+ public:
+    void Clear();
+    size_t Size() const;
+
+    void UseProgram(unsigned int program);
+    void BindTexture(unsigned int unit, unsigned int target, unsigned int texture);
+    void DrawIndexed(unsigned int vertexArray, unsigned int mode, unsigned int nrIndices, unsigned int firstIndex, int baseVertex);
+
+    // Draws [firstDraw, firstDraw + drawCount) of the bound indirect buffer,
+    // DrawElementsIndirectCommand records filled by the GPU, see GpuScene
+    void DrawIndexedIndirect(unsigned int vertexArray, unsigned int mode, unsigned int firstDraw, unsigned int drawCount);
+
+    // Range of a uniform buffer bound to a uniform block binding, see UniformRing
+    void BindUniformBlock(unsigned int binding, unsigned int buffer, unsigned int offset, unsigned int size);
+
+    void BindStorageBuffer(unsigned int binding, unsigned int buffer);
+    void BindIndirectBuffer(unsigned int buffer);
+
+    // Skipped for negative slots, like glUniform* ignores location -1
+    void SetUniform(int slot, int value);
+    void SetUniform(int slot, unsigned int value);
+    void SetUniform(int slot, float value);
+    void SetUniform(int slot, const float *values, unsigned int count);
+    void SetUniform(int slot, const glm::vec3 *values, unsigned int count = 1);
+    void SetUniform(int slot, const glm::vec4 *values, unsigned int count = 1);
+    void SetUniform(int slot, const glm::mat4 *values, unsigned int count = 1);
+
+ private:
+    void AddUniform(RenderCommand::Type type, int slot, const void *values, unsigned int count, size_t size);
+
+ private:
+    friend class CommandQueue;
+
+    std::vector<RenderCommand> commands;
+    std::vector<unsigned char> payload;
+};
+
+
+// Commands of a frame recorded by the job threads into one buffer per
+// thread, then run in recording order on the GL thread. The GL context stays
+// on a single thread while culling and command generation are spread over
+// the cores.
+class CommandQueue
+{
+ public:
+    // Fills the commands of the items [begin, end) into buffer
+    typedef std::function<void(CommandBuffer &buffer, size_t begin, size_t end)> RecordFunction;
+
+    CommandQueue();
+
+    // Drops the recorded commands, memory is kept for the next frame
+    void Reset();
+
+    // Splits [0, count) over the job threads and returns once all the parts
+    // are recorded. The commands run in the order of their items, after those
+    // of the previous calls. Must be called from a thread of the job system
+    void Record(size_t count, const RecordFunction &record, size_t minGrain = 1);
+
+    // GL thread only, runs everything recorded since Reset()
+    void Execute();
+
+    size_t GetCommandCount() const;
+
+ private:
+    // Commands [first, last) of a thread buffer, recorded for the item at key
+    struct Segment
+    {
+        size_t key;
+        unsigned int thread;
+        size_t first, last;
+    };
+
+    std::vector<CommandBuffer> buffers;             // One per job thread
+    std::vector<std::vector<Segment>> segments;     // Same
+    std::vector<Segment> order;
+    size_t nextKey;
+};
@@ -0,0 +1,88 @@
+#include "core/gpu/dynamic_resolution.h"
+
+#include <cmath>
+
+#include "utils/math_utils.h"
+
+
+// Scale granularity and number of frames averaged before each decision
+static const float STEP = 0.05f;
+static const unsigned int INTERVAL = 8;
+
+// Fraction of the budget the next scale up may use, leaves room for noise
+static const float UPSCALE_MARGIN = 0.9f;
+
+
+DynamicResolution::DynamicResolution(float targetMilliseconds, float minScale, float maxScale)
+    : targetMilliseconds(targetMilliseconds), enabled(true), sampleSum(0), sampleCount(0)
+{
+    minLevel = MAX(static_cast<int>(std::ceil(minScale / STEP - 1e-3f)), 1);
+    maxLevel = MAX(static_cast<int>(std::floor(maxScale / STEP + 1e-3f)), minLevel);
+    level = maxLevel;
+}
+
+
+void DynamicResolution::SetEnabled(bool enabled)
+{
+    this->enabled = enabled;
+    level = maxLevel;
+    sampleSum = 0;
+    sampleCount = 0;
+}
+
+
+bool DynamicResolution::IsEnabled() const
+{
+    return enabled;
+}
+
+
+void DynamicResolution::SetTarget(float milliseconds)
+{
+    targetMilliseconds = milliseconds;
+}
+
+
+float DynamicResolution::GetTarget() const
+{
+    return targetMilliseconds;
+}
+
+
+bool DynamicResolution::AddSample(float milliseconds)
+{
+    if (!enabled)
+        return false;
+
+    sampleSum += milliseconds;
+    if (++sampleCount < INTERVAL)
+        return false;
+
+    float average = sampleSum / sampleCount;
+    sampleSum = 0;
+    sampleCount = 0;
+
+    int newLevel = level;
+    if (average > targetMilliseconds)
+    {
+        float scale = level * STEP * std::sqrt(targetMilliseconds / average);
+        newLevel = MIN(static_cast<int>(scale / STEP), level - 1);
+    }
+    else
+    {
+        float ratio = static_cast<float>(level + 1) / level;
+        if (average * ratio * ratio < targetMilliseconds * UPSCALE_MARGIN)
+            newLevel = level + 1;
+    }
+
+    newLevel = MAX(minLevel, MIN(newLevel, maxLevel));
+    bool changed = newLevel != level;
+    level = newLevel;
+    return changed;
+}
+
+
+float DynamicResolution::GetScale() const
+{
+    return level * STEP;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+
+// Render scale of the 3D scene picked from measured GPU frame times. The
+// scale moves in fixed steps and only after a few frames have been averaged,
+// so render targets aren't reallocated every frame and a single slow frame
+// doesn't change anything.
+//
+// Going down is done in one go, the pixel cost follows the square of the
+// scale so the step is sized from the square root of the time ratio. Going
+// up is one step at a time and only when the predicted time of the larger
+// scale still fits the budget, which keeps the scale from oscillating.
+class DynamicResolution
+{
+ public:
+    // targetMilliseconds: GPU budget of a frame; scales are fractions of the window size
+    DynamicResolution(float targetMilliseconds = 14.0f, float minScale = 0.5f, float maxScale = 1.0f);
+
+    // While disabled the scale stays at its maximum
+    void SetEnabled(bool enabled);
+    bool IsEnabled() const;
+
+    void SetTarget(float milliseconds);
+    float GetTarget() const;
+
+    // Adds the GPU time of one frame, returns true if the scale changed
+    bool AddSample(float milliseconds);
+
+    float GetScale() const;
+
+ private:
+    float targetMilliseconds;
+    int minLevel, maxLevel;
+    int level;                  // Scale in steps of STEP
+    bool enabled;
+
+    float sampleSum;
+    unsigned int sampleCount;
+};
@@ -17,13 +17,16 @@ FrameBuffer::FrameBuffer()
     depthTexture = nullptr;
     textures = nullptr;
     DrawBuffers = nullptr;
+    nrTextures = 0;
+    width = 0;
+    height = 0;
     clearColor = glm::vec4(0, 0, 0, 1);
 }
 
 
 FrameBuffer::~FrameBuffer()
 {
-    SAFE_FREE(depthTexture);
+    Clean();
 }
 
 
@@ -31,8 +34,11 @@ void FrameBuffer::Clean()
 {
     if (FBO)
         glDeleteFramebuffers(1, &FBO);
+    FBO = 0;
     SAFE_FREE_ARRAY(textures);
     SAFE_FREE_ARRAY(DrawBuffers)
+    SAFE_FREE(depthTexture);
+    nrTextures = 0;
 }
 
 
@@ -0,0 +1,309 @@
+#include "core/gpu/frame_capture.h"
+
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "stb/stb_image_write.h"
+#include "utils/math_utils.h"
+
+
+// Encoded frames waiting in the queue before recorded frames get dropped
+static const size_t MAX_QUEUED_JOBS = 8;
+
+
+FrameCapture::FrameCapture(unsigned int ringSize, unsigned int encoderCount)
+    : slots(MAX(ringSize, 1u)), writeIndex(0), pending(0),
+      recordFormat(Format::RAW), recording(false), recordFrame(0),
+      busy(0), quit(false), framesWritten(0), framesDropped(0), framesFailed(0)
+{
+    for (auto &slot : slots)
+    {
+        slot.PBO = 0;
+        slot.fence = 0;
+        slot.width = 0;
+        slot.height = 0;
+        slot.capacity = 0;
+    }
+
+    // Leave a core for the render thread and one for the rest of the engine
+    if (encoderCount == 0)
+    {
+        unsigned int cores = std::thread::hardware_concurrency();
+        encoderCount = cores > 2 ? MIN(cores - 2, 4u) : 1;
+    }
+
+    for (unsigned int i = 0; i < encoderCount; i++) {
+        encoders.push_back(std::thread(&FrameCapture::EncoderLoop, this));
+    }
+}
+
+
+FrameCapture::~FrameCapture()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    jobAvailable.notify_all();
+
+    // The encoders finish the queued frames before leaving
+    for (auto &encoder : encoders) {
+        encoder.join();
+    }
+
+    for (auto &slot : slots)
+    {
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        if (slot.PBO)
+            glDeleteBuffers(1, &slot.PBO);
+    }
+}
+
+
+void FrameCapture::StartRecording(const std::string &prefix, Format format)
+{
+    recordPrefix = prefix;
+    recordFormat = format;
+    recordFrame = 0;
+    recording = true;
+}
+
+
+void FrameCapture::StopRecording()
+{
+    // The frames still in flight belong to the recording, they are written before returning
+    recording = false;
+    Flush();
+}
+
+
+bool FrameCapture::IsRecording() const
+{
+    return recording;
+}
+
+
+void FrameCapture::RequestScreenshot(const std::string &path)
+{
+    screenshotPath = path;
+}
+
+
+void FrameCapture::Capture(int width, int height)
+{
+    if ((!recording && screenshotPath.empty()) || width <= 0 || height <= 0)
+    {
+        Collect(false);
+        return;
+    }
+
+    if (!slots[0].PBO)
+    {
+        for (auto &slot : slots) {
+            glGenBuffers(1, &slot.PBO);
+        }
+    }
+
+    Collect(false);
+
+    // Every buffer still in flight, the oldest one is the only thing to wait for
+    if (pending == slots.size())
+        Collect(true);
+
+    // The oldest buffer is still not read back after the wait. It is never
+    // overwritten, this frame is skipped and a screenshot waits for the next one
+    if (pending == slots.size())
+    {
+        if (recording)
+            framesDropped++;
+        return;
+    }
+
+    Slot &slot = slots[writeIndex];
+    const size_t size = static_cast<size_t>(width) * height * 4;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+    if (slot.capacity < size)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        slot.capacity = size;
+    }
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.width = width;
+    slot.height = height;
+    slot.outputs.clear();
+
+    if (recording)
+    {
+        char name[64];
+        if (recordFormat == Format::PNG) {
+            snprintf(name, sizeof(name), "_%06u.png", recordFrame);
+        } else {
+            snprintf(name, sizeof(name), "_%06u_%dx%d.rgba", recordFrame, width, height);
+        }
+        Output output = { recordPrefix + name, recordFormat, true };
+        slot.outputs.push_back(output);
+        recordFrame++;
+    }
+
+    if (!screenshotPath.empty())
+    {
+        Output output = { screenshotPath, Format::PNG, false };
+        slot.outputs.push_back(output);
+        screenshotPath.clear();
+    }
+
+    writeIndex = (writeIndex + 1) % slots.size();
+    pending++;
+    CheckOpenGLError();
+}
+
+
+void FrameCapture::Collect(bool wait)
+{
+    while (pending > 0)
+    {
+        Slot &slot = slots[(writeIndex + slots.size() - pending) % slots.size()];
+
+        GLenum status = wait
+            ? glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000)
+            : glClientWaitSync(slot.fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+            break;
+
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+        pending--;
+        wait = false;
+
+        // The copy may never have finished, the buffer is not read
+        if (status == GL_WAIT_FAILED)
+        {
+            framesFailed += static_cast<unsigned int>(slot.outputs.size());
+            slot.outputs.clear();
+            CheckOpenGLError();
+            continue;
+        }
+
+        const size_t rowSize = static_cast<size_t>(slot.width) * 4;
+        const size_t size = rowSize * slot.height;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+        const unsigned char *data = static_cast<const unsigned char *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT));
+
+        if (data)
+        {
+            for (const auto &output : slot.outputs)
+            {
+                Job job;
+                job.path = output.path;
+                job.format = output.format;
+                job.width = slot.width;
+                job.height = slot.height;
+
+                // Rows come bottom up from OpenGL, images are stored top down
+                job.pixels.resize(size);
+                for (int y = 0; y < slot.height; y++) {
+                    memcpy(&job.pixels[y * rowSize], data + (slot.height - 1 - y) * rowSize, rowSize);
+                }
+
+                Enqueue(job, output.droppable);
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.outputs.clear();
+    }
+}
+
+
+void FrameCapture::Enqueue(Job &job, bool droppable)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (droppable && jobs.size() >= MAX_QUEUED_JOBS)
+        {
+            framesDropped++;
+            return;
+        }
+        jobs.push_back(std::move(job));
+    }
+    jobAvailable.notify_one();
+}
+
+
+void FrameCapture::EncoderLoop()
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock, [this]() { return quit || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            busy++;
+        }
+
+        bool written = false;
+        if (job.format == Format::PNG)
+        {
+            written = stbi_write_png(job.path.c_str(), job.width, job.height, 4, job.pixels.data(), job.width * 4) != 0;
+        }
+        else if (FILE *file = fopen(job.path.c_str(), "wb"))
+        {
+            written = fwrite(job.pixels.data(), 1, job.pixels.size(), file) == job.pixels.size();
+            written = fclose(file) == 0 && written;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy--;
+            if (written)
+                framesWritten++;
+            else
+                framesFailed++;
+        }
+        jobDone.notify_all();
+    }
+}
+
+
+void FrameCapture::Flush()
+{
+    while (pending > 0) {
+        Collect(true);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    jobDone.wait(lock, [this]() { return jobs.empty() && busy == 0; });
+}
+
+
+unsigned int FrameCapture::GetFramesWritten() const
+{
+    return framesWritten;
+}
+
+
+unsigned int FrameCapture::GetFramesDropped() const
+{
+    return framesDropped;
+}
+
+
+unsigned int FrameCapture::GetFramesFailed() const
+{
+    return framesFailed;
+}
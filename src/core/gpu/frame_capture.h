@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/gl_utils.h"
+
+
+// Reads frames back from the GPU without stalling it and writes them from
+// background threads.
+//
+// glReadPixels goes into a ring of pixel pack buffers, so the call returns as
+// soon as the copy is queued. Each buffer gets a fence and is only mapped once
+// the fence has passed, normally a few frames later. The pixels are then
+// handed to a pool of encoder threads writing PNG or raw RGBA files.
+//
+// Recording keeps going at the full frame rate: when the encoders fall behind
+// and their queue is full, frames are dropped and counted instead of making
+// the render thread wait.
+class FrameCapture
+{
+ public:
+    enum class Format { PNG, RAW };
+
+    // ringSize: frames in flight on the GPU; encoders: 0 picks from the core count
+    FrameCapture(unsigned int ringSize = 3, unsigned int encoders = 0);
+    ~FrameCapture();
+
+    // Files are named prefix_<frame>.png, or prefix_<frame>_<width>x<height>.rgba
+    // for raw frames, which ffmpeg reads with -f rawvideo -pix_fmt rgba
+    void StartRecording(const std::string &prefix, Format format = Format::RAW);
+    // GL thread. Waits until the frames of the recording still in flight are written
+    void StopRecording();
+    bool IsRecording() const;
+
+    // One PNG of the next captured frame
+    void RequestScreenshot(const std::string &path);
+
+    // Call once per frame after rendering, with the frame in the bound read framebuffer
+    void Capture(int width, int height);
+
+    // GL thread. Waits until everything captured so far is written, call it
+    // before the context goes away or the last frames are lost
+    void Flush();
+
+    unsigned int GetFramesWritten() const;
+    unsigned int GetFramesDropped() const;
+    // Files that could not be written and frames whose read back failed
+    unsigned int GetFramesFailed() const;
+
+ private:
+    struct Output {
+        std::string path;
+        Format format;
+        bool droppable;         // Recorded frames can be dropped, screenshots can't
+    };
+
+    struct Slot {
+        GLuint PBO;
+        GLsync fence;
+        int width;
+        int height;
+        size_t capacity;
+        std::vector<Output> outputs;
+    };
+
+    struct Job {
+        std::string path;
+        Format format;
+        int width;
+        int height;
+        std::vector<unsigned char> pixels;
+    };
+
+    void Collect(bool wait);
+    void Enqueue(Job &job, bool droppable);
+    void EncoderLoop();
+
+ private:
+    std::vector<Slot> slots;
+    unsigned int writeIndex;
+    unsigned int pending;
+
+    std::string recordPrefix;
+    Format recordFormat;
+    bool recording;
+    unsigned int recordFrame;
+    std::string screenshotPath;
+
+    std::vector<std::thread> encoders;
+    std::deque<Job> jobs;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable jobDone;
+    unsigned int busy;
+    bool quit;
+
+    std::atomic<unsigned int> framesWritten;
+    std::atomic<unsigned int> framesDropped;
+    std::atomic<unsigned int> framesFailed;
+};
@@ -0,0 +1,506 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <vector>
+
+#include "utils/gl_utils.h"
+#include "utils/math_utils.h"
+
+
+// Typed GL buffer of a fixed number of entries with a CPU copy. Writes go
+// to the copy and only mark their entries dirty, Flush() sends the dirty
+// spans, merged, either in place or as new storage for the whole buffer.
+// The copy is allocated on the first write, a buffer only written by
+// shaders never has one.
+//
+// ReadAsync() copies entries to a staging buffer behind the commands issued
+// so far and returns a future. PollReadbacks() resolves it once the fence
+// after the copy signaled, so results of compute shaders come back a few
+// frames later without the CPU waiting for the GPU.
+//
+// With direct state access the buffer is never bound for an update or a
+// copy. Without it the copy targets are used, they are left bound since
+// every user binds them before use.
+template <class T>
+class GpuBuffer
+{
+ public:
+    // How Flush() sends the dirty entries
+    enum class UpdateStrategy
+    {
+        SubData,    // The dirty spans in place, the driver may wait for the draws still reading them
+        Orphan      // The whole copy into new storage, the draws in flight keep the old one
+    };
+
+    GpuBuffer(GLenum target, unsigned int size, GLenum usage = GL_DYNAMIC_DRAW, UpdateStrategy strategy = UpdateStrategy::SubData);
+    virtual ~GpuBuffer();
+
+    void Set(unsigned int index, const T &value);
+    void Set(const T *values, unsigned int first, unsigned int count);
+    // Entries to write in place, marked dirty
+    T *Modify(unsigned int first, unsigned int count);
+    void MarkDirty(unsigned int first, unsigned int count);
+    // The copy is zeroed when allocated before the first write
+    void AllocateLocalCopy();
+    // Null while there is no copy
+    const T *GetData() const;
+    // GL thread. Flushes, then frees the copy. A later write starts again from a zeroed copy
+    void ReleaseLocalCopy();
+
+    // GL thread. Nothing is sent when no entry is dirty
+    void Flush();
+    // GL thread. Applied by the next Flush(), which then sends the whole copy
+    void SetUsage(GLenum usage);
+    void SetStrategy(UpdateStrategy strategy);
+    // GL thread. Zeroes the GPU storage, the CPU copy is left alone
+    void ClearStorage() const;
+
+    void Bind() const;
+    // Indexed targets: storage, uniform and atomic counter buffers
+    void BindBase(GLuint index) const;
+    void BindRange(GLuint index, unsigned int first, unsigned int count) const;
+
+    // GL thread. Writes of shaders need glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT) first.
+    // The result is empty when the fence or the mapping of the copy failed
+    std::future<std::vector<T>> ReadAsync(unsigned int first, unsigned int count);
+    // GL thread. Resolves the readbacks whose copy finished, wait blocks until all did
+    void PollReadbacks(bool wait = false);
+    // GL thread. Blocking readback into the CPU copy, which then matches the GPU
+    void Read(unsigned int first, unsigned int count);
+
+    GLuint GetBufferID() const;
+    GLenum GetUsage() const;
+    unsigned int GetSize() const;
+    size_t GetMemorySize() const;
+    unsigned int GetPendingReadbacks() const;
+
+ private:
+    // Entries [first, last)
+    struct Span
+    {
+        unsigned int first;
+        unsigned int last;
+    };
+
+    struct StagingBuffer
+    {
+        GLuint buffer;
+        size_t size;            // In bytes
+    };
+
+    struct Readback
+    {
+        StagingBuffer staging;
+        GLsync fence;
+        unsigned int count;
+        std::promise<std::vector<T>> promise;
+    };
+
+    // Fence waits of a blocking poll are split so a lost context can't hang it
+    static const GLuint64 FENCE_TIMEOUT_NS = 1000000;
+
+    static GLuint CreateBuffer();
+    static void SetStorage(GLuint buffer, size_t size, const void *data, GLenum usage);
+    StagingBuffer AcquireStaging(size_t size);
+
+ private:
+    GpuBuffer(const GpuBuffer &) = delete;
+    GpuBuffer &operator=(const GpuBuffer &) = delete;
+
+ private:
+    GLenum target;
+    GLenum usage;
+    UpdateStrategy strategy;
+    GLuint buffer;
+    unsigned int size;
+    bool respecify;             // Usage changed, the next Flush() creates new storage
+
+    std::vector<T> localCopy;
+    std::vector<Span> dirty;    // Unsorted, merged by Flush()
+
+    std::vector<Readback> readbacks;
+    std::vector<StagingBuffer> freeStaging;
+};
+
+
+template <class T>
+GpuBuffer<T>::GpuBuffer(GLenum target, unsigned int size, GLenum usage, UpdateStrategy strategy)
+    : target(target), usage(usage), strategy(strategy), buffer(CreateBuffer()), size(size), respecify(false)
+{
+    SetStorage(buffer, GetMemorySize(), NULL, usage);
+}
+
+
+template <class T>
+GpuBuffer<T>::~GpuBuffer()
+{
+    // The futures of the pending readbacks get a broken promise
+    for (Readback &readback : readbacks)
+    {
+        glDeleteSync(readback.fence);
+        freeStaging.push_back(readback.staging);
+    }
+    for (const StagingBuffer &staging : freeStaging)
+        glDeleteBuffers(1, &staging.buffer);
+
+    glDeleteBuffers(1, &buffer);
+}
+
+
+template <class T>
+void GpuBuffer<T>::Set(unsigned int index, const T &value)
+{
+    // Out of range writes are ignored, as by the ranged Set()
+    if (T *entry = Modify(index, 1))
+        *entry = value;
+}
+
+
+template <class T>
+void GpuBuffer<T>::Set(const T *values, unsigned int first, unsigned int count)
+{
+    T *entries = Modify(first, count);
+    if (entries && entries != values)
+        std::memmove(entries, values, sizeof(T) * MIN(count, size - first));
+}
+
+
+template <class T>
+T *GpuBuffer<T>::Modify(unsigned int first, unsigned int count)
+{
+    if (first >= size)
+        return nullptr;
+
+    AllocateLocalCopy();
+    MarkDirty(first, count);
+    return &localCopy[first];
+}
+
+
+template <class T>
+void GpuBuffer<T>::MarkDirty(unsigned int first, unsigned int count)
+{
+    count = MIN(count, size - MIN(first, size));
+    if (count)
+        dirty.push_back({ first, first + count });
+}
+
+
+template <class T>
+void GpuBuffer<T>::AllocateLocalCopy()
+{
+    if (localCopy.empty())
+        localCopy.resize(size);
+}
+
+
+template <class T>
+const T *GpuBuffer<T>::GetData() const
+{
+    return localCopy.empty() ? nullptr : localCopy.data();
+}
+
+
+template <class T>
+void GpuBuffer<T>::ReleaseLocalCopy()
+{
+    Flush();
+    std::vector<T>().swap(localCopy);
+    dirty.clear();
+}
+
+
+template <class T>
+void GpuBuffer<T>::Flush()
+{
+    if (localCopy.empty() || (dirty.empty() && !respecify))
+        return;
+
+    if (strategy == UpdateStrategy::Orphan || respecify)
+    {
+        SetStorage(buffer, GetMemorySize(), localCopy.data(), usage);
+        respecify = false;
+        dirty.clear();
+        return;
+    }
+
+    // Overlapping and touching spans are sent as one
+    std::sort(dirty.begin(), dirty.end(), [](const Span &a, const Span &b) {
+        return a.first < b.first;
+    });
+
+    if (!GLEW_ARB_direct_state_access)
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+    Span span = dirty[0];
+    for (size_t i = 1; i <= dirty.size(); i++)
+    {
+        if (i < dirty.size() && dirty[i].first <= span.last)
+        {
+            span.last = MAX(span.last, dirty[i].last);
+            continue;
+        }
+
+        const GLintptr offset = sizeof(T) * span.first;
+        const GLsizeiptr bytes = sizeof(T) * (span.last - span.first);
+        if (GLEW_ARB_direct_state_access)
+            glNamedBufferSubData(buffer, offset, bytes, &localCopy[span.first]);
+        else
+            glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, &localCopy[span.first]);
+
+        if (i < dirty.size())
+            span = dirty[i];
+    }
+    dirty.clear();
+}
+
+
+template <class T>
+void GpuBuffer<T>::SetUsage(GLenum usage)
+{
+    if (usage == this->usage)
+        return;
+
+    this->usage = usage;
+    if (localCopy.empty())
+        SetStorage(buffer, GetMemorySize(), NULL, usage);
+    else
+        respecify = true;
+}
+
+
+template <class T>
+void GpuBuffer<T>::SetStrategy(UpdateStrategy strategy)
+{
+    this->strategy = strategy;
+}
+
+
+template <class T>
+void GpuBuffer<T>::ClearStorage() const
+{
+    const GLuint zero = 0;
+    if (GLEW_ARB_direct_state_access)
+    {
+        glClearNamedBufferData(buffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    }
+    else
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glClearBufferData(GL_COPY_WRITE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    }
+    CheckOpenGLError();
+}
+
+
+template <class T>
+void GpuBuffer<T>::Bind() const
+{
+    glBindBuffer(target, buffer);
+}
+
+
+template <class T>
+void GpuBuffer<T>::BindBase(GLuint index) const
+{
+    glBindBufferBase(target, index, buffer);
+}
+
+
+template <class T>
+void GpuBuffer<T>::BindRange(GLuint index, unsigned int first, unsigned int count) const
+{
+    glBindBufferRange(target, index, buffer, sizeof(T) * first, sizeof(T) * count);
+}
+
+
+template <class T>
+std::future<std::vector<T>> GpuBuffer<T>::ReadAsync(unsigned int first, unsigned int count)
+{
+    std::promise<std::vector<T>> promise;
+    std::future<std::vector<T>> future = promise.get_future();
+
+    count = MIN(count, size - MIN(first, size));
+    if (!count)
+    {
+        promise.set_value(std::vector<T>());
+        return future;
+    }
+
+    const size_t bytes = sizeof(T) * count;
+    StagingBuffer staging = AcquireStaging(bytes);
+    if (GLEW_ARB_direct_state_access)
+    {
+        glCopyNamedBufferSubData(buffer, staging.buffer, sizeof(T) * first, 0, bytes);
+    }
+    else
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, staging.buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sizeof(T) * first, 0, bytes);
+    }
+
+    Readback readback;
+    readback.staging = staging;
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback.count = count;
+    readback.promise = std::move(promise);
+    readbacks.push_back(std::move(readback));
+    return future;
+}
+
+
+template <class T>
+void GpuBuffer<T>::PollReadbacks(bool wait)
+{
+    // In issue order, a readback never finishes before an older one
+    size_t done = 0;
+    for (; done < readbacks.size(); done++)
+    {
+        Readback &readback = readbacks[done];
+
+        // The flush makes sure the fence reaches the GPU, polling alone could wait forever
+        GLenum result = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        while (wait && result == GL_TIMEOUT_EXPIRED)
+            result = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+        if (result == GL_TIMEOUT_EXPIRED)
+            break;
+
+        // A failed fence resolves the readback empty, the error is left for CheckOpenGLError()
+        std::vector<T> values;
+        if (result != GL_WAIT_FAILED)
+        {
+            const size_t bytes = sizeof(T) * readback.count;
+            const void *mapped;
+            if (GLEW_ARB_direct_state_access)
+            {
+                mapped = glMapNamedBufferRange(readback.staging.buffer, 0, bytes, GL_MAP_READ_BIT);
+            }
+            else
+            {
+                glBindBuffer(GL_COPY_READ_BUFFER, readback.staging.buffer);
+                mapped = glMapBufferRange(GL_COPY_READ_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+            }
+
+            if (mapped)
+            {
+                values.resize(readback.count);
+                std::memcpy(values.data(), mapped, bytes);
+            }
+
+            if (GLEW_ARB_direct_state_access)
+                glUnmapNamedBuffer(readback.staging.buffer);
+            else
+                glUnmapBuffer(GL_COPY_READ_BUFFER);
+        }
+
+        readback.promise.set_value(std::move(values));
+        glDeleteSync(readback.fence);
+        freeStaging.push_back(readback.staging);
+    }
+
+    readbacks.erase(readbacks.begin(), readbacks.begin() + done);
+}
+
+
+template <class T>
+void GpuBuffer<T>::Read(unsigned int first, unsigned int count)
+{
+    std::future<std::vector<T>> future = ReadAsync(first, count);
+    PollReadbacks(true);
+
+    const std::vector<T> values = future.get();
+    if (values.empty())
+        return;
+
+    // Same entries as the GPU, nothing to send back
+    AllocateLocalCopy();
+    std::copy(values.begin(), values.end(), localCopy.begin() + first);
+}
+
+
+template <class T>
+GLuint GpuBuffer<T>::GetBufferID() const
+{
+    return buffer;
+}
+
+
+template <class T>
+GLenum GpuBuffer<T>::GetUsage() const
+{
+    return usage;
+}
+
+
+template <class T>
+unsigned int GpuBuffer<T>::GetSize() const
+{
+    return size;
+}
+
+
+template <class T>
+size_t GpuBuffer<T>::GetMemorySize() const
+{
+    return sizeof(T) * size;
+}
+
+
+template <class T>
+unsigned int GpuBuffer<T>::GetPendingReadbacks() const
+{
+    return static_cast<unsigned int>(readbacks.size());
+}
+
+
+template <class T>
+GLuint GpuBuffer<T>::CreateBuffer()
+{
+    // A name from glGenBuffers has no object until it is bound, the named functions need one
+    GLuint buffer = 0;
+    if (GLEW_ARB_direct_state_access)
+        glCreateBuffers(1, &buffer);
+    else
+        glGenBuffers(1, &buffer);
+    return buffer;
+}
+
+
+template <class T>
+void GpuBuffer<T>::SetStorage(GLuint buffer, size_t size, const void *data, GLenum usage)
+{
+    if (GLEW_ARB_direct_state_access)
+    {
+        glNamedBufferData(buffer, size, data, usage);
+    }
+    else
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, data, usage);
+    }
+}
+
+
+template <class T>
+typename GpuBuffer<T>::StagingBuffer GpuBuffer<T>::AcquireStaging(size_t size)
+{
+    // Staging buffers are kept for the next readbacks, the first one large enough is taken
+    for (size_t i = 0; i < freeStaging.size(); i++)
+    {
+        if (freeStaging[i].size >= size)
+        {
+            StagingBuffer staging = freeStaging[i];
+            freeStaging.erase(freeStaging.begin() + i);
+            return staging;
+        }
+    }
+
+    StagingBuffer staging;
+    staging.buffer = CreateBuffer();
+    staging.size = size;
+    SetStorage(staging.buffer, size, NULL, GL_STREAM_READ);
+    return staging;
+}
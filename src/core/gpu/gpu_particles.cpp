@@ -0,0 +1,277 @@
+#include "core/gpu/gpu_particles.h"
+
+#include <chrono>
+#include <cmath>
+
+#include "core/gpu/render_stats.h"
+#include "core/gpu/shader.h"
+#include "utils/math_utils.h"
+
+
+namespace
+{
+    // Work group of C_ParticleSimulate.glsl and C_ParticleEmit.glsl
+    const GLuint GROUP_SIZE = 256;
+
+    // Particle of the shaders, std430 layout: position and age, velocity and emitter
+    const size_t PARTICLE_SIZE = 32;
+
+    // Storage buffer bindings of the compute shaders, see C_ParticleSimulate.glsl
+    const GLuint SOURCE_BINDING = 0;
+    const GLuint DESTINATION_BINDING = 1;
+    const GLuint STATE_BINDING = 3;
+
+    // State buffer: live counts of both buffers, dispatch arguments, draw arguments
+    const GLintptr DISPATCH_ARGS_OFFSET = 2 * sizeof(GLuint);
+    const GLintptr DRAW_ARGS_OFFSET = 5 * sizeof(GLuint);
+    const unsigned int STATE_ENTRIES = 9;
+}
+
+
+const GLuint GpuParticles::PARTICLE_BINDING;
+const GLuint GpuParticles::EMITTER_BINDING;
+const float GpuParticles::MAX_STEP = 0.1f;
+
+
+ParticleEmitter::ParticleEmitter()
+    : position(0), radius(0), velocity(0), spread(0), color(1), rate(0),
+      lifetime(1), size(0.05f), gravity(0), drag(0)
+{
+}
+
+
+GpuParticles::GpuParticles()
+    : capacity(0), source(0), spawnTotal(0), frame(0),
+      emitterBuffer(0), state(nullptr), liveCount(0), emitterCapacity(0), vertexArray(0)
+{
+    particleBuffers[0] = particleBuffers[1] = 0;
+}
+
+
+GpuParticles::~GpuParticles()
+{
+    Release();
+}
+
+
+bool GpuParticles::IsSupported()
+{
+    return GLEW_VERSION_4_3 != 0;
+}
+
+
+void GpuParticles::Init(unsigned int capacity)
+{
+    Release();
+    if (!capacity)
+        return;
+
+    this->capacity = capacity;
+    source = 0;
+
+    // Only ever written by the shaders, the storage is left undefined
+    glGenBuffers(2, particleBuffers);
+    for (GLuint buffer : particleBuffers)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, PARTICLE_SIZE * capacity, NULL, GL_DYNAMIC_COPY);
+    }
+
+    // No particle alive in either buffer, nothing to dispatch or draw
+    state = new GpuBuffer<GLuint>(GL_SHADER_STORAGE_BUFFER, STATE_ENTRIES, GL_DYNAMIC_COPY);
+    state->ClearStorage();
+
+    glGenBuffers(1, &emitterBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    glGenVertexArrays(1, &vertexArray);
+}
+
+
+void GpuParticles::Release()
+{
+    const GLuint buffers[3] = { particleBuffers[0], particleBuffers[1], emitterBuffer };
+    for (GLuint buffer : buffers)
+    {
+        if (buffer)
+            glDeleteBuffers(1, &buffer);
+    }
+    if (vertexArray)
+        glDeleteVertexArrays(1, &vertexArray);
+
+    // A pending readback of the state is dropped with it
+    delete state;
+    state = nullptr;
+    liveCountReadback = std::future<std::vector<GLuint>>();
+    liveCount = 0;
+
+    particleBuffers[0] = particleBuffers[1] = 0;
+    emitterBuffer = 0;
+    vertexArray = 0;
+    emitterCapacity = 0;
+    capacity = 0;
+}
+
+
+unsigned int GpuParticles::AddEmitter(const ParticleEmitter &emitter)
+{
+    emitters.push_back(emitter);
+    spawnCarry.push_back(0.0f);
+    return static_cast<unsigned int>(emitters.size() - 1);
+}
+
+
+ParticleEmitter &GpuParticles::GetEmitter(unsigned int emitter)
+{
+    return emitters[emitter];
+}
+
+
+void GpuParticles::Simulate(Shader *args, Shader *simulate, Shader *emit, float deltaTime)
+{
+    spawnTotal = 0;
+    if (!IsValid())
+        return;
+
+    state->PollReadbacks();
+    if (liveCountReadback.valid() && liveCountReadback.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        const std::vector<GLuint> count = liveCountReadback.get();
+        if (!count.empty())
+            liveCount = count[0];
+    }
+
+    if (emitters.empty())
+        return;
+    if (!args || !args->GetProgramID() || !simulate || !simulate->GetProgramID() || !emit || !emit->GetProgramID())
+        return;
+
+    deltaTime = MIN(MAX(deltaTime, 0.0f), MAX_STEP);
+
+    // Each emitter gets a range of the emission invocations, the fraction of a
+    // particle left is carried to the next steps so low rates still emit
+    emitterData.resize(emitters.size());
+    for (size_t i = 0; i < emitters.size(); i++)
+    {
+        const ParticleEmitter &emitter = emitters[i];
+        spawnCarry[i] += MAX(emitter.rate, 0.0f) * deltaTime;
+        const float spawnCount = std::floor(spawnCarry[i]);
+        spawnCarry[i] -= spawnCount;
+
+        EmitterData &data = emitterData[i];
+        data.position = glm::vec4(emitter.position, emitter.spread);
+        data.velocity = glm::vec4(emitter.velocity, MAX(emitter.lifetime, 1e-3f));
+        data.color = emitter.color;
+        data.motion = glm::vec4(emitter.size, emitter.gravity, emitter.drag, emitter.radius);
+        data.firstSpawn = spawnTotal;
+        data.spawnCount = static_cast<GLuint>(spawnCount);
+        spawnTotal += data.spawnCount;
+    }
+
+    // Orphaned every step so the driver never waits for the last draw reading them
+    const size_t emitterSize = sizeof(EmitterData) * emitterData.size();
+    emitterCapacity = MAX(emitterCapacity, emitterSize);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, emitterBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, emitterCapacity, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, emitterSize, emitterData.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    const GLuint destination = 1 - source;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SOURCE_BINDING, particleBuffers[source]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DESTINATION_BINDING, particleBuffers[destination]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTER_BINDING, emitterBuffer);
+    state->BindBase(STATE_BINDING);
+
+    // Dispatch over the particles of the last step, empty destination
+    render_stats::UseProgram(args->GetProgramID());
+    glUniform1i(args->GetUniformSlot("stage"), 0);
+    glUniform1ui(args->GetUniformSlot("source"), source);
+    glUniform1ui(args->GetUniformSlot("capacity"), capacity);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+    render_stats::UseProgram(simulate->GetProgramID());
+    glUniform1ui(simulate->GetUniformSlot("source"), source);
+    glUniform1f(simulate->GetUniformSlot("delta_time"), deltaTime);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, state->GetBufferID());
+    glDispatchComputeIndirect(DISPATCH_ARGS_OFFSET);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    if (spawnTotal)
+    {
+        render_stats::UseProgram(emit->GetProgramID());
+        glUniform1ui(emit->GetUniformSlot("source"), source);
+        glUniform1ui(emit->GetUniformSlot("capacity"), capacity);
+        glUniform1ui(emit->GetUniformSlot("spawn_total"), spawnTotal);
+        glUniform1ui(emit->GetUniformSlot("emitter_count"), static_cast<GLuint>(emitters.size()));
+        glUniform1ui(emit->GetUniformSlot("frame_seed"), frame);
+        glUniform1f(emit->GetUniformSlot("delta_time"), deltaTime);
+        glDispatchCompute((spawnTotal + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // Draw arguments from the final count
+    render_stats::UseProgram(args->GetProgramID());
+    glUniform1i(args->GetUniformSlot("stage"), 1);
+    glDispatchCompute(1, 1, 1);
+
+    // The draw reads its arguments and the particles from the vertex shader, the readback copies the count
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    source = destination;
+    frame++;
+
+    // One readback in flight, resolved by a later step once its fence passed
+    if (!liveCountReadback.valid())
+        liveCountReadback = state->ReadAsync(source, 1);
+}
+
+
+void GpuParticles::Draw() const
+{
+    if (!IsValid())
+        return;
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_BINDING, particleBuffers[source]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTER_BINDING, emitterBuffer);
+
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, state->GetBufferID());
+    glDrawArraysIndirect(GL_POINTS, (void *)DRAW_ARGS_OFFSET);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+
+    // The points drawn are only known to the GPU, one call is counted without primitives
+    render_stats::AddDraw(GL_POINTS, 0);
+}
+
+
+bool GpuParticles::IsValid() const
+{
+    return state != nullptr;
+}
+
+
+unsigned int GpuParticles::GetCapacity() const
+{
+    return capacity;
+}
+
+
+unsigned int GpuParticles::GetEmitterCount() const
+{
+    return static_cast<unsigned int>(emitters.size());
+}
+
+
+unsigned int GpuParticles::GetEmittedLastStep() const
+{
+    return spawnTotal;
+}
+
+
+unsigned int GpuParticles::GetLiveCount() const
+{
+    return liveCount;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <future>
+#include <vector>
+
+#include "core/gpu/gpu_buffer.h"
+#include "utils/glm_utils.h"
+#include "utils/gl_utils.h"
+
+
+class Shader;
+
+
+// Source of particles, set again every frame to follow an object
+struct ParticleEmitter
+{
+    ParticleEmitter();
+
+    glm::vec3 position;
+    float radius;           // Half size of the cube the particles start in
+    glm::vec3 velocity;     // Mean start velocity
+    float spread;           // Random start velocity added on each axis, up to this
+    glm::vec4 color;        // Alpha scales the additive contribution
+    float rate;             // Particles per second
+    float lifetime;         // Seconds
+    float size;             // World size of a particle
+    float gravity;          // Downward acceleration, negative rises
+    float drag;             // Fraction of the velocity lost per second
+};
+
+
+// Particles emitted, moved and killed by compute shaders, the CPU never
+// reads or writes a particle. Simulate() reads the live particles of one
+// buffer and appends the survivors to the other one, then the new particles
+// after them, with atomic counters in a small state buffer. The same buffer
+// holds the arguments of the indirect simulation dispatch and of the
+// indirect draw, written by the GPU from the counters, so the live count
+// never has to come back to the CPU. The buffers swap roles every step.
+// The HUD still gets it, read back without waiting and a few frames late.
+//
+// The CPU only uploads the emitters, the particle vertex shader reads the
+// particles at PARTICLE_BINDING and the emitters at EMITTER_BINDING, see
+// V_Particle.glsl.
+class GpuParticles
+{
+ public:
+    // Storage buffer bindings read by the particle vertex shader
+    static const GLuint PARTICLE_BINDING = 0;
+    static const GLuint EMITTER_BINDING = 2;
+
+    GpuParticles();
+    ~GpuParticles();
+
+    // Compute shaders, storage buffers and indirect dispatch, all core in GL 4.3
+    static bool IsSupported();
+
+    // GL thread. Allocates both particle buffers, the live particles are dropped
+    void Init(unsigned int capacity);
+    void Release();
+
+    // Returns the index of the emitter, emitters are never removed
+    unsigned int AddEmitter(const ParticleEmitter &emitter);
+    ParticleEmitter &GetEmitter(unsigned int emitter);
+
+    // GL thread, GL 4.3. Shaders: C_ParticleArgs, C_ParticleSimulate and C_ParticleEmit.
+    // A long step is cut to MAX_STEP, the emitters would fill the buffer at once
+    void Simulate(Shader *args, Shader *simulate, Shader *emit, float deltaTime);
+
+    // Points of the last step, the caller binds the program and its camera
+    void Draw() const;
+
+    bool IsValid() const;
+    unsigned int GetCapacity() const;
+    unsigned int GetEmitterCount() const;
+    unsigned int GetEmittedLastStep() const;
+    // Live particles of a recent step, the readback lags the GPU by a few frames
+    unsigned int GetLiveCount() const;
+
+ private:
+    // Emitter read by the shaders, std430 layout
+    struct EmitterData
+    {
+        glm::vec4 position;     // Center, spread (w)
+        glm::vec4 velocity;     // Mean velocity, lifetime (w)
+        glm::vec4 color;
+        glm::vec4 motion;       // Size, gravity, drag, radius
+        GLuint firstSpawn;      // Range of the emission invocations of the step
+        GLuint spawnCount;
+        GLuint padding[2];
+    };
+    static_assert(sizeof(EmitterData) == 80, "EmitterData must match the std430 layout of the particle shaders");
+
+    // Longest step simulated, in seconds
+    static const float MAX_STEP;
+
+ private:
+    GpuParticles(const GpuParticles &) = delete;
+    GpuParticles &operator=(const GpuParticles &) = delete;
+
+ private:
+    std::vector<ParticleEmitter> emitters;
+    std::vector<float> spawnCarry;          // Fraction of a particle left from the last steps, per emitter
+    std::vector<EmitterData> emitterData;
+
+    unsigned int capacity;
+    unsigned int source;                    // Buffer written by the last step, drawn by Draw()
+    unsigned int spawnTotal;
+    unsigned int frame;
+
+    GLuint particleBuffers[2];
+    GLuint emitterBuffer;
+    GpuBuffer<GLuint> *state;               // Live counts, dispatch and draw arguments
+    std::future<std::vector<GLuint>> liveCountReadback;
+    unsigned int liveCount;
+    size_t emitterCapacity;                 // In bytes
+    GLuint vertexArray;                     // Empty, the vertex shader reads the particles from storage
+};
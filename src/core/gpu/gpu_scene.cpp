@@ -0,0 +1,219 @@
+#include "core/gpu/gpu_scene.h"
+
+#include "core/gpu/command_buffer.h"
+#include "core/gpu/hiz_pyramid.h"
+#include "core/gpu/mesh.h"
+#include "core/gpu/render_stats.h"
+#include "core/gpu/shader.h"
+#include "utils/math_utils.h"
+
+
+namespace
+{
+    // Work group of C_Cull.glsl, one instance per invocation
+    const GLuint GROUP_SIZE = 64;
+
+    // Storage buffer bindings of C_Cull.glsl after the instances
+    const GLuint BATCH_BINDING = 1;
+    const GLuint COMMAND_BINDING = 2;
+    const GLuint VISIBLE_BINDING = 3;
+}
+
+
+const GLuint GpuScene::INSTANCE_ATTRIBUTE;
+const GLuint GpuScene::INSTANCE_BINDING;
+
+
+GpuScene::GpuScene()
+    : instanceBuffer(0), batchBuffer(0), commandBuffer(0), visibleBuffer(0),
+      instanceCapacity(0), batchCapacity(0), commandCapacity(0), visibleCapacity(0)
+{
+}
+
+
+GpuScene::~GpuScene()
+{
+    const GLuint buffers[4] = { instanceBuffer, batchBuffer, commandBuffer, visibleBuffer };
+    for (GLuint buffer : buffers)
+    {
+        if (buffer)
+            glDeleteBuffers(1, &buffer);
+    }
+}
+
+
+bool GpuScene::IsSupported()
+{
+    return GLEW_VERSION_4_3 != 0;
+}
+
+
+void GpuScene::Clear()
+{
+    instances.clear();
+    batches.clear();
+    batchDraws.clear();
+    indirectCommands.clear();
+}
+
+
+unsigned int GpuScene::AddBatch(const Mesh *mesh, unsigned int lod)
+{
+    Batch batch = {};
+    batch.firstCommand = static_cast<GLuint>(indirectCommands.size());
+    mesh->AppendIndirectCommands(indirectCommands, lod);
+    batch.commandCount = static_cast<GLuint>(indirectCommands.size()) - batch.firstCommand;
+    batches.push_back(batch);
+
+    BatchDraw draw;
+    draw.vertexArray = mesh->GetBuffers()->m_VAO;
+    draw.mode = mesh->GetDrawMode();
+    draw.instanceCount = 0;
+    batchDraws.push_back(draw);
+
+    return static_cast<unsigned int>(batches.size() - 1);
+}
+
+
+void GpuScene::AddInstance(unsigned int batch, const glm::mat4 &model, const BoundingSphere &bounds)
+{
+    Instance instance = {};
+    instance.model = model;
+    instance.sphere = glm::vec4(bounds.center, bounds.radius);
+    instance.batch = batch;
+    instances.push_back(instance);
+
+    batchDraws[batch].instanceCount++;
+}
+
+
+void GpuScene::Cull(Shader *shader, const glm::mat4 &viewProjection, const HiZPyramid *occlusion)
+{
+    if (!shader || !shader->GetProgramID() || instances.empty())
+        return;
+
+    // Created on first use, the context doesn't exist yet when the owner is constructed
+    if (!instanceBuffer)
+    {
+        glGenBuffers(1, &instanceBuffer);
+        glGenBuffers(1, &batchBuffer);
+        glGenBuffers(1, &commandBuffer);
+        glGenBuffers(1, &visibleBuffer);
+    }
+
+    // Each batch gets a range of the visible list as large as its instances,
+    // its commands start from it with no instance drawn
+    GLuint firstInstance = 0;
+    for (size_t i = 0; i < batches.size(); i++)
+    {
+        Batch &batch = batches[i];
+        batch.firstInstance = firstInstance;
+
+        for (GLuint c = batch.firstCommand; c < batch.firstCommand + batch.commandCount; c++)
+        {
+            indirectCommands[c].instanceCount = 0;
+            indirectCommands[c].baseInstance = firstInstance;
+        }
+        firstInstance += batchDraws[i].instanceCount;
+    }
+
+    Upload(instanceBuffer, instanceCapacity, instances.data(), sizeof(Instance) * instances.size());
+    Upload(batchBuffer, batchCapacity, batches.data(), sizeof(Batch) * batches.size());
+    Upload(commandBuffer, commandCapacity, indirectCommands.data(), sizeof(DrawElementsIndirectCommand) * indirectCommands.size());
+
+    // Only written by the culling shader, the storage is left undefined
+    const size_t visibleSize = sizeof(GLuint) * instances.size();
+    if (visibleSize > visibleCapacity)
+    {
+        visibleCapacity = visibleSize;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, visibleBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, visibleCapacity, NULL, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // The visible list feeds the instance attribute of the batch meshes. Other
+    // programs don't read the attribute, it can stay enabled in the meshes
+    for (const BatchDraw &draw : batchDraws)
+    {
+        glBindVertexArray(draw.vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, visibleBuffer);
+        glEnableVertexAttribArray(INSTANCE_ATTRIBUTE);
+        glVertexAttribIPointer(INSTANCE_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void *)0);
+        glVertexAttribDivisor(INSTANCE_ATTRIBUTE, 1);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    frustum.SetViewProjection(viewProjection);
+    const bool occlusionEnabled = occlusion && occlusion->IsValid();
+
+    render_stats::UseProgram(shader->GetProgramID());
+    glUniform1ui(shader->GetUniformSlot("instance_count"), static_cast<GLuint>(instances.size()));
+    glUniform4fv(shader->GetUniformSlot("frustum_planes"), 6, glm::value_ptr(frustum.GetPlanes()[0]));
+    glUniform1i(shader->GetUniformSlot("occlusion_enabled"), occlusionEnabled ? 1 : 0);
+
+    if (occlusionEnabled)
+    {
+        const glm::ivec2 &size = occlusion->GetSize();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, occlusion->GetTexture());
+        glUniformMatrix4fv(shader->GetUniformSlot("hiz_view_projection"), 1, GL_FALSE, glm::value_ptr(occlusion->GetViewProjection()));
+        glUniform2f(shader->GetUniformSlot("hiz_size"), static_cast<float>(size.x), static_cast<float>(size.y));
+        glUniform1i(shader->GetUniformSlot("hiz_levels"), static_cast<GLint>(occlusion->GetLevels()));
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BINDING, instanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BATCH_BINDING, batchBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_BINDING, visibleBuffer);
+
+    const GLuint groups = (static_cast<GLuint>(instances.size()) + GROUP_SIZE - 1) / GROUP_SIZE;
+    glDispatchCompute(groups, 1, 1);
+
+    // The draws read the commands, the visible list as an attribute and the instances
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+void GpuScene::RecordBatch(CommandBuffer &commands, unsigned int batch) const
+{
+    const Batch &range = batches[batch];
+    const BatchDraw &draw = batchDraws[batch];
+    if (!draw.instanceCount || !range.commandCount)
+        return;
+
+    commands.BindStorageBuffer(INSTANCE_BINDING, instanceBuffer);
+    commands.BindIndirectBuffer(commandBuffer);
+    commands.DrawIndexedIndirect(draw.vertexArray, draw.mode, range.firstCommand, range.commandCount);
+}
+
+
+unsigned int GpuScene::GetBatchCount() const
+{
+    return static_cast<unsigned int>(batches.size());
+}
+
+
+unsigned int GpuScene::GetInstanceCount() const
+{
+    return static_cast<unsigned int>(instances.size());
+}
+
+
+unsigned int GpuScene::GetCommandCount() const
+{
+    return static_cast<unsigned int>(indirectCommands.size());
+}
+
+
+void GpuScene::Upload(GLuint buffer, size_t &capacity, const void *data, size_t size)
+{
+    // Orphaned every frame so the driver never waits for the draws of the last one
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    capacity = MAX(capacity, size);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
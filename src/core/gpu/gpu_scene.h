@@ -0,0 +1,124 @@
+#pragma once
+
+#include <vector>
+
+#include "core/culling/bounding_volume.h"
+#include "core/culling/frustum_culler.h"
+#include "utils/glm_utils.h"
+#include "utils/gl_utils.h"
+
+
+class CommandBuffer;
+class HiZPyramid;
+class Mesh;
+class Shader;
+
+
+// Draw record of glMultiDrawElementsIndirect, the layout is fixed by GL
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+static_assert(sizeof(DrawElementsIndirectCommand) == 20, "DrawElementsIndirectCommand is read by GL as 5 packed integers");
+
+
+// Instances of the scene culled and drawn by the GPU. The instances of a
+// frame are grouped in batches, one per mesh, level of detail and pipeline
+// state, and every entry of the mesh of a batch is one indirect command.
+//
+// Cull() uploads the instances and runs the culling compute shader, which
+// tests each instance against the frustum and the depth pyramid of the
+// previous frame and appends the visible ones to the instance range of their
+// batch, counting them in the instanceCount of its commands. A batch is then
+// drawn by a single glMultiDrawElementsIndirect whatever its number of
+// instances, so the CPU cost of the submission only follows the batches.
+//
+// The vertex shaders read the visible instance index from the attribute at
+// INSTANCE_ATTRIBUTE, fed from the visible list through the base instance of
+// the commands, and fetch their instance from the storage buffer at
+// INSTANCE_BINDING, see V_SceneIndirect.glsl.
+class GpuScene
+{
+ public:
+    // Vertex attribute of the visible instance index, after those of VertexFormat
+    static const GLuint INSTANCE_ATTRIBUTE = 8;
+
+    // Storage buffer binding of the instances, in the culling and vertex shaders
+    static const GLuint INSTANCE_BINDING = 0;
+
+    GpuScene();
+    ~GpuScene();
+
+    // Compute shaders, storage buffers and multi draw indirect, all core in GL 4.3
+    static bool IsSupported();
+
+    // Drops the batches and instances of the last frame, the memory is kept
+    void Clear();
+
+    // Batch drawing the entries of a mesh at a level of detail, returns its index
+    unsigned int AddBatch(const Mesh *mesh, unsigned int lod);
+
+    // bounds: world bounding sphere, always drawn when invalid
+    void AddInstance(unsigned int batch, const glm::mat4 &model, const BoundingSphere &bounds);
+
+    // GL thread, GL 4.3. shader: culling compute shader, see C_Cull.glsl.
+    // occlusion: depth pyramid of the previous frame, null to test the frustum only
+    void Cull(Shader *shader, const glm::mat4 &viewProjection, const HiZPyramid *occlusion);
+
+    // Draw of a batch culled by the last Cull(), the caller binds the program first
+    void RecordBatch(CommandBuffer &commands, unsigned int batch) const;
+
+    unsigned int GetBatchCount() const;
+    unsigned int GetInstanceCount() const;
+    unsigned int GetCommandCount() const;
+
+ private:
+    // Instance read by the shaders, std430 layout
+    struct Instance
+    {
+        glm::mat4 model;
+        glm::vec4 sphere;       // World center, radius
+        GLuint batch;
+        GLuint padding[3];
+    };
+    static_assert(sizeof(Instance) == 96, "Instance must match the std430 layout of C_Cull.glsl");
+
+    // Batch read by the culling shader, std430 layout
+    struct Batch
+    {
+        GLuint firstCommand;
+        GLuint commandCount;
+        GLuint firstInstance;   // Start of the range of the batch in the visible list
+        GLuint padding;
+    };
+    static_assert(sizeof(Batch) == 16, "Batch must match the std430 layout of C_Cull.glsl");
+
+    // GL side of a batch
+    struct BatchDraw
+    {
+        GLuint vertexArray;
+        GLenum mode;
+        unsigned int instanceCount;
+    };
+
+    // Orphans the storage and uploads, the capacity only grows
+    static void Upload(GLuint buffer, size_t &capacity, const void *data, size_t size);
+
+ private:
+    GpuScene(const GpuScene &) = delete;
+    GpuScene &operator=(const GpuScene &) = delete;
+
+ private:
+    std::vector<Instance> instances;
+    std::vector<Batch> batches;
+    std::vector<BatchDraw> batchDraws;
+    std::vector<DrawElementsIndirectCommand> indirectCommands;
+    FrustumCuller frustum;
+
+    GLuint instanceBuffer, batchBuffer, commandBuffer, visibleBuffer;
+    size_t instanceCapacity, batchCapacity, commandCapacity, visibleCapacity;   // In bytes
+};
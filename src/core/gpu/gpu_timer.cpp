@@ -0,0 +1,74 @@
+#include "core/gpu/gpu_timer.h"
+
+#include "utils/math_utils.h"
+
+
+GpuTimer::GpuTimer(unsigned int latency)
+    : queries(MAX(latency, 1u), 0), readIndex(0), pending(0), running(false), lastMilliseconds(0)
+{
+}
+
+
+GpuTimer::~GpuTimer()
+{
+    if (queries[0])
+        glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+}
+
+
+void GpuTimer::Begin()
+{
+    // Created on first use, the context doesn't exist yet when the owner is constructed
+    if (!queries[0])
+        glGenQueries(static_cast<GLsizei>(queries.size()), queries.data());
+
+    if (running || pending == queries.size())
+        return;
+
+    unsigned int writeIndex = (readIndex + pending) % queries.size();
+    glBeginQuery(GL_TIME_ELAPSED, queries[writeIndex]);
+    running = true;
+}
+
+
+void GpuTimer::End()
+{
+    if (!running)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    running = false;
+    pending++;
+}
+
+
+bool GpuTimer::Poll(float &milliseconds)
+{
+    bool finished = false;
+
+    // Queries finish in the order they were issued
+    while (pending > 0)
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(queries[readIndex], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[readIndex], GL_QUERY_RESULT, &nanoseconds);
+        lastMilliseconds = static_cast<float>(nanoseconds * 1e-6);
+        finished = true;
+
+        readIndex = (readIndex + 1) % queries.size();
+        pending--;
+    }
+
+    milliseconds = lastMilliseconds;
+    return finished;
+}
+
+
+float GpuTimer::GetMilliseconds() const
+{
+    return lastMilliseconds;
+}
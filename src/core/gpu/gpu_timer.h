@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+
+#include "utils/gl_utils.h"
+
+
+// GPU time spent between Begin() and End(), measured with timer queries.
+// Queries are kept in a ring and read back a few frames later, so asking for
+// the result never makes the CPU wait for the GPU.
+class GpuTimer
+{
+ public:
+    // latency: number of measurements that can be in flight at the same time
+    GpuTimer(unsigned int latency = 4);
+    ~GpuTimer();
+
+    // Skipped while the ring is full, End() then does nothing either
+    void Begin();
+    void End();
+
+    // Reads back the finished measurements, returns false if none finished
+    // since the last call. milliseconds is the newest one
+    bool Poll(float &milliseconds);
+
+    // Newest measurement returned by Poll()
+    float GetMilliseconds() const;
+
+ private:
+    std::vector<GLuint> queries;
+    unsigned int readIndex;
+    unsigned int pending;
+    bool running;
+    float lastMilliseconds;
+};
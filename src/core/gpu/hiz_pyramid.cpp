@@ -0,0 +1,134 @@
+#include "core/gpu/hiz_pyramid.h"
+
+#include "core/gpu/render_stats.h"
+#include "core/gpu/shader.h"
+#include "utils/math_utils.h"
+
+
+namespace
+{
+    // Work group of C_HiZ.glsl
+    const int GROUP_SIZE = 8;
+}
+
+
+HiZPyramid::HiZPyramid()
+    : texture(0), size(0), levels(0), viewProjection(1)
+{
+}
+
+
+HiZPyramid::~HiZPyramid()
+{
+    Release();
+}
+
+
+void HiZPyramid::Build(Shader *shader, GLuint depthTexture, const glm::ivec2 &size, const glm::mat4 &viewProjection)
+{
+    if (!shader || !shader->GetProgramID() || !depthTexture || size.x <= 0 || size.y <= 0)
+        return;
+
+    if (!texture || size != this->size)
+    {
+        Release();
+        this->size = size;
+
+        levels = 1;
+        for (int extent = MAX(size.x, size.y); extent > 1; extent /= 2)
+            levels++;
+
+        // Immutable, every level can be bound as an image. Nearest filtering,
+        // a texel never mixes with one it doesn't cover
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, levels, GL_R32F, size.x, size.y);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    this->viewProjection = viewProjection;
+
+    render_stats::UseProgram(shader->GetProgramID());
+    const GLint copyDepth = shader->GetUniformSlot("copy_depth");
+    const GLint sourceSize = shader->GetUniformSlot("source_size");
+    const GLint destinationSize = shader->GetUniformSlot("destination_size");
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+
+    // Level 0 is copied from the depth, each level above reduces the one below it
+    glm::ivec2 levelSize = size;
+    glm::ivec2 previousSize = size;
+    for (unsigned int level = 0; level < levels; level++)
+    {
+        if (level > 0) {
+            glBindImageTexture(0, texture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        }
+        glBindImageTexture(1, texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+        glUniform1i(copyDepth, level == 0 ? 1 : 0);
+        glUniform2i(sourceSize, previousSize.x, previousSize.y);
+        glUniform2i(destinationSize, levelSize.x, levelSize.y);
+        glDispatchCompute((levelSize.x + GROUP_SIZE - 1) / GROUP_SIZE, (levelSize.y + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+
+        // The next level reads the texels written by this one
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+        // Rounded down as the GL levels are, C_HiZ folds an odd last row and column into
+        // the last texels and C_Cull maps its rectangles the same way
+        previousSize = levelSize;
+        levelSize = glm::max(levelSize / 2, glm::ivec2(1));
+    }
+
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+    glBindImageTexture(1, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // The culling shader samples the pyramid as a texture
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+
+void HiZPyramid::Release()
+{
+    if (texture)
+        glDeleteTextures(1, &texture);
+
+    texture = 0;
+    size = glm::ivec2(0);
+    levels = 0;
+}
+
+
+bool HiZPyramid::IsValid() const
+{
+    return texture != 0;
+}
+
+
+GLuint HiZPyramid::GetTexture() const
+{
+    return texture;
+}
+
+
+const glm::ivec2 &HiZPyramid::GetSize() const
+{
+    return size;
+}
+
+
+unsigned int HiZPyramid::GetLevels() const
+{
+    return levels;
+}
+
+
+const glm::mat4 &HiZPyramid::GetViewProjection() const
+{
+    return viewProjection;
+}
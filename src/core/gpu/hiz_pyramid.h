@@ -0,0 +1,44 @@
+#pragma once
+
+#include "utils/glm_utils.h"
+#include "utils/gl_utils.h"
+
+
+class Shader;
+
+
+// Hierarchical depth buffer for occlusion tests on the GPU. Level 0 is a copy
+// of a depth buffer and every texel of the levels above keeps the farthest
+// depth of the texels it covers below, odd edges included. An object whose
+// nearest depth is behind the texels covering its screen rectangle is hidden,
+// and a rectangle of any size is covered by 4 texels of the right level.
+//
+// The pyramid is built from the depth of a finished frame and keeps the view
+// projection of that frame, the next frame projects its objects with it.
+class HiZPyramid
+{
+ public:
+    HiZPyramid();
+    ~HiZPyramid();
+
+    // GL thread, GL 4.3. shader: compute shader of the reduction, see C_HiZ.glsl.
+    // The storage is created again when the size of the depth buffer changes
+    void Build(Shader *shader, GLuint depthTexture, const glm::ivec2 &size, const glm::mat4 &viewProjection);
+    void Release();
+
+    bool IsValid() const;
+    GLuint GetTexture() const;
+    const glm::ivec2 &GetSize() const;
+    unsigned int GetLevels() const;
+    const glm::mat4 &GetViewProjection() const;
+
+ private:
+    HiZPyramid(const HiZPyramid &) = delete;
+    HiZPyramid &operator=(const HiZPyramid &) = delete;
+
+ private:
+    GLuint texture;             // GL_R32F, one level per halving down to 1x1
+    glm::ivec2 size;
+    unsigned int levels;
+    glm::mat4 viewProjection;
+};
@@ -1,11 +1,16 @@
 #include "core/gpu/mesh.h"
 
+#include <algorithm>
 #include <utility>
 
 #include "assimp/Importer.hpp"          // C++ importer interface
 #include "assimp/postprocess.h"         // Post processing flags
 
+#include "core/gpu/command_buffer.h"
 #include "core/gpu/gpu_buffers.h"
+#include "core/gpu/gpu_scene.h"
+#include "core/gpu/mesh_simplifier.h"
+#include "core/gpu/render_stats.h"
 #include "core/gpu/texture2D.h"
 #include "core/managers/texture_manager.h"
 
@@ -20,6 +25,7 @@ Mesh::Mesh(std::string meshID)
     this->meshID = std::move(meshID);
 
     useMaterial = true;
+    lodLevels = 0;
     glDrawMode = GL_TRIANGLES;
     buffers = new GPUBuffers();
 }
@@ -140,6 +146,7 @@ void Mesh::InitFromData()
     M.nrIndices = (unsigned int)indices.size();
     meshEntries.push_back(M);
 
+    ComputeBounds();
     buffers->ReleaseMemory();
 }
 
@@ -242,6 +249,9 @@ bool Mesh::InitFromScene(const aiScene* pScene)
         InitMesh(i, paiMesh);
     }
 
+    ComputeBounds();
+    GenerateLods();
+
     if (useMaterial && !InitMaterials(pScene))
         return false;
 
@@ -453,6 +463,175 @@ void Mesh::UseMaterials(bool value)
 }
 
 
+void Mesh::SetLodLevels(unsigned int levels)
+{
+    lodLevels = levels;
+}
+
+
+void Mesh::GenerateLods()
+{
+    if (lodLevels == 0 || glDrawMode != GL_TRIANGLES)
+        return;
+
+    // Entries this small are cheaper to draw than to switch
+    const unsigned int minIndices = 3 * 64;
+
+    for (auto &entry : meshEntries)
+    {
+        entry.lods.clear();
+        if (entry.nrIndices < minIndices || entry.baseIndex + entry.nrIndices > indices.size())
+            continue;
+
+        // The simplifier works on the entry alone, with indices relative to its base vertex
+        std::vector<unsigned int> entryIndices(indices.begin() + entry.baseIndex,
+                                               indices.begin() + entry.baseIndex + entry.nrIndices);
+        unsigned int nrVertices = *std::max_element(entryIndices.begin(), entryIndices.end()) + 1;
+        if (entry.baseVertex + nrVertices > positions.size())
+            continue;
+
+        std::vector<glm::vec3> entryPositions(positions.begin() + entry.baseVertex,
+                                              positions.begin() + entry.baseVertex + nrVertices);
+
+        MeshSimplifier simplifier(entryPositions, entryIndices);
+        unsigned int target = entry.nrIndices;
+
+        for (unsigned int level = 1; level <= lodLevels; level++)
+        {
+            // Every level halves the triangle count
+            target = target / 6 * 3;
+            simplifier.Simplify(target);
+
+            const std::vector<unsigned int> &lodIndices = simplifier.GetIndices();
+            unsigned int previous = entry.lods.empty() ? entry.nrIndices : entry.lods.back().nrIndices;
+
+            // Locked borders stop the simplification, a level that barely differs is not worth keeping
+            if (lodIndices.size() < 3 || lodIndices.size() > previous * 9 / 10)
+                break;
+
+            MeshLod lod;
+            lod.baseIndex = static_cast<unsigned int>(indices.size());
+            lod.nrIndices = static_cast<unsigned int>(lodIndices.size());
+            lod.error = simplifier.GetError();
+            entry.lods.push_back(lod);
+
+            indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+        }
+    }
+}
+
+
+void Mesh::ComputeBounds()
+{
+    boundingBox = BoundingBox();
+    boundingSphere = BoundingSphere();
+
+    const bool hasPositions = !positions.empty();
+    const size_t nrVertices = hasPositions ? positions.size() : vertices.size();
+
+    for (auto &entry : meshEntries)
+    {
+        entry.boundingBox = BoundingBox();
+        entry.boundingSphere = BoundingSphere();
+
+        // Only the vertices referenced by the entry contribute to its bounds
+        unsigned int lastIndex = MIN(entry.baseIndex + entry.nrIndices, (unsigned int)indices.size());
+        for (unsigned int i = entry.baseIndex; i < lastIndex; i++)
+        {
+            size_t vertexID = entry.baseVertex + indices[i];
+            if (vertexID < nrVertices) {
+                entry.boundingBox.Expand(hasPositions ? positions[vertexID] : vertices[vertexID].position);
+            }
+        }
+
+        if (!entry.boundingBox.IsValid())
+            continue;
+
+        // Tighter than the half diagonal: the farthest referenced vertex from the box center
+        glm::vec3 center = entry.boundingBox.GetCenter();
+        float radius2 = 0;
+        for (unsigned int i = entry.baseIndex; i < lastIndex; i++)
+        {
+            size_t vertexID = entry.baseVertex + indices[i];
+            if (vertexID < nrVertices) {
+                glm::vec3 d = (hasPositions ? positions[vertexID] : vertices[vertexID].position) - center;
+                radius2 = MAX(radius2, glm::dot(d, d));
+            }
+        }
+
+        entry.boundingSphere = BoundingSphere(center, sqrt(radius2));
+        boundingBox.Expand(entry.boundingBox);
+    }
+
+    if (!boundingBox.IsValid())
+        return;
+
+    // Merge the entry spheres into one sphere centered on the mesh box
+    glm::vec3 center = boundingBox.GetCenter();
+    float radius = 0;
+    for (const auto &entry : meshEntries)
+    {
+        if (entry.boundingSphere.IsValid()) {
+            radius = MAX(radius, glm::length(entry.boundingSphere.center - center) + entry.boundingSphere.radius);
+        }
+    }
+    boundingSphere = BoundingSphere(center, MIN(radius, glm::length(boundingBox.GetExtents())));
+}
+
+
+void Mesh::SetBoundingBox(const BoundingBox& box)
+{
+    boundingBox = box;
+    boundingSphere = box.IsValid() ? BoundingSphere(box.GetCenter(), glm::length(box.GetExtents())) : BoundingSphere();
+}
+
+
+const BoundingBox& Mesh::GetBoundingBox() const
+{
+    return boundingBox;
+}
+
+
+const BoundingSphere& Mesh::GetBoundingSphere() const
+{
+    return boundingSphere;
+}
+
+
+unsigned int Mesh::GetLodCount() const
+{
+    size_t count = 0;
+    for (const auto &entry : meshEntries) {
+        count = MAX(count, entry.lods.size());
+    }
+    return static_cast<unsigned int>(count + 1);
+}
+
+
+float Mesh::GetLodError(unsigned int lod) const
+{
+    float error = 0;
+    for (const auto &entry : meshEntries)
+    {
+        unsigned int level = MIN(lod, (unsigned int)entry.lods.size());
+        if (level > 0) error = MAX(error, entry.lods[level - 1].error);
+    }
+    return error;
+}
+
+
+unsigned int Mesh::GetLodIndexCount(unsigned int lod) const
+{
+    unsigned int count = 0;
+    for (const auto &entry : meshEntries)
+    {
+        unsigned int level = MIN(lod, (unsigned int)entry.lods.size());
+        count += level > 0 ? entry.lods[level - 1].nrIndices : entry.nrIndices;
+    }
+    return count;
+}
+
+
 void Mesh::Render() const
 {
     glBindVertexArray(buffers->m_VAO);
@@ -472,6 +651,53 @@ void Mesh::Render() const
         glDrawElementsBaseVertex(glDrawMode, meshEntries[i].nrIndices,
             GL_UNSIGNED_INT, (void*)(sizeof(unsigned int) * meshEntries[i].baseIndex),
             meshEntries[i].baseVertex);
+        render_stats::AddDraw(glDrawMode, meshEntries[i].nrIndices);
+    }
+    glBindVertexArray(0);
+}
+
+
+void Mesh::RenderGeometry(unsigned int lod) const
+{
+    glBindVertexArray(buffers->m_VAO);
+    for (const auto &entry : meshEntries)
+    {
+        unsigned int level = MIN(lod, (unsigned int)entry.lods.size());
+        unsigned int nrIndices = level > 0 ? entry.lods[level - 1].nrIndices : entry.nrIndices;
+        unsigned int baseIndex = level > 0 ? entry.lods[level - 1].baseIndex : entry.baseIndex;
+
+        glDrawElementsBaseVertex(glDrawMode, nrIndices,
+            GL_UNSIGNED_INT, (void*)(sizeof(unsigned int) * baseIndex),
+            entry.baseVertex);
+        render_stats::AddDraw(glDrawMode, nrIndices);
     }
     glBindVertexArray(0);
 }
+
+
+void Mesh::RecordGeometry(CommandBuffer &commands, unsigned int lod) const
+{
+    for (const auto &entry : meshEntries)
+    {
+        unsigned int level = MIN(lod, (unsigned int)entry.lods.size());
+        unsigned int nrIndices = level > 0 ? entry.lods[level - 1].nrIndices : entry.nrIndices;
+        unsigned int baseIndex = level > 0 ? entry.lods[level - 1].baseIndex : entry.baseIndex;
+
+        commands.DrawIndexed(buffers->m_VAO, glDrawMode, nrIndices, baseIndex, entry.baseVertex);
+    }
+}
+
+
+void Mesh::AppendIndirectCommands(std::vector<DrawElementsIndirectCommand> &commands, unsigned int lod) const
+{
+    for (const auto &entry : meshEntries)
+    {
+        unsigned int level = MIN(lod, (unsigned int)entry.lods.size());
+
+        DrawElementsIndirectCommand command = {};
+        command.count = level > 0 ? entry.lods[level - 1].nrIndices : entry.nrIndices;
+        command.firstIndex = level > 0 ? entry.lods[level - 1].baseIndex : entry.baseIndex;
+        command.baseVertex = static_cast<GLint>(entry.baseVertex);
+        commands.push_back(command);
+    }
+}
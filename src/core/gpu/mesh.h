@@ -7,9 +7,15 @@
 #include "core/gpu/vertex_format.h"
 #include "core/gpu/texture2D.h"
 #include "core/gpu/gpu_buffers.h"
+#include "core/culling/bounding_volume.h"
 
 #include "assimp/scene.h"   // Output data structure
 
+
+class CommandBuffer;
+struct DrawElementsIndirectCommand;
+
+
 class Material {
 public:
     Material() : texture(nullptr) {}
@@ -25,6 +31,16 @@ public:
 
 static const unsigned int INVALID_MATERIAL = std::numeric_limits<unsigned int>::max();
 
+// Simplified version of a MeshEntry, stored in the same index buffer after the original geometry
+class MeshLod {
+public:
+    MeshLod() : nrIndices(0), baseIndex(0), error(0) {}
+
+    unsigned int nrIndices;
+    unsigned int baseIndex;
+    float error;            // Largest deviation from the original surface, in object space
+};
+
 class MeshEntry {
 public:
      MeshEntry() : nrIndices(0), baseVertex(0), baseIndex(0), materialIndex(INVALID_MATERIAL) {}
@@ -33,6 +49,13 @@ public:
     unsigned int baseVertex;
     unsigned int baseIndex;
     unsigned int materialIndex;
+
+    // Object space bounds of the entry, computed when the geometry is loaded
+    BoundingBox boundingBox;
+    BoundingSphere boundingSphere;
+
+    // Levels of detail 1..n, level 0 is the entry itself; same base vertex
+    std::vector<MeshLod> lods;
 };
 
 class Mesh {
@@ -69,6 +92,23 @@ class Mesh {
     glm::mat4 ConvertMatrix(const aiMatrix4x4& aiMat);
     void UseMaterials(bool value);
 
+    // Number of simplified levels generated when the mesh is loaded from a file, 0 disables them
+    void SetLodLevels(unsigned int levels);
+
+    // Recomputes the bounds of every entry from the CPU side geometry
+    void ComputeBounds();
+
+    // Overrides the bounds of the whole mesh, e.g. when a shader displaces the vertices
+    void SetBoundingBox(const BoundingBox& box);
+
+    const BoundingBox& GetBoundingBox() const;
+    const BoundingSphere& GetBoundingSphere() const;
+
+    // Level 0 is the original geometry; entries with fewer levels use their coarsest one
+    unsigned int GetLodCount() const;
+    float GetLodError(unsigned int lod) const;
+    unsigned int GetLodIndexCount(unsigned int lod) const;
+
     // GL_POINTS, GL_TRIANGLES, GL_LINES, GL_LINE_STRIP, GL_LINE_LOOP, GL_LINE_STRIP_ADJACENCY, GL_LINES_ADJACENCY,
     // GL_TRIANGLE_STRIP, GL_TRIANGLE_FAN, GL_TRIANGLE_STRIP_ADJACENCY, GL_TRIANGLES_ADJACENCY
     void SetDrawMode(GLenum primitive);
@@ -76,6 +116,15 @@ class Mesh {
 
     void Render() const;
 
+    // Draws every entry at the given level of detail, without binding materials
+    void RenderGeometry(unsigned int lod = 0) const;
+
+    // Same draws as RenderGeometry, recorded for later instead, see CommandQueue
+    void RecordGeometry(CommandBuffer &commands, unsigned int lod = 0) const;
+
+    // Same draws as RenderGeometry, as indirect commands without instances, see GpuScene
+    void AppendIndirectCommands(std::vector<DrawElementsIndirectCommand> &commands, unsigned int lod = 0) const;
+
     const GPUBuffers* GetBuffers() const;
     const char* GetMeshID() const;
 
@@ -83,6 +132,7 @@ class Mesh {
     void InitFromData();
 
     void InitMesh(int index, const aiMesh* paiMesh);
+    void GenerateLods();
     void LoadBones(int MeshIndex, const aiMesh* pMesh);
     bool InitMaterials(const aiScene* pScene);
     bool InitFromScene(const aiScene* pScene);
@@ -97,6 +147,11 @@ class Mesh {
  private:
     std::string meshID;
 
+    BoundingBox boundingBox;
+    BoundingSphere boundingSphere;
+
+    unsigned int lodLevels;
+
  public:
     std::vector<glm::vec3> positions;
     std::vector<glm::vec3> normals;
@@ -0,0 +1,253 @@
+#include "core/gpu/mesh_simplifier.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+MeshSimplifier::Quadric::Quadric()
+    : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0)
+{
+}
+
+
+MeshSimplifier::Quadric::Quadric(const glm::dvec4 &p)
+    : a2(p.x * p.x), ab(p.x * p.y), ac(p.x * p.z), ad(p.x * p.w),
+      b2(p.y * p.y), bc(p.y * p.z), bd(p.y * p.w),
+      c2(p.z * p.z), cd(p.z * p.w),
+      d2(p.w * p.w)
+{
+}
+
+
+MeshSimplifier::Quadric &MeshSimplifier::Quadric::operator+=(const Quadric &o)
+{
+    a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+    b2 += o.b2; bc += o.bc; bd += o.bd;
+    c2 += o.c2; cd += o.cd;
+    d2 += o.d2;
+    return *this;
+}
+
+
+double MeshSimplifier::Quadric::Evaluate(const glm::vec3 &v) const
+{
+    // Sum of squared distances from v to all planes of the quadric
+    double x = v.x, y = v.y, z = v.z;
+    double result = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                  + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                  + c2 * z * z + 2 * cd * z
+                  + d2;
+    return MAX(result, 0.0);
+}
+
+
+MeshSimplifier::MeshSimplifier(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices)
+    : positions(positions), maxCost(0)
+{
+    // Only keep complete triangles that reference existing vertices
+    this->indices.reserve(indices.size());
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        if (indices[i] < positions.size() && indices[i + 1] < positions.size() && indices[i + 2] < positions.size())
+            this->indices.insert(this->indices.end(), indices.begin() + i, indices.begin() + i + 3);
+    }
+
+    quadrics.resize(positions.size());
+    locked.resize(positions.size(), 0);
+
+    // Every vertex starts with the planes of its triangles
+    for (size_t i = 0; i < this->indices.size(); i += 3)
+    {
+        const glm::vec3 &p0 = positions[this->indices[i]];
+        const glm::vec3 &p1 = positions[this->indices[i + 1]];
+        const glm::vec3 &p2 = positions[this->indices[i + 2]];
+
+        glm::dvec3 normal = glm::cross(glm::dvec3(p1 - p0), glm::dvec3(p2 - p0));
+        double length = glm::length(normal);
+        if (length <= 0) continue;
+
+        normal /= length;
+        Quadric plane(glm::dvec4(normal, -glm::dot(normal, glm::dvec3(p0))));
+        for (int k = 0; k < 3; k++) {
+            quadrics[this->indices[i + k]] += plane;
+        }
+    }
+
+    // Edges not shared by exactly two triangles are borders, their vertices never move
+    std::vector<std::pair<unsigned int, unsigned int>> edges;
+    edges.reserve(this->indices.size());
+    for (size_t i = 0; i < this->indices.size(); i += 3)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int a = this->indices[i + k];
+            unsigned int b = this->indices[i + (k + 1) % 3];
+            edges.push_back(std::make_pair(MIN(a, b), MAX(a, b)));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    for (size_t i = 0; i < edges.size();)
+    {
+        size_t j = i;
+        while (j < edges.size() && edges[j] == edges[i]) j++;
+        if (j - i != 2)
+        {
+            locked[edges[i].first] = 1;
+            locked[edges[i].second] = 1;
+        }
+        i = j;
+    }
+}
+
+
+void MeshSimplifier::BuildAdjacency()
+{
+    adjacencyOffsets.assign(positions.size() + 1, 0);
+    for (unsigned int index : indices) {
+        adjacencyOffsets[index + 1]++;
+    }
+    for (size_t i = 1; i < adjacencyOffsets.size(); i++) {
+        adjacencyOffsets[i] += adjacencyOffsets[i - 1];
+    }
+
+    adjacency.resize(indices.size());
+    std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+}
+
+
+bool MeshSimplifier::FlipsTriangle(unsigned int from, unsigned int to) const
+{
+    // Moving "from" onto "to" must not turn any of its remaining triangles over
+    for (unsigned int k = adjacencyOffsets[from]; k < adjacencyOffsets[from + 1]; k++)
+    {
+        const unsigned int *triangle = &indices[adjacency[k] * 3];
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+            continue;   // Removed by the collapse
+
+        glm::vec3 before[3], after[3];
+        for (int v = 0; v < 3; v++)
+        {
+            before[v] = positions[triangle[v]];
+            after[v] = positions[triangle[v] == from ? to : triangle[v]];
+        }
+
+        glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+        glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+        if (glm::dot(normalBefore, normalAfter) <= 0)
+            return true;
+    }
+
+    return false;
+}
+
+
+void MeshSimplifier::Simplify(unsigned int targetIndexCount, float maxError)
+{
+    const double maxCostAllowed = static_cast<double>(maxError) * maxError;
+    std::vector<unsigned int> remap(positions.size());
+    std::vector<unsigned char> touched(positions.size());
+    std::vector<Collapse> collapses;
+
+    while (indices.size() > targetIndexCount)
+    {
+        BuildAdjacency();
+
+        // One candidate per edge, in the cheaper direction a locked vertex allows
+        collapses.clear();
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int a = indices[i + k];
+                unsigned int b = indices[i + (k + 1) % 3];
+                if (a > b) continue;    // Interior edges are seen from both sides
+
+                Quadric merged = quadrics[a];
+                merged += quadrics[b];
+
+                Collapse collapse;
+                collapse.cost = std::numeric_limits<double>::max();
+                if (!locked[a]) {
+                    collapse.from = a;
+                    collapse.to = b;
+                    collapse.cost = merged.Evaluate(positions[b]);
+                }
+                if (!locked[b]) {
+                    double cost = merged.Evaluate(positions[a]);
+                    if (cost < collapse.cost) {
+                        collapse.from = b;
+                        collapse.to = a;
+                        collapse.cost = cost;
+                    }
+                }
+
+                if (collapse.cost <= maxCostAllowed)
+                    collapses.push_back(collapse);
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) {
+            return a.cost < b.cost;
+        });
+
+        for (size_t i = 0; i < remap.size(); i++) remap[i] = static_cast<unsigned int>(i);
+        std::fill(touched.begin(), touched.end(), 0);
+
+        size_t remaining = indices.size();
+        unsigned int applied = 0;
+
+        for (const auto &collapse : collapses)
+        {
+            if (remaining <= targetIndexCount) break;
+            if (touched[collapse.from] || touched[collapse.to]) continue;
+            if (FlipsTriangle(collapse.from, collapse.to)) continue;
+
+            // The whole one ring is frozen for this pass, the flip test above
+            // would be stale if one of the neighbouring triangles changed too
+            for (unsigned int k = adjacencyOffsets[collapse.from]; k < adjacencyOffsets[collapse.from + 1]; k++)
+            {
+                const unsigned int *triangle = &indices[adjacency[k] * 3];
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                    remaining -= 3;
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to] += quadrics[collapse.from];
+            maxCost = MAX(maxCost, collapse.cost);
+            applied++;
+        }
+
+        if (applied == 0)
+            break;
+
+        // Apply the collapses and drop the triangles that became degenerate
+        size_t write = 0;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            unsigned int a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+            if (a == b || b == c || a == c) continue;
+
+            indices[write++] = a;
+            indices[write++] = b;
+            indices[write++] = c;
+        }
+        indices.resize(write);
+    }
+}
+
+
+const std::vector<unsigned int> &MeshSimplifier::GetIndices() const
+{
+    return indices;
+}
+
+
+float MeshSimplifier::GetError() const
+{
+    return static_cast<float>(sqrt(maxCost));
+}
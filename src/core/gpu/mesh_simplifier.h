@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+
+#include "utils/glm_utils.h"
+
+
+// Quadric error edge collapse simplification of an indexed triangle list.
+// Vertices are only ever collapsed onto one of their neighbours, so the
+// simplified triangles reference the original vertex buffer and need no
+// new vertex data. Vertices on open or non manifold edges are locked, which
+// also keeps attribute seams (split vertices) in place.
+//
+// Successive Simplify() calls continue from the previous result, so a whole
+// LOD chain is produced by calling it with decreasing targets.
+class MeshSimplifier
+{
+ public:
+    MeshSimplifier(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices);
+
+    // Collapses edges until at most targetIndexCount indices are left, no valid
+    // collapse remains, or the next collapse would exceed maxError
+    void Simplify(unsigned int targetIndexCount, float maxError = std::numeric_limits<float>::max());
+
+    const std::vector<unsigned int> &GetIndices() const;
+
+    // Largest collapse error so far, as a distance in object space
+    float GetError() const;
+
+ private:
+    struct Quadric {
+        Quadric();
+        Quadric(const glm::dvec4 &plane);
+
+        Quadric &operator+=(const Quadric &other);
+        double Evaluate(const glm::vec3 &p) const;
+
+        double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+    };
+
+    struct Collapse {
+        unsigned int from;
+        unsigned int to;
+        double cost;
+    };
+
+    bool FlipsTriangle(unsigned int from, unsigned int to) const;
+    void BuildAdjacency();
+
+ private:
+    const std::vector<glm::vec3> &positions;
+    std::vector<unsigned int> indices;
+
+    std::vector<Quadric> quadrics;
+    std::vector<unsigned char> locked;
+
+    // Vertex to triangle adjacency of the current indices
+    std::vector<unsigned int> adjacencyOffsets;
+    std::vector<unsigned int> adjacency;
+
+    double maxCost;
+};
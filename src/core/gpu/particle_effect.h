@@ -2,9 +2,11 @@
 
 #include <vector>
 #include <chrono>
+#include <functional>
 
 #include "utils/gl_utils.h"
 #include "utils/glm_utils.h"
+#include "utils/memory_utils.h"
 
 #include "components/camera.h"
 #include "components/transform.h"
@@ -134,8 +136,16 @@ void ParticleEffect<T>::Generate(unsigned int particleCount, bool createLocalBuf
 template <class T>
 void ParticleEffect<T>::FillRandomData(std::function<T(void)> generator)
 {
-    particles->ReadBuffer();
+    // Every entry is overwritten, the GPU copy is never read back. Generated
+    // into the local buffer when there is one, so it matches the GPU copy
     auto data = const_cast<T*>(particles->GetBuffer());
+    std::vector<T> scratch;
+    if (!data)
+    {
+        scratch.resize(particleCount);
+        data = scratch.data();
+    }
+
     for (unsigned int i = 0; i < particleCount; i++) {
         data[i] = generator();
     }
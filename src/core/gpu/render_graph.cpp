@@ -0,0 +1,502 @@
+#include "core/gpu/render_graph.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "utils/memory_utils.h"
+
+
+// Pooled textures and framebuffers nobody asked for during this many frames are deleted
+static const unsigned int MAX_UNUSED_FRAMES = 3;
+
+
+RenderTargetDesc RenderTargetDesc::Color(unsigned int precision, float scale, unsigned int channels)
+{
+    RenderTargetDesc desc;
+    desc.precision = (precision / 8) * 8;
+    desc.channels = MAX(MIN(channels, 4u), 1u);
+    desc.scale = scale;
+    return desc;
+}
+
+
+RenderTargetDesc RenderTargetDesc::Depth(float scale)
+{
+    RenderTargetDesc desc;
+    desc.precision = 32;
+    desc.scale = scale;
+    desc.depth = true;
+    return desc;
+}
+
+
+RenderTargetDesc RenderTargetDesc::DepthStencil(float scale)
+{
+    RenderTargetDesc desc = Depth(scale);
+    desc.stencil = true;
+    return desc;
+}
+
+
+RenderGraph::RenderGraph()
+    : resolution(1), compiled(false), incompleteFramebuffers(0)
+{
+    Reset();
+}
+
+
+RenderGraph::~RenderGraph()
+{
+    for (auto &framebuffer : framebuffers) {
+        glDeleteFramebuffers(1, &framebuffer.FBO);
+    }
+    for (auto &entry : pool) {
+        SAFE_FREE(entry.texture);
+    }
+}
+
+
+void RenderGraph::Resize(int width, int height)
+{
+    glm::ivec2 size(MAX(width, 1), MAX(height, 1));
+    if (size == resolution)
+        return;
+
+    resolution = size;
+
+    // Nothing is in use between frames, every texture of the old size can go
+    ReleaseUnused(0);
+}
+
+
+glm::ivec2 RenderGraph::GetResolution() const
+{
+    return resolution;
+}
+
+
+void RenderGraph::Reset()
+{
+    passes.clear();
+    targets.clear();
+    compiled = false;
+
+    Target backbuffer;
+    backbuffer.name = "backbuffer";
+    backbuffer.size = resolution;
+    backbuffer.firstPass = -1;
+    backbuffer.lastPass = -1;
+    backbuffer.texture = -1;
+    backbuffer.imported = nullptr;
+    targets.push_back(backbuffer);
+}
+
+
+RenderTargetHandle RenderGraph::CreateTarget(const std::string &name, const RenderTargetDesc &desc)
+{
+    Target target;
+    target.name = name;
+    target.desc = desc;
+    target.firstPass = -1;
+    target.lastPass = -1;
+    target.texture = -1;
+    target.imported = nullptr;
+
+    if (desc.size.x > 0 && desc.size.y > 0) {
+        target.size = desc.size;
+    } else {
+        target.size = glm::max(glm::ivec2(glm::vec2(resolution) * desc.scale + 0.5f), glm::ivec2(1));
+    }
+
+    targets.push_back(target);
+    return static_cast<RenderTargetHandle>(targets.size() - 1);
+}
+
+
+RenderTargetHandle RenderGraph::ImportTexture(const std::string &name, Texture2D *texture, bool depth)
+{
+    Target target;
+    target.name = name;
+    target.desc.depth = depth;
+    target.size = texture ? glm::ivec2(texture->GetWidth(), texture->GetHeight()) : glm::ivec2(0);
+    target.firstPass = -1;
+    target.lastPass = -1;
+    target.texture = -1;
+    target.imported = texture;
+
+    targets.push_back(target);
+    return static_cast<RenderTargetHandle>(targets.size() - 1);
+}
+
+
+void RenderGraph::AddPass(const std::string &name,
+                          const std::vector<RenderTargetHandle> &reads,
+                          const std::vector<RenderTargetHandle> &writes,
+                          std::function<void()> execute)
+{
+    Pass pass;
+    pass.name = name;
+    pass.reads = reads;
+    pass.writes = writes;
+    pass.execute = std::move(execute);
+    pass.culled = false;
+    passes.push_back(std::move(pass));
+    compiled = false;
+}
+
+
+void RenderGraph::Compile()
+{
+    ReleaseUnused(MAX_UNUSED_FRAMES);
+
+    // Walk back from the backbuffer, a pass survives if a later surviving
+    // pass (or the screen) needs one of the targets it writes
+    std::vector<unsigned char> needed(targets.size(), 0);
+    needed[BACKBUFFER] = 1;
+
+    for (int i = static_cast<int>(passes.size()) - 1; i >= 0; i--)
+    {
+        Pass &pass = passes[i];
+        pass.culled = true;
+        for (RenderTargetHandle target : pass.writes) {
+            if (target < targets.size() && needed[target]) pass.culled = false;
+        }
+
+        if (pass.culled) continue;
+        for (RenderTargetHandle target : pass.reads) {
+            if (target < targets.size()) needed[target] = 1;
+        }
+    }
+
+    // Lifetimes in pass indices
+    for (auto &target : targets)
+    {
+        target.firstPass = -1;
+        target.lastPass = -1;
+        target.texture = -1;
+    }
+
+    for (int i = 0; i < static_cast<int>(passes.size()); i++)
+    {
+        if (passes[i].culled) continue;
+
+        auto use = [&](RenderTargetHandle handle) {
+            if (handle >= targets.size()) return;
+            Target &target = targets[handle];
+            if (target.firstPass < 0) target.firstPass = i;
+            target.lastPass = i;
+        };
+        for (RenderTargetHandle target : passes[i].reads) use(target);
+        for (RenderTargetHandle target : passes[i].writes) use(target);
+    }
+
+    // Hand out the pooled textures in pass order, a texture freed by the last
+    // use of one target is reused by the next compatible target that starts
+    for (auto &entry : pool) {
+        entry.inUse = false;
+    }
+
+    for (int i = 0; i < static_cast<int>(passes.size()); i++)
+    {
+        if (passes[i].culled) continue;
+
+        for (size_t t = 1; t < targets.size(); t++)
+        {
+            if (targets[t].firstPass == i && !targets[t].imported)
+                targets[t].texture = AcquireTexture(targets[t]);
+        }
+
+        for (size_t t = 1; t < targets.size(); t++)
+        {
+            if (targets[t].lastPass == i && targets[t].texture >= 0)
+                pool[targets[t].texture].inUse = false;
+        }
+    }
+
+    compiled = true;
+}
+
+
+void RenderGraph::Execute()
+{
+    if (!compiled)
+        Compile();
+
+    for (const auto &pass : passes)
+    {
+        if (pass.culled) continue;
+
+        bool toBackbuffer = false;
+        for (RenderTargetHandle target : pass.writes) {
+            if (target == BACKBUFFER) toBackbuffer = true;
+        }
+
+        if (toBackbuffer || pass.writes.empty())
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(0, 0, resolution.x, resolution.y);
+        }
+        else
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, GetFramebuffer(pass));
+            glm::ivec2 size = targets[pass.writes[0]].size;
+            glViewport(0, 0, size.x, size.y);
+        }
+
+        if (pass.execute)
+            pass.execute();
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, resolution.x, resolution.y);
+    CheckOpenGLError();
+}
+
+
+Texture2D *RenderGraph::GetTexture(RenderTargetHandle target) const
+{
+    if (target >= targets.size())
+        return nullptr;
+    if (targets[target].imported)
+        return targets[target].imported;
+    if (targets[target].texture < 0)
+        return nullptr;
+    return pool[targets[target].texture].texture;
+}
+
+
+glm::ivec2 RenderGraph::GetSize(RenderTargetHandle target) const
+{
+    if (target >= targets.size())
+        return glm::ivec2(0);
+    return target == BACKBUFFER ? resolution : targets[target].size;
+}
+
+
+unsigned int RenderGraph::GetPassCount() const
+{
+    return static_cast<unsigned int>(passes.size());
+}
+
+
+unsigned int RenderGraph::GetCulledPassCount() const
+{
+    unsigned int count = 0;
+    for (const auto &pass : passes) {
+        if (pass.culled) count++;
+    }
+    return count;
+}
+
+
+unsigned int RenderGraph::GetIncompleteFramebufferCount() const
+{
+    return incompleteFramebuffers;
+}
+
+
+unsigned int RenderGraph::GetTextureCount() const
+{
+    return static_cast<unsigned int>(pool.size());
+}
+
+
+size_t RenderGraph::GetTextureMemory() const
+{
+    // Bytes per channel of the formats picked by Texture2D for 8, 16, 24 and 32 bits
+    static const size_t channelBytes[4] = { 1, 2, 2, 4 };
+
+    size_t bytes = 0;
+    for (const auto &entry : pool)
+    {
+        size_t pixels = static_cast<size_t>(entry.size.x) * entry.size.y;
+        if (entry.depth) {
+            bytes += pixels * (entry.stencil ? 8 : 4);
+        } else {
+            bytes += pixels * entry.channels * channelBytes[MIN(MAX(entry.precision / 8, 1u), 4u) - 1];
+        }
+    }
+    return bytes;
+}
+
+
+int RenderGraph::AcquireTexture(const Target &target)
+{
+    for (size_t i = 0; i < pool.size(); i++)
+    {
+        PooledTexture &entry = pool[i];
+        if (entry.inUse || entry.size != target.size || entry.depth != target.desc.depth)
+            continue;
+        if (entry.depth && entry.stencil != target.desc.stencil)
+            continue;
+        if (!entry.depth && (entry.precision != target.desc.precision || entry.channels != target.desc.channels))
+            continue;
+
+        entry.inUse = true;
+        entry.unusedFrames = 0;
+        return static_cast<int>(i);
+    }
+
+    PooledTexture entry;
+    entry.texture = new Texture2D();
+    entry.size = target.size;
+    entry.precision = target.desc.precision;
+    entry.channels = target.desc.channels;
+    entry.depth = target.desc.depth;
+    entry.stencil = target.desc.depth && target.desc.stencil;
+    entry.inUse = true;
+    entry.unusedFrames = 0;
+
+    entry.texture->SetWrappingMode(GL_CLAMP_TO_EDGE);
+    if (entry.depth) {
+        if (entry.stencil) {
+            entry.texture->CreateDepthStencilTexture(entry.size.x, entry.size.y);
+        } else {
+            entry.texture->CreateDepthTexture(entry.size.x, entry.size.y);
+        }
+        entry.texture->SetFiltering(GL_NEAREST, GL_NEAREST);
+    } else {
+        entry.texture->CreateRenderTexture(entry.size.x, entry.size.y, entry.precision, entry.channels);
+    }
+
+    pool.push_back(entry);
+    return static_cast<int>(pool.size() - 1);
+}
+
+
+GLuint RenderGraph::GetFramebuffer(const Pass &pass)
+{
+    std::vector<GLuint> attachments;
+    GLuint depthID = 0;
+    bool stencil = false;
+    for (RenderTargetHandle handle : pass.writes)
+    {
+        Texture2D *texture = GetTexture(handle);
+        if (!texture) continue;
+
+        if (targets[handle].desc.depth) {
+            depthID = texture->GetTextureID();
+            stencil = targets[handle].desc.stencil;
+        } else {
+            attachments.push_back(texture->GetTextureID());
+        }
+    }
+    attachments.push_back(depthID);
+
+    return GetFramebuffer(attachments, stencil, pass.name);
+}
+
+
+GLuint RenderGraph::GetFramebuffer(const std::vector<GLuint> &attachments, bool stencil, const std::string &name)
+{
+    for (auto &framebuffer : framebuffers)
+    {
+        if (framebuffer.attachments == attachments && framebuffer.stencil == stencil)
+        {
+            framebuffer.unusedFrames = 0;
+            return framebuffer.FBO;
+        }
+    }
+
+    CachedFramebuffer framebuffer;
+    framebuffer.attachments = attachments;
+    framebuffer.stencil = stencil;
+    framebuffer.unusedFrames = 0;
+
+    glGenFramebuffers(1, &framebuffer.FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.FBO);
+
+    const unsigned int nrColors = static_cast<unsigned int>(attachments.size() - 1);
+    const GLuint depthID = attachments.back();
+    std::vector<GLenum> drawBuffers(nrColors);
+    for (unsigned int i = 0; i < nrColors; i++)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, attachments[i], 0);
+        drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+    }
+    if (depthID) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthID, 0);
+    }
+
+    if (nrColors > 0) {
+        glDrawBuffers(nrColors, drawBuffers.data());
+    } else {
+        glDrawBuffer(GL_NONE);
+    }
+
+    // Kept in the cache so it is not created again every frame, the passes drawing to it draw nothing
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        incompleteFramebuffers++;
+    CheckOpenGLError();
+
+    framebuffers.push_back(framebuffer);
+    return framebuffer.FBO;
+}
+
+
+void RenderGraph::BlitDepth(RenderTargetHandle source)
+{
+    Texture2D *texture = GetTexture(source);
+    if (!texture || !targets[source].desc.depth)
+        return;
+
+    GLint drawFBO = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFBO);
+
+    const bool stencil = targets[source].desc.stencil;
+    std::vector<GLuint> attachments(1, texture->GetTextureID());
+    GLuint readFBO = GetFramebuffer(attachments, stencil, targets[source].name);
+
+    const glm::ivec2 size = targets[source].size;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFBO);
+    glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, size.x, size.y,
+                      GL_DEPTH_BUFFER_BIT | (stencil ? GL_STENCIL_BUFFER_BIT : 0), GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, drawFBO);
+}
+
+
+void RenderGraph::ReleaseUnused(unsigned int maxUnusedFrames)
+{
+    for (size_t i = 0; i < pool.size();)
+    {
+        PooledTexture &entry = pool[i];
+        if (entry.inUse || entry.unusedFrames < maxUnusedFrames)
+        {
+            entry.unusedFrames++;
+            i++;
+            continue;
+        }
+
+        ReleaseFramebuffers(entry.texture->GetTextureID());
+        SAFE_FREE(entry.texture);
+        pool.erase(pool.begin() + i);
+    }
+
+    for (size_t i = 0; i < framebuffers.size();)
+    {
+        if (framebuffers[i].unusedFrames++ < maxUnusedFrames) {
+            i++;
+            continue;
+        }
+
+        glDeleteFramebuffers(1, &framebuffers[i].FBO);
+        framebuffers.erase(framebuffers.begin() + i);
+    }
+}
+
+
+void RenderGraph::ReleaseFramebuffers(GLuint textureID)
+{
+    for (size_t i = 0; i < framebuffers.size();)
+    {
+        const auto &attachments = framebuffers[i].attachments;
+        if (std::find(attachments.begin(), attachments.end(), textureID) == attachments.end()) {
+            i++;
+            continue;
+        }
+
+        glDeleteFramebuffers(1, &framebuffers[i].FBO);
+        framebuffers.erase(framebuffers.begin() + i);
+    }
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "core/gpu/texture2D.h"
+#include "utils/glm_utils.h"
+
+
+typedef unsigned int RenderTargetHandle;
+
+
+// Format and size of a render graph target. Targets follow the output
+// resolution of the graph through their scale unless a fixed size is set.
+struct RenderTargetDesc
+{
+    RenderTargetDesc() : scale(1), size(0), precision(8), channels(4), depth(false), stencil(false) { }
+
+    static RenderTargetDesc Color(unsigned int precision = 8, float scale = 1, unsigned int channels = 4);
+    static RenderTargetDesc Depth(float scale = 1);
+    static RenderTargetDesc DepthStencil(float scale = 1);
+
+    float scale;
+    glm::ivec2 size;            // Used instead of the scale when not zero
+    unsigned int precision;     // Bits per channel, same meaning as Texture2D::CreateRenderTexture
+    unsigned int channels;
+    bool depth;
+    bool stencil;               // Depth targets only
+};
+
+
+// Frame graph on top of plain textures and framebuffers. Every frame the
+// passes are declared with the targets they read and write, then Compile()
+// removes the passes whose results never reach the backbuffer and computes
+// the first and last pass using each target.
+//
+// Targets are transient: a texture is only owned by a target between its
+// first and last use, after which it goes back to the pool and can be handed
+// to a later target of the same size and format in the same frame. The
+// content of a target is undefined when its first pass starts, that pass has
+// to clear it or overwrite it completely.
+//
+// Textures and framebuffers persist across frames, so a graph that is the
+// same every frame allocates nothing after the first one.
+class RenderGraph
+{
+ public:
+    // Passes writing the backbuffer render to the default framebuffer
+    static const RenderTargetHandle BACKBUFFER = 0;
+
+    RenderGraph();
+    ~RenderGraph();
+
+    // Textures of the old resolution are released, the next Compile() allocates the new ones
+    void Resize(int width, int height);
+    glm::ivec2 GetResolution() const;
+
+    // Forgets the passes and targets of the previous frame, the pool is kept
+    void Reset();
+
+    RenderTargetHandle CreateTarget(const std::string &name, const RenderTargetDesc &desc);
+
+    // Texture owned outside the graph and kept across frames, declaring it
+    // orders the passes using it and keeps its writers from being culled
+    RenderTargetHandle ImportTexture(const std::string &name, Texture2D *texture, bool depth = false);
+
+    // All written targets must have the same size, the backbuffer can't be
+    // mixed with other targets
+    void AddPass(const std::string &name,
+                 const std::vector<RenderTargetHandle> &reads,
+                 const std::vector<RenderTargetHandle> &writes,
+                 std::function<void()> execute);
+
+    void Compile();
+
+    // Runs the passes left by Compile() in the order they were added, each with
+    // a framebuffer of its written targets bound and the viewport set to their size
+    void Execute();
+
+    // Copies depth and stencil of a target into the depth attachment of the
+    // framebuffer bound for drawing, both need the same size and format
+    void BlitDepth(RenderTargetHandle source);
+
+    // Texture of a target, only valid while the passes using it execute
+    Texture2D *GetTexture(RenderTargetHandle target) const;
+    glm::ivec2 GetSize(RenderTargetHandle target) const;
+
+    unsigned int GetPassCount() const;
+    unsigned int GetCulledPassCount() const;
+    // Framebuffers of the passes that were not complete when created, since the start
+    unsigned int GetIncompleteFramebufferCount() const;
+    unsigned int GetTextureCount() const;
+    size_t GetTextureMemory() const;
+
+ private:
+    struct Target {
+        std::string name;
+        RenderTargetDesc desc;
+        glm::ivec2 size;
+        int firstPass;
+        int lastPass;
+        int texture;            // Index in the pool, -1 while not allocated
+        Texture2D *imported;
+    };
+
+    struct Pass {
+        std::string name;
+        std::vector<RenderTargetHandle> reads;
+        std::vector<RenderTargetHandle> writes;
+        std::function<void()> execute;
+        bool culled;
+    };
+
+    struct PooledTexture {
+        Texture2D *texture;
+        glm::ivec2 size;
+        unsigned int precision;
+        unsigned int channels;
+        bool depth;
+        bool stencil;
+        bool inUse;
+        unsigned int unusedFrames;
+    };
+
+    struct CachedFramebuffer {
+        std::vector<GLuint> attachments;    // Color textures, then the depth texture or 0
+        bool stencil;
+        GLuint FBO;
+        unsigned int unusedFrames;
+    };
+
+    int AcquireTexture(const Target &target);
+    GLuint GetFramebuffer(const Pass &pass);
+    GLuint GetFramebuffer(const std::vector<GLuint> &attachments, bool stencil, const std::string &name);
+    void ReleaseUnused(unsigned int maxUnusedFrames);
+    void ReleaseFramebuffers(GLuint textureID);
+
+ private:
+    glm::ivec2 resolution;
+
+    std::vector<Target> targets;
+    std::vector<Pass> passes;
+    bool compiled;
+
+    std::vector<PooledTexture> pool;
+    std::vector<CachedFramebuffer> framebuffers;
+    unsigned int incompleteFramebuffers;
+};
@@ -0,0 +1,59 @@
+#include "core/gpu/render_stats.h"
+
+
+namespace
+{
+    RenderStats current;
+    RenderStats lastFrame;
+    GLuint boundProgram = 0;
+}
+
+
+void render_stats::AddDraw(GLenum mode, unsigned int count)
+{
+    current.drawCalls++;
+
+    switch (mode)
+    {
+    case GL_TRIANGLES:
+        current.triangles += count / 3;
+        break;
+    case GL_TRIANGLE_STRIP:
+    case GL_TRIANGLE_FAN:
+        current.triangles += count > 2 ? count - 2 : 0;
+        break;
+    default:
+        break;
+    }
+}
+
+
+void render_stats::AddTextureBind()
+{
+    current.textureBinds++;
+}
+
+
+void render_stats::UseProgram(GLuint program)
+{
+    // Programs bound with a direct glUseProgram aren't seen here, the call is
+    // never skipped so the binding stays right, only the count can be off
+    if (program != boundProgram) {
+        current.programSwitches++;
+        boundProgram = program;
+    }
+    glUseProgram(program);
+}
+
+
+void render_stats::EndFrame()
+{
+    lastFrame = current;
+    current = RenderStats();
+}
+
+
+const RenderStats &render_stats::GetLastFrame()
+{
+    return lastFrame;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "utils/gl_utils.h"
+
+
+// GL work submitted in a frame. The counts are kept on the CPU by the
+// wrappers issuing the calls (Mesh, Texture2D, Shader and the batchers), so
+// reading them never waits for the GPU, unlike pipeline statistics queries.
+struct RenderStats
+{
+    RenderStats() : drawCalls(0), triangles(0), textureBinds(0), programSwitches(0) { }
+
+    unsigned int drawCalls;
+    unsigned int triangles;
+    unsigned int textureBinds;
+    unsigned int programSwitches;   // Binds of a program other than the bound one
+};
+
+
+namespace render_stats
+{
+    // count: vertices or indices drawn with the given primitive
+    void AddDraw(GLenum mode, unsigned int count);
+    void AddTextureBind();
+
+    // glUseProgram that only counts a switch when the program changes
+    void UseProgram(GLuint program);
+
+    // Closes the counts of the frame, called once per frame by the world loop
+    void EndFrame();
+
+    // Counts of the last closed frame
+    const RenderStats &GetLastFrame();
+}
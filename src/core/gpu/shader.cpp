@@ -3,6 +3,9 @@
 #include <fstream>
 #include <iostream>
 
+#include "core/gpu/render_stats.h"
+#include "utils/math_utils.h"
+
 
 Shader::Shader(const std::string &name)
 {
@@ -34,7 +37,7 @@ void Shader::Use() const
 {
     if (program)
     {
-        glUseProgram(program);
+        render_stats::UseProgram(program);
         CheckOpenGLError();
     }
 }
@@ -66,6 +69,13 @@ GLint Shader::GetUniformLocation(const char *uniformName) const
 }
 
 
+GLint Shader::GetUniformSlot(const std::string &uniformName) const
+{
+    auto slot = uniformSlots.find(uniformName);
+    return slot != uniformSlots.end() ? slot->second : INVALID_LOC;
+}
+
+
 void Shader::OnLoad(std::function<void()> onLoad)
 {
     loadObservers.push_back(onLoad);
@@ -105,12 +115,53 @@ void Shader::GetUniforms()
     // Text
     text_color              = GetUniformLocation("text_color");
 
+    ReflectUniforms();
     BindTexturesUnits();
 
     CheckOpenGLError();
 }
 
 
+void Shader::ReflectUniforms()
+{
+    uniformSlots.clear();
+
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::vector<char> name(MAX(maxLength, 1));
+    for (GLint i = 0; i < count; i++)
+    {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, i, static_cast<GLsizei>(name.size()), &length, &size, &type, name.data());
+
+        // Members of uniform blocks have no location
+        std::string uniformName(name.data(), length);
+        GLint location = GetUniformLocation(uniformName.c_str());
+        if (location < 0)
+            continue;
+
+        uniformSlots[uniformName] = location;
+
+        // Arrays are reported by their first element
+        size_t bracket = uniformName.rfind("[0]");
+        if (bracket == std::string::npos || bracket + 3 != uniformName.size())
+            continue;
+
+        std::string arrayName = uniformName.substr(0, bracket);
+        uniformSlots[arrayName] = location;
+        for (GLint element = 1; element < size; element++)
+        {
+            std::string elementName = arrayName + "[" + std::to_string(element) + "]";
+            uniformSlots[elementName] = GetUniformLocation(elementName.c_str());
+        }
+    }
+}
+
+
 void Shader::AddShader(const std::string & shaderFile, GLenum shaderType)
 {
     ShaderFile S;
@@ -159,7 +210,7 @@ unsigned int Shader::CreateAndLink()
 
         if (program)
         {
-            glUseProgram(program);
+            render_stats::UseProgram(program);
             GetUniforms();
             for (auto Observer : loadObservers) {
                 Observer();
@@ -4,6 +4,7 @@
 #include <vector>
 #include <list>
 #include <functional>
+#include <unordered_map>
 
 #include "utils/gl_utils.h"
 
@@ -32,10 +33,16 @@ class Shader
     void BindTexturesUnits();
     GLint GetUniformLocation(const char * uniformName) const;
 
+    // Location of an active uniform, found when the program was linked. Array
+    // elements are listed as "name[i]", the first one also as "name".
+    // Makes no GL call, so any thread can look slots up
+    GLint GetUniformSlot(const std::string &uniformName) const;
+
     void OnLoad(std::function<void()> onLoad);
 
  private:
     void GetUniforms();
+    void ReflectUniforms();
     static unsigned int CreateShader(const std::string &shaderFile, GLenum shaderType);
     static unsigned int CompileShader(const std::string shaderCode, GLenum shaderType);
     static unsigned int CreateProgram(const std::vector<unsigned int> &shaderObjects);
@@ -80,4 +87,5 @@ class Shader
     std::vector<ShaderFile> shaderFiles;
     std::vector<ShaderFile> shaderCodes;
     std::list<std::function<void()>> loadObservers;
+    std::unordered_map<std::string, GLint> uniformSlots;
 };
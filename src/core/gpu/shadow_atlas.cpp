@@ -0,0 +1,248 @@
+#include "core/gpu/shadow_atlas.h"
+
+#include <algorithm>
+
+#include "utils/memory_utils.h"
+
+
+ShadowAtlas::ShadowAtlas(unsigned int size, unsigned int pageSize)
+    : size(size), pageSize(MIN(pageSize, size)), staticBudget(2),
+      staticDepth(nullptr), depth(nullptr), staticFBO(0), FBO(0),
+      staticUpdates(0), dynamicUpdates(0), complete(false)
+{
+}
+
+
+ShadowAtlas::~ShadowAtlas()
+{
+    if (staticFBO)
+        glDeleteFramebuffers(1, &staticFBO);
+    if (FBO)
+        glDeleteFramebuffers(1, &FBO);
+    SAFE_FREE(staticDepth);
+    SAFE_FREE(depth);
+}
+
+
+int ShadowAtlas::AddLight(unsigned int staticInterval, unsigned int dynamicInterval)
+{
+    const unsigned int pagesPerRow = size / pageSize;
+    if (lights.size() >= pagesPerRow * pagesPerRow)
+        return -1;
+
+    Light light;
+    light.page = static_cast<unsigned int>(lights.size());
+    light.staticInterval = MAX(staticInterval, 1u);
+    light.dynamicInterval = MAX(dynamicInterval, 1u);
+    light.framesSinceStatic = 0;
+    light.framesSinceDynamic = 0;
+    light.requested = glm::mat4(1);
+    light.current = glm::mat4(1);
+    light.hasStatic = false;
+    light.ready = false;
+
+    lights.push_back(light);
+    return static_cast<int>(lights.size() - 1);
+}
+
+
+void ShadowAtlas::SetLightMatrix(unsigned int light, const glm::mat4 &viewProjection)
+{
+    lights[light].requested = viewProjection;
+}
+
+
+void ShadowAtlas::SetStaticBudget(unsigned int pagesPerFrame)
+{
+    staticBudget = MAX(pagesPerFrame, 1u);
+}
+
+
+void ShadowAtlas::InvalidateStatic()
+{
+    for (auto &light : lights) {
+        light.hasStatic = false;
+    }
+}
+
+
+void ShadowAtlas::Init()
+{
+    if (depth)
+        return;
+
+    staticDepth = new Texture2D();
+    depth = new Texture2D();
+
+    complete = true;
+    Texture2D *textures[2] = { staticDepth, depth };
+    GLuint *framebuffers[2] = { &staticFBO, &FBO };
+
+    for (int i = 0; i < 2; i++)
+    {
+        textures[i]->SetWrappingMode(GL_CLAMP_TO_EDGE);
+        textures[i]->CreateDepthTexture(size, size);
+        textures[i]->SetFiltering(GL_NEAREST, GL_NEAREST);
+
+        glGenFramebuffers(1, framebuffers[i]);
+        glBindFramebuffer(GL_FRAMEBUFFER, *framebuffers[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures[i]->GetTextureID(), 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+
+        complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CheckOpenGLError();
+}
+
+
+glm::ivec4 ShadowAtlas::GetPageViewport(unsigned int page) const
+{
+    const unsigned int pagesPerRow = size / pageSize;
+    return glm::ivec4((page % pagesPerRow) * pageSize, (page / pagesPerRow) * pageSize, pageSize, pageSize);
+}
+
+
+void ShadowAtlas::ClearPage(const glm::ivec4 &viewport) const
+{
+    glViewport(viewport.x, viewport.y, viewport.z, viewport.w);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(viewport.x, viewport.y, viewport.z, viewport.w);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+}
+
+
+void ShadowAtlas::Update(const CasterCallback &renderStatic, const CasterCallback &renderDynamic)
+{
+    Init();
+
+    staticUpdates = 0;
+    dynamicUpdates = 0;
+
+    for (auto &light : lights)
+    {
+        light.framesSinceStatic++;
+        light.framesSinceDynamic++;
+    }
+
+    // Lights due for a static update, the most overdue first
+    std::vector<unsigned int> due;
+    for (unsigned int i = 0; i < lights.size(); i++)
+    {
+        if (!lights[i].hasStatic || lights[i].framesSinceStatic >= lights[i].staticInterval)
+            due.push_back(i);
+    }
+
+    std::stable_sort(due.begin(), due.end(), [this](unsigned int a, unsigned int b) {
+        const Light &la = lights[a], &lb = lights[b];
+        if (la.hasStatic != lb.hasStatic) return !la.hasStatic;
+        return la.framesSinceStatic - la.staticInterval > lb.framesSinceStatic - lb.staticInterval;
+    });
+    if (due.size() > staticBudget)
+        due.resize(staticBudget);
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+
+    // Slope scaled offset against self shadowing
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(1.5f, 4.0f);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, staticFBO);
+    for (unsigned int index : due)
+    {
+        Light &light = lights[index];
+        light.current = light.requested;
+        light.framesSinceStatic = 0;
+        light.hasStatic = true;
+
+        // The copy below is stale now, redraw the moving casters in the same frame
+        light.framesSinceDynamic = light.dynamicInterval;
+
+        ClearPage(GetPageViewport(light.page));
+        if (renderStatic)
+            renderStatic(index, light.current);
+        staticUpdates++;
+    }
+
+    for (unsigned int i = 0; i < lights.size(); i++)
+    {
+        Light &light = lights[i];
+        if (!light.hasStatic || light.framesSinceDynamic < light.dynamicInterval)
+            continue;
+
+        light.framesSinceDynamic = 0;
+        light.ready = true;
+
+        // Restart from the cached static depth, then add the moving casters
+        glm::ivec4 viewport = GetPageViewport(light.page);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+        glBlitFramebuffer(viewport.x, viewport.y, viewport.x + viewport.z, viewport.y + viewport.w,
+                          viewport.x, viewport.y, viewport.x + viewport.z, viewport.y + viewport.w,
+                          GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(viewport.x, viewport.y, viewport.z, viewport.w);
+        if (renderDynamic)
+            renderDynamic(i, light.current);
+        dynamicUpdates++;
+    }
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CheckOpenGLError();
+}
+
+
+const glm::mat4 &ShadowAtlas::GetLightMatrix(unsigned int light) const
+{
+    return lights[light].current;
+}
+
+
+glm::vec4 ShadowAtlas::GetPageRect(unsigned int light) const
+{
+    glm::vec4 viewport(GetPageViewport(lights[light].page));
+    return viewport / static_cast<float>(size);
+}
+
+
+bool ShadowAtlas::IsReady(unsigned int light) const
+{
+    return light < lights.size() && lights[light].ready;
+}
+
+
+Texture2D *ShadowAtlas::GetTexture() const
+{
+    return depth;
+}
+
+
+unsigned int ShadowAtlas::GetSize() const
+{
+    return size;
+}
+
+
+bool ShadowAtlas::IsComplete() const
+{
+    return complete;
+}
+
+
+unsigned int ShadowAtlas::GetStaticUpdates() const
+{
+    return staticUpdates;
+}
+
+
+unsigned int ShadowAtlas::GetDynamicUpdates() const
+{
+    return dynamicUpdates;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "core/gpu/texture2D.h"
+#include "utils/glm_utils.h"
+
+
+// Shadow maps of several lights packed as square pages of one depth texture.
+//
+// Every page exists twice: a cached copy with only the static casters and
+// the page that is sampled, which is the cached copy plus the moving casters.
+// Updating the moving casters is a depth blit of the cached copy followed by
+// drawing the moving casters alone, the static casters are only drawn again
+// when the light moves.
+//
+// Lights move on their own schedule: SetLightMatrix() only records the new
+// matrix, which is applied at the light's next static update. Static updates
+// are limited per frame and go to the most overdue lights first, so a light
+// with a long interval can't starve and several lights falling due together
+// don't cause a spike.
+class ShadowAtlas
+{
+ public:
+    // Callback drawing casters for a light, with the depth shader state up to the callee
+    typedef std::function<void(unsigned int light, const glm::mat4 &viewProjection)> CasterCallback;
+
+    // The atlas holds (size / pageSize)^2 pages
+    ShadowAtlas(unsigned int size = 2048, unsigned int pageSize = 1024);
+    ~ShadowAtlas();
+
+    // Creates the depth textures, needs a GL context. Done by Update() otherwise
+    void Init();
+
+    // staticInterval and dynamicInterval are in frames, returns -1 when no page is left
+    int AddLight(unsigned int staticInterval, unsigned int dynamicInterval = 1);
+    void SetLightMatrix(unsigned int light, const glm::mat4 &viewProjection);
+
+    // Most static page updates done in one frame
+    void SetStaticBudget(unsigned int pagesPerFrame);
+    // Forces a static update of every light, for when static casters change
+    void InvalidateStatic();
+
+    // Redraws the pages due this frame, leaves the default framebuffer bound
+    void Update(const CasterCallback &renderStatic, const CasterCallback &renderDynamic);
+
+    // Matrix the page of the light was rendered with, to be used for sampling
+    const glm::mat4 &GetLightMatrix(unsigned int light) const;
+    // Page area in texture coordinates: offset in xy, size in zw
+    glm::vec4 GetPageRect(unsigned int light) const;
+    // False until the first update of the light
+    bool IsReady(unsigned int light) const;
+
+    Texture2D *GetTexture() const;
+    unsigned int GetSize() const;
+    // False before Init() or when a framebuffer of the atlas was not complete
+    bool IsComplete() const;
+
+    unsigned int GetStaticUpdates() const;
+    unsigned int GetDynamicUpdates() const;
+
+ private:
+    struct Light {
+        unsigned int page;
+        unsigned int staticInterval;
+        unsigned int dynamicInterval;
+        unsigned int framesSinceStatic;
+        unsigned int framesSinceDynamic;
+        glm::mat4 requested;
+        glm::mat4 current;
+        bool hasStatic;
+        bool ready;
+    };
+
+    glm::ivec4 GetPageViewport(unsigned int page) const;
+    void ClearPage(const glm::ivec4 &viewport) const;
+
+ private:
+    unsigned int size;
+    unsigned int pageSize;
+    unsigned int staticBudget;
+
+    std::vector<Light> lights;
+
+    Texture2D *staticDepth;     // Static casters only
+    Texture2D *depth;           // Static and moving casters, sampled by the shading
+    GLuint staticFBO;
+    GLuint FBO;
+
+    unsigned int staticUpdates;
+    unsigned int dynamicUpdates;
+    bool complete;
+};
@@ -1,105 +1,61 @@
 #pragma once
 
-#include "utils/gl_utils.h"
-#include "utils/memory_utils.h"
+#include "core/gpu/gpu_buffer.h"
 
 
+// Shader storage buffer, see GpuBuffer. The calls below send or read the
+// whole buffer at once, GpuBuffer batches the writes until Flush() and
+// reads without waiting with ReadAsync(). Without a local buffer the CPU
+// copy made by SetBufferData() is freed once uploaded
 template <class StorageEntry>
-class SSBO
+class SSBO : public GpuBuffer<StorageEntry>
 {
  public:
-    explicit SSBO(unsigned int size, bool createLocalBuffer = false)
+    explicit SSBO(unsigned int size, bool createLocalBuffer = false, GLenum usage = GL_DYNAMIC_DRAW)
+        : GpuBuffer<StorageEntry>(GL_SHADER_STORAGE_BUFFER, size, usage), keepLocalBuffer(createLocalBuffer)
     {
-        this->size = size;
-        memorySize = size * sizeof(StorageEntry);
-        data = createLocalBuffer ? new StorageEntry[size] : nullptr;
-
-        #ifdef GLEW_ARB_shader_storage_buffer_object
-        {
-            glGenBuffers(1, &ssbo);
-            Bind();
-            glBufferData(GL_SHADER_STORAGE_BUFFER, memorySize, NULL, GL_DYNAMIC_DRAW);
-            Unbind();
-        }
-        #endif
+        if (createLocalBuffer)
+            this->AllocateLocalCopy();
     }
 
-    ~SSBO()
-    {
-        glDeleteBuffers(1, &ssbo);
-        SAFE_FREE_ARRAY(data);
-    };
-
+    // Updated in place, new storage only when the usage changes
     void SetBufferData(const StorageEntry *data, GLenum usage = GL_DYNAMIC_DRAW)
     {
-        Bind();
-        glBufferData(GL_SHADER_STORAGE_BUFFER, memorySize, data, GL_DYNAMIC_DRAW);
-        Unbind();
+        this->Set(data, 0, this->GetSize());
+        this->SetUsage(usage);
+        if (keepLocalBuffer)
+            this->Flush();
+        else
+            this->ReleaseLocalCopy();
     }
 
     void SetBufferSubData(const StorageEntry *data, int offset, int size)
     {
-        Bind();
-        glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, size * sizeof(StorageEntry), data);
-        Unbind();
+        this->Set(data, offset, size);
+        this->Flush();
     }
 
     void BindBuffer(GLuint index) const
     {
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, ssbo);
+        this->BindBase(index);
     }
 
+    // Waits for the GPU, ReadAsync() doesn't
     void ReadBuffer()
     {
-        if (data == nullptr)
-        {
-            data = new StorageEntry[size];
-        }
-
-        Bind();
-        GLvoid* p = glMapBuffer(GL_SHADER_STORAGE_BUFFER, GL_READ_ONLY);
-        memcpy(data, p, memorySize);
-        CheckOpenGLError();
-        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
-        CheckOpenGLError();
-        Unbind();
+        this->Read(0, this->GetSize());
     }
 
     const StorageEntry* GetBuffer() const
     {
-        return data;
-    }
-
-    unsigned int GetSize() const
-    {
-        return size;
+        return this->GetData();
     }
 
     void ClearBuffer() const
     {
-        Bind();
-        unsigned int value = 0;
-        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED, GL_UNSIGNED_INT, &value);
-        Unbind();
-        CheckOpenGLError();
-    }
-
- private:
-    inline void Bind() const
-    {
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
-        CheckOpenGLError();
-    }
-
-    static inline void Unbind()
-    {
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-        CheckOpenGLError();
+        this->ClearStorage();
     }
 
  private:
-    unsigned int ssbo;
-    unsigned int size;
-    unsigned int memorySize;
-    StorageEntry *data;
+    bool keepLocalBuffer;
 };
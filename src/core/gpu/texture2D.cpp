@@ -8,13 +8,14 @@
 #include "stb/stb_image.h"
 #include "stb/stb_image_write.h"
 
+#include "core/gpu/render_stats.h"
 #include "utils/memory_utils.h"
 
 
 void write_image_thread(const char* fileName, unsigned int width, unsigned int height, unsigned int channels, const unsigned char *data)
 {
     stbi_write_png(fileName, width, height, channels, data, width * channels);
-    delete data;
+    delete[] data;
 }
 
 
@@ -39,10 +40,14 @@ Texture2D::Texture2D()
     wrappingMode = GL_REPEAT;
     textureMinFilter = GL_LINEAR;
     textureMagFilter = GL_LINEAR;
+    imageData = nullptr;
 }
 
 
-Texture2D::~Texture2D() {
+Texture2D::~Texture2D()
+{
+    if (textureID)
+        glDeleteTextures(1, &textureID);
 }
 
 
@@ -178,28 +183,49 @@ void Texture2D::CreateCubeTexture(const float *data, unsigned int width, unsigne
 }
 
 
-void Texture2D::CreateFrameBufferTexture(unsigned int width, unsigned int height, unsigned int targetID, unsigned int precision)
+void Texture2D::CreateRenderTexture(unsigned int width, unsigned int height, unsigned int precision, unsigned int channels)
 {
     bitsPerPixel = precision;
     int prec = precision / 8 - 1;
-    Init2DTexture(width, height, 4);
-    glTexImage2D(targetType, 0, internalFormat[prec][4], width, height, 0, pixelFormat[4], GL_UNSIGNED_BYTE, 0);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + targetID, GL_TEXTURE_2D, textureID, 0);
+    Init2DTexture(width, height, channels);
+    glTexImage2D(targetType, 0, internalFormat[prec][channels], width, height, 0, pixelFormat[channels], GL_UNSIGNED_BYTE, 0);
     UnBind();
 }
 
 
-void Texture2D::CreateDepthBufferTexture(unsigned int width, unsigned int height)
+void Texture2D::CreateDepthTexture(unsigned int width, unsigned int height)
 {
     Init2DTexture(width, height, 1);
     glTexImage2D(targetType, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, 0);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textureID, 0);
     UnBind();
 }
 
 
+void Texture2D::CreateDepthStencilTexture(unsigned int width, unsigned int height)
+{
+    Init2DTexture(width, height, 1);
+    glTexImage2D(targetType, 0, GL_DEPTH32F_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_FLOAT_32_UNSIGNED_INT_24_8_REV, 0);
+    UnBind();
+}
+
+
+void Texture2D::CreateFrameBufferTexture(unsigned int width, unsigned int height, unsigned int targetID, unsigned int precision)
+{
+    CreateRenderTexture(width, height, precision);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + targetID, GL_TEXTURE_2D, textureID, 0);
+}
+
+
+void Texture2D::CreateDepthBufferTexture(unsigned int width, unsigned int height)
+{
+    CreateDepthTexture(width, height);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textureID, 0);
+}
+
+
 void Texture2D::Bind() const
 {
+    render_stats::AddTextureBind();
     glBindTexture(GL_TEXTURE_2D, textureID);
 }
 
@@ -207,6 +233,7 @@ void Texture2D::Bind() const
 void Texture2D::BindToTextureUnit(GLenum TextureUnit) const
 {
     if (!textureID) return;
+    render_stats::AddTextureBind();
     glActiveTexture(TextureUnit);
     glBindTexture(GL_TEXTURE_2D, textureID);
 }
@@ -21,6 +21,11 @@ class Texture2D
     void CreateU16(const unsigned int* img, int width, int height, int chn);
 
     void CreateCubeTexture(const float *data, unsigned int width, unsigned int height, unsigned int chn);
+    // Empty render targets, not attached to any framebuffer
+    void CreateRenderTexture(unsigned int width, unsigned int height, unsigned int precision = 32, unsigned int channels = 4);
+    void CreateDepthTexture(unsigned int width, unsigned int height);
+    void CreateDepthStencilTexture(unsigned int width, unsigned int height);
+
     void CreateFrameBufferTexture(unsigned int width, unsigned int height, unsigned int targetID, unsigned int precision = 32);
     void CreateDepthBufferTexture(unsigned int width, unsigned int height);
 
@@ -0,0 +1,233 @@
+#include "core/gpu/texture2D_array.h"
+
+#include <algorithm>
+
+#include "stb/stb_image.h"
+
+#include "core/gpu/render_stats.h"
+#include "utils/math_utils.h"
+
+
+namespace
+{
+    // Layers are stored as RGBA8, whatever the channels of their images
+    const unsigned int LAYER_CHANNELS = 4;
+
+    // Source texel of a destination texel along one axis and its weight
+    struct Tap
+    {
+        unsigned int index;
+        float weight;
+    };
+
+
+    // Taps of each destination texel along an axis. A texel shrinking the
+    // image averages the source texels it covers, partly covered ones by their
+    // coverage; a texel enlarging it blends the 2 nearest source texels
+    std::vector<std::vector<Tap>> GetAxisTaps(unsigned int sourceSize, unsigned int size)
+    {
+        std::vector<std::vector<Tap>> taps(size);
+        const float scale = static_cast<float>(sourceSize) / size;
+
+        for (unsigned int i = 0; i < size; i++)
+        {
+            if (scale > 1.0f)
+            {
+                const float begin = i * scale;
+                const float end = (i + 1) * scale;
+                for (unsigned int s = static_cast<unsigned int>(begin); s < sourceSize && s < end; s++)
+                {
+                    const float coverage = MIN(end, s + 1.0f) - MAX(begin, static_cast<float>(s));
+                    if (coverage > 0.0f)
+                        taps[i].push_back({ s, coverage / scale });
+                }
+            }
+            else
+            {
+                const float center = MIN(MAX((i + 0.5f) * scale - 0.5f, 0.0f), sourceSize - 1.0f);
+                const unsigned int s = static_cast<unsigned int>(center);
+                const float t = center - s;
+                taps[i].push_back({ s, 1.0f - t });
+                taps[i].push_back({ MIN(s + 1, sourceSize - 1), t });
+            }
+        }
+        return taps;
+    }
+
+
+    // Resamples an RGBA8 image, the rows first then the columns
+    void Resample(const unsigned char *source, unsigned int sourceWidth, unsigned int sourceHeight,
+                  unsigned char *destination, unsigned int width, unsigned int height)
+    {
+        const std::vector<std::vector<Tap>> columnTaps = GetAxisTaps(sourceWidth, width);
+        const std::vector<std::vector<Tap>> rowTaps = GetAxisTaps(sourceHeight, height);
+
+        std::vector<float> rows(static_cast<size_t>(sourceHeight) * width * LAYER_CHANNELS, 0.0f);
+        for (unsigned int y = 0; y < sourceHeight; y++)
+        {
+            const unsigned char *sourceRow = source + static_cast<size_t>(y) * sourceWidth * LAYER_CHANNELS;
+            float *row = &rows[static_cast<size_t>(y) * width * LAYER_CHANNELS];
+            for (unsigned int x = 0; x < width; x++)
+            {
+                for (const Tap &tap : columnTaps[x])
+                {
+                    for (unsigned int c = 0; c < LAYER_CHANNELS; c++)
+                        row[x * LAYER_CHANNELS + c] += sourceRow[tap.index * LAYER_CHANNELS + c] * tap.weight;
+                }
+            }
+        }
+
+        for (unsigned int y = 0; y < height; y++)
+        {
+            unsigned char *destinationRow = destination + static_cast<size_t>(y) * width * LAYER_CHANNELS;
+            for (unsigned int x = 0; x < width * LAYER_CHANNELS; x++)
+            {
+                float value = 0.0f;
+                for (const Tap &tap : rowTaps[y])
+                    value += rows[static_cast<size_t>(tap.index) * width * LAYER_CHANNELS + x] * tap.weight;
+                destinationRow[x] = static_cast<unsigned char>(MIN(value + 0.5f, 255.0f));
+            }
+        }
+    }
+}
+
+
+Texture2DArray::Texture2DArray(unsigned int width, unsigned int height)
+    : width(width), height(height), textureID(0)
+{
+}
+
+
+Texture2DArray::~Texture2DArray()
+{
+    if (textureID)
+        glDeleteTextures(1, &textureID);
+}
+
+
+int Texture2DArray::AddLayer(const std::string &name, const std::string &fileName)
+{
+    int imageWidth, imageHeight, chn;
+    unsigned char *image = stbi_load(fileName.c_str(), &imageWidth, &imageHeight, &chn, LAYER_CHANNELS);
+    if (image == NULL)
+        return -1;
+
+    int layer = AddLayer(name, image, imageWidth, imageHeight, LAYER_CHANNELS);
+    stbi_image_free(image);
+    return layer;
+}
+
+
+int Texture2DArray::AddLayer(const std::string &name, const unsigned char *pixels, unsigned int width, unsigned int height, unsigned int channels)
+{
+    if (textureID || !pixels || !width || !height || channels < 1 || channels > LAYER_CHANNELS)
+        return -1;
+
+    // Missing channels are filled as GL does, green and blue with 0 and alpha with 255
+    std::vector<unsigned char> rgba;
+    const unsigned char *image = pixels;
+    if (channels != LAYER_CHANNELS)
+    {
+        const size_t texels = static_cast<size_t>(width) * height;
+        rgba.resize(texels * LAYER_CHANNELS);
+        for (size_t i = 0; i < texels; i++)
+        {
+            for (unsigned int c = 0; c < LAYER_CHANNELS; c++)
+                rgba[i * LAYER_CHANNELS + c] = c < channels ? pixels[i * channels + c] : c == 3 ? 255 : 0;
+        }
+        image = rgba.data();
+    }
+
+    const size_t layerSize = static_cast<size_t>(this->width) * this->height * LAYER_CHANNELS;
+    layerData.resize(layerData.size() + layerSize);
+    unsigned char *layer = &layerData[layerData.size() - layerSize];
+
+    if (width == this->width && height == this->height)
+        std::copy(image, image + layerSize, layer);
+    else
+        Resample(image, width, height, layer, this->width, this->height);
+
+    layerNames.push_back(name);
+    return static_cast<int>(layerNames.size() - 1);
+}
+
+
+bool Texture2DArray::Build(GLenum wrappingMode)
+{
+    if (textureID || layerNames.empty())
+        return false;
+
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, static_cast<GLsizei>(layerNames.size()), 0,
+        GL_RGBA, GL_UNSIGNED_BYTE, layerData.data());
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrappingMode);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrappingMode);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    CheckOpenGLError();
+
+    std::vector<unsigned char>().swap(layerData);
+    return true;
+}
+
+
+void Texture2DArray::Bind() const
+{
+    render_stats::AddTextureBind();
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+}
+
+
+void Texture2DArray::BindToTextureUnit(GLenum textureUnit) const
+{
+    if (!textureID) return;
+    render_stats::AddTextureBind();
+    glActiveTexture(textureUnit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+}
+
+
+void Texture2DArray::UnBind() const
+{
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    CheckOpenGLError();
+}
+
+
+int Texture2DArray::GetLayer(const std::string &name) const
+{
+    for (size_t i = 0; i < layerNames.size(); i++)
+    {
+        if (layerNames[i] == name)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+
+unsigned int Texture2DArray::GetLayerCount() const
+{
+    return static_cast<unsigned int>(layerNames.size());
+}
+
+
+unsigned int Texture2DArray::GetWidth() const
+{
+    return width;
+}
+
+
+unsigned int Texture2DArray::GetHeight() const
+{
+    return height;
+}
+
+
+GLuint Texture2DArray::GetTextureID() const
+{
+    return textureID;
+}
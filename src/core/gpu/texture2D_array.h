@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "utils/gl_utils.h"
+
+
+// Textures of the same size packed as the RGBA8 layers of one
+// GL_TEXTURE_2D_ARRAY. The objects whose materials are in the same array
+// share one binding and only differ by the layers they read, so they can
+// be drawn one after the other, or instanced, without binding textures.
+//
+// The layers are kept on the CPU until Build() uploads them all, an image
+// of another size is resampled to the size of the array when it is added.
+class Texture2DArray
+{
+ public:
+    Texture2DArray(unsigned int width, unsigned int height);
+    ~Texture2DArray();
+
+    // Returns the layer of the image, -1 when it can't be loaded or the array is built
+    int AddLayer(const std::string &name, const std::string &fileName);
+    // pixels: rows of width * channels bytes, 1 to 4 channels
+    int AddLayer(const std::string &name, const unsigned char *pixels, unsigned int width, unsigned int height, unsigned int channels);
+
+    // GL thread. Uploads the layers with their mipmaps and frees the CPU copies,
+    // the wrapping mode is shared by all the layers
+    bool Build(GLenum wrappingMode = GL_REPEAT);
+
+    void Bind() const;
+    void BindToTextureUnit(GLenum textureUnit) const;
+    void UnBind() const;
+
+    // -1 when no layer has the name
+    int GetLayer(const std::string &name) const;
+    unsigned int GetLayerCount() const;
+    unsigned int GetWidth() const;
+    unsigned int GetHeight() const;
+    GLuint GetTextureID() const;
+
+ private:
+    Texture2DArray(const Texture2DArray &) = delete;
+    Texture2DArray &operator=(const Texture2DArray &) = delete;
+
+ private:
+    unsigned int width;
+    unsigned int height;
+    GLuint textureID;
+
+    std::vector<std::string> layerNames;
+    std::vector<unsigned char> layerData;   // RGBA8 layers waiting for Build(), one after the other
+};
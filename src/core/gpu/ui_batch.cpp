@@ -0,0 +1,87 @@
+#include "core/gpu/ui_batch.h"
+
+#include <cstddef>
+
+#include "core/gpu/render_stats.h"
+#include "utils/math_utils.h"
+
+
+UIBatch::UIBatch()
+    : lastQuadCount(0), VAO(0), VBO(0), bufferCapacity(0)
+{
+}
+
+
+UIBatch::~UIBatch()
+{
+    if (VBO) glDeleteBuffers(1, &VBO);
+    if (VAO) glDeleteVertexArrays(1, &VAO);
+}
+
+
+void UIBatch::AddQuad(const glm::vec2 &position, const glm::vec2 &size, const glm::vec3 &color, unsigned int type)
+{
+    const float widget = static_cast<float>(type);
+    const glm::vec2 corners[6] = {
+        glm::vec2(0, 0), glm::vec2(1, 0), glm::vec2(1, 1),
+        glm::vec2(0, 0), glm::vec2(1, 1), glm::vec2(0, 1)
+    };
+
+    for (const glm::vec2 &corner : corners)
+    {
+        Vertex vertex;
+        vertex.position = position + corner * size;
+        vertex.local = corner;
+        vertex.color = color;
+        vertex.type = widget;
+        vertices.push_back(vertex);
+    }
+}
+
+
+void UIBatch::Flush()
+{
+    lastQuadCount = static_cast<unsigned int>(vertices.size() / 6);
+    if (vertices.empty())
+        return;
+
+    // Created on first use, the context doesn't exist yet when the owner is constructed
+    if (!VAO)
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, local));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, color));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, type));
+        glBindVertexArray(0);
+    }
+
+    // The storage is orphaned every frame so the driver never waits for the
+    // previous draw, and only grows
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    bufferCapacity = MAX(bufferCapacity, vertices.size());
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * bufferCapacity, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Vertex) * vertices.size(), vertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindVertexArray(VAO);
+    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices.size()));
+    render_stats::AddDraw(GL_TRIANGLES, static_cast<unsigned int>(vertices.size()));
+    glBindVertexArray(0);
+
+    vertices.clear();
+}
+
+
+unsigned int UIBatch::GetQuadCount() const
+{
+    return lastQuadCount;
+}
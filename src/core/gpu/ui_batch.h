@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+
+#include "utils/glm_utils.h"
+#include "utils/gl_utils.h"
+
+
+// Immediate mode 2D batcher. Quads are collected on the CPU during the frame
+// and drawn by Flush() in one call, in the order they were added, so later
+// quads are painted over earlier ones.
+//
+// Each vertex carries the widget type and the color of its quad, and the
+// local coordinates inside the quad (0 to 1), so a single shader draws every
+// kind of widget. What a type means is up to that shader.
+class UIBatch
+{
+ public:
+    UIBatch();
+    ~UIBatch();
+
+    // position: corner with the smallest coordinates; size: extent along x and y
+    void AddQuad(const glm::vec2 &position, const glm::vec2 &size, const glm::vec3 &color, unsigned int type = 0);
+
+    // Draws the quads added since the last call with the shader bound by the
+    // caller, its uniforms are set beforehand. Depth testing is the caller's choice
+    void Flush();
+
+    unsigned int GetQuadCount() const;
+
+ private:
+    struct Vertex {
+        glm::vec2 position;
+        glm::vec2 local;
+        glm::vec3 color;
+        float type;
+    };
+
+ private:
+    std::vector<Vertex> vertices;
+    unsigned int lastQuadCount;
+
+    GLuint VAO, VBO;
+    size_t bufferCapacity;      // Vertices the buffer has room for
+};
@@ -0,0 +1,195 @@
+#include "core/gpu/uniform_ring.h"
+
+#include "utils/math_utils.h"
+
+
+namespace
+{
+    // Fence waits are split so a lost context can't hang the frame
+    const GLuint64 FENCE_TIMEOUT_NS = 1000000;
+}
+
+
+UniformRing::UniformRing()
+    : buffer(0), regionSize(0), alignment(1), regionCount(0), region(0), mapped(nullptr),
+      used(0), flushed(0), stalls(0), overflows(0)
+{
+}
+
+
+UniformRing::~UniformRing()
+{
+    Release();
+}
+
+
+void UniformRing::Init(GLsizeiptr regionSize, unsigned int regions)
+{
+    Release();
+
+    GLint offsetAlignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+    alignment = MAX(offsetAlignment, 16);
+
+    this->regionSize = (regionSize + alignment - 1) / alignment * alignment;
+    regionCount = MAX(regions, 1u);
+    fences.assign(regionCount, nullptr);
+
+    // The first BeginFrame moves to region 0
+    region = regionCount - 1;
+    used = 0;
+    flushed = 0;
+
+    const GLsizeiptr totalSize = this->regionSize * regionCount;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+
+    if (GLEW_ARB_buffer_storage)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_UNIFORM_BUFFER, totalSize, nullptr, flags);
+        mapped = static_cast<unsigned char *>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, totalSize, flags));
+    }
+
+    // Immutable storage can't be respecified, a failed mapping needs a new buffer
+    if (!mapped)
+    {
+        if (GLEW_ARB_buffer_storage)
+        {
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        }
+
+        glBufferData(GL_UNIFORM_BUFFER, totalSize, nullptr, GL_STREAM_DRAW);
+        staging.resize(this->regionSize);
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+
+void UniformRing::Release()
+{
+    for (GLsync fence : fences)
+    {
+        if (fence)
+            glDeleteSync(fence);
+    }
+    fences.clear();
+
+    if (buffer)
+    {
+        if (mapped)
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+
+    buffer = 0;
+    mapped = nullptr;
+    staging.clear();
+    regionCount = 0;
+}
+
+
+void UniformRing::BeginFrame()
+{
+    if (!buffer)
+        return;
+
+    region = (region + 1) % regionCount;
+
+    // The GPU may still read the blocks of the last frame that used the region
+    GLsync fence = fences[region];
+    if (fence)
+    {
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+        {
+            stalls++;
+            do {
+                result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+            } while (result == GL_TIMEOUT_EXPIRED);
+        }
+
+        glDeleteSync(fence);
+        fences[region] = nullptr;
+    }
+
+    used.store(0, std::memory_order_relaxed);
+    flushed = 0;
+}
+
+
+UniformAllocation UniformRing::Allocate(GLsizeiptr size)
+{
+    UniformAllocation allocation = {};
+
+    const GLsizeiptr alignedSize = (size + alignment - 1) / alignment * alignment;
+    const GLsizeiptr offset = used.fetch_add(alignedSize, std::memory_order_relaxed);
+    if (!buffer || offset + alignedSize > regionSize)
+        return allocation;
+
+    allocation.data = (mapped ? mapped + region * regionSize : staging.data()) + offset;
+    allocation.offset = region * regionSize + offset;
+    allocation.size = size;
+    return allocation;
+}
+
+
+void UniformRing::Flush()
+{
+    const GLsizeiptr allocated = used.load(std::memory_order_relaxed);
+
+    // Coherent writes are seen by the commands issued after them
+    const GLsizeiptr end = MIN(allocated, regionSize);
+    if (mapped || end <= flushed)
+        return;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, region * regionSize + flushed, end - flushed, staging.data() + flushed);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    flushed = end;
+}
+
+
+void UniformRing::EndFrame()
+{
+    if (!buffer)
+        return;
+
+    if (used.load(std::memory_order_relaxed) > regionSize)
+        overflows++;
+
+    if (fences[region])
+        glDeleteSync(fences[region]);
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+
+GLuint UniformRing::GetBuffer() const
+{
+    return buffer;
+}
+
+
+bool UniformRing::IsPersistent() const
+{
+    return mapped != nullptr;
+}
+
+
+unsigned int UniformRing::GetStalls() const
+{
+    return stalls;
+}
+
+
+unsigned int UniformRing::GetOverflows() const
+{
+    return overflows;
+}
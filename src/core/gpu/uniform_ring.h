@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "utils/gl_utils.h"
+
+
+// Block of a UniformRing, written by the CPU and read by the draws of the frame
+struct UniformAllocation
+{
+    unsigned char *data;    // Null when the region of the frame is full
+    GLintptr offset;        // In the buffer, for glBindBufferRange
+    GLsizeiptr size;
+};
+
+
+// Uniform buffer split into one region per frame in flight. The blocks of a
+// frame are carved out of its region and bound with glBindBufferRange, no
+// buffer is allocated or respecified while drawing.
+//
+// With GL_ARB_buffer_storage the buffer is mapped once, persistent and
+// coherent, and the blocks are written straight into it. Without it they are
+// written to a copy of the region that Flush() uploads.
+//
+// Every frame ends with a fence and a region is only reused once the GPU
+// passed the fence of its last frame: with 3 regions the CPU only waits when
+// the GPU is more than 2 frames behind.
+class UniformRing
+{
+ public:
+    UniformRing();
+    ~UniformRing();
+
+    // GL thread, regionSize is rounded up to the offset alignment of uniform buffers
+    void Init(GLsizeiptr regionSize, unsigned int regions = 3);
+    void Release();
+
+    // GL thread, before the first block of the frame
+    void BeginFrame();
+
+    // Any thread, lock free. The size is rounded up to the offset alignment
+    UniformAllocation Allocate(GLsizeiptr size);
+
+    // GL thread, before the draws reading the blocks allocated since the last flush
+    void Flush();
+
+    // GL thread, after the last draw of the frame
+    void EndFrame();
+
+    GLuint GetBuffer() const;
+    bool IsPersistent() const;
+
+    // Frames that found the GPU still reading their region
+    unsigned int GetStalls() const;
+    // Frames that ran out of room in their region, the blocks past its end were dropped
+    unsigned int GetOverflows() const;
+
+ private:
+    UniformRing(const UniformRing &) = delete;
+    UniformRing &operator=(const UniformRing &) = delete;
+
+ private:
+    GLuint buffer;
+    GLsizeiptr regionSize;
+    GLsizeiptr alignment;
+    unsigned int regionCount;
+    unsigned int region;                    // Region of the current frame
+    std::vector<GLsync> fences;             // Last frame of each region, null once passed
+
+    unsigned char *mapped;                  // Whole buffer, persistent mapping only
+    std::vector<unsigned char> staging;     // Region of the frame, without the persistent mapping
+
+    std::atomic<GLsizeiptr> used;           // Bytes handed out in the region, may run past its size
+    GLsizeiptr flushed;
+    unsigned int stalls;
+    unsigned int overflows;
+};
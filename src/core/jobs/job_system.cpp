@@ -0,0 +1,423 @@
+#include "core/jobs/job_system.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+
+#include "core/jobs/work_stealing_deque.h"
+#include "utils/math_utils.h"
+
+
+namespace
+{
+    struct Job
+    {
+        std::function<void()> function;
+        JobCounter *counter;
+    };
+
+    // A ParallelFor() range runs in chunks of this fraction of what is left,
+    // it can only be split between two chunks
+    const size_t CHUNKS_PER_RANGE = 8;
+
+    // Deque 0 belongs to the main thread, the others to the workers
+    std::vector<std::unique_ptr<WorkStealingDeque<Job *>>> deques;
+    std::vector<std::thread> workers;
+    bool initialized = false;
+
+    // Jobs started by threads outside the pool
+    std::mutex sharedMutex;
+    std::deque<Job *> sharedJobs;
+
+    std::mutex mainThreadMutex;
+    std::deque<Job *> mainThreadJobs;
+
+    // Idle workers sleep until a job is queued. The count is only a hint, the
+    // timeout covers a notification sent just before a worker starts waiting
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<int> queuedJobs(0);
+    std::atomic<bool> quit(false);
+
+    // Threads of the pool, or waiting on it, that found no job to run. Also a hint
+    std::atomic<int> idleThreads(0);
+
+    // Index of the deque of the calling thread, -1 outside the pool
+    thread_local int threadIndex = -1;
+}
+
+
+JobCounter::JobCounter()
+    : pending(0)
+{
+}
+
+
+bool JobCounter::IsDone() const
+{
+    return pending.load(std::memory_order_acquire) == 0;
+}
+
+
+// Job handling shared by JobSystem and the workers, a friend of JobCounter
+class JobScheduler
+{
+ public:
+    static void Submit(std::function<void()> &&function, JobCounter *counter);
+    static void Finish(JobCounter *counter);
+    static void Execute(Job *job);
+};
+
+
+void JobScheduler::Finish(JobCounter *counter)
+{
+    if (!counter)
+        return;
+
+    std::vector<std::pair<std::function<void()>, JobCounter *>> ready;
+    {
+        // Decremented under the lock, Wait() takes it before returning so
+        // the counter stays alive until this thread is done with it
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            ready.swap(counter->continuations);
+    }
+
+    for (auto &continuation : ready)
+        Submit(std::move(continuation.first), continuation.second);
+}
+
+
+void JobScheduler::Execute(Job *job)
+{
+    job->function();
+    Finish(job->counter);
+    delete job;
+}
+
+
+void JobScheduler::Submit(std::function<void()> &&function, JobCounter *counter)
+{
+    if (!initialized)
+    {
+        function();
+        Finish(counter);
+        return;
+    }
+
+    Job *job = new Job{ std::move(function), counter };
+
+    if (threadIndex >= 0)
+    {
+        // A full deque means enough work is queued already, running the job now is as good
+        if (!deques[threadIndex]->Push(job))
+        {
+            Execute(job);
+            return;
+        }
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        sharedJobs.push_back(job);
+    }
+
+    queuedJobs.fetch_add(1, std::memory_order_release);
+    wake.notify_one();
+}
+
+
+namespace
+{
+    Job *FindJob(int index)
+    {
+        Job *job = nullptr;
+
+        if (index >= 0 && deques[index]->Pop(job))
+        {
+            queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            return job;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(sharedMutex);
+            if (!sharedJobs.empty())
+            {
+                job = sharedJobs.front();
+                sharedJobs.pop_front();
+                queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+                return job;
+            }
+        }
+
+        // Starts next to the own deque so thieves spread over the victims
+        const size_t count = deques.size();
+        const size_t start = index >= 0 ? static_cast<size_t>(index) + 1 : 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t victim = (start + i) % count;
+            if (static_cast<int>(victim) != index && deques[victim]->Steal(job))
+            {
+                queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+                return job;
+            }
+        }
+
+        return nullptr;
+    }
+
+
+    bool RunOneMainThreadJob()
+    {
+        Job *job = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mainThreadMutex);
+            if (mainThreadJobs.empty())
+                return false;
+
+            job = mainThreadJobs.front();
+            mainThreadJobs.pop_front();
+        }
+
+        JobScheduler::Execute(job);
+        return true;
+    }
+
+
+    // Counts the calling thread in idleThreads while it finds no job
+    void SetIdle(bool &idle, bool value)
+    {
+        if (idle != value)
+            idleThreads.fetch_add(value ? 1 : -1, std::memory_order_relaxed);
+        idle = value;
+    }
+
+
+    void WorkerLoop(int index)
+    {
+        threadIndex = index;
+        bool idle = false;
+
+        while (!quit.load(std::memory_order_acquire))
+        {
+            if (Job *job = FindJob(index))
+            {
+                SetIdle(idle, false);
+                JobScheduler::Execute(job);
+                continue;
+            }
+
+            SetIdle(idle, true);
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait_for(lock, std::chrono::milliseconds(1), []()
+            {
+                return quit.load(std::memory_order_acquire) || queuedJobs.load(std::memory_order_acquire) > 0;
+            });
+        }
+
+        SetIdle(idle, false);
+    }
+
+
+    // Runs the range in chunks and only splits it when threads are waiting
+    // for work that no queued job can give them: the second half of what is
+    // left becomes a job for them to steal. Without idle threads the range
+    // is never split, with many of them it is split down to the grain
+    void RunRange(const std::function<void(size_t, size_t)> &body, JobCounter &counter, size_t grain, size_t begin, size_t end)
+    {
+        while (begin < end)
+        {
+            const size_t left = end - begin;
+            if (left >= 2 * grain &&
+                idleThreads.load(std::memory_order_relaxed) > queuedJobs.load(std::memory_order_relaxed))
+            {
+                size_t middle = begin + left / 2;
+                JobSystem::Run([&body, &counter, grain, middle, end]()
+                {
+                    RunRange(body, counter, grain, middle, end);
+                }, &counter);
+                end = middle;
+                continue;
+            }
+
+            // A tail smaller than the grain is run with the chunk before it
+            size_t chunk = MAX(grain, left / CHUNKS_PER_RANGE);
+            size_t chunkEnd = left < chunk + grain ? end : begin + chunk;
+            body(begin, chunkEnd);
+            begin = chunkEnd;
+        }
+    }
+}
+
+
+void JobSystem::Init(unsigned int workerCount)
+{
+    if (initialized)
+        return;
+
+    if (workerCount == 0)
+    {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+    }
+
+    for (unsigned int i = 0; i <= workerCount; i++)
+        deques.emplace_back(new WorkStealingDeque<Job *>());
+
+    quit = false;
+    threadIndex = 0;
+    initialized = true;
+
+    for (unsigned int i = 1; i <= workerCount; i++)
+        workers.emplace_back(WorkerLoop, static_cast<int>(i));
+}
+
+
+void JobSystem::Shutdown()
+{
+    if (!initialized)
+        return;
+
+    quit = true;
+    wake.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+
+    // Runs what is left, the deques of the workers included, so no counter is left waiting
+    do
+    {
+        while (Job *job = FindJob(threadIndex))
+            JobScheduler::Execute(job);
+    }
+    while (RunOneMainThreadJob());
+
+    workers.clear();
+    deques.clear();
+    threadIndex = -1;
+    initialized = false;
+}
+
+
+unsigned int JobSystem::GetThreadCount()
+{
+    return initialized ? static_cast<unsigned int>(deques.size()) : 1;
+}
+
+
+bool JobSystem::IsMainThread()
+{
+    return !initialized || threadIndex == 0;
+}
+
+
+int JobSystem::GetThreadIndex()
+{
+    return initialized ? threadIndex : 0;
+}
+
+
+void JobSystem::Run(std::function<void()> job, JobCounter *counter)
+{
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+    JobScheduler::Submit(std::move(job), counter);
+}
+
+
+void JobSystem::RunOnMainThread(std::function<void()> job, JobCounter *counter)
+{
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+    if (IsMainThread())
+    {
+        job();
+        JobScheduler::Finish(counter);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mainThreadMutex);
+    mainThreadJobs.push_back(new Job{ std::move(job), counter });
+}
+
+
+void JobSystem::RunAfter(JobCounter &dependency, std::function<void()> job, JobCounter *counter)
+{
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lock(dependency.mutex);
+        if (dependency.pending.load(std::memory_order_acquire) > 0)
+        {
+            dependency.continuations.emplace_back(std::move(job), counter);
+            return;
+        }
+    }
+
+    JobScheduler::Submit(std::move(job), counter);
+}
+
+
+void JobSystem::Wait(JobCounter &counter)
+{
+    bool idle = false;
+    while (!counter.IsDone())
+    {
+        if (!initialized)
+            break;
+
+        if (Job *job = FindJob(threadIndex))
+        {
+            SetIdle(idle, false);
+            JobScheduler::Execute(job);
+        }
+        else if (threadIndex == 0 && RunOneMainThreadJob())
+        {
+            SetIdle(idle, false);
+        }
+        else
+        {
+            SetIdle(idle, true);
+            std::this_thread::yield();
+        }
+    }
+    SetIdle(idle, false);
+
+    // The last job may still hold the lock, see Finish()
+    std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+
+void JobSystem::RunMainThreadJobs()
+{
+    std::deque<Job *> jobs;
+    {
+        std::lock_guard<std::mutex> lock(mainThreadMutex);
+        jobs.swap(mainThreadJobs);
+    }
+
+    for (Job *job : jobs)
+        JobScheduler::Execute(job);
+}
+
+
+void JobSystem::ParallelFor(size_t count, const std::function<void(size_t begin, size_t end)> &body, size_t minGrain)
+{
+    if (count == 0)
+        return;
+
+    const size_t grain = MAX(minGrain, static_cast<size_t>(1));
+    if (GetThreadCount() == 1 || count <= grain)
+    {
+        body(0, count);
+        return;
+    }
+
+    JobCounter counter;
+    RunRange(body, counter, grain, 0, count);
+    Wait(counter);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+
+// Number of jobs still running in a group. Jobs started with a counter
+// increment it and decrement it when they end, JobSystem::Wait() returns once
+// it is back to zero. A counter can also hold jobs that only start when it
+// reaches zero (JobSystem::RunAfter), which is how dependencies are built.
+//
+// Always Wait() on a counter before it is destroyed.
+class JobCounter
+{
+ public:
+    JobCounter();
+
+    bool IsDone() const;
+
+ private:
+    JobCounter(const JobCounter &) = delete;
+    JobCounter &operator=(const JobCounter &) = delete;
+
+ private:
+    friend class JobSystem;
+    friend class JobScheduler;
+
+    std::atomic<unsigned int> pending;
+    std::mutex mutex;
+    std::vector<std::pair<std::function<void()>, JobCounter *>> continuations;
+};
+
+
+// Work stealing thread pool. Every thread of the pool, the main thread
+// included, has its own deque: it runs the jobs it started newest first,
+// and takes the oldest job of another thread when it has none left. Threads
+// outside the pool hand their jobs over through a shared queue.
+//
+// Waiting never blocks a thread of the pool, it runs other jobs meanwhile,
+// so jobs can start jobs and wait for them.
+//
+// GL calls have to come from the main thread: such jobs go to a separate
+// queue only the main thread runs, while it waits or in RunMainThreadJobs().
+//
+// Before Init() and after Shutdown() every job runs right away on the calling thread.
+class JobSystem
+{
+ public:
+    // workers: threads started besides the calling one, which becomes the
+    // main thread. 0 starts one per hardware thread left
+    static void Init(unsigned int workers = 0);
+    static void Shutdown();
+
+    // Threads running jobs, the main thread included
+    static unsigned int GetThreadCount();
+    static bool IsMainThread();
+
+    // 0 on the main thread, 1 to GetThreadCount() - 1 on the workers, -1 outside the pool
+    static int GetThreadIndex();
+
+    static void Run(std::function<void()> job, JobCounter *counter = nullptr);
+    static void RunOnMainThread(std::function<void()> job, JobCounter *counter = nullptr);
+
+    // Starts the job once the dependency has no jobs left. counter is
+    // incremented right away, waiting on it covers the delayed job
+    static void RunAfter(JobCounter &dependency, std::function<void()> job, JobCounter *counter = nullptr);
+
+    // Runs jobs until the counter is done. A thread outside the pool can wait
+    // too, it then only helps with the shared queue and by stealing
+    static void Wait(JobCounter &counter);
+
+    // Main thread only, runs the main thread jobs queued so far
+    static void RunMainThreadJobs();
+
+    // Calls body(begin, end) on parts of [0, count) and returns when they are
+    // all done. The range is only split in halves while other threads are idle,
+    // so the grain follows the load: one busy pool keeps large parts, idle
+    // threads steal halves that get split again as long as threads wait.
+    // Parts are never smaller than minGrain, a range of at most minGrain runs
+    // on the calling thread without any job
+    static void ParallelFor(size_t count, const std::function<void(size_t begin, size_t end)> &body, size_t minGrain = 1);
+};
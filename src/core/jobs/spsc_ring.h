@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+
+// Bounded ring between one producer and one consumer thread, without locks.
+// Each side owns one index and only reads the other one, with acquire and
+// release pairs publishing the items. The indices are padded apart so they
+// don't share a cache line, and each side keeps a copy of the last index it
+// read from the other, so the shared lines are only touched when the ring
+// looks full or empty.
+//
+// The capacity is fixed, Push() fails when the ring is full.
+template <class T>
+class SpscRing
+{
+ public:
+    // capacity: rounded up to a power of two
+    explicit SpscRing(size_t capacity = 1024)
+        : head(0), cachedTail(0), tail(0), cachedHead(0)
+    {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        mask = size - 1;
+        items.reset(new T[size]);
+    }
+
+    // Producer thread only
+    bool Push(const T &item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cachedHead > mask)
+        {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t - cachedHead > mask)
+                return false;
+        }
+
+        items[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only, takes the oldest item
+    bool Pop(T &item)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == cachedTail)
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h == cachedTail)
+                return false;
+        }
+
+        item = items[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate when the other side is using the ring
+    bool IsEmpty() const
+    {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_relaxed);
+    }
+
+    size_t GetCapacity() const
+    {
+        return mask + 1;
+    }
+
+ private:
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+ private:
+    // Padding rather than alignas, the owners may be allocated with a plain new
+    static const size_t CACHE_LINE = 64;
+
+    // Consumer side
+    std::atomic<size_t> head;
+    size_t cachedTail;
+    char headPadding[CACHE_LINE];
+
+    // Producer side
+    std::atomic<size_t> tail;
+    size_t cachedHead;
+    char tailPadding[CACHE_LINE];
+
+    size_t mask;
+    std::unique_ptr<T[]> items;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+
+// Chase-Lev deque: the owner thread pushes and pops at the bottom without
+// locks, other threads steal from the top. Only the last item can be
+// contended, a compare and swap on the top decides who gets it.
+//
+// Memory orderings follow "Correct and Efficient Work-Stealing for Weak
+// Memory Models" (Le, Pop, Cohen, Zappa Nardelli, 2013). The capacity is
+// fixed, Push() fails when it is full. T has to be trivially copyable,
+// in practice a pointer.
+template <class T>
+class WorkStealingDeque
+{
+ public:
+    // capacity: rounded up to a power of two
+    explicit WorkStealingDeque(size_t capacity = 4096)
+        : top(0), bottom(0)
+    {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        mask = static_cast<long long>(size - 1);
+        items.reset(new std::atomic<T>[size]);
+    }
+
+    // Owner thread only
+    bool Push(T item)
+    {
+        long long b = bottom.load(std::memory_order_relaxed);
+        long long t = top.load(std::memory_order_acquire);
+        if (b - t > mask)
+            return false;
+
+        // Release store rather than the fence of the paper, same ordering and sanitizers understand it
+        items[b & mask].store(item, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Owner thread only, takes the newest item
+    bool Pop(T &item)
+    {
+        long long b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long long t = top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            // Empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        item = items[b & mask].load(std::memory_order_relaxed);
+        if (t < b)
+            return true;
+
+        // Last item, a thief may be taking it at the same time
+        bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+
+    // Any thread, takes the oldest item. Can fail while items are left when another thread won the race
+    bool Steal(T &item)
+    {
+        long long t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long long b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b)
+            return false;
+
+        item = items[t & mask].load(std::memory_order_relaxed);
+        return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    // Approximate when other threads are using the deque
+    bool IsEmpty() const
+    {
+        return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+    }
+
+ private:
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+ private:
+    std::atomic<long long> top;
+    std::atomic<long long> bottom;
+    long long mask;
+    std::unique_ptr<std::atomic<T>[]> items;
+};
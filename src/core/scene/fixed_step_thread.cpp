@@ -0,0 +1,90 @@
+#include "core/scene/fixed_step_thread.h"
+
+
+namespace
+{
+    // Steps the thread may lag behind before it stops catching up
+    const unsigned int MAX_LAG_STEPS = 10;
+}
+
+
+FixedStepThread::FixedStepThread()
+    : stepSeconds(0), quit(false)
+{
+}
+
+
+FixedStepThread::~FixedStepThread()
+{
+    Stop();
+}
+
+
+void FixedStepThread::Start(double stepSeconds, StepFunction step)
+{
+    Stop();
+
+    this->stepSeconds = stepSeconds;
+    this->step = step;
+    start = Clock::now();
+    quit = false;
+
+    thread = std::thread(&FixedStepThread::Loop, this);
+}
+
+
+void FixedStepThread::Stop()
+{
+    if (!thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    condition.notify_one();
+    thread.join();
+}
+
+
+bool FixedStepThread::IsRunning() const
+{
+    return thread.joinable();
+}
+
+
+double FixedStepThread::GetStep() const
+{
+    return stepSeconds;
+}
+
+
+void FixedStepThread::Loop()
+{
+    const Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(stepSeconds));
+    Clock::time_point scheduleStart = start;
+    unsigned long long index = 0;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        Clock::time_point due = scheduleStart + period * static_cast<Clock::rep>(index + 1);
+
+        // Returns early only to quit
+        if (condition.wait_until(lock, due, [this]() { return quit; }))
+            break;
+
+        // Too far behind to catch up, the schedule restarts from now
+        Clock::time_point now = Clock::now();
+        if (now - due > period * static_cast<Clock::rep>(MAX_LAG_STEPS))
+        {
+            scheduleStart += now - due;
+            due = now;
+        }
+
+        index++;
+        lock.unlock();
+        step(index, due);
+        lock.lock();
+    }
+}
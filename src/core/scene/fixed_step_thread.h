@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+
+// Calls a function at a fixed rate on its own thread. Steps are scheduled
+// from the start time rather than from the end of the previous step, so a
+// slow step is made up by the next ones and the number of steps only depends
+// on the time elapsed. When the thread falls too far behind (a debugger
+// break, the machine sleeping) the missed steps are dropped instead.
+class FixedStepThread
+{
+ public:
+    typedef std::chrono::steady_clock Clock;
+
+    // index: number of the step, starting at 1; due: time the step was scheduled for
+    typedef std::function<void(unsigned long long index, Clock::time_point due)> StepFunction;
+
+    FixedStepThread();
+    ~FixedStepThread();
+
+    // The first step is due one step after the call
+    void Start(double stepSeconds, StepFunction step);
+
+    // Waits for the step in progress, if any
+    void Stop();
+
+    bool IsRunning() const;
+    double GetStep() const;
+
+ private:
+    void Loop();
+
+ private:
+    double stepSeconds;
+    StepFunction step;
+    Clock::time_point start;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool quit;
+};
@@ -0,0 +1,64 @@
+#include "core/scene/lod_selector.h"
+
+
+LodSelector::LodSelector(float pixelThreshold, float hysteresis)
+    : pixelThreshold(pixelThreshold), hysteresis(hysteresis), eyePosition(0), pixelsPerUnit(1)
+{
+}
+
+
+void LodSelector::SetView(const glm::vec3 &eyePosition, const glm::mat4 &projection, float viewportHeight)
+{
+    // projection[1][1] is cot(fovY / 2)
+    this->eyePosition = eyePosition;
+    pixelsPerUnit = 0.5f * viewportHeight * projection[1][1];
+}
+
+
+float LodSelector::GetProjectedError(const Mesh *mesh, const glm::mat4 &model, unsigned int lod) const
+{
+    if (lod == 0) return 0;
+
+    float scaleX = glm::length(glm::vec3(model[0]));
+    float scaleY = glm::length(glm::vec3(model[1]));
+    float scaleZ = glm::length(glm::vec3(model[2]));
+    float scale = MAX(scaleX, MAX(scaleY, scaleZ));
+
+    // Distance to the nearest point of the bounding sphere, the worst case for the error
+    BoundingSphere sphere = bounds_utils::Transform(mesh->GetBoundingSphere(), model);
+    float distance = glm::length(sphere.center - eyePosition) - MAX(sphere.radius, 0.0f);
+    if (distance <= 1e-3f) return std::numeric_limits<float>::max();
+
+    return mesh->GetLodError(lod) * scale * pixelsPerUnit / distance;
+}
+
+
+unsigned int LodSelector::Select(const Mesh *mesh, const glm::mat4 &model, unsigned int currentLod) const
+{
+    const unsigned int count = mesh->GetLodCount();
+    if (count <= 1) return 0;
+
+    currentLod = MIN(currentLod, count - 1);
+
+    // Coarsest level under the threshold, errors grow with the level
+    unsigned int lod = 0;
+    while (lod + 1 < count && GetProjectedError(mesh, model, lod + 1) <= pixelThreshold) {
+        lod++;
+    }
+
+    if (lod > currentLod)
+    {
+        // Going coarser needs a margin below the threshold
+        while (lod > currentLod && GetProjectedError(mesh, model, lod) > pixelThreshold * (1 - hysteresis)) {
+            lod--;
+        }
+    }
+    else if (lod < currentLod)
+    {
+        // Going finer only once the current level is clearly too coarse
+        if (GetProjectedError(mesh, model, currentLod) <= pixelThreshold * (1 + hysteresis))
+            lod = currentLod;
+    }
+
+    return lod;
+}
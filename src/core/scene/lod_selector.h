@@ -0,0 +1,30 @@
+#pragma once
+
+#include "core/gpu/mesh.h"
+#include "utils/glm_utils.h"
+
+
+// Picks a level of detail from the projected screen space error of each
+// level. The level used in the previous frame is only left when the error
+// moves past a band around the threshold, so objects sitting right at a
+// switching distance don't flicker between two levels.
+class LodSelector
+{
+ public:
+    // pixelThreshold: largest tolerated error in pixels; hysteresis: relative width of the band
+    LodSelector(float pixelThreshold = 1.0f, float hysteresis = 0.25f);
+
+    void SetView(const glm::vec3 &eyePosition, const glm::mat4 &projection, float viewportHeight);
+
+    unsigned int Select(const Mesh *mesh, const glm::mat4 &model, unsigned int currentLod) const;
+
+    // Object space error of a level converted to pixels for the given instance
+    float GetProjectedError(const Mesh *mesh, const glm::mat4 &model, unsigned int lod) const;
+
+ private:
+    float pixelThreshold;
+    float hysteresis;
+
+    glm::vec3 eyePosition;
+    float pixelsPerUnit;    // Pixels covered by one world unit at distance 1
+};
@@ -0,0 +1,299 @@
+#include "core/scene/transform_system.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "core/jobs/job_system.h"
+
+
+// Nodes per update job, smaller levels are updated on the calling thread
+static const unsigned int UPDATE_GRAIN = 4096;
+
+
+TransformSystem::TransformSystem()
+{
+    anyDirty = false;
+    needsSort = false;
+    levelsValid = true;
+}
+
+
+TransformHandle TransformSystem::Create(TransformHandle parent)
+{
+    TransformHandle handle = static_cast<TransformHandle>(handleToSlot.size());
+    unsigned int slot = static_cast<unsigned int>(slotToHandle.size());
+
+    handleToSlot.push_back(slot);
+    slotToHandle.push_back(handle);
+
+    localPositions.push_back(glm::vec3(0));
+    localRotations.push_back(glm::quat(1, 0, 0, 0));
+    localScales.push_back(glm::vec3(1));
+    worldMatrices.push_back(glm::mat4(1));
+    parents.push_back(parent == INVALID_TRANSFORM ? -1 : static_cast<int>(handleToSlot[parent]));
+    dirty.push_back(1);
+
+    // A parent is never deeper than the last slot, the new node either extends
+    // the last level, starts the next one or is out of depth order
+    unsigned int depth = parents.back() >= 0 ? depths[parents.back()] + 1 : 0;
+    if (levelsValid)
+    {
+        if (levelStarts.empty())
+            levelStarts.push_back(0);
+
+        if (slot == 0 || depth == depths.back() + 1)
+            levelStarts.push_back(slot + 1);
+        else if (depth == depths.back())
+            levelStarts.back() = slot + 1;
+        else
+            levelsValid = false;
+    }
+    depths.push_back(depth);
+
+    anyDirty = true;
+    return handle;
+}
+
+
+void TransformSystem::SetParent(TransformHandle node, TransformHandle parent)
+{
+    unsigned int slot = handleToSlot[node];
+    int parentSlot = parent == INVALID_TRANSFORM ? -1 : static_cast<int>(handleToSlot[parent]);
+
+    parents[slot] = parentSlot;
+    MarkDirty(node);
+
+    // The depth of the whole subtree changes
+    levelsValid = false;
+
+    // A parent stored after its child breaks the single pass update
+    if (parentSlot > static_cast<int>(slot))
+        needsSort = true;
+}
+
+
+void TransformSystem::Clear()
+{
+    localPositions.clear();
+    localRotations.clear();
+    localScales.clear();
+    worldMatrices.clear();
+    parents.clear();
+    depths.clear();
+    dirty.clear();
+    levelStarts.clear();
+    handleToSlot.clear();
+    slotToHandle.clear();
+    anyDirty = false;
+    needsSort = false;
+    levelsValid = true;
+}
+
+
+void TransformSystem::SetLocalPosition(TransformHandle node, const glm::vec3 &position)
+{
+    localPositions[handleToSlot[node]] = position;
+    MarkDirty(node);
+}
+
+
+void TransformSystem::SetLocalRotation(TransformHandle node, const glm::quat &rotation)
+{
+    localRotations[handleToSlot[node]] = rotation;
+    MarkDirty(node);
+}
+
+
+void TransformSystem::SetLocalScale(TransformHandle node, const glm::vec3 &scale)
+{
+    localScales[handleToSlot[node]] = scale;
+    MarkDirty(node);
+}
+
+
+void TransformSystem::SetLocalTRS(TransformHandle node, const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale)
+{
+    unsigned int slot = handleToSlot[node];
+    localPositions[slot] = position;
+    localRotations[slot] = rotation;
+    localScales[slot] = scale;
+    MarkDirty(node);
+}
+
+
+const glm::vec3 &TransformSystem::GetLocalPosition(TransformHandle node) const
+{
+    return localPositions[handleToSlot[node]];
+}
+
+
+const glm::quat &TransformSystem::GetLocalRotation(TransformHandle node) const
+{
+    return localRotations[handleToSlot[node]];
+}
+
+
+const glm::vec3 &TransformSystem::GetLocalScale(TransformHandle node) const
+{
+    return localScales[handleToSlot[node]];
+}
+
+
+const glm::mat4 &TransformSystem::GetWorldMatrix(TransformHandle node) const
+{
+    return worldMatrices[handleToSlot[node]];
+}
+
+
+glm::vec3 TransformSystem::GetWorldPosition(TransformHandle node) const
+{
+    return glm::vec3(worldMatrices[handleToSlot[node]][3]);
+}
+
+
+unsigned int TransformSystem::Size() const
+{
+    return static_cast<unsigned int>(slotToHandle.size());
+}
+
+
+void TransformSystem::MarkDirty(TransformHandle node)
+{
+    dirty[handleToSlot[node]] = 1;
+    anyDirty = true;
+}
+
+
+void TransformSystem::Update()
+{
+    if (!anyDirty)
+        return;
+
+    const unsigned int count = Size();
+
+    // Sorting by depth only pays off when there is enough work to share
+    if (needsSort || (!levelsValid && count > UPDATE_GRAIN))
+        SortHierarchy();
+
+    if (levelsValid)
+    {
+        // Parents live in earlier levels, every level is final before the next one starts
+        for (size_t level = 0; level + 1 < levelStarts.size(); level++)
+        {
+            const unsigned int first = levelStarts[level];
+            JobSystem::ParallelFor(levelStarts[level + 1] - first, [this, first](size_t begin, size_t end)
+            {
+                UpdateRange(first + static_cast<unsigned int>(begin), first + static_cast<unsigned int>(end));
+            }, UPDATE_GRAIN);
+        }
+    }
+    else
+    {
+        UpdateRange(0, count);
+    }
+
+    memset(dirty.data(), 0, count);
+    anyDirty = false;
+}
+
+
+void TransformSystem::UpdateRange(unsigned int begin, unsigned int end)
+{
+    const int *parent = parents.data();
+    unsigned char *isDirty = dirty.data();
+    glm::mat4 *world = worldMatrices.data();
+
+    for (unsigned int i = begin; i < end; i++)
+    {
+        // Parents are already final, so their flag reaches the whole subtree in this pass
+        const int p = parent[i];
+        if (p >= 0) isDirty[i] |= isDirty[p];
+        if (!isDirty[i]) continue;
+
+        // Local TRS written straight into the columns, no intermediate matrices
+        const glm::quat &q = localRotations[i];
+        const glm::vec3 &s = localScales[i];
+        const glm::vec3 &t = localPositions[i];
+
+        const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+        const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+        const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+        glm::mat4 local(
+            (1 - 2 * (yy + zz)) * s.x,  2 * (xy + wz) * s.x,        2 * (xz - wy) * s.x,        0,
+            2 * (xy - wz) * s.y,        (1 - 2 * (xx + zz)) * s.y,  2 * (yz + wx) * s.y,        0,
+            2 * (xz + wy) * s.z,        2 * (yz - wx) * s.z,        (1 - 2 * (xx + yy)) * s.z,  0,
+            t.x,                        t.y,                        t.z,                        1);
+
+        world[i] = (p >= 0) ? world[p] * local : local;
+    }
+}
+
+
+void TransformSystem::SortHierarchy()
+{
+    const unsigned int count = Size();
+
+    // Depth of every slot; a parent always gets a smaller depth than its children
+    std::vector<unsigned int> depth(count, INVALID_TRANSFORM);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        unsigned int d = 0;
+        int p = parents[i];
+        while (p >= 0 && depth[p] == INVALID_TRANSFORM) {
+            d++;
+            p = parents[p];
+        }
+        if (p >= 0) d += depth[p] + 1;
+        depth[i] = d;
+    }
+
+    // Stable order by depth keeps siblings next to each other
+    std::vector<unsigned int> order(count);
+    for (unsigned int i = 0; i < count; i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&depth](unsigned int a, unsigned int b) {
+        return depth[a] < depth[b];
+    });
+
+    std::vector<unsigned int> newSlot(count);
+    for (unsigned int i = 0; i < count; i++) newSlot[order[i]] = i;
+
+    std::vector<glm::vec3> positions(count), scales(count);
+    std::vector<glm::quat> rotations(count);
+    std::vector<glm::mat4> matrices(count);
+    std::vector<int> newParents(count);
+    std::vector<TransformHandle> handles(count);
+
+    std::vector<unsigned int> newDepths(count);
+    levelStarts.clear();
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        unsigned int old = order[i];
+        newDepths[i] = depth[old];
+        if (i == 0 || newDepths[i] != newDepths[i - 1])
+            levelStarts.push_back(i);
+
+        positions[i] = localPositions[old];
+        rotations[i] = localRotations[old];
+        scales[i] = localScales[old];
+        matrices[i] = worldMatrices[old];
+        newParents[i] = parents[old] >= 0 ? static_cast<int>(newSlot[parents[old]]) : -1;
+        handles[i] = slotToHandle[old];
+        handleToSlot[handles[i]] = i;
+    }
+
+    localPositions.swap(positions);
+    localRotations.swap(rotations);
+    localScales.swap(scales);
+    worldMatrices.swap(matrices);
+    parents.swap(newParents);
+    depths.swap(newDepths);
+    slotToHandle.swap(handles);
+    levelStarts.push_back(count);
+    levelsValid = true;
+
+    // Moved nodes are recomputed from scratch
+    std::fill(dirty.begin(), dirty.end(), 1);
+    needsSort = false;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+
+#include "utils/glm_utils.h"
+
+
+typedef unsigned int TransformHandle;
+static const TransformHandle INVALID_TRANSFORM = std::numeric_limits<unsigned int>::max();
+
+
+// Data oriented replacement for a gfxc::Transform hierarchy. Local TRS and
+// world matrices live in contiguous arrays, ordered so that every parent is
+// stored before its children. Update() then refreshes all dirty subtrees in
+// a single linear pass, without recursion or per-node virtual calls.
+//
+// When the slots are also sorted by depth, nodes of the same depth never
+// depend on each other and large levels are updated in parallel jobs.
+//
+// Handles are stable; the storage slots behind them may move when the
+// hierarchy is re-sorted after a SetParent() call.
+class TransformSystem
+{
+ public:
+    TransformSystem();
+
+    // The parent must already exist, so new nodes never break the ordering
+    TransformHandle Create(TransformHandle parent = INVALID_TRANSFORM);
+    void SetParent(TransformHandle node, TransformHandle parent);
+    void Clear();
+
+    void SetLocalPosition(TransformHandle node, const glm::vec3 &position);
+    void SetLocalRotation(TransformHandle node, const glm::quat &rotation);
+    void SetLocalScale(TransformHandle node, const glm::vec3 &scale);
+    void SetLocalTRS(TransformHandle node, const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale);
+
+    const glm::vec3 &GetLocalPosition(TransformHandle node) const;
+    const glm::quat &GetLocalRotation(TransformHandle node) const;
+    const glm::vec3 &GetLocalScale(TransformHandle node) const;
+
+    // World data is only valid after Update()
+    const glm::mat4 &GetWorldMatrix(TransformHandle node) const;
+    glm::vec3 GetWorldPosition(TransformHandle node) const;
+
+    // Recomputes the world matrix of every dirty node and of all its descendants
+    void Update();
+
+    unsigned int Size() const;
+
+ private:
+    void MarkDirty(TransformHandle node);
+    void SortHierarchy();
+    void UpdateRange(unsigned int begin, unsigned int end);
+
+ private:
+    // Per slot data, parents before children
+    std::vector<glm::vec3> localPositions;
+    std::vector<glm::quat> localRotations;
+    std::vector<glm::vec3> localScales;
+    std::vector<glm::mat4> worldMatrices;
+    std::vector<int> parents;
+    std::vector<unsigned int> depths;
+    std::vector<unsigned char> dirty;
+
+    // First slot of every depth followed by the slot count, only valid while sorted by depth
+    std::vector<unsigned int> levelStarts;
+    bool levelsValid;
+
+    // Indirection between the stable handles and the storage slots
+    std::vector<unsigned int> handleToSlot;
+    std::vector<TransformHandle> slotToHandle;
+
+    bool anyDirty;
+    bool needsSort;
+};
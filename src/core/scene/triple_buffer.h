@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+
+
+// Lock free hand over of a value from one writer thread to one reader thread.
+// The writer fills its own slot and publishes it, the reader takes the newest
+// published slot. Neither ever waits for the other: the third slot sits in
+// between and is swapped with whichever side is done with its own.
+//
+// The reader always sees complete values, but not necessarily all of them,
+// a value published twice before a read is replaced by the newer one.
+template <class T>
+class TripleBuffer
+{
+ public:
+    TripleBuffer() : middle(1), back(0), front(2) { }
+
+    // Slot the writer fills before Publish(), its previous content is stale
+    T &GetWriteBuffer() { return slots[back]; }
+
+    void Publish()
+    {
+        unsigned int previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        back = previous & INDEX;
+    }
+
+    // Takes the newest published value, returns false if nothing was published since the last call
+    bool Read()
+    {
+        if (!(middle.load(std::memory_order_acquire) & FRESH))
+            return false;
+
+        unsigned int previous = middle.exchange(front, std::memory_order_acq_rel);
+        front = previous & INDEX;
+        return true;
+    }
+
+    // Value taken by the last Read()
+    const T &GetReadBuffer() const { return slots[front]; }
+
+ private:
+    static const unsigned int INDEX = 3;
+    static const unsigned int FRESH = 4;    // Set on the middle slot when it holds a value not read yet
+
+    T slots[3];
+    std::atomic<unsigned int> middle;
+    unsigned int back;      // Writer thread only
+    unsigned int front;     // Reader thread only
+};
@@ -0,0 +1,246 @@
+#include "core/spatial/bvh.h"
+
+#include <algorithm>
+#include <future>
+#include <thread>
+
+
+static const unsigned int NUM_BINS = 16;
+static const unsigned int MIN_LEAF_SIZE = 2;
+static const unsigned int MAX_LEAF_SIZE = 8;
+static const float TRAVERSAL_COST = 1.0f;
+
+// Subtrees smaller than this are not worth a thread of their own
+static const unsigned int PARALLEL_BUILD_THRESHOLD = 4096;
+
+
+struct BVH::BuildContext
+{
+    const std::vector<BoundingBox> *bounds;
+    std::vector<glm::vec3> centroids;
+    unsigned int maxParallelDepth;
+};
+
+
+static float SurfaceArea(const BoundingBox &box)
+{
+    if (!box.IsValid()) return 0;
+
+    glm::vec3 size = box.max - box.min;
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+
+BVH::BVH()
+{
+}
+
+
+void BVH::Clear()
+{
+    nodes.clear();
+    primitiveIndices.clear();
+}
+
+
+void BVH::Build(const std::vector<BoundingBox> &primitiveBounds, bool parallel)
+{
+    Clear();
+
+    const unsigned int count = static_cast<unsigned int>(primitiveBounds.size());
+    if (count == 0) return;
+
+    BuildContext context;
+    context.bounds = &primitiveBounds;
+    context.centroids.resize(count);
+    for (unsigned int i = 0; i < count; i++) {
+        context.centroids[i] = primitiveBounds[i].GetCenter();
+    }
+
+    // Every split level doubles the number of tasks, stop once all cores are busy
+    context.maxParallelDepth = 0;
+    if (parallel) {
+        unsigned int cores = MAX(1u, std::thread::hardware_concurrency());
+        while ((1u << context.maxParallelDepth) < cores) context.maxParallelDepth++;
+    }
+
+    primitiveIndices.resize(count);
+    for (unsigned int i = 0; i < count; i++) primitiveIndices[i] = i;
+
+    nodes.reserve(2 * count / MIN_LEAF_SIZE);
+    BuildRecursive(context, 0, count, 0, nodes);
+}
+
+
+void BVH::BuildRecursive(BuildContext &context, unsigned int begin, unsigned int end,
+                         unsigned int depth, std::vector<BVHNode> &out)
+{
+    const std::vector<BoundingBox> &bounds = *context.bounds;
+    const std::vector<glm::vec3> &centroids = context.centroids;
+    const unsigned int count = end - begin;
+
+    BoundingBox box, centroidBox;
+    for (unsigned int i = begin; i < end; i++)
+    {
+        box.Expand(bounds[primitiveIndices[i]]);
+        centroidBox.Expand(centroids[primitiveIndices[i]]);
+    }
+
+    const unsigned int nodeIndex = static_cast<unsigned int>(out.size());
+    BVHNode node;
+    node.min = box.min;
+    node.max = box.max;
+    node.skip = 1;
+    node.firstPrimitive = begin;
+    node.primitiveCount = count;
+    out.push_back(node);
+
+    if (count <= MIN_LEAF_SIZE)
+        return;
+
+    // Split along the axis with the largest centroid spread
+    glm::vec3 extent = centroidBox.max - centroidBox.min;
+    int axis = 0;
+    if (extent.y > extent[axis]) axis = 1;
+    if (extent.z > extent[axis]) axis = 2;
+
+    unsigned int mid = begin + count / 2;
+
+    if (extent[axis] > 0)
+    {
+        struct Bin {
+            BoundingBox box;
+            unsigned int count = 0;
+        } bins[NUM_BINS];
+
+        const float origin = centroidBox.min[axis];
+        const float scale = NUM_BINS * (1 - 1e-5f) / extent[axis];
+
+        for (unsigned int i = begin; i < end; i++)
+        {
+            unsigned int id = primitiveIndices[i];
+            unsigned int b = MIN(static_cast<unsigned int>((centroids[id][axis] - origin) * scale), NUM_BINS - 1);
+            bins[b].box.Expand(bounds[id]);
+            bins[b].count++;
+        }
+
+        // Sweep from the right to get the cost of every right partition
+        float rightArea[NUM_BINS];
+        unsigned int rightCount[NUM_BINS];
+        BoundingBox accumulated;
+        unsigned int accumulatedCount = 0;
+        for (unsigned int b = NUM_BINS - 1; b > 0; b--)
+        {
+            accumulated.Expand(bins[b].box);
+            accumulatedCount += bins[b].count;
+            rightArea[b] = SurfaceArea(accumulated);
+            rightCount[b] = accumulatedCount;
+        }
+
+        // Then from the left, the split happens between bin b - 1 and bin b
+        float bestCost = std::numeric_limits<float>::max();
+        unsigned int bestSplit = 0;
+        accumulated = BoundingBox();
+        accumulatedCount = 0;
+        for (unsigned int b = 1; b < NUM_BINS; b++)
+        {
+            accumulated.Expand(bins[b - 1].box);
+            accumulatedCount += bins[b - 1].count;
+
+            float cost = accumulatedCount * SurfaceArea(accumulated) + rightCount[b] * rightArea[b];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestSplit = b;
+            }
+        }
+
+        float splitCost = TRAVERSAL_COST + bestCost / MAX(SurfaceArea(box), 1e-12f);
+        if (splitCost >= count && count <= MAX_LEAF_SIZE)
+            return;
+
+        unsigned int *split = std::partition(primitiveIndices.data() + begin, primitiveIndices.data() + end,
+            [&](unsigned int id) {
+                return MIN(static_cast<unsigned int>((centroids[id][axis] - origin) * scale), NUM_BINS - 1) < bestSplit;
+            });
+        mid = static_cast<unsigned int>(split - primitiveIndices.data());
+
+        // All primitives ended up on one side, fall back to a median split
+        if (mid == begin || mid == end)
+            mid = begin + count / 2;
+    }
+    else if (count <= MAX_LEAF_SIZE)
+    {
+        // All centroids coincide, splitting would not separate anything
+        return;
+    }
+
+    out[nodeIndex].primitiveCount = 0;
+
+    if (depth < context.maxParallelDepth && count >= PARALLEL_BUILD_THRESHOLD)
+    {
+        // The two halves touch disjoint index ranges, so they can be built concurrently
+        std::vector<BVHNode> leftNodes, rightNodes;
+        std::future<void> left = std::async(std::launch::async, [&]() {
+            BuildRecursive(context, begin, mid, depth + 1, leftNodes);
+        });
+        BuildRecursive(context, mid, end, depth + 1, rightNodes);
+        left.get();
+
+        out.insert(out.end(), leftNodes.begin(), leftNodes.end());
+        out.insert(out.end(), rightNodes.begin(), rightNodes.end());
+    }
+    else
+    {
+        BuildRecursive(context, begin, mid, depth + 1, out);
+        BuildRecursive(context, mid, end, depth + 1, out);
+    }
+
+    out[nodeIndex].skip = static_cast<unsigned int>(out.size()) - nodeIndex;
+}
+
+
+void BVH::Refit(const std::vector<BoundingBox> &primitiveBounds)
+{
+    // Children are always stored after their parent, so a reverse walk is bottom up
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        BVHNode &node = nodes[i];
+        BoundingBox box;
+
+        if (node.IsLeaf())
+        {
+            for (unsigned int k = 0; k < node.primitiveCount; k++) {
+                box.Expand(primitiveBounds[primitiveIndices[node.firstPrimitive + k]]);
+            }
+        }
+        else
+        {
+            const BVHNode &left = nodes[i + 1];
+            const BVHNode &right = nodes[i + 1 + left.skip];
+            box.Expand(BoundingBox(left.min, left.max));
+            box.Expand(BoundingBox(right.min, right.max));
+        }
+
+        node.min = box.min;
+        node.max = box.max;
+    }
+}
+
+
+BoundingBox BVH::GetBounds() const
+{
+    if (nodes.empty()) return BoundingBox();
+    return BoundingBox(nodes[0].min, nodes[0].max);
+}
+
+
+const std::vector<BVHNode> &BVH::GetNodes() const
+{
+    return nodes;
+}
+
+
+const std::vector<unsigned int> &BVH::GetPrimitiveIndices() const
+{
+    return primitiveIndices;
+}
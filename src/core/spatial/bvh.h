@@ -0,0 +1,134 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+
+#include "core/culling/bounding_volume.h"
+#include "utils/glm_utils.h"
+
+
+struct Ray
+{
+    Ray() : origin(0), direction(0, 0, -1), tMax(std::numeric_limits<float>::max()) { }
+
+    Ray(const glm::vec3 &origin, const glm::vec3 &direction, float tMax = std::numeric_limits<float>::max())
+        : origin(origin), direction(direction), tMax(tMax) { }
+
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float tMax;
+};
+
+
+static const unsigned int INVALID_PRIMITIVE = std::numeric_limits<unsigned int>::max();
+
+
+struct RayHit
+{
+    RayHit() : t(std::numeric_limits<float>::max()), u(0), v(0), primitive(INVALID_PRIMITIVE), instance(INVALID_PRIMITIVE) { }
+
+    bool IsHit() const { return primitive != INVALID_PRIMITIVE; }
+
+    float t;
+    float u, v;                 // Barycentric coordinates inside the triangle
+    unsigned int primitive;     // Triangle index inside the mesh
+    unsigned int instance;      // User id of the instance, only set by SceneBVH
+};
+
+
+// Nodes are stored in depth first order: the left child of an inner node
+// always follows it, and "skip" is the size of the node's subtree. This lets
+// the traversal run without a stack (next node is i + 1 on hit, i + skip on
+// miss) and lets independently built subtrees be concatenated as they are.
+struct BVHNode
+{
+    glm::vec3 min;
+    unsigned int skip;
+    glm::vec3 max;
+    unsigned int firstPrimitive;
+    unsigned int primitiveCount;    // 0 for inner nodes
+
+    bool IsLeaf() const { return primitiveCount != 0; }
+};
+
+
+// Bounding volume hierarchy over abstract primitives, given by their boxes.
+// Built with binned SAH; large subtrees are built on worker threads.
+class BVH
+{
+ public:
+    BVH();
+
+    void Build(const std::vector<BoundingBox> &primitiveBounds, bool parallel = true);
+    void Clear();
+
+    // Recomputes the node bounds after the primitives moved, keeping the topology
+    void Refit(const std::vector<BoundingBox> &primitiveBounds);
+
+    // Stackless traversal. The callback receives a primitive index and the current
+    // ray, and may shorten ray.tMax; returning true stops the traversal (any hit queries).
+    template <typename F>
+    void Traverse(Ray &ray, F &&intersectPrimitive) const;
+
+    BoundingBox GetBounds() const;
+    const std::vector<BVHNode> &GetNodes() const;
+    const std::vector<unsigned int> &GetPrimitiveIndices() const;
+
+ public:
+    static bool IntersectBox(const glm::vec3 &min, const glm::vec3 &max,
+                             const glm::vec3 &origin, const glm::vec3 &invDirection, float tMax);
+
+ private:
+    struct BuildContext;
+    void BuildRecursive(BuildContext &context, unsigned int begin, unsigned int end,
+                        unsigned int depth, std::vector<BVHNode> &out);
+
+ private:
+    std::vector<BVHNode> nodes;
+    std::vector<unsigned int> primitiveIndices;
+};
+
+
+inline bool BVH::IntersectBox(const glm::vec3 &min, const glm::vec3 &max,
+                              const glm::vec3 &origin, const glm::vec3 &invDirection, float tMax)
+{
+    glm::vec3 t0 = (min - origin) * invDirection;
+    glm::vec3 t1 = (max - origin) * invDirection;
+    glm::vec3 tNear = glm::min(t0, t1);
+    glm::vec3 tFar = glm::max(t0, t1);
+
+    float enter = MAX(MAX(tNear.x, tNear.y), MAX(tNear.z, 0.0f));
+    float exit = MIN(MIN(tFar.x, tFar.y), MIN(tFar.z, tMax));
+    return enter <= exit;
+}
+
+
+template <typename F>
+void BVH::Traverse(Ray &ray, F &&intersectPrimitive) const
+{
+    const unsigned int count = static_cast<unsigned int>(nodes.size());
+    const glm::vec3 invDirection = 1.0f / ray.direction;
+
+    unsigned int i = 0;
+    while (i < count)
+    {
+        const BVHNode &node = nodes[i];
+        if (!IntersectBox(node.min, node.max, ray.origin, invDirection, ray.tMax)) {
+            i += node.skip;
+            continue;
+        }
+
+        if (node.IsLeaf())
+        {
+            for (unsigned int k = 0; k < node.primitiveCount; k++) {
+                if (intersectPrimitive(primitiveIndices[node.firstPrimitive + k], ray))
+                    return;
+            }
+            i += node.skip;
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
@@ -0,0 +1,163 @@
+#include "core/spatial/mesh_bvh.h"
+
+#include "utils/gl_utils.h"
+
+
+static bool IntersectTriangle(const glm::vec3 &v0, const glm::vec3 &edge1, const glm::vec3 &edge2,
+                              const Ray &ray, float &t, float &u, float &v)
+{
+    // Moller-Trumbore, both faces are hit
+    glm::vec3 p = glm::cross(ray.direction, edge2);
+    float det = glm::dot(edge1, p);
+    if (fabs(det) < 1e-12f) return false;
+
+    float invDet = 1.0f / det;
+    glm::vec3 s = ray.origin - v0;
+    u = glm::dot(s, p) * invDet;
+    if (u < 0 || u > 1) return false;
+
+    glm::vec3 q = glm::cross(s, edge1);
+    v = glm::dot(ray.direction, q) * invDet;
+    if (v < 0 || u + v > 1) return false;
+
+    t = glm::dot(edge2, q) * invDet;
+    return t > 0 && t < ray.tMax;
+}
+
+
+MeshBVH::MeshBVH()
+{
+}
+
+
+bool MeshBVH::Build(const Mesh *mesh, bool parallel)
+{
+    Clear();
+
+    if (!mesh || mesh->GetDrawMode() != GL_TRIANGLES)
+        return false;
+
+    const std::vector<unsigned int> &indices = mesh->indices;
+    const bool hasPositions = !mesh->positions.empty();
+    const size_t nrVertices = hasPositions ? mesh->positions.size() : mesh->vertices.size();
+
+    for (const auto &entry : mesh->meshEntries)
+    {
+        unsigned int lastIndex = MIN(entry.baseIndex + entry.nrIndices, (unsigned int)indices.size());
+        for (unsigned int i = entry.baseIndex; i + 2 < lastIndex; i += 3)
+        {
+            size_t id[3] = { entry.baseVertex + indices[i], entry.baseVertex + indices[i + 1], entry.baseVertex + indices[i + 2] };
+            if (id[0] >= nrVertices || id[1] >= nrVertices || id[2] >= nrVertices)
+                continue;
+
+            glm::vec3 v[3];
+            for (int k = 0; k < 3; k++) {
+                v[k] = hasPositions ? mesh->positions[id[k]] : mesh->vertices[id[k]].position;
+            }
+
+            Triangle triangle;
+            triangle.v0 = v[0];
+            triangle.edge1 = v[1] - v[0];
+            triangle.edge2 = v[2] - v[0];
+            triangles.push_back(triangle);
+        }
+    }
+
+    BuildHierarchy(parallel);
+    return !triangles.empty();
+}
+
+
+bool MeshBVH::Build(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices, bool parallel)
+{
+    Clear();
+
+    triangles.reserve(indices.size() / 3);
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        if (indices[i] >= positions.size() || indices[i + 1] >= positions.size() || indices[i + 2] >= positions.size())
+            continue;
+
+        Triangle triangle;
+        triangle.v0 = positions[indices[i]];
+        triangle.edge1 = positions[indices[i + 1]] - triangle.v0;
+        triangle.edge2 = positions[indices[i + 2]] - triangle.v0;
+        triangles.push_back(triangle);
+    }
+
+    BuildHierarchy(parallel);
+    return !triangles.empty();
+}
+
+
+void MeshBVH::BuildHierarchy(bool parallel)
+{
+    std::vector<BoundingBox> bounds(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++)
+    {
+        const Triangle &triangle = triangles[i];
+        bounds[i].Expand(triangle.v0);
+        bounds[i].Expand(triangle.v0 + triangle.edge1);
+        bounds[i].Expand(triangle.v0 + triangle.edge2);
+    }
+
+    bvh.Build(bounds, parallel);
+}
+
+
+void MeshBVH::Clear()
+{
+    bvh.Clear();
+    triangles.clear();
+}
+
+
+bool MeshBVH::Intersect(Ray &ray, RayHit &hit) const
+{
+    bool found = false;
+
+    bvh.Traverse(ray, [&](unsigned int id, Ray &r) {
+        const Triangle &triangle = triangles[id];
+        float t, u, v;
+        if (IntersectTriangle(triangle.v0, triangle.edge1, triangle.edge2, r, t, u, v))
+        {
+            r.tMax = t;
+            hit.t = t;
+            hit.u = u;
+            hit.v = v;
+            hit.primitive = id;
+            found = true;
+        }
+        return false;
+    });
+
+    return found;
+}
+
+
+bool MeshBVH::IntersectAny(const Ray &ray) const
+{
+    bool found = false;
+    Ray query = ray;
+
+    bvh.Traverse(query, [&](unsigned int id, Ray &r) {
+        const Triangle &triangle = triangles[id];
+        float t, u, v;
+        found = IntersectTriangle(triangle.v0, triangle.edge1, triangle.edge2, r, t, u, v);
+        return found;
+    });
+
+    return found;
+}
+
+
+BoundingBox MeshBVH::GetBounds() const
+{
+    return bvh.GetBounds();
+}
+
+
+unsigned int MeshBVH::GetTriangleCount() const
+{
+    return static_cast<unsigned int>(triangles.size());
+}
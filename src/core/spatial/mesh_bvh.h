@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+
+#include "core/gpu/mesh.h"
+#include "core/spatial/bvh.h"
+
+
+// Bottom level hierarchy over the triangles of one mesh, in object space.
+// Meant for static geometry; moving objects reuse it through SceneBVH instances.
+class MeshBVH
+{
+ public:
+    MeshBVH();
+
+    // Uses the CPU side geometry of all entries, only GL_TRIANGLES meshes are supported
+    bool Build(const Mesh *mesh, bool parallel = true);
+    bool Build(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices, bool parallel = true);
+    void Clear();
+
+    // Closest hit, shortens ray.tMax when a triangle is hit
+    bool Intersect(Ray &ray, RayHit &hit) const;
+
+    // Any hit before ray.tMax, for shadow and line of sight queries
+    bool IntersectAny(const Ray &ray) const;
+
+    BoundingBox GetBounds() const;
+    unsigned int GetTriangleCount() const;
+
+ private:
+    void BuildHierarchy(bool parallel);
+
+ private:
+    // Stored as one vertex and two edges, ready for the Moller-Trumbore test
+    struct Triangle {
+        glm::vec3 v0;
+        glm::vec3 edge1;
+        glm::vec3 edge2;
+    };
+
+    BVH bvh;
+    std::vector<Triangle> triangles;
+};
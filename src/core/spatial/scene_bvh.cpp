@@ -0,0 +1,110 @@
+#include "core/spatial/scene_bvh.h"
+
+
+SceneBVH::SceneBVH()
+{
+    needsRefit = false;
+}
+
+
+unsigned int SceneBVH::AddInstance(const MeshBVH *mesh, const glm::mat4 &model, unsigned int userID)
+{
+    Instance instance;
+    instance.mesh = mesh;
+    instance.model = model;
+    instance.invModel = glm::inverse(model);
+    instance.userID = userID;
+    instances.push_back(instance);
+
+    worldBounds.push_back(bounds_utils::Transform(mesh->GetBounds(), model));
+    return static_cast<unsigned int>(instances.size() - 1);
+}
+
+
+void SceneBVH::SetTransform(unsigned int instance, const glm::mat4 &model)
+{
+    Instance &target = instances[instance];
+    target.model = model;
+    target.invModel = glm::inverse(model);
+
+    worldBounds[instance] = bounds_utils::Transform(target.mesh->GetBounds(), model);
+    needsRefit = true;
+}
+
+
+void SceneBVH::Clear()
+{
+    bvh.Clear();
+    instances.clear();
+    worldBounds.clear();
+    needsRefit = false;
+}
+
+
+void SceneBVH::Build()
+{
+    // Only a handful of instances, not worth spreading over threads
+    bvh.Build(worldBounds, false);
+    needsRefit = false;
+}
+
+
+void SceneBVH::Refit()
+{
+    if (!needsRefit) return;
+
+    bvh.Refit(worldBounds);
+    needsRefit = false;
+}
+
+
+bool SceneBVH::Intersect(const Ray &ray, RayHit &hit) const
+{
+    Ray query = ray;
+    bool found = false;
+
+    bvh.Traverse(query, [&](unsigned int id, Ray &r) {
+        const Instance &instance = instances[id];
+
+        // The direction is not normalized, so t stays the same in both spaces
+        Ray local(glm::vec3(instance.invModel * glm::vec4(r.origin, 1)),
+                  glm::vec3(instance.invModel * glm::vec4(r.direction, 0)), r.tMax);
+
+        RayHit localHit;
+        if (instance.mesh->Intersect(local, localHit))
+        {
+            r.tMax = localHit.t;
+            hit = localHit;
+            hit.instance = instance.userID;
+            found = true;
+        }
+        return false;
+    });
+
+    return found;
+}
+
+
+bool SceneBVH::HasLineOfSight(const glm::vec3 &from, const glm::vec3 &to) const
+{
+    // Stop slightly short of the target so its own surface does not block it
+    Ray query(from, to - from, 1.0f - 1e-4f);
+    bool blocked = false;
+
+    bvh.Traverse(query, [&](unsigned int id, Ray &r) {
+        const Instance &instance = instances[id];
+        Ray local(glm::vec3(instance.invModel * glm::vec4(r.origin, 1)),
+                  glm::vec3(instance.invModel * glm::vec4(r.direction, 0)), r.tMax);
+
+        blocked = instance.mesh->IntersectAny(local);
+        return blocked;
+    });
+
+    return !blocked;
+}
+
+
+unsigned int SceneBVH::GetInstanceCount() const
+{
+    return static_cast<unsigned int>(instances.size());
+}
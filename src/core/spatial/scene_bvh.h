@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+#include "core/spatial/bvh.h"
+#include "core/spatial/mesh_bvh.h"
+
+
+// Top level hierarchy over mesh instances. Rays are moved into the object
+// space of each instance and tested against its shared MeshBVH. Moving
+// instances only need SetTransform() + Refit(); Build() is needed again
+// only when instances are added or when they moved far from their start.
+class SceneBVH
+{
+ public:
+    SceneBVH();
+
+    // The mesh hierarchy must outlive the scene hierarchy
+    unsigned int AddInstance(const MeshBVH *mesh, const glm::mat4 &model, unsigned int userID);
+    void SetTransform(unsigned int instance, const glm::mat4 &model);
+    void Clear();
+
+    void Build();
+    void Refit();
+
+    // Closest hit; hit.instance is the user id of the instance
+    bool Intersect(const Ray &ray, RayHit &hit) const;
+
+    // True if nothing blocks the segment between the two points
+    bool HasLineOfSight(const glm::vec3 &from, const glm::vec3 &to) const;
+
+    unsigned int GetInstanceCount() const;
+
+ private:
+    struct Instance {
+        const MeshBVH *mesh;
+        glm::mat4 model;
+        glm::mat4 invModel;
+        unsigned int userID;
+    };
+
+    BVH bvh;
+    std::vector<Instance> instances;
+    std::vector<BoundingBox> worldBounds;
+    bool needsRefit;
+};
@@ -0,0 +1,215 @@
+#include "core/window/frame_pacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "utils/math_utils.h"
+
+
+namespace
+{
+    typedef std::chrono::duration<double> Seconds;
+    typedef std::chrono::duration<float, std::milli> Milliseconds;
+
+    // Sleeps are asked for this long, the scheduler usually gives more
+    const std::chrono::milliseconds SLEEP_STEP(1);
+
+    // Samples the sleep estimate is averaged over, older ones fade out so it follows the system load
+    const unsigned long long MAX_SLEEP_SAMPLES = 200;
+
+    // Fence waits are split so a lost context can't hang the loop
+    const GLuint64 FENCE_TIMEOUT_NS = 1000000;
+}
+
+
+const unsigned int FramePacer::HISTORY;
+
+
+FramePacer::FramePacer()
+    : targetFps(0), framesInFlight(0), frame(0), inputFrame(0)
+{
+    // Pessimistic until the first sleeps are measured
+    sleepMean = 0.005;
+    sleepVariance = 0;
+    sleepCount = 1;
+
+    std::fill(intervals, intervals + HISTORY, 0.0f);
+    std::fill(inputLatencies, inputLatencies + HISTORY, 0.0f);
+}
+
+
+FramePacer::~FramePacer()
+{
+    SetFramesInFlight(0);
+}
+
+
+void FramePacer::SetTargetFps(float fps)
+{
+    targetFps = MAX(fps, 0.0f);
+    deadline = Clock::time_point();
+}
+
+
+float FramePacer::GetTargetFps() const
+{
+    return targetFps;
+}
+
+
+void FramePacer::SetFramesInFlight(unsigned int frames)
+{
+    framesInFlight = frames;
+    if (framesInFlight == 0)
+    {
+        for (GLsync fence : fences)
+            glDeleteSync(fence);
+        fences.clear();
+    }
+}
+
+
+unsigned int FramePacer::GetFramesInFlight() const
+{
+    return framesInFlight;
+}
+
+
+void FramePacer::BeginFrame()
+{
+    Clock::time_point start = Clock::now();
+    WaitForGpu();
+
+    Clock::time_point gpuDone = Clock::now();
+    stats.gpuWait = Milliseconds(gpuDone - start).count();
+    stats.limiterWait = 0;
+
+    if (targetFps <= 0)
+        return;
+
+    const Clock::duration period = std::chrono::duration_cast<Clock::duration>(Seconds(1.0 / targetFps));
+
+    // More than a frame late: the schedule restarts instead of rushing frames out to catch up
+    if (deadline == Clock::time_point() || gpuDone - deadline > period)
+        deadline = gpuDone;
+
+    WaitUntil(deadline);
+    deadline += period;
+
+    stats.limiterWait = Milliseconds(Clock::now() - gpuDone).count();
+}
+
+
+void FramePacer::EndFrame()
+{
+    if (framesInFlight > 0)
+        fences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+
+    Clock::time_point now = Clock::now();
+    if (lastPresent != Clock::time_point())
+        UpdateStats(Milliseconds(now - lastPresent).count());
+
+    lastPresent = now;
+}
+
+
+void FramePacer::AddInputLatency(float milliseconds)
+{
+    inputLatencies[inputFrame % HISTORY] = milliseconds;
+    inputFrame++;
+
+    const unsigned int count = MIN(inputFrame, HISTORY);
+    float sum = 0;
+    stats.inputLatencyMax = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        sum += inputLatencies[i];
+        stats.inputLatencyMax = MAX(stats.inputLatencyMax, inputLatencies[i]);
+    }
+    stats.inputLatency = sum / count;
+}
+
+
+const FramePacingStats &FramePacer::GetStats() const
+{
+    return stats;
+}
+
+
+void FramePacer::WaitForGpu()
+{
+    // The fence left on top is the one of frame N - k
+    while (framesInFlight > 0 && fences.size() >= framesInFlight)
+    {
+        GLsync fence = fences.front();
+        fences.pop_front();
+
+        GLenum result;
+        do {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+        } while (result == GL_TIMEOUT_EXPIRED);
+
+        glDeleteSync(fence);
+    }
+}
+
+
+void FramePacer::WaitUntil(Clock::time_point until)
+{
+    while (true)
+    {
+        Clock::time_point now = Clock::now();
+        double remaining = Seconds(until - now).count();
+
+        // Worst likely sleep, the mean plus one standard deviation
+        double sleepEstimate = sleepMean + sqrt(sleepVariance);
+        if (remaining <= sleepEstimate)
+            break;
+
+        std::this_thread::sleep_for(SLEEP_STEP);
+        double slept = Seconds(Clock::now() - now).count();
+
+        // Welford update, with the count capped so the estimate keeps adapting
+        sleepCount = MIN(sleepCount + 1, MAX_SLEEP_SAMPLES);
+        double delta = slept - sleepMean;
+        sleepMean += delta / sleepCount;
+        sleepVariance += (delta * (slept - sleepMean) - sleepVariance) / sleepCount;
+    }
+
+    // Spins for the last part, the scheduler can't be trusted with it
+    while (Clock::now() < until)
+        std::this_thread::yield();
+}
+
+
+void FramePacer::UpdateStats(float interval)
+{
+    intervals[frame % HISTORY] = interval;
+    frame++;
+
+    const unsigned int count = MIN(frame, HISTORY);
+    float sum = 0;
+    stats.min = interval;
+    stats.max = interval;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        sum += intervals[i];
+        stats.min = MIN(stats.min, intervals[i]);
+        stats.max = MAX(stats.max, intervals[i]);
+    }
+
+    stats.last = interval;
+    stats.average = sum / count;
+
+    const float expected = targetFps > 0 ? 1000.0f / targetFps : stats.average;
+    float squares = 0;
+    stats.lateFrames = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        squares += (intervals[i] - stats.average) * (intervals[i] - stats.average);
+        if (intervals[i] > 1.5f * expected)
+            stats.lateFrames++;
+    }
+    stats.jitter = sqrtf(squares / count);
+}
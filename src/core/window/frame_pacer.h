@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+
+#include "utils/gl_utils.h"
+
+
+// Present intervals over the last frames, in milliseconds
+struct FramePacingStats
+{
+    FramePacingStats() : last(0), average(0), min(0), max(0), jitter(0), lateFrames(0), gpuWait(0), limiterWait(0),
+        inputLatency(0), inputLatencyMax(0) { }
+
+    float last;
+    float average;
+    float min;
+    float max;
+    float jitter;               // Standard deviation
+    unsigned int lateFrames;    // Intervals over 1.5 times the target, or the average without one
+    float gpuWait;              // Time the last frame waited for the GPU
+    float limiterWait;          // Time the last frame waited for its slot
+    float inputLatency;         // Average from the oldest input of a frame to its present, over the frames with input
+    float inputLatencyMax;
+};
+
+
+// Frame rate limiter and latency control, around the swap of the world loop.
+//
+// The limiter gives every frame a slot at the target rate. The wait sleeps
+// while the time left is safely above what a sleep can overshoot by, as
+// measured on the previous sleeps, and spins for the rest.
+//
+// With frames in flight set to k, the CPU work of frame N only starts once
+// the GPU finished frame N - k: input is read later and the frames queued by
+// the driver can't pile up behind it.
+class FramePacer
+{
+ public:
+    typedef std::chrono::steady_clock Clock;
+
+    FramePacer();
+    ~FramePacer();
+
+    // 0 leaves the rate to vSync
+    void SetTargetFps(float fps);
+    float GetTargetFps() const;
+
+    // 0 never waits for the GPU
+    void SetFramesInFlight(unsigned int frames);
+    unsigned int GetFramesInFlight() const;
+
+    // Before the CPU work of a frame, waits for the GPU and then for the slot of the frame
+    void BeginFrame();
+
+    // After the swap, GL thread only
+    void EndFrame();
+
+    // Time from the oldest input event of the frame to its present, after EndFrame()
+    void AddInputLatency(float milliseconds);
+
+    const FramePacingStats &GetStats() const;
+
+ private:
+    void WaitForGpu();
+    void WaitUntil(Clock::time_point until);
+    void UpdateStats(float interval);
+
+ private:
+    static const unsigned int HISTORY = 120;
+
+    float targetFps;
+    Clock::time_point deadline;     // Slot of the next frame, zero until the first frame
+
+    unsigned int framesInFlight;
+    std::deque<GLsync> fences;      // Oldest frame first
+
+    // Running estimate of the duration of a short sleep
+    double sleepMean;
+    double sleepVariance;
+    unsigned long long sleepCount;
+
+    Clock::time_point lastPresent;
+    float intervals[HISTORY];
+    unsigned int frame;
+
+    float inputLatencies[HISTORY];
+    unsigned int inputFrame;
+
+    FramePacingStats stats;
+};
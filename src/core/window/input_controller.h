@@ -15,6 +15,9 @@ class InputController
     void SetActive(bool value);
 
  protected:
+    // The event methods below are called once per event, in the order the events happened
+    // Use window->GetEventTime() inside them for the time of the event, in engine time seconds
+
     // Method will be called each frame before the Update() method
     // Use for real-time frame-independent interaction such as performing continuous updates when pressing a key
     // @param deltaTime - frame time in seconds for the previous frame, may be used for frame time independent updates
@@ -22,6 +25,7 @@ class InputController
     //             - the modifiers value holds information about the special keys pressed alongside the normal key event
     //             - use for testing key combination such as: CONTROL + ALT + KEY, CONTROL + SHIFT + KEY, etc
     // Use window->KeyHold(GLFW_KEY_"KEYCODE") for testing if a key is being pressed
+    // Use window->GetKeyHoldTime(GLFW_KEY_"KEYCODE") for the part of the frame a key was held, taps included
     virtual void OnInputUpdate(float deltaTime, int mods) {}
 
     // If a KEY PRESS event is registered the method will be called before the Update() method
@@ -44,7 +48,7 @@ class InputController
     // If a MOUSE BUTTON PRESS event is registered the method will be called before the Update() method
     // @param mouseX - X coordinate in pixels of the mouse position relative to the top-left corner ([0, 0])
     // @param mouseY - Y coordinate in pixels of the mouse position relative to the top-left corner
-    // @param button - bit-mask with the buttons currently pressed. Use the preprocessor helpers for testing:
+    // @param button - bit-mask with the button of the event. Use the preprocessor helpers for testing:
     //
     //                        IS_BIT_SET(button, GLFW_MOUSE_BUTTON_LEFT)
     //                        IS_BIT_SET(button, GLFW_MOUSE_BUTTON_RIGHT)
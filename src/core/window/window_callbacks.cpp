@@ -13,7 +13,7 @@ void WindowCallbacks::KeyCallback(GLFWwindow *W, int key, int scanCode, int acti
 
 void WindowCallbacks::CursorMove(GLFWwindow *W, double posX, double posY)
 {
-    Engine::GetWindow()->MouseMove((int)posX, (int)posY);
+    Engine::GetWindow()->MouseMove(posX, posY);
 }
 
 
@@ -1,5 +1,6 @@
 #include "core/window/window_object.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include "core/engine.h"
@@ -7,6 +8,7 @@
 #include "core/window/input_controller.h"
 
 #include "utils/gl_utils.h"
+#include "utils/math_utils.h"
 #include "utils/memory_utils.h"
 #include "utils/window_utils.h"
 
@@ -19,6 +21,17 @@ struct WindowDataImpl
 };
 
 
+namespace
+{
+    // Events a frame can buffer, well above what a 8 kHz mouse sends during a slow frame
+    const size_t INPUT_EVENT_CAPACITY = 4096;
+
+    // Core contexts tried in order. 4.3 adds compute shaders, storage buffers
+    // and multi draw indirect; 3.3 is what the framework needs
+    const int CONTEXT_VERSIONS[][2] = { { 4, 3 }, { 3, 3 } };
+}
+
+
 WindowProperties::WindowProperties()
 {
     name = "WindowName";
@@ -33,28 +46,29 @@ WindowProperties::WindowProperties()
     visible = true;
     hideOnClose = false;
     vSync = true;
+    targetFps = 0;
+    framesInFlight = 0;
 }
 
 
 WindowObject::WindowObject(WindowProperties properties)
-    : props(properties)
+    : props(properties), inputEvents(INPUT_EVENT_CAPACITY)
 {
     window = new WindowDataImpl();
     window->handle = nullptr;
 
     resizeEvent = false;
-    scrollEvent = false;
-    mouseMoveEvent = false;
+    droppedInputEvents = 0;
+    eventTime = 0;
+    frameInputTime = -1;
 
     frameID = 0;
     deltaFrameTime = 0;
     props.aspectRatio = float(props.resolution.x) / props.resolution.y;
 
-    // Set context version, meaning 3.3 core profile
+    // Core profile, the context version is picked when the window is created
     glfwWindowHint(GLFW_VISIBLE, props.visible);
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 #if defined(__APPLE__)
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
@@ -65,10 +79,11 @@ WindowObject::WindowObject(WindowProperties properties)
     SetVSync(props.vSync);
 
     // Set default state
-    mouseButtonAction = 0;
     mouseButtonStates = 0;
-    registeredKeyEvents = 0;
-    memset(keyStates, 0, 384);
+    keyMods = 0;
+    memset(keyStates, 0, sizeof(keyStates));
+    std::fill(keyPressTime, keyPressTime + MAX_KEYS, 0.0);
+    std::fill(keyHoldTime, keyHoldTime + MAX_KEYS, 0.0f);
     memset(keyScanCode, 0, 512);
 
     SetWindowCallbacks();
@@ -198,7 +213,7 @@ void WindowObject::FullScreen()
 {
     GLFWmonitor *monitor = glfwGetPrimaryMonitor();
     const GLFWvidmode *videoDisplay = glfwGetVideoMode(monitor);
-    window->handle = glfwCreateWindow(videoDisplay->width, videoDisplay->height, props.name.c_str(), monitor, NULL);
+    window->handle = CreateHandle(videoDisplay->width, videoDisplay->height, monitor);
     assert(window->handle != nullptr);
 
     glfwMakeContextCurrent(window->handle);
@@ -207,6 +222,22 @@ void WindowObject::FullScreen()
 }
 
 
+GLFWwindow *WindowObject::CreateHandle(int width, int height, GLFWmonitor *monitor)
+{
+    for (const auto &version : CONTEXT_VERSIONS)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+
+        GLFWwindow *handle = glfwCreateWindow(width, height, props.name.c_str(), monitor, NULL);
+        if (handle)
+            return handle;
+    }
+
+    return nullptr;
+}
+
+
 void error_callback(int error, const char* description)
 {
     fprintf(stderr, "Error: %s\n", description);
@@ -217,7 +248,7 @@ void WindowObject::WindowMode()
 {
     glfwSetErrorCallback(error_callback);
     if (!glfwInit()) { fprintf(stderr, "Failed to initialize GLFW\n"); }
-    window->handle = glfwCreateWindow(props.resolution.x, props.resolution.y, props.name.c_str(), NULL, NULL);
+    window->handle = CreateHandle(props.resolution.x, props.resolution.y, NULL);
     assert(window->handle != nullptr);
     glfwMakeContextCurrent(window->handle);
 
@@ -276,6 +307,32 @@ int WindowObject::GetSpecialKeyState() const
 }
 
 
+float WindowObject::GetKeyHoldTime(int keyCode) const
+{
+    if (keyCode < 0 || keyCode >= MAX_KEYS)
+        return 0;
+
+    if (!keyStates[keyCode])
+        return keyHoldTime[keyCode];
+
+    // Still down, held from the press or the start of the frame until now
+    const double frameStart = elapsedTime - deltaFrameTime;
+    return keyHoldTime[keyCode] + static_cast<float>(elapsedTime - MAX(keyPressTime[keyCode], frameStart));
+}
+
+
+double WindowObject::GetEventTime() const
+{
+    return eventTime;
+}
+
+
+double WindowObject::GetFrameInputTime() const
+{
+    return frameInputTime;
+}
+
+
 glm::ivec2 WindowObject::GetCursorPosition() const
 {
     return props.cursorPos;
@@ -284,50 +341,66 @@ glm::ivec2 WindowObject::GetCursorPosition() const
 
 void WindowObject::KeyCallback(int key, int scanCode, int action, int mods)
 {
-    keyMods = mods;
-    if (keyStates[key] == (action ? true : false))
-        return;
-    keyStates[key] = action ? true : false;
-    keyEvents[registeredKeyEvents] = key;
-    registeredKeyEvents++;
+    InputEvent event = {};
+    event.type = InputEvent::KEY;
+    event.code = key;
+    event.action = action;
+    event.mods = mods;
+    PushInputEvent(event);
 }
 
 
 void WindowObject::MouseButtonCallback(int button, int action, int mods)
 {
-    // Only button events and mods are kept
-    // Mouse position is the current frame position
-    keyMods = mods;
-    SET_BIT(mouseButtonAction, button);
-    action ? SET_BIT(mouseButtonStates, button) : CLEAR_BIT(mouseButtonStates, button);
+    // Mouse position is the one of the last move event before it
+    InputEvent event = {};
+    event.type = InputEvent::MOUSE_BUTTON;
+    event.code = button;
+    event.action = action;
+    event.mods = mods;
+    PushInputEvent(event);
 }
 
 
-void WindowObject::MouseMove(int posX, int posY)
+void WindowObject::MouseMove(double posX, double posY)
 {
-    // Save information for processing later on the Update thread
-    if (mouseMoveEvent) {
-        mouseDeltaX += posX - props.cursorPos.x;
-        mouseDeltaY += posY - props.cursorPos.y;
-    } else {
-        mouseMoveEvent = true;
-        mouseDeltaX = posX - props.cursorPos.x;
-        mouseDeltaY = posY - props.cursorPos.y;
-    }
-    props.cursorPos = glm::ivec2(posX, posY);
+    // Every move is kept, the delta is computed when it is sent
+    InputEvent event = {};
+    event.type = InputEvent::MOUSE_MOVE;
+    event.x = posX;
+    event.y = posY;
+    PushInputEvent(event);
 }
 
 
 void WindowObject::MouseScroll(double offsetX, double offsetY)
 {
-    mouseScrollDeltaX = (int)offsetX;
-    mouseScrollDeltaY = (int)offsetY;
+    InputEvent event = {};
+    event.type = InputEvent::MOUSE_SCROLL;
+    event.x = offsetX;
+    event.y = offsetY;
+    PushInputEvent(event);
+}
+
+
+void WindowObject::PushInputEvent(InputEvent &event)
+{
+    event.time = Engine::GetElapsedTime();
+
+    // A full ring means the frames stopped draining it, dropping is better than blocking the callback
+    if (!inputEvents.Push(event))
+    {
+        droppedInputEvents++;
+        if (droppedInputEvents == 1)
+            std::cout << "[INPUT]\tEvent buffer full, events are dropped" << std::endl;
+    }
 }
 
 
 void WindowObject::UpdateObservers()
 {
     ComputeFrameTime();
+    const double frameStart = elapsedTime - deltaFrameTime;
 
     // Signal window resize
     if (resizeEvent)
@@ -338,57 +411,89 @@ void WindowObject::UpdateObservers()
         }
     }
 
-    // Signal mouse move event
-    if (mouseMoveEvent)
-    {
-        mouseMoveEvent = false;
-        for (auto obs : observers) {
-            obs->OnMouseMove(props.cursorPos.x, props.cursorPos.y, mouseDeltaX, mouseDeltaY);
-        }
-    }
+    std::fill(keyHoldTime, keyHoldTime + MAX_KEYS, 0.0f);
+    frameInputTime = -1;
 
-    // Signal mouse button press event
-    auto pressEvent = mouseButtonAction & mouseButtonStates;
-    if (pressEvent)
+    // Signal the buffered events in the order they happened, the input state
+    // seen by the observers is the one at the time of each event
+    InputEvent event;
+    while (inputEvents.Pop(event))
     {
-        for (auto obs : observers) {
-            obs->OnMouseBtnPress(props.cursorPos.x, props.cursorPos.y, pressEvent, keyMods);
+        eventTime = event.time;
+        if (frameInputTime < 0)
+            frameInputTime = event.time;
+
+        switch (event.type)
+        {
+        case InputEvent::KEY:
+        {
+            const bool pressed = event.action != GLFW_RELEASE;
+            keyMods = event.mods;
+
+            // Repeats and unknown keys are not signaled
+            if (event.code < 0 || event.code >= MAX_KEYS || keyStates[event.code] == pressed)
+                break;
+
+            keyStates[event.code] = pressed;
+            if (pressed)
+            {
+                keyPressTime[event.code] = event.time;
+                for (auto obs : observers)
+                    obs->OnKeyPress(event.code, keyMods);
+            }
+            else
+            {
+                keyHoldTime[event.code] += static_cast<float>(event.time - MAX(keyPressTime[event.code], frameStart));
+                for (auto obs : observers)
+                    obs->OnKeyRelease(event.code, keyMods);
+            }
+            break;
         }
-    }
 
-    // Signal mouse button release event
-    auto releaseEvent = mouseButtonAction & (~mouseButtonStates);
-    if (releaseEvent)
-    {
-        for (auto obs : observers) {
-            obs->OnMouseBtnRelease(props.cursorPos.x, props.cursorPos.y, releaseEvent, keyMods);
+        case InputEvent::MOUSE_BUTTON:
+        {
+            int button = 0;
+            SET_BIT(button, event.code);
+            keyMods = event.mods;
+
+            if (event.action == GLFW_PRESS)
+            {
+                SET_BIT(mouseButtonStates, event.code);
+                for (auto obs : observers)
+                    obs->OnMouseBtnPress(props.cursorPos.x, props.cursorPos.y, button, keyMods);
+            }
+            else
+            {
+                CLEAR_BIT(mouseButtonStates, event.code);
+                for (auto obs : observers)
+                    obs->OnMouseBtnRelease(props.cursorPos.x, props.cursorPos.y, button, keyMods);
+            }
+            break;
         }
-    }
 
-    // Signal mouse scroll event
-    if (scrollEvent) {
-        scrollEvent = false;
-        for (auto obs : observers) {
-            obs->OnMouseScroll(props.cursorPos.x, props.cursorPos.y, mouseScrollDeltaX, mouseScrollDeltaY);
+        case InputEvent::MOUSE_MOVE:
+        {
+            const glm::ivec2 position(static_cast<int>(event.x), static_cast<int>(event.y));
+            const glm::ivec2 delta = position - props.cursorPos;
+            props.cursorPos = position;
+
+            for (auto obs : observers)
+                obs->OnMouseMove(position.x, position.y, delta.x, delta.y);
+            break;
         }
-    }
 
-    // Signal key events
-    if (registeredKeyEvents)
-    {
-        for (int i = 0; i < registeredKeyEvents; i++) {
+        case InputEvent::MOUSE_SCROLL:
             for (auto obs : observers)
-                keyStates[keyEvents[i]] ? obs->OnKeyPress(keyEvents[i], keyMods) : obs->OnKeyRelease(keyEvents[i], keyMods);
+                obs->OnMouseScroll(props.cursorPos.x, props.cursorPos.y, static_cast<int>(event.x), static_cast<int>(event.y));
+            break;
         }
-        registeredKeyEvents = 0;
     }
 
     // Continuous events
+    eventTime = elapsedTime;
     for (auto obs : observers) {
         obs->OnInputUpdate(static_cast<float>(deltaFrameTime), keyMods);
     }
-
-    mouseButtonAction = 0;
 }
 
 
@@ -3,6 +3,7 @@
 #include <string>
 #include <list>
 
+#include "core/jobs/spsc_ring.h"
 #include "core/window/input_controller.h"
 #include "core/window/window_callbacks.h"
 
@@ -28,6 +29,28 @@ class WindowProperties
     bool centered;
     bool hideOnClose;
     bool vSync;
+    float targetFps;                // Frame limiter of the world loop, 0 leaves the rate to vSync
+    unsigned int framesInFlight;    // Frames the GPU may be behind the CPU, 0 never waits for it
+};
+
+
+// Input received by a window callback, in the order GLFW reported it
+struct InputEvent
+{
+    enum Type : unsigned char
+    {
+        KEY,
+        MOUSE_BUTTON,
+        MOUSE_MOVE,
+        MOUSE_SCROLL
+    };
+
+    Type type;
+    int code;           // Key or mouse button
+    int action;         // GLFW_PRESS, GLFW_RELEASE or GLFW_REPEAT
+    int mods;
+    double x, y;        // Cursor position or scroll offsets
+    double time;        // Engine time in seconds
 };
 
 
@@ -85,10 +108,20 @@ class WindowObject
     bool MouseHold(int button) const;
     int GetSpecialKeyState() const;
 
+    // Seconds the key was held down during the last frame, taps shorter than a frame included
+    float GetKeyHoldTime(int keyCode) const;
+
+    // Time of the event being sent to the observers, the frame time during OnInputUpdate
+    double GetEventTime() const;
+
+    // Time of the oldest event sent during the last update, negative when there was none
+    double GetFrameInputTime() const;
+
     // Use unscaled resolution when working with mouse coordinates.
     glm::ivec2 GetCursorPosition() const;
 
     // Update event listeners (key press / mouse move / window events)
+    // Buffered events are sent one by one in the order they happened
     void UpdateObservers();
 
  protected:
@@ -99,10 +132,14 @@ class WindowObject
     void FullScreen();
     void WindowMode();
 
+    // Window with the newest context the driver gives, see GLEW_VERSION_4_3
+    GLFWwindow *CreateHandle(int width, int height, GLFWmonitor *monitor);
+
     // Input Processing
+    // Callbacks only push events, the state is updated when they are sent
     void KeyCallback(int key, int scanCode, int action, int mods);
     void MouseButtonCallback(int button, int action, int mods);
-    void MouseMove(int posX, int posY);
+    void MouseMove(double posX, double posY);
     void MouseScroll(double offsetX, double offsetY);
 
     // Subscribe to receive input events
@@ -111,6 +148,7 @@ class WindowObject
 
  private:
     void SetWindowCallbacks();
+    void PushInputEvent(InputEvent &event);
 
  public:
     WindowProperties props;
@@ -126,25 +164,20 @@ class WindowObject
     bool hiddenPointer;
     bool resizeEvent;
 
-    // Mouse button callback
-    int mouseButtonCallback;            // bit field for button callback
-    int mouseButtonAction;              // bit field for button state
-    int mouseButtonStates;              // bit field for mouse button state
+    // Input events, pushed by the callbacks and drained by UpdateObservers()
+    SpscRing<InputEvent> inputEvents;
+    unsigned int droppedInputEvents;
+    double eventTime;
+    double frameInputTime;
 
-    // Mouse move event
-    bool mouseMoveEvent;
-    int mouseDeltaX;
-    int mouseDeltaY;
-
-    // Mouse scroll event
-    bool scrollEvent;
-    int mouseScrollDeltaX;
-    int mouseScrollDeltaY;
+    // Mouse button state
+    int mouseButtonStates;              // bit field for mouse button state
 
     // States for keyboard buttons - PRESSED(true) / RELEASED(false)
-    int registeredKeyEvents;
-    int keyEvents[128];
-    bool keyStates[384];
+    static const int MAX_KEYS = 384;
+    bool keyStates[MAX_KEYS];
+    double keyPressTime[MAX_KEYS];
+    float keyHoldTime[MAX_KEYS];        // Held time of the keys released during the frame
 
     // Platform specific key codes - PRESSED(true) / RELEASED(false)
     bool keyScanCode[512];
@@ -1,6 +1,8 @@
 #include "core/world.h"
 
 #include "core/engine.h"
+#include "core/gpu/render_stats.h"
+#include "core/jobs/job_system.h"
 #include "components/camera_input.h"
 #include "components/transform.h"
 
@@ -14,6 +16,11 @@ World::World()
     shouldClose = false;
 
     window = Engine::GetWindow();
+    if (window)
+    {
+        framePacer.SetTargetFps(window->props.targetFps);
+        framePacer.SetFramesInFlight(window->props.framesInFlight);
+    }
 }
 
 
@@ -48,6 +55,12 @@ double World::GetLastFrameTime()
 }
 
 
+FramePacer &World::GetFramePacer()
+{
+    return framePacer;
+}
+
+
 void World::ComputeFrameDeltaTime()
 {
     elapsedTime = Engine::GetElapsedTime();
@@ -58,14 +71,20 @@ void World::ComputeFrameDeltaTime()
 
 void World::LoopUpdate()
 {
+    // Waits for the GPU and for the slot of the frame before reading the input, so it is as fresh as it can be
+    framePacer.BeginFrame();
+
     // Polls and buffers the events
     window->PollEvents();
 
+    // GL work handed over by the job threads since the last frame
+    JobSystem::RunMainThreadJobs();
+
     // Computes frame deltaTime in seconds
     ComputeFrameDeltaTime();
 
-    // Calls the methods of the instance of InputController in the following order
-    // OnWindowResize, OnMouseMove, OnMouseBtnPress, OnMouseBtnRelease, OnMouseScroll, OnKeyPress, OnMouseScroll, OnInputUpdate
+    // Calls the methods of the instance of InputController: OnWindowResize, then one call per buffered event
+    // in the order they happened (OnKeyPress, OnKeyRelease, OnMouseMove, OnMouseBtnPress, OnMouseBtnRelease, OnMouseScroll)
     // OnInputUpdate will be called each frame, the other functions are called only if an event is registered
     window->UpdateObservers();
 
@@ -74,6 +93,15 @@ void World::LoopUpdate()
     Update(static_cast<float>(deltaTime));
     FrameEnd();
 
+    // Counts of the frame are final, the next frame reads them while it fills new ones
+    render_stats::EndFrame();
+
     // Swap front and back buffers - image will be displayed to the screen
     window->SwapBuffers();
+    framePacer.EndFrame();
+
+    // Oldest input the frame reacted to until the swap returned, the driver may still queue the image after it
+    const double inputTime = window->GetFrameInputTime();
+    if (inputTime >= 0)
+        framePacer.AddInputLatency(static_cast<float>((Engine::GetElapsedTime() - inputTime) * 1000.0));
 }
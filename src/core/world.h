@@ -1,6 +1,7 @@
 #pragma once
 
 #include "window/input_controller.h"
+#include "window/frame_pacer.h"
 
 
 class World : public InputController
@@ -19,6 +20,8 @@ class World : public InputController
 
     double GetLastFrameTime();
 
+    FramePacer &GetFramePacer();
+
  private:
     void ComputeFrameDeltaTime();
     void LoopUpdate();
@@ -29,4 +32,5 @@ class World : public InputController
     double deltaTime;
     bool paused;
     bool shouldClose;
+    FramePacer framePacer;
 };
@@ -29,6 +29,21 @@ int main(int argc, char **argv)
     wp.vSync = true;
     wp.selfDir = GetParentDir(std::string(argv[0]));
 
+    // Frame pacing: --fps <rate>, --frames-in-flight <frames>, --no-vsync
+    for (int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if (option == "--fps" && i + 1 < argc) {
+            wp.targetFps = static_cast<float>(atof(argv[++i]));
+        } else if (option == "--frames-in-flight" && i + 1 < argc) {
+            wp.framesInFlight = static_cast<unsigned int>(atoi(argv[++i]));
+        } else if (option == "--no-vsync") {
+            wp.vSync = false;
+        } else {
+            std::cout << "Unknown option " << option << std::endl;
+        }
+    }
+
     // Init the Engine and create a new window with the defined properties
     (void)Engine::Init(wp);
 
@@ -23,3 +23,50 @@ std::string text_utils::Join(
 
     return os.str();
 }
+
+
+// -------------------------------------------------------------------------
+unsigned int text_utils::DecodeUTF8(
+    const std::string &text,
+    size_t &position)
+{
+    const unsigned int replacement = 0xFFFD;
+    const unsigned char lead = static_cast<unsigned char>(text[position++]);
+
+    if (lead < 0x80) {
+        return lead;
+    }
+
+    // Length and payload bits of the lead byte
+    unsigned int length, codepoint, minimum;
+    if ((lead & 0xE0) == 0xC0) {
+        length = 2; codepoint = lead & 0x1F; minimum = 0x80;
+    } else if ((lead & 0xF0) == 0xE0) {
+        length = 3; codepoint = lead & 0x0F; minimum = 0x800;
+    } else if ((lead & 0xF8) == 0xF0) {
+        length = 4; codepoint = lead & 0x07; minimum = 0x10000;
+    } else {
+        return replacement;
+    }
+
+    if (position + length - 1 > text.size()) {
+        return replacement;
+    }
+
+    for (unsigned int i = 1; i < length; i++)
+    {
+        const unsigned char next = static_cast<unsigned char>(text[position + i - 1]);
+        if ((next & 0xC0) != 0x80) {
+            return replacement;
+        }
+        codepoint = (codepoint << 6) | (next & 0x3F);
+    }
+
+    // Overlong forms, surrogates and values past the last plane are invalid
+    if (codepoint < minimum || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+        return replacement;
+    }
+
+    position += length - 1;
+    return codepoint;
+}
@@ -21,4 +21,10 @@ namespace text_utils
         const std::string &separator);
 
 #define PATH_JOIN(...) text_utils::Join(std::vector<std::string>{__VA_ARGS__}, std::string(1, PATH_SEPARATOR))
+
+    // Code point of the UTF-8 sequence starting at position, which is moved
+    // past it. Malformed or truncated sequences decode to U+FFFD one byte at a time
+    unsigned int DecodeUTF8(
+        const std::string &text,
+        size_t &position);
 }